@@ -7,27 +7,19 @@
 //
 
 #import "ASCIIArmor.h"
-#
+#import "Instrumentation.h"
+#import "OpenPGPCore.h"
 
 #pragma mark - Constants
 
-#define CRC24_INIT 0xB704CEL
-#define CRC24_POLY 0x1864CFBL
+#define ASCIIArmorLineLength 64
 
 typedef NS_ENUM(NSUInteger, ASCIIArmorHeaderIndex) {
     PGPHeaderIndexKey = 0,
     PGPHeaderIndexValue = 1
 };
 
-typedef NS_ENUM(NSUInteger, ASCIIArmorReadState) {
-    ASCIIArmorReadStateArmorHeader,
-    ASCIIArmorReadStateHeaders,
-    ASCIIArmorReadStateContent,
-    ASCIIArmorReadStateFinished
-};
-
 static NSString *const PGPLineBreak = @"\r\n";
-static NSString *const PGPBackupBreak = @"\n";
 
 static NSString *const ASCIIArmorHeaderMessage =      @"-----BEGIN PGP MESSAGE-----";
 static NSString *const ASCIIArmorHeaderPublicKey =    @"-----BEGIN PGP PUBLIC KEY BLOCK-----";
@@ -54,10 +46,10 @@ static NSString *const ASCIIArmorFooterSignature =    @"-----END PGP SIGNATURE--
 
 /// Text to ASCIIArmor:
 
++ (ASCIIArmor *)readArmorFromText:(NSString *)text;
 + (ASCIIArmorType)typeForArmorHeader:(NSString *)armorHeader;
-+ (NSData *)readContentString:(NSString *)contentString checksum:(NSString *)checksum;
++ (NSDictionary *)headersFromString:(NSString *)headersString;
 + (NSUInteger)checksumForBase64Data:(NSData *)data;
-+ (NSUInteger)valueForChecksumString:(NSString *)checksumString;
 
 /// ASCIIArmor to text:
 
@@ -84,82 +76,58 @@ static NSString *const ASCIIArmorFooterSignature =    @"-----END PGP SIGNATURE--
 
 
 + (ASCIIArmor *)armorFromText:(NSString *)text {
-    NSArray *lines = [text componentsSeparatedByString:PGPLineBreak];
-    if (lines.count == 1) {
-        lines = [text componentsSeparatedByString:PGPBackupBreak];
+    PGP_STAGE_BEGIN(PGP_STAGE_ARMOR);
+    ASCIIArmor *armor = [self readArmorFromText:text];
+    PGP_STAGE_END(PGP_STAGE_ARMOR, text.length);
+    
+    return armor;
+}
+
++ (ASCIIArmor *)readArmorFromText:(NSString *)text {
+    NSData *textData = [text dataUsingEncoding:NSUTF8StringEncoding];
+    const char *characters = textData.bytes;
+    
+    pgp_armor armor;
+    
+    if (pgp_armor_parse(characters, textData.length, &armor) != PGP_OK) {
+        NSLog(@"Text is not armored.");
+        return nil;
     }
     
-    ASCIIArmorReadState state = ASCIIArmorReadStateArmorHeader;
+    NSString *label = [[NSString alloc] initWithBytes:characters + armor.labelOffset
+                                               length:armor.labelLength
+                                             encoding:NSUTF8StringEncoding];
     
-    ASCIIArmorType armorHeaderType = ASCIIArmorTypeUnknown;
-    NSMutableDictionary *headers = [NSMutableDictionary dictionary];
-    NSMutableString *contentString = [NSMutableString string];
-    NSString *checksumString = nil;
-    
-    for (NSString *line in lines) {
-        switch (state) {
-            case ASCIIArmorReadStateArmorHeader: {
-                armorHeaderType = [ASCIIArmor typeForArmorHeader:line];
-                
-                if (armorHeaderType == ASCIIArmorTypeUnknown) {
-                    NSLog(@"Text is not armored, first line is: %@", line);
-                    return nil;
-                }
-                
-                state = ASCIIArmorReadStateHeaders;
-                continue;
-            }
-                
-            case ASCIIArmorReadStateHeaders: {
-                if ([line isEqualToString:@""]) {
-                    state = ASCIIArmorReadStateContent;
-                    continue;
-                }
-                
-                NSArray *keyAndValue = [line componentsSeparatedByString:@": "];
-                
-                if (keyAndValue.count != 2) {
-                    NSLog(@"Can't find headers: text on line is not properly formatted : %@", line);
-                    return nil;
-                }
-                
-                NSString *key = keyAndValue[PGPHeaderIndexKey];
-                NSString *value = keyAndValue[PGPHeaderIndexValue];
-                
-                [headers setValue:value forKey:key];
-                
-                continue;
-            }
-                
-            case ASCIIArmorReadStateContent: {
-                if ([line characterAtIndex:0] == '=') {
-                    checksumString = line;
-                    state = ASCIIArmorReadStateFinished;
-                    
-                    continue;
-                }
-                
-                [contentString appendString:line];
-                
-                continue;
-            }
-                
-            case ASCIIArmorReadStateFinished: {
-                continue;
-            } // End case.
-        } // End switch.
-    } // End for loop.
-    
-    NSData *content = [ASCIIArmor readContentString:contentString checksum:checksumString];
-    
-    if (content == nil) {
+    ASCIIArmorType armorHeaderType = [ASCIIArmor typeForArmorHeader:[NSString stringWithFormat:@"-----BEGIN %@-----", label]];
+    
+    if (armorHeaderType == ASCIIArmorTypeUnknown) {
+        NSLog(@"Text is not armored, armor header is: %@", label);
+        return nil;
+    }
+    
+    NSString *headersString = [[NSString alloc] initWithBytes:characters + armor.headersOffset
+                                                       length:armor.headersLength
+                                                     encoding:NSUTF8StringEncoding];
+    
+    NSDictionary *headers = [ASCIIArmor headersFromString:headersString];
+    
+    if (headers == nil) {
+        return nil;
+    }
+    
+    NSMutableData *content = [NSMutableData dataWithLength:armor.contentLength * 3 / 4];
+    size_t contentLength = 0;
+    
+    if (pgp_armor_decode(characters, &armor, content.mutableBytes, &contentLength) != PGP_OK) {
         NSLog(@"Failed to read content.");
         return nil;
     }
     
+    content.length = contentLength;
+    
     return [[self alloc] initWithHeaderType:armorHeaderType
-                                    headers:[NSDictionary dictionaryWithDictionary:headers]
-                                    content:content];
+                                    headers:headers
+                                    content:[NSData dataWithData:content]];
 }
 
 + (ASCIIArmor *)armorFromPacketList:(PacketList *)packetList type:(ASCIIArmorType)type {
@@ -174,6 +142,8 @@ static NSString *const ASCIIArmorFooterSignature =    @"-----END PGP SIGNATURE--
 
 
 - (NSString *)text {
+    PGP_STAGE_BEGIN(PGP_STAGE_ARMOR);
+    
     NSMutableString *text = [NSMutableString string];
     
     [text appendString:[ASCIIArmor armorHeaderForType:self.type]];
@@ -190,9 +160,10 @@ static NSString *const ASCIIArmorFooterSignature =    @"-----END PGP SIGNATURE--
     
     [text appendString:PGPLineBreak];
     
-    NSDataBase64EncodingOptions options = NSDataBase64Encoding64CharacterLineLength | NSDataBase64EncodingEndLineWithCarriageReturn | NSDataBase64EncodingEndLineWithLineFeed;
+    NSMutableData *contentData = [NSMutableData dataWithLength:pgp_base64_encoded_length(self.content.length, ASCIIArmorLineLength)];
+    pgp_base64_encode(contentData.mutableBytes, self.content.bytes, self.content.length, ASCIIArmorLineLength);
     
-    NSString *contentString = [self.content base64EncodedStringWithOptions:options];
+    NSString *contentString = [[NSString alloc] initWithData:contentData encoding:NSASCIIStringEncoding];
     [text appendString:contentString];
     [text appendString:PGPLineBreak];
     
@@ -207,6 +178,8 @@ static NSString *const ASCIIArmorFooterSignature =    @"-----END PGP SIGNATURE--
     [text appendString:footerString];
     [text appendString:PGPLineBreak];
     
+    PGP_STAGE_END(PGP_STAGE_ARMOR, self.content.length);
+    
     return [NSString stringWithString:text];
 }
 
@@ -244,63 +217,55 @@ static NSString *const ASCIIArmorFooterSignature =    @"-----END PGP SIGNATURE--
     return ASCIIArmorTypeUnknown;
 }
 
-+ (NSData *)readContentString:(NSString *)contentString checksum:(NSString *)checksumString {
-    NSData *contentData = [[NSData alloc] initWithBase64EncodedString:contentString options:NSDataBase64DecodingIgnoreUnknownCharacters];
-    
-    NSUInteger contentChecksum = [ASCIIArmor checksumForBase64Data:contentData];
-    NSUInteger checksum = [ASCIIArmor valueForChecksumString:checksumString];
++ (NSDictionary *)headersFromString:(NSString *)headersString {
+    NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+    NSCharacterSet *newlines = [NSCharacterSet newlineCharacterSet];
     
-    return (contentChecksum == checksum) ? contentData : nil;
-}
-
-+ (NSUInteger)checksumForBase64Data:(NSData *)data {
-    unsigned const char *octets = (unsigned const char *) data.bytes;
-    unsigned long len = data.length;
-    
-    NSUInteger crc = CRC24_INIT;
-    int i;
-    while (len--) {
-        crc ^= (*octets++) << 16;
-        for (i = 0; i < 8; i++) {
-            crc <<= 1;
-            if (crc & 0x1000000)
-                crc ^= CRC24_POLY;
+    for (NSString *line in [headersString componentsSeparatedByCharactersInSet:newlines]) {
+        if (line.length == 0) {
+            continue;
+        }
+        
+        NSArray *keyAndValue = [line componentsSeparatedByString:@": "];
+        
+        if (keyAndValue.count != 2) {
+            NSLog(@"Can't find headers: text on line is not properly formatted : %@", line);
+            return nil;
         }
+        
+        NSString *key = keyAndValue[PGPHeaderIndexKey];
+        NSString *value = keyAndValue[PGPHeaderIndexValue];
+        
+        [headers setValue:value forKey:key];
     }
     
-    return crc & 0xFFFFFFL;
+    return [NSDictionary dictionaryWithDictionary:headers];
 }
 
-+ (NSUInteger)valueForChecksumString:(NSString *)checksumString {
-    NSData *checksumData = [[NSData alloc] initWithBase64EncodedString:[checksumString substringFromIndex:1] options:0];
-
-    const Byte *octets = (const Byte *) checksumData.bytes;
-    
-    return  (octets[0] << 020) +
-            (octets[1] << 010) +
-            (octets[2] << 000);
++ (NSUInteger)checksumForBase64Data:(NSData *)data {
+    return pgp_crc24(PGP_CRC24_INIT, data.bytes, data.length);
 }
 
 + (NSString *)armorHeaderForType:(ASCIIArmorType)type {
     switch (type) {
         case ASCIIArmorTypeMessage:
             return ASCIIArmorHeaderMessage;
-            
+        
         case ASCIIArmorTypePublicKey:
             return ASCIIArmorHeaderPublicKey;
-            
+        
         case ASCIIArmorTypePrivateKey:
             return ASCIIArmorHeaderPrivateKey;
-            
+        
         case ASCIIArmorTypeMessageX:
             return ASCIIArmorHeaderMessageX;
-            
+        
         case ASCIIArmorTypeMessageXofY:
             return ASCIIArmorHeaderMessageXofY;
-            
+        
         case ASCIIArmorTypeSignature:
             return ASCIIArmorHeaderSignature;
-            
+        
         case ASCIIArmorTypeUnknown:
             return nil;
     }
@@ -310,22 +275,22 @@ static NSString *const ASCIIArmorFooterSignature =    @"-----END PGP SIGNATURE--
     switch (type) {
         case ASCIIArmorTypeMessage:
             return ASCIIArmorFooterMessage;
-            
+        
         case ASCIIArmorTypePublicKey:
             return ASCIIArmorFooterPublicKey;
-            
+        
         case ASCIIArmorTypePrivateKey:
             return ASCIIArmorFooterPrivateKey;
-            
+        
         case ASCIIArmorTypeMessageX:
             return ASCIIArmorFooterMessageX;
-            
+        
         case ASCIIArmorTypeMessageXofY:
             return ASCIIArmorFooterMessageXofY;
-            
+        
         case ASCIIArmorTypeSignature:
             return ASCIIArmorFooterSignature;
-            
+        
         case ASCIIArmorTypeUnknown:
             return nil;
     }
@@ -0,0 +1,31 @@
+//
+//  BatchSigner.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Signature.h"
+
+@class SecretKey;
+
+/// Signs many payloads with one key. The hashed subpackets and trailer are built once and only
+/// the creation time is patched per batch, and the key's prepared RSA handle is shared by every
+/// worker.
+@interface BatchSigner : NSObject
+
+@property (nonatomic, readonly) SecretKey *signatureKey;
+@property (nonatomic, readonly) SignatureType signatureType;
+
+/// Throughput of the last batch signed:
+@property (nonatomic, readonly) double signaturesPerSecond;
+
++ (BatchSigner *)signerWithSignatureKey:(SecretKey *)signatureKey signatureType:(SignatureType)signatureType;
+
+/// Payloads are NSData. Returns a Signature per payload in input order, NSNull where signing
+/// failed. A workerCount of 0 uses all active cores:
+- (NSArray *)signPayloads:(NSArray *)payloads workerCount:(NSUInteger)workerCount;
+
+@end
@@ -0,0 +1,136 @@
+//
+//  BatchSigner.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "BatchSigner.h"
+#import "HashContext.h"
+#import "Key.h"
+#import "SignatureContext.h"
+#import "SignaturePacket.h"
+#import "Utility.h"
+
+/// The creation time subpacket comes first, its four byte time follows the length and type:
+#define BatchSignerCreationTimeOffset 2
+
+/// The trailer starts with the six byte signature header before the hashed subpackets:
+#define BatchSignerTrailerHeaderLength 6
+
+@interface BatchSigner () {
+    NSData *_hashedSubpacketsTemplate;
+    NSData *_trailerTemplate;
+}
+
+- (instancetype)initWithSignatureKey:(SecretKey *)signatureKey signatureType:(SignatureType)signatureType;
+
+/// Copies of the templates with the creation time filled in:
+- (NSData *)hashedSubpacketsWithCreationTime:(NSUInteger)creationTime;
+- (NSData *)trailerWithCreationTime:(NSUInteger)creationTime;
+
+@end
+
+@implementation BatchSigner
+
++ (BatchSigner *)signerWithSignatureKey:(SecretKey *)signatureKey signatureType:(SignatureType)signatureType {
+    return [[self alloc] initWithSignatureKey:signatureKey signatureType:signatureType];
+}
+
+- (instancetype)initWithSignatureKey:(SecretKey *)signatureKey signatureType:(SignatureType)signatureType {
+    self = [super init];
+    
+    if (self != nil) {
+        _signatureKey = signatureKey;
+        _signatureType = signatureType;
+        
+        _hashedSubpacketsTemplate = [SignaturePacket hashedSubpacketDataWithCreationTime:0
+                                                                                   keyId:signatureKey.publicKey.keyID];
+        
+        NSData *hashData = [SignaturePacket hashDataWithSignatureType:signatureType
+                                                   publicKeyAlgorithm:signatureKey.publicKey.publicKeyAlgorithm
+                                                        hashAlgorithm:HashAlgorithmSHA256
+                                                     hashedSubpackets:_hashedSubpacketsTemplate];
+        
+        _trailerTemplate = [SignaturePacket trailerForHashData:hashData];
+    }
+    
+    return self;
+}
+
+- (NSArray *)signPayloads:(NSArray *)payloads workerCount:(NSUInteger)workerCount {
+    NSUInteger count = payloads.count;
+    NSUInteger workers = workerCount > 0 ? workerCount : [NSProcessInfo processInfo].activeProcessorCount;
+    workers = MAX(MIN(workers, count), 1);
+    
+    // One clock read for the whole batch:
+    NSUInteger creationTime = [[NSDate date] timeIntervalSince1970];
+    NSData *hashedSubpackets = [self hashedSubpacketsWithCreationTime:creationTime];
+    NSData *trailer = [self trailerWithCreationTime:creationTime];
+    
+    SecretKey *signatureKey = self.signatureKey;
+    SignatureType signatureType = self.signatureType;
+    
+    void **results = calloc(MAX(count, 1), sizeof(void *));
+    
+    NSUInteger nextIndex = 0;
+    NSUInteger *next = &nextIndex;
+    
+    NSDate *start = [NSDate date];
+    
+    dispatch_apply(workers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+        for (NSUInteger i = __sync_fetch_and_add(next, 1); i < count; i = __sync_fetch_and_add(next, 1)) {
+            @autoreleasepool {
+                SignatureContext *context = [SignatureContext contextWithSignatureType:signatureType
+                                                                         hashAlgorithm:HashAlgorithmSHA256];
+                [context updateWithData:payloads[i]];
+                
+                Signature *signature = [Signature signatureWithType:signatureType
+                                                        hashContext:context.hashContext
+                                                   hashedSubpackets:hashedSubpackets
+                                                            trailer:trailer
+                                                       signatureKey:signatureKey];
+                
+                results[i] = (void *) CFBridgingRetain(signature ?: [NSNull null]);
+            }
+        }
+    });
+    
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    _signaturesPerSecond = elapsed > 0 ? count / elapsed : 0;
+    
+    NSMutableArray *signatures = [NSMutableArray arrayWithCapacity:count];
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        [signatures addObject:CFBridgingRelease(results[i])];
+    }
+    
+    free(results);
+    
+    return [NSArray arrayWithArray:signatures];
+}
+
+#pragma mark Private
+
+- (NSData *)hashedSubpacketsWithCreationTime:(NSUInteger)creationTime {
+    NSMutableData *hashedSubpackets = [_hashedSubpacketsTemplate mutableCopy];
+    
+    [Utility writeNumber:creationTime
+                   bytes:(Byte *) hashedSubpackets.mutableBytes + BatchSignerCreationTimeOffset
+                  length:4];
+    
+    return [NSData dataWithData:hashedSubpackets];
+}
+
+- (NSData *)trailerWithCreationTime:(NSUInteger)creationTime {
+    NSMutableData *trailer = [_trailerTemplate mutableCopy];
+    
+    [Utility writeNumber:creationTime
+                   bytes:(Byte *) trailer.mutableBytes + BatchSignerTrailerHeaderLength + BatchSignerCreationTimeOffset
+                  length:4];
+    
+    return [NSData dataWithData:trailer];
+}
+
+@end
@@ -33,7 +33,9 @@ typedef NS_ENUM(NSUInteger, PublicKeyAlgorithm) {
     PublicKeyAlgorithmRSAEncrypt = 2,
     PublicKeyAlgorithmRSASign = 3,
     PublicKeyAlgorithmElGamal = 16,
-    PublicKeyAlgorithmDSA = 17
+    PublicKeyAlgorithmDSA = 17,
+    PublicKeyAlgorithmECDH = 18,
+    PublicKeyAlgorithmEdDSA = 22
 };
 
 typedef NS_ENUM(NSUInteger, SymmetricAlgorithm) {
@@ -63,16 +65,44 @@ typedef NS_ENUM(NSUInteger, SymmetricAlgorithm) {
 + (NSData *)signData:(NSData *)data withSecretKey:(SecretKey *)key;
 + (BOOL)verifyData:(NSData *)messageData withSignatureData:(NSData *)signatureData withPublicKey:(PublicKey *)key;
 
+/// Sign/verify an already computed digest. RSA keys EMSA-PKCS1-v1_5 encode the digest but don't hash it
+/// again, EdDSA keys sign the digest as the message and produce the 64 byte R || S:
++ (NSData *)signDigest:(NSData *)digest algorithm:(HashAlgorithm)algorithm withSecretKey:(SecretKey *)key;
++ (BOOL)verifyDigest:(NSData *)digest algorithm:(HashAlgorithm)algorithm withSignatureData:(NSData *)signatureData withPublicKey:(PublicKey *)key;
+
+/// ECDH session key wrapping (RFC 6637). The message is the algorithm, session key and checksum,
+/// the padding is added and removed here. Encrypting generates the ephemeral point to send along:
++ (NSData *)ecdhEncryptMessage:(NSData *)message withPublicKey:(PublicKey *)key ephemeralPoint:(MPI **)ephemeralPoint;
++ (NSData *)ecdhDecryptMessage:(NSData *)wrappedMessage ephemeralPoint:(MPI *)ephemeralPoint withSecretKey:(SecretKey *)key;
+
 // AES decrypt/encrypt:
 + (NSData *)generateSessionKey;
 
 + (NSData *)decryptData:(NSData *)data withSymmetricKey:(const Byte *)symmetricKey;
 + (NSData *)encryptData:(NSData *)data withSymmetricKey:(const Byte *)symmetricKey;
 
+/// The random prefix of integrity protected data repeats its last two bytes, so a wrong key
+/// shows after decrypting just the first block:
++ (BOOL)quickCheckData:(NSData *)data withSymmetricKey:(const Byte *)symmetricKey;
+
+/// CFB with an IV for AES and CAST5, which is how passphrase protected secret key material is
+/// encrypted. Returns nil for the other algorithms:
++ (NSData *)decryptData:(NSData *)data symmetricAlgorithm:(SymmetricAlgorithm)algorithm key:(NSData *)key iv:(NSData *)iv;
+
+/// 0 if the algorithm isn't supported:
++ (NSUInteger)keyLengthForSymmetricAlgorithm:(SymmetricAlgorithm)algorithm;
++ (NSUInteger)blockSizeForSymmetricAlgorithm:(SymmetricAlgorithm)algorithm;
+
 + (NSData *)emePKCSEncodeMessage:(NSData *)message keyLength:(NSUInteger)keyLength;
 + (NSData *)emePKCSDecodeMessage:(NSData *)message;
 
 // Generate keypair:
 + (Keypair *)generateKeypairWithBits:(int)bits;
++ (Keypair *)generateEd25519Keypair;
++ (Keypair *)generateX25519Keypair;
+
+// Curve OIDs as they appear in key packets, without the length octet:
++ (NSData *)ed25519CurveOID;
++ (NSData *)curve25519CurveOID;
 
 @end
@@ -6,11 +6,17 @@
 //  Copyright (c) 2015 Gradient. All rights reserved.
 //
 
+#import <pthread.h>
 #import <openssl/aes.h>
+#import <openssl/crypto.h>
 #import <openssl/objects.h>
 #import <openssl/rsa.h>
 #import <openssl/sha.h>
 #import "Crypto.h"
+#import "Curve25519.h"
+#import "Instrumentation.h"
+#import "OpenPGPCore.h"
+#import "Random.h"
 #import "Key.h"
 #import "Keypair.h"
 
@@ -30,10 +36,44 @@
                         p:(BIGNUM *)p
                         q:(BIGNUM *)q;
 
+/// Fills in the CRT exponents and coefficient, without them OpenSSL does the full size exponentiation:
+- (BOOL)addCRTValues;
+
 @end
 
+static pthread_mutex_t *CryptoLocks = NULL;
+
+/// OpenSSL 1.0 shares its random pool and other state between threads only through these:
+static void CryptoLockingCallback(int mode, int type, const char *file, int line) {
+    if (mode & CRYPTO_LOCK) {
+        pthread_mutex_lock(&CryptoLocks[type]);
+    } else {
+        pthread_mutex_unlock(&CryptoLocks[type]);
+    }
+}
+
+static void CryptoThreadIDCallback(CRYPTO_THREADID *threadID) {
+    CRYPTO_THREADID_set_numeric(threadID, (unsigned long) pthread_self());
+}
+
 @implementation Crypto
 
++ (void)initialize {
+    if (self != [Crypto class]) {
+        return;
+    }
+    
+    int lockCount = CRYPTO_num_locks();
+    CryptoLocks = calloc(lockCount, sizeof(pthread_mutex_t));
+    
+    for (int i = 0; i < lockCount; i++) {
+        pthread_mutex_init(&CryptoLocks[i], NULL);
+    }
+    
+    CRYPTO_THREADID_set_callback(CryptoThreadIDCallback);
+    CRYPTO_set_locking_callback(CryptoLockingCallback);
+}
+
 + (NSData *)hashData:(NSData *)data {
     Byte hash[SHA256_DIGEST_LENGTH];
     SHA256(data.bytes, data.length, hash);
@@ -49,29 +89,31 @@
 
 + (NSData *)decryptMessage:(MPI *)message withSecretKey:(SecretKey *)key {
     
-    NSUInteger length = BN_num_bytes(message.bn);
-    Byte mpibuf[length];
-    
-    memset(mpibuf, 0, length);
-    
-    BN_bn2bin(message.bn, mpibuf);
+    // Straight from the wire encoding, past the bit count:
+    NSData *data = message.data;
     
-    return [self decryptBytes:mpibuf length:length withSecretKey:key];
+    return [self decryptBytes:(const Byte *) data.bytes + 2 length:data.length - 2 withSecretKey:key];
 }
 
 + (NSData *)decryptBytes:(const Byte *)bytes length:(NSUInteger)length withSecretKey:(SecretKey *)key {
-    RSAWrapper *rsaWrapper = [RSAWrapper rsaWithSecretKey:key];
+    RSAWrapper *rsaWrapper = [self preparedRSAWithSecretKey:key];
     
-    if (RSA_check_key(rsaWrapper.rsa) != 1) {
+    if (rsaWrapper == nil) {
         NSLog(@"Error with key.");
         return nil;
     }
     
     Byte outbuf[8192];
     
-    NSUInteger outLength = RSA_private_decrypt((int) length, bytes, outbuf, rsaWrapper.rsa, RSA_PKCS1_PADDING);
+    PGP_COUNT(PGP_COUNTER_RSA_OPERATIONS);
+    PGP_STAGE_BEGIN(PGP_STAGE_RSA_PRIVATE);
     
-    return [NSData dataWithBytes:outbuf length:outLength];
+    // Fails on the padding check when the message was for some other key:
+    int outLength = RSA_private_decrypt((int) length, bytes, outbuf, rsaWrapper.rsa, RSA_PKCS1_PADDING);
+    
+    PGP_STAGE_END(PGP_STAGE_RSA_PRIVATE, length);
+    
+    return outLength >= 0 ? [NSData dataWithBytes:outbuf length:outLength] : nil;
 }
 
 + (NSData *)encryptData:(NSData *)data withPublicKey:(PublicKey *)key {
@@ -80,44 +122,398 @@
     
     Byte outbuf[8192];
     
+    PGP_COUNT(PGP_COUNTER_RSA_OPERATIONS);
+    PGP_STAGE_BEGIN(PGP_STAGE_RSA_PUBLIC);
+    
     NSInteger outLength = RSA_public_encrypt((int) data.length, data.bytes, outbuf, rsaWrapper.rsa, RSA_PKCS1_PADDING);
     
+    PGP_STAGE_END(PGP_STAGE_RSA_PUBLIC, data.length);
+    
     return outLength > 0 ? [NSData dataWithBytes:outbuf length:outLength] : nil;
 }
 
 #pragma mark RSA sign/verify
 
 + (NSData *)signData:(NSData *)data withSecretKey:(SecretKey *)key {
+    return [self signDigest:[self hashData:data] algorithm:HashAlgorithmSHA256 withSecretKey:key];
+}
+
++ (BOOL)verifyData:(NSData *)messageData withSignatureData:(NSData *)signatureData withPublicKey:(PublicKey *)key {
+    return [self verifyDigest:[self hashData:messageData] algorithm:HashAlgorithmSHA256 withSignatureData:signatureData withPublicKey:key];
+}
+
++ (NSData *)signDigest:(NSData *)digest algorithm:(HashAlgorithm)algorithm withSecretKey:(SecretKey *)key {
     
-    NSUInteger keyLength = key.publicKey.n.length;
-    NSData *encodedData = [self emsaPKCSEncodeMessage:data algorithm:HashAlgorithmSHA256 length:keyLength];
+    if (key.publicKey.publicKeyAlgorithm == PublicKeyAlgorithmEdDSA) {
+        return [self ed25519SignDigest:digest withSecretKey:key];
+    }
+    
+    NSUInteger keyLength = BN_num_bytes(key.publicKey.n.bn);
+    NSData *encodedData = [self emsaPKCSEncodeDigest:digest algorithm:algorithm length:keyLength];
+    
+    if (encodedData == nil) {
+        NSLog(@"Error encoding digest.");
+        return nil;
+    }
     
-    RSAWrapper *rsaWrapper = [RSAWrapper rsaWithSecretKey:key];
+    RSAWrapper *rsaWrapper = [self preparedRSAWithSecretKey:key];
     
-    if (RSA_check_key(rsaWrapper.rsa) != 1) {
+    if (rsaWrapper == nil) {
         NSLog(@"Error with key.");
         return nil;
     }
     
     Byte outbuf[8192];
     
+    PGP_COUNT(PGP_COUNTER_RSA_OPERATIONS);
+    PGP_STAGE_BEGIN(PGP_STAGE_RSA_PRIVATE);
+    
     int res = RSA_private_encrypt((int) encodedData.length, encodedData.bytes, outbuf, rsaWrapper.rsa, RSA_NO_PADDING);
     
+    PGP_STAGE_END(PGP_STAGE_RSA_PRIVATE, encodedData.length);
+    
     return res > 0 ? [NSData dataWithBytes:outbuf length:res] : nil;
 }
 
-+ (BOOL)verifyData:(NSData *)messageData withSignatureData:(NSData *)signatureData withPublicKey:(PublicKey *)key {
++ (BOOL)verifyDigest:(NSData *)digest algorithm:(HashAlgorithm)algorithm withSignatureData:(NSData *)signatureData withPublicKey:(PublicKey *)key {
+    
+    if (key.publicKeyAlgorithm == PublicKeyAlgorithmEdDSA) {
+        return [self ed25519VerifyDigest:digest withSignatureData:signatureData withPublicKey:key];
+    }
+    
+    // Curve keys have no modulus, there's nothing to build an RSA key from:
+    if (key.n == nil || key.e == nil) {
+        return NO;
+    }
     
     RSAWrapper *rsaWrapper = [RSAWrapper rsaWithPublicKey:key];
     
-    return RSA_verify(NID_sha256, messageData.bytes, (unsigned int) messageData.length, signatureData.bytes, (unsigned int) signatureData.length, rsaWrapper.rsa);
+    NSUInteger keyLength = RSA_size(rsaWrapper.rsa);
+    
+    if (signatureData.length == 0 || signatureData.length > keyLength) {
+        return NO;
+    }
+    
+    // The signature MPI drops leading zeros, RSA wants it padded back out to the modulus size:
+    Byte signature[keyLength];
+    memset(signature, 0, keyLength);
+    memcpy(signature + keyLength - signatureData.length, signatureData.bytes, signatureData.length);
+    
+    Byte outbuf[keyLength];
+    
+    PGP_COUNT(PGP_COUNTER_RSA_OPERATIONS);
+    PGP_STAGE_BEGIN(PGP_STAGE_RSA_PUBLIC);
+    
+    int res = RSA_public_decrypt((int) keyLength, signature, outbuf, rsaWrapper.rsa, RSA_NO_PADDING);
+    
+    PGP_STAGE_END(PGP_STAGE_RSA_PUBLIC, keyLength);
+    
+    if (res != keyLength) {
+        return NO;
+    }
+    
+    NSData *encodedData = [self emsaPKCSEncodeDigest:digest algorithm:algorithm length:keyLength];
+    
+    return encodedData != nil && memcmp(encodedData.bytes, outbuf, keyLength) == 0;
+}
+
+#pragma mark Ed25519 sign/verify
+
++ (NSData *)ed25519SignDigest:(NSData *)digest withSecretKey:(SecretKey *)key {
+    Byte seed[ED25519_SEED_LENGTH];
+    Byte publicKey[ED25519_PUBLIC_KEY_LENGTH];
+    
+    if (![self getBytes:seed length:ED25519_SEED_LENGTH fromMPI:key.d]
+        || ![self getEd25519PublicKey:publicKey fromPublicKey:key.publicKey]) {
+        NSLog(@"Error with key.");
+        return nil;
+    }
+    
+    Byte signature[ED25519_SIGNATURE_LENGTH];
+    ed25519_sign(signature, digest.bytes, digest.length, seed, publicKey);
+    
+    memset(seed, 0, ED25519_SEED_LENGTH);
+    
+    return [NSData dataWithBytes:signature length:ED25519_SIGNATURE_LENGTH];
+}
+
++ (BOOL)ed25519VerifyDigest:(NSData *)digest withSignatureData:(NSData *)signatureData withPublicKey:(PublicKey *)key {
+    Byte publicKey[ED25519_PUBLIC_KEY_LENGTH];
+    
+    if (signatureData.length != ED25519_SIGNATURE_LENGTH
+        || ![self getEd25519PublicKey:publicKey fromPublicKey:key]) {
+        return NO;
+    }
+    
+    return ed25519_verify(signatureData.bytes, digest.bytes, digest.length, publicKey) == 1;
+}
+
+/// The public point is stored as an MPI of 0x40 followed by the 32 byte little endian encoding:
++ (BOOL)getEd25519PublicKey:(Byte *)bytes fromPublicKey:(PublicKey *)key {
+    Byte point[ED25519_PUBLIC_KEY_LENGTH + 1];
+    
+    if (![key.curveOID isEqualToData:[self ed25519CurveOID]]
+        || ![self getBytes:point length:sizeof(point) fromMPI:key.q]
+        || point[0] != 0x40) {
+        return NO;
+    }
+    
+    memcpy(bytes, point + 1, ED25519_PUBLIC_KEY_LENGTH);
+    
+    return YES;
+}
+
+/// MPIs drop leading zeros, this puts them back for fixed length values. Works from the wire
+/// encoding so curve keys never need a BIGNUM:
++ (BOOL)getBytes:(Byte *)bytes length:(NSUInteger)length fromMPI:(MPI *)mpi {
+    if (mpi == nil) {
+        return NO;
+    }
+    
+    NSData *data = mpi.data;
+    const Byte *mpiBytes = (const Byte *) data.bytes + 2;
+    NSUInteger mpiLength = data.length - 2;
+    
+    while (mpiLength > 0 && mpiBytes[0] == 0) {
+        mpiBytes++;
+        mpiLength--;
+    }
+    
+    if (mpiLength > length) {
+        return NO;
+    }
+    
+    memset(bytes, 0, length - mpiLength);
+    memcpy(bytes + length - mpiLength, mpiBytes, mpiLength);
+    
+    return YES;
+}
+
+#pragma mark ECDH encrypt/decrypt
+
++ (NSData *)ecdhEncryptMessage:(NSData *)message withPublicKey:(PublicKey *)key ephemeralPoint:(MPI **)ephemeralPoint {
+    Byte recipientPoint[X25519_KEY_LENGTH];
+    
+    if (![self getX25519PublicKey:recipientPoint fromPublicKey:key]) {
+        return nil;
+    }
+    
+    Byte ephemeralSecret[X25519_KEY_LENGTH];
+    random_bytes(ephemeralSecret, X25519_KEY_LENGTH);
+    
+    Byte point[X25519_KEY_LENGTH + 1];
+    point[0] = 0x40;
+    x25519_public_key(point + 1, ephemeralSecret);
+    
+    Byte sharedSecret[X25519_KEY_LENGTH];
+    int valid = x25519_shared_secret(sharedSecret, ephemeralSecret, recipientPoint);
+    
+    memset(ephemeralSecret, 0, X25519_KEY_LENGTH);
+    
+    if (!valid) {
+        return nil;
+    }
+    
+    // PKCS5 pad up to a multiple of the 8 byte key wrap block:
+    NSUInteger padding = 8 - message.length % 8;
+    NSUInteger paddedLength = message.length + padding;
+    
+    Byte paddedMessage[paddedLength];
+    memcpy(paddedMessage, message.bytes, message.length);
+    memset(paddedMessage + message.length, (int) padding, padding);
+    
+    Byte wrapped[paddedLength + 8];
+    int wrappedLength = [self ecdhWrap:YES
+                                 bytes:paddedMessage
+                                length:paddedLength
+                                output:wrapped
+                          sharedSecret:sharedSecret
+                         withPublicKey:key];
+    
+    memset(sharedSecret, 0, X25519_KEY_LENGTH);
+    memset(paddedMessage, 0, paddedLength);
+    
+    if (wrappedLength <= 0) {
+        return nil;
+    }
+    
+    *ephemeralPoint = [MPI mpiFromBytes:point byteCount:sizeof(point)];
+    
+    return [NSData dataWithBytes:wrapped length:wrappedLength];
+}
+
++ (NSData *)ecdhDecryptMessage:(NSData *)wrappedMessage ephemeralPoint:(MPI *)ephemeralPoint withSecretKey:(SecretKey *)key {
+    
+    // The wrap adds one 8 byte block to a padded, so non empty, message:
+    if (wrappedMessage.length < 16 || wrappedMessage.length % 8 != 0) {
+        return nil;
+    }
+    
+    Byte point[X25519_KEY_LENGTH + 1];
+    Byte secret[X25519_KEY_LENGTH];
+    
+    if (![self getBytes:point length:sizeof(point) fromMPI:ephemeralPoint] || point[0] != 0x40 ||
+        ![self getBytes:secret length:X25519_KEY_LENGTH fromMPI:key.d]) {
+        
+        return nil;
+    }
+    
+    // The secret MPI is big endian, X25519 wants it the other way round:
+    Byte nativeSecret[X25519_KEY_LENGTH];
+    
+    for (NSUInteger i = 0; i < X25519_KEY_LENGTH; i++) {
+        nativeSecret[i] = secret[X25519_KEY_LENGTH - 1 - i];
+    }
+    
+    Byte sharedSecret[X25519_KEY_LENGTH];
+    int valid = x25519_shared_secret(sharedSecret, nativeSecret, point + 1);
+    
+    memset(secret, 0, X25519_KEY_LENGTH);
+    memset(nativeSecret, 0, X25519_KEY_LENGTH);
+    
+    if (!valid) {
+        return nil;
+    }
+    
+    Byte unwrapped[wrappedMessage.length];
+    int unwrappedLength = [self ecdhWrap:NO
+                                   bytes:wrappedMessage.bytes
+                                  length:wrappedMessage.length
+                                  output:unwrapped
+                            sharedSecret:sharedSecret
+                           withPublicKey:key.publicKey];
+    
+    memset(sharedSecret, 0, X25519_KEY_LENGTH);
+    
+    if (unwrappedLength <= 0) {
+        return nil;
+    }
+    
+    NSUInteger padding = unwrapped[unwrappedLength - 1];
+    
+    if (padding == 0 || padding > 8 || padding > (NSUInteger) unwrappedLength) {
+        return nil;
+    }
+    
+    for (NSUInteger i = unwrappedLength - padding; i < unwrappedLength; i++) {
+        if (unwrapped[i] != padding) {
+            return nil;
+        }
+    }
+    
+    NSData *message = [NSData dataWithBytes:unwrapped length:unwrappedLength - padding];
+    
+    memset(unwrapped, 0, unwrappedLength);
+    
+    return message;
+}
+
+/// Derives the key encryption key from the shared secret and runs the AES key wrap either way,
+/// returning the output length or a value <= 0 on failure:
++ (int)ecdhWrap:(BOOL)wrap
+          bytes:(const Byte *)bytes
+         length:(NSUInteger)length
+         output:(Byte *)output
+   sharedSecret:(const Byte *)sharedSecret
+  withPublicKey:(PublicKey *)key {
+    
+    NSUInteger keyLength;
+    
+    switch (key.kdfSymmetricAlgorithm) {
+        case SymmetricAlgorithmAES128: keyLength = 16; break;
+        case SymmetricAlgorithmAES192: keyLength = 24; break;
+        case SymmetricAlgorithmAES256: keyLength = 32; break;
+        default: return 0;
+    }
+    
+    // Param = curve OID, public key algorithm, KDF parameters, "Anonymous Sender    ", recipient fingerprint:
+    NSMutableData *param = [NSMutableData data];
+    
+    Byte oidLength = key.curveOID.length;
+    [param appendBytes:&oidLength length:1];
+    [param appendData:key.curveOID];
+    
+    Byte kdfParameters[5] = {PublicKeyAlgorithmECDH, 0x03, 0x01, key.kdfHashAlgorithm, key.kdfSymmetricAlgorithm};
+    [param appendBytes:kdfParameters length:sizeof(kdfParameters)];
+    [param appendBytes:"Anonymous Sender    " length:20];
+    
+    Fingerprint fingerprint = key.fingerprint;
+    [param appendBytes:fingerprint.bytes length:fingerprint.length];
+    
+    // The KDF is a single round of Hash(00 00 00 01 || shared secret || Param):
+    static const Byte counter[4] = {0x00, 0x00, 0x00, 0x01};
+    Byte kek[SHA512_DIGEST_LENGTH];
+    
+    switch (key.kdfHashAlgorithm) {
+        case HashAlgorithmSHA256: {
+            SHA256_CTX context;
+            SHA256_Init(&context);
+            SHA256_Update(&context, counter, sizeof(counter));
+            SHA256_Update(&context, sharedSecret, X25519_KEY_LENGTH);
+            SHA256_Update(&context, param.bytes, param.length);
+            SHA256_Final(kek, &context);
+            break;
+        }
+            
+        case HashAlgorithmSHA384:
+        case HashAlgorithmSHA512: {
+            SHA512_CTX context;
+            
+            if (key.kdfHashAlgorithm == HashAlgorithmSHA384) {
+                SHA384_Init(&context);
+            } else {
+                SHA512_Init(&context);
+            }
+            
+            SHA512_Update(&context, counter, sizeof(counter));
+            SHA512_Update(&context, sharedSecret, X25519_KEY_LENGTH);
+            SHA512_Update(&context, param.bytes, param.length);
+            SHA512_Final(kek, &context);
+            break;
+        }
+            
+        default:
+            return 0;
+    }
+    
+    AES_KEY aesKey;
+    int outputLength;
+    
+    if (wrap) {
+        AES_set_encrypt_key(kek, (int) keyLength * 8, &aesKey);
+        outputLength = AES_wrap_key(&aesKey, NULL, output, bytes, (unsigned int) length);
+    } else {
+        AES_set_decrypt_key(kek, (int) keyLength * 8, &aesKey);
+        outputLength = AES_unwrap_key(&aesKey, NULL, output, bytes, (unsigned int) length);
+    }
+    
+    memset(kek, 0, sizeof(kek));
+    memset(&aesKey, 0, sizeof(aesKey));
+    
+    return outputLength;
+}
+
++ (BOOL)getX25519PublicKey:(Byte *)bytes fromPublicKey:(PublicKey *)key {
+    if (key.publicKeyAlgorithm != PublicKeyAlgorithmECDH || ![key.curveOID isEqualToData:[self curve25519CurveOID]]) {
+        return NO;
+    }
+    
+    Byte point[X25519_KEY_LENGTH + 1];
+    
+    if (![self getBytes:point length:sizeof(point) fromMPI:key.q] || point[0] != 0x40) {
+        return NO;
+    }
+    
+    memcpy(bytes, point + 1, X25519_KEY_LENGTH);
+    
+    return YES;
 }
 
 #pragma mark AES decrypt/encrypt
 
 + (NSData *)generateSessionKey {
     Byte sessionKey[kCCKeySizeAES256];
-    arc4random_buf(sessionKey, kCCKeySizeAES256);
+    random_bytes(sessionKey, kCCKeySizeAES256);
     
     return [NSData dataWithBytes:sessionKey length:kCCKeySizeAES256];
 }
@@ -125,11 +521,12 @@
 + (NSData *)decryptData:(NSData *)data withSymmetricKey:(const Byte *)symmetricKey {
     NSUInteger length = data.length + kCCBlockSizeAES128;
     
-    Byte outbuf[length];
+    // On the heap, data can be larger than a secondary thread's stack:
+    NSMutableData *output = [NSMutableData dataWithLength:length];
+    Byte *outbuf = output.mutableBytes;
     Byte iv[16];
     size_t num = 0;
     
-    memset(outbuf, 0, length);
     memset(iv, 0, 16);
     
     CCCryptorStatus     err;
@@ -143,7 +540,9 @@
         NSLog(@"Error with CCCryptor create: %i", err);
     }
     
+    PGP_STAGE_BEGIN(PGP_STAGE_SYMMETRIC);
     err = CCCryptorUpdate(cryptor, data.bytes, data.length, outbuf, length, &num);
+    PGP_STAGE_END(PGP_STAGE_SYMMETRIC, data.length);
     
     if (err) {
         NSLog(@"Error with CCCryptor update: %i", err);
@@ -155,18 +554,22 @@
         NSLog(@"Error with CCCryptor final: %i", err);
     }
     
-    return [NSData dataWithBytes:outbuf length:num];
+    CCCryptorRelease(cryptor);
+    
+    output.length = num;
+    
+    return output;
 }
 
 + (NSData *)encryptData:(NSData *)data withSymmetricKey:(const Byte *)symmetricKey {
     
     // TODO Add Preamble and MDC:
     
-    Byte outbuf[data.length];
+    NSMutableData *output = [NSMutableData dataWithLength:data.length];
+    Byte *outbuf = output.mutableBytes;
     Byte iv[16];
     size_t num = 0;
     
-    memset(outbuf, 0, data.length);
     memset(iv, 0, 16);
     
     CCCryptorStatus     err;
@@ -179,7 +582,9 @@
         NSLog(@"Error with CCCryptor create: %i", err);
     }
     
+    PGP_STAGE_BEGIN(PGP_STAGE_SYMMETRIC);
     err = CCCryptorUpdate(cryptor, data.bytes, data.length, outbuf, data.length, &num);
+    PGP_STAGE_END(PGP_STAGE_SYMMETRIC, data.length);
     
     if (err) {
         NSLog(@"Error with CCCryptor update: %i", err);
@@ -191,36 +596,120 @@
         NSLog(@"Error with CCCryptor final: %i", err);
     }
     
-    return [NSData dataWithBytes:outbuf length:data.length];
+    CCCryptorRelease(cryptor);
+    
+    return output;
+}
+
++ (BOOL)quickCheckData:(NSData *)data withSymmetricKey:(const Byte *)symmetricKey {
+    NSUInteger prefixLength = kCCBlockSizeAES128 + 2;
+    
+    if (data.length < prefixLength) {
+        return NO;
+    }
+    
+    NSData *prefix = [self decryptData:[data subdataWithRange:NSMakeRange(0, prefixLength)] withSymmetricKey:symmetricKey];
+    
+    if (prefix.length != prefixLength) {
+        return NO;
+    }
+    
+    const Byte *bytes = prefix.bytes;
+    
+    return bytes[prefixLength - 4] == bytes[prefixLength - 2] && bytes[prefixLength - 3] == bytes[prefixLength - 1];
+}
+
++ (NSData *)decryptData:(NSData *)data symmetricAlgorithm:(SymmetricAlgorithm)algorithm key:(NSData *)key iv:(NSData *)iv {
+    NSUInteger blockSize = [self blockSizeForSymmetricAlgorithm:algorithm];
+    
+    if (blockSize == 0 || key.length != [self keyLengthForSymmetricAlgorithm:algorithm] || iv.length != blockSize) {
+        return nil;
+    }
+    
+    NSMutableData *output = [NSMutableData dataWithLength:data.length];
+    
+    PGP_STAGE_BEGIN(PGP_STAGE_SYMMETRIC);
+    pgp_status status = pgp_cfb_decrypt(algorithm, key.bytes, iv.bytes, data.bytes, output.mutableBytes, data.length);
+    PGP_STAGE_END(PGP_STAGE_SYMMETRIC, data.length);
+    
+    if (status != PGP_OK) {
+        return nil;
+    }
+    
+    return output;
+}
+
++ (NSUInteger)keyLengthForSymmetricAlgorithm:(SymmetricAlgorithm)algorithm {
+    return pgp_cipher_key_length(algorithm);
+}
+
++ (NSUInteger)blockSizeForSymmetricAlgorithm:(SymmetricAlgorithm)algorithm {
+    return pgp_cipher_block_size(algorithm);
 }
 
 #pragma mark Keypair
 
 + (Keypair *)generateKeypairWithBits:(int)bits {
-    RSA *rsa;
-    BIGNUM *bne;
-    BN_CTX *ctx;
+    BIGNUM *bne = BN_new();
+    BN_set_word(bne, RSA_F4);
     
-    ctx = BN_CTX_new();
+    // Same split as RSA_generate_key_ex, but p and q are searched for at the same time:
+    int pBits = (bits + 1) / 2;
+    int qBits = bits - pBits;
+    BIGNUM *primes[2] = {NULL, NULL};
+    BIGNUM **primeSlots = primes;
     
-    bne = BN_new();
-    BN_set_word(bne, RSA_F4);
+    dispatch_apply(2, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        primeSlots[i] = [self generatePrimeWithBits:i == 0 ? pBits : qBits publicExponent:bne];
+    });
     
-    rsa = RSA_new();
-    RSA_generate_key_ex(rsa, bits, bne, NULL);
+    while (BN_cmp(primes[0], primes[1]) == 0) {
+        BN_free(primes[1]);
+        primes[1] = [self generatePrimeWithBits:qBits publicExponent:bne];
+    }
     
-    NSDate *now = [NSDate date];
-    NSUInteger timestamp = [now timeIntervalSince1970];
+    // p > q, as OpenSSL orders them:
+    if (BN_cmp(primes[0], primes[1]) < 0) {
+        BIGNUM *swap = primes[0];
+        primes[0] = primes[1];
+        primes[1] = swap;
+    }
+    
+    BN_CTX *ctx = BN_CTX_new();
     
-    MPI *n = [MPI mpiWithBIGNUM:rsa->n];
-    MPI *e = [MPI mpiWithBIGNUM:rsa->e];
+    BIGNUM *bnn = BN_new();
+    BN_mul(bnn, primes[0], primes[1], ctx);
     
-    MPI *d = [MPI mpiWithBIGNUM:rsa->d];
-    MPI *p = [MPI mpiWithBIGNUM:rsa->p];
-    MPI *q = [MPI mpiWithBIGNUM:rsa->q];
-    MPI *u = [MPI mpiWithBIGNUM:BN_mod_inverse(NULL, rsa->p, rsa->q, ctx)];
+    BIGNUM *p1 = BN_new();
+    BIGNUM *q1 = BN_new();
+    BIGNUM *phi = BN_new();
+    BN_sub(p1, primes[0], BN_value_one());
+    BN_sub(q1, primes[1], BN_value_one());
+    BN_mul(phi, p1, q1, ctx);
     
-    RSA_free(rsa);
+    BIGNUM *bnd = BN_mod_inverse(NULL, bne, phi, ctx);
+    BIGNUM *bnu = BN_mod_inverse(NULL, primes[0], primes[1], ctx);
+    
+    NSDate *now = [NSDate date];
+    NSUInteger timestamp = [now timeIntervalSince1970];
+    
+    MPI *n = [MPI mpiWithBIGNUM:bnn];
+    MPI *e = [MPI mpiWithBIGNUM:bne];
+    
+    MPI *d = [MPI mpiWithBIGNUM:bnd];
+    MPI *p = [MPI mpiWithBIGNUM:primes[0]];
+    MPI *q = [MPI mpiWithBIGNUM:primes[1]];
+    MPI *u = [MPI mpiWithBIGNUM:bnu];
+    
+    BN_clear_free(bnd);
+    BN_clear_free(bnu);
+    BN_clear_free(phi);
+    BN_clear_free(p1);
+    BN_clear_free(q1);
+    BN_clear_free(primes[0]);
+    BN_clear_free(primes[1]);
+    BN_free(bnn);
+    BN_free(bne);
     BN_CTX_free(ctx);
     
     PublicKey *publicKey = [PublicKey keyWithCreationTime:timestamp n:n e:e];
@@ -229,8 +718,126 @@
     return [Keypair keypairWithPublicKey:publicKey secretKey:secretKey];
 }
 
++ (Keypair *)generateEd25519Keypair {
+    Byte seed[ED25519_SEED_LENGTH];
+    random_bytes(seed, ED25519_SEED_LENGTH);
+    
+    Byte point[ED25519_PUBLIC_KEY_LENGTH + 1];
+    point[0] = 0x40;
+    ed25519_public_key(point + 1, seed);
+    
+    NSDate *now = [NSDate date];
+    NSUInteger timestamp = [now timeIntervalSince1970];
+    
+    MPI *q = [MPI mpiFromBytes:point byteCount:sizeof(point)];
+    MPI *d = [MPI mpiFromBytes:seed byteCount:ED25519_SEED_LENGTH];
+    
+    memset(seed, 0, ED25519_SEED_LENGTH);
+    
+    PublicKey *publicKey = [PublicKey keyWithCreationTime:timestamp
+                                       publicKeyAlgorithm:PublicKeyAlgorithmEdDSA
+                                                 curveOID:[self ed25519CurveOID]
+                                                        q:q];
+    
+    SecretKey *secretKey = [SecretKey keyWithPublicKey:publicKey d:d];
+    
+    return [Keypair keypairWithPublicKey:publicKey secretKey:secretKey];
+}
+
++ (Keypair *)generateX25519Keypair {
+    Byte secret[X25519_KEY_LENGTH];
+    random_bytes(secret, X25519_KEY_LENGTH);
+    
+    // Clamp up front so the stored scalar is the one actually used:
+    secret[0] &= 248;
+    secret[31] &= 127;
+    secret[31] |= 64;
+    
+    Byte point[X25519_KEY_LENGTH + 1];
+    point[0] = 0x40;
+    x25519_public_key(point + 1, secret);
+    
+    // The secret MPI is big endian, unlike the native encoding:
+    Byte reversedSecret[X25519_KEY_LENGTH];
+    
+    for (NSUInteger i = 0; i < X25519_KEY_LENGTH; i++) {
+        reversedSecret[i] = secret[X25519_KEY_LENGTH - 1 - i];
+    }
+    
+    NSDate *now = [NSDate date];
+    NSUInteger timestamp = [now timeIntervalSince1970];
+    
+    MPI *q = [MPI mpiFromBytes:point byteCount:sizeof(point)];
+    MPI *d = [MPI mpiFromBytes:reversedSecret byteCount:X25519_KEY_LENGTH];
+    
+    memset(secret, 0, X25519_KEY_LENGTH);
+    memset(reversedSecret, 0, X25519_KEY_LENGTH);
+    
+    PublicKey *publicKey = [PublicKey keyWithCreationTime:timestamp
+                                                 curveOID:[self curve25519CurveOID]
+                                                        q:q
+                                         kdfHashAlgorithm:HashAlgorithmSHA256
+                                    kdfSymmetricAlgorithm:SymmetricAlgorithmAES128];
+    
+    SecretKey *secretKey = [SecretKey keyWithPublicKey:publicKey d:d];
+    
+    return [Keypair keypairWithPublicKey:publicKey secretKey:secretKey];
+}
+
++ (NSData *)ed25519CurveOID {
+    
+    // 1.3.6.1.4.1.11591.15.1:
+    static const Byte oid[] = {0x2B, 0x06, 0x01, 0x04, 0x01, 0xDA, 0x47, 0x0F, 0x01};
+    return [NSData dataWithBytesNoCopy:(void *)oid length:sizeof(oid) freeWhenDone:NO];
+}
+
++ (NSData *)curve25519CurveOID {
+    
+    // 1.3.6.1.4.1.3029.1.5.1:
+    static const Byte oid[] = {0x2B, 0x06, 0x01, 0x04, 0x01, 0x97, 0x55, 0x01, 0x05, 0x01};
+    return [NSData dataWithBytesNoCopy:(void *)oid length:sizeof(oid) freeWhenDone:NO];
+}
+
 #pragma mark Private
 
+/// Built and checked once per key, then shared: with the locking callbacks set OpenSSL keeps the
+/// blinding and Montgomery values of one RSA safe to use from several threads:
++ (RSAWrapper *)preparedRSAWithSecretKey:(SecretKey *)key {
+    RSAWrapper *rsaWrapper = key.preparedKey;
+    
+    if (rsaWrapper != nil) {
+        return rsaWrapper;
+    }
+    
+    rsaWrapper = [RSAWrapper rsaWithSecretKey:key];
+    
+    if (![rsaWrapper addCRTValues] || RSA_check_key(rsaWrapper.rsa) != 1) {
+        return nil;
+    }
+    
+    key.preparedKey = rsaWrapper;
+    
+    return rsaWrapper;
+}
+
+/// A probable prime whose p - 1 is coprime to e, so the private exponent exists:
++ (BIGNUM *)generatePrimeWithBits:(int)bits publicExponent:(const BIGNUM *)e {
+    BIGNUM *prime = BN_new();
+    BIGNUM *gcd = BN_new();
+    BN_CTX *ctx = BN_CTX_new();
+    
+    do {
+        BN_generate_prime_ex(prime, bits, 0, NULL, NULL, NULL);
+        BN_sub(gcd, prime, BN_value_one());
+        BN_gcd(gcd, gcd, e, ctx);
+    } while (!BN_is_one(gcd));
+    
+    BN_free(gcd);
+    BN_CTX_free(ctx);
+    
+    return prime;
+}
+
 + (NSData *)emePKCSEncodeMessage:(NSData *)message keyLength:(NSUInteger)keyLength {
     
     if (message.length > keyLength - 11) {
@@ -278,33 +885,22 @@
     }
 }
 
-+ (NSData *)emsaPKCSEncodeMessage:(NSData *)message algorithm:(HashAlgorithm)algorithm length:(NSUInteger)length {
-    if (algorithm != HashAlgorithmSHA256) {
++ (NSData *)emsaPKCSEncodeDigest:(NSData *)digest algorithm:(HashAlgorithm)algorithm length:(NSUInteger)length {
+    NSData *hashHeader = [self emsaPKCSHashHeaderForAlgorithm:algorithm];
+    
+    if (hashHeader == nil) {
         return nil;
     }
     
-    Byte digest[SHA256_DIGEST_LENGTH];
-    SHA256(message.bytes, message.length, digest);
+    NSUInteger tLength = hashHeader.length + digest.length;
     
-    const NSUInteger HASH_HEADER_LENGTH = 19;
-    Byte hashHeader[HASH_HEADER_LENGTH] = {
-        0x30, 0x31, 0x30, 0x0d,
-        0x06, 0x09, 0x60, 0x86,
-        0x48, 0x01, 0x65, 0x03,
-        0x04, 0x02, 0x01, 0x05,
-        0x00, 0x04, 0x20
-    };
-    
-    
-    NSUInteger tLength = HASH_HEADER_LENGTH + SHA256_DIGEST_LENGTH;
-    Byte T[tLength];
-    
-    memmove(T, hashHeader, HASH_HEADER_LENGTH);
-    memmove(T + HASH_HEADER_LENGTH, digest, SHA256_DIGEST_LENGTH);
+    if (length < tLength + 11) {
+        return nil;
+    }
     
     NSMutableData *encodedMessage = [NSMutableData dataWithCapacity:length];
     
-    Byte header[2] = {0x00, 0x02};
+    Byte header[2] = {0x00, 0x01};
     [encodedMessage appendBytes:header length:2];
     
     NSUInteger paddingLength = length - tLength - 3;
@@ -313,24 +909,87 @@
     
     Byte zero = 0;
     [encodedMessage appendBytes:&zero length:1];
-    [encodedMessage appendBytes:T length:tLength];
+    [encodedMessage appendData:hashHeader];
+    [encodedMessage appendData:digest];
     
     return [NSData dataWithData:encodedMessage];
 }
 
-+ (NSData *)emePKCSPaddingWithLength:(NSUInteger)length {
-    NSMutableData *padding = [NSMutableData dataWithCapacity:length];
-    
-    NSUInteger paddingLength = 0;
-    while (paddingLength < length) {
-        Byte random = arc4random() & 0xFF;
-        if (random != 0) {
-            [padding appendBytes:(void *)&random length:1];
-            paddingLength++;
++ (NSData *)emsaPKCSHashHeaderForAlgorithm:(HashAlgorithm)algorithm {
+    
+    // DER encoded DigestInfo prefixes, RFC 4880 section 5.2.2:
+    switch (algorithm) {
+        case HashAlgorithmMD5: {
+            static const Byte header[] = {
+                0x30, 0x20, 0x30, 0x0C, 0x06, 0x08, 0x2A, 0x86,
+                0x48, 0x86, 0xF7, 0x0D, 0x02, 0x05, 0x05, 0x00,
+                0x04, 0x10
+            };
+            return [NSData dataWithBytesNoCopy:(void *)header length:sizeof(header) freeWhenDone:NO];
+        }
+            
+        case HashAlgorithmSHA1: {
+            static const Byte header[] = {
+                0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2B, 0x0E,
+                0x03, 0x02, 0x1A, 0x05, 0x00, 0x04, 0x14
+            };
+            return [NSData dataWithBytesNoCopy:(void *)header length:sizeof(header) freeWhenDone:NO];
+        }
+            
+        case HashAlgorithmRipeMD: {
+            static const Byte header[] = {
+                0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2B, 0x24,
+                0x03, 0x02, 0x01, 0x05, 0x00, 0x04, 0x14
+            };
+            return [NSData dataWithBytesNoCopy:(void *)header length:sizeof(header) freeWhenDone:NO];
+        }
+            
+        case HashAlgorithmSHA224: {
+            static const Byte header[] = {
+                0x30, 0x2D, 0x30, 0x0D, 0x06, 0x09, 0x60, 0x86,
+                0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x04, 0x05,
+                0x00, 0x04, 0x1C
+            };
+            return [NSData dataWithBytesNoCopy:(void *)header length:sizeof(header) freeWhenDone:NO];
         }
+            
+        case HashAlgorithmSHA256: {
+            static const Byte header[] = {
+                0x30, 0x31, 0x30, 0x0D, 0x06, 0x09, 0x60, 0x86,
+                0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05,
+                0x00, 0x04, 0x20
+            };
+            return [NSData dataWithBytesNoCopy:(void *)header length:sizeof(header) freeWhenDone:NO];
+        }
+            
+        case HashAlgorithmSHA384: {
+            static const Byte header[] = {
+                0x30, 0x41, 0x30, 0x0D, 0x06, 0x09, 0x60, 0x86,
+                0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x02, 0x05,
+                0x00, 0x04, 0x30
+            };
+            return [NSData dataWithBytesNoCopy:(void *)header length:sizeof(header) freeWhenDone:NO];
+        }
+            
+        case HashAlgorithmSHA512: {
+            static const Byte header[] = {
+                0x30, 0x51, 0x30, 0x0D, 0x06, 0x09, 0x60, 0x86,
+                0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x03, 0x05,
+                0x00, 0x04, 0x40
+            };
+            return [NSData dataWithBytesNoCopy:(void *)header length:sizeof(header) freeWhenDone:NO];
+        }
+            
+        default:
+            return nil;
     }
+}
+
++ (NSData *)emePKCSPaddingWithLength:(NSUInteger)length {
+    NSMutableData *padding = [NSMutableData dataWithLength:length];
+    random_nonzero_bytes(padding.mutableBytes, length);
     
-    return [NSData dataWithData:padding];
+    return padding;
 }
 
 + (NSData *)emsaPKCSPaddingWithLength:(NSUInteger)length {
@@ -395,6 +1054,32 @@
     return self;
 }
 
+- (BOOL)addCRTValues {
+    if (_rsa->d == NULL || _rsa->p == NULL || _rsa->q == NULL) {
+        return NO;
+    }
+    
+    BN_CTX *ctx = BN_CTX_new();
+    BIGNUM *p1 = BN_new();
+    BIGNUM *q1 = BN_new();
+    
+    _rsa->dmp1 = BN_new();
+    _rsa->dmq1 = BN_new();
+    
+    BOOL success = ctx != NULL
+        && BN_sub(p1, _rsa->p, BN_value_one())
+        && BN_sub(q1, _rsa->q, BN_value_one())
+        && BN_mod(_rsa->dmp1, _rsa->d, p1, ctx)
+        && BN_mod(_rsa->dmq1, _rsa->d, q1, ctx)
+        && (_rsa->iqmp = BN_mod_inverse(NULL, _rsa->q, _rsa->p, ctx)) != NULL;
+    
+    BN_free(p1);
+    BN_free(q1);
+    BN_CTX_free(ctx);
+    
+    return success;
+}
+
 - (void)dealloc {
     RSA_free(_rsa);
 }
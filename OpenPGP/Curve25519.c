@@ -0,0 +1,867 @@
+//
+//  Curve25519.c
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#include <pthread.h>
+#include <string.h>
+#include <openssl/sha.h>
+#include "Curve25519.h"
+
+// Field arithmetic:
+
+// Elements of GF(2^255 - 19) are held in ten signed limbs of alternately 26 and 25 bits
+// (radix 2^25.5), so every limb product fits in 64 bits on both 32 and 64 bit targets.
+
+typedef int32_t fe[10];
+
+static const fe fe_d = {
+    56195235, 13857412, 51736253, 6949390, 114729,
+    24766616, 60832955, 30306712, 48412415, 21499315
+};
+
+static const fe fe_d2 = {
+    45281625, 27714825, 36363642, 13898781, 229458,
+    15978800, 54557047, 27058993, 29715967, 9444199
+};
+
+static const fe fe_sqrtm1 = {
+    34513072, 25610706, 9377949, 3500415, 12389472,
+    33281959, 41962654, 31548777, 326685, 11406482
+};
+
+static inline int fe_width(int i) {
+    return (i & 1) ? 25 : 26;
+}
+
+static void fe_0(fe h) {
+    memset(h, 0, sizeof(fe));
+}
+
+static void fe_1(fe h) {
+    fe_0(h);
+    h[0] = 1;
+}
+
+static void fe_copy(fe h, const fe f) {
+    memcpy(h, f, sizeof(fe));
+}
+
+// Carry limb i into limb i + 1, rounding so the limb ends up centred on zero:
+#define FE_CARRY(t, i, width) do {                                    \
+    int64_t c = ((t)[i] + ((int64_t) 1 << ((width) - 1))) >> (width); \
+    (t)[(i) + 1] += c;                                                \
+    (t)[i] -= c * ((int64_t) 1 << (width));                           \
+} while (0)
+
+static void fe_carry(fe h, int64_t t[10]) {
+    int64_t c;
+
+    // Interleaved so that no limb overflows before it is carried out of:
+    FE_CARRY(t, 0, 26);
+    FE_CARRY(t, 4, 26);
+    FE_CARRY(t, 1, 25);
+    FE_CARRY(t, 5, 25);
+    FE_CARRY(t, 2, 26);
+    FE_CARRY(t, 6, 26);
+    FE_CARRY(t, 3, 25);
+    FE_CARRY(t, 7, 25);
+    FE_CARRY(t, 4, 26);
+    FE_CARRY(t, 8, 26);
+
+    c = (t[9] + ((int64_t) 1 << 24)) >> 25;
+    t[0] += c * 19;
+    t[9] -= c * ((int64_t) 1 << 25);
+
+    FE_CARRY(t, 0, 26);
+
+    for (int i = 0; i < 10; i++) {
+        h[i] = (int32_t) t[i];
+    }
+}
+
+// Sums and differences are left uncarried, fe_mul has headroom for a few of them:
+
+static void fe_add(fe h, const fe f, const fe g) {
+    for (int i = 0; i < 10; i++) {
+        h[i] = f[i] + g[i];
+    }
+}
+
+static void fe_sub(fe h, const fe f, const fe g) {
+    for (int i = 0; i < 10; i++) {
+        h[i] = f[i] - g[i];
+    }
+}
+
+static void fe_neg(fe h, const fe f) {
+    for (int i = 0; i < 10; i++) {
+        h[i] = -f[i];
+    }
+}
+
+/// Schoolbook product, written out so the compiler keeps everything in registers. Two odd limbs
+/// overshoot their combined position by one bit (the _2 terms), and since 2^255 = 19 mod p the
+/// products past the top limb wrap around multiplied by 19 (the _19 terms):
+static void fe_mul(fe h, const fe f, const fe g) {
+    int64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    int64_t f5 = f[5], f6 = f[6], f7 = f[7], f8 = f[8], f9 = f[9];
+    int64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+    int64_t g5 = g[5], g6 = g[6], g7 = g[7], g8 = g[8], g9 = g[9];
+    int64_t f1_2 = 2 * f1, f3_2 = 2 * f3, f5_2 = 2 * f5, f7_2 = 2 * f7, f9_2 = 2 * f9;
+    int64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4, g5_19 = 19 * g5;
+    int64_t g6_19 = 19 * g6, g7_19 = 19 * g7, g8_19 = 19 * g8, g9_19 = 19 * g9;
+    int64_t t[10];
+
+    t[0] = f0 * g0 + f1_2 * g9_19 + f2 * g8_19 + f3_2 * g7_19 + f4 * g6_19
+           + f5_2 * g5_19 + f6 * g4_19 + f7_2 * g3_19 + f8 * g2_19 + f9_2 * g1_19;
+    t[1] = f0 * g1 + f1 * g0 + f2 * g9_19 + f3 * g8_19 + f4 * g7_19
+           + f5 * g6_19 + f6 * g5_19 + f7 * g4_19 + f8 * g3_19 + f9 * g2_19;
+    t[2] = f0 * g2 + f1_2 * g1 + f2 * g0 + f3_2 * g9_19 + f4 * g8_19
+           + f5_2 * g7_19 + f6 * g6_19 + f7_2 * g5_19 + f8 * g4_19 + f9_2 * g3_19;
+    t[3] = f0 * g3 + f1 * g2 + f2 * g1 + f3 * g0 + f4 * g9_19
+           + f5 * g8_19 + f6 * g7_19 + f7 * g6_19 + f8 * g5_19 + f9 * g4_19;
+    t[4] = f0 * g4 + f1_2 * g3 + f2 * g2 + f3_2 * g1 + f4 * g0
+           + f5_2 * g9_19 + f6 * g8_19 + f7_2 * g7_19 + f8 * g6_19 + f9_2 * g5_19;
+    t[5] = f0 * g5 + f1 * g4 + f2 * g3 + f3 * g2 + f4 * g1
+           + f5 * g0 + f6 * g9_19 + f7 * g8_19 + f8 * g7_19 + f9 * g6_19;
+    t[6] = f0 * g6 + f1_2 * g5 + f2 * g4 + f3_2 * g3 + f4 * g2
+           + f5_2 * g1 + f6 * g0 + f7_2 * g9_19 + f8 * g8_19 + f9_2 * g7_19;
+    t[7] = f0 * g7 + f1 * g6 + f2 * g5 + f3 * g4 + f4 * g3
+           + f5 * g2 + f6 * g1 + f7 * g0 + f8 * g9_19 + f9 * g8_19;
+    t[8] = f0 * g8 + f1_2 * g7 + f2 * g6 + f3_2 * g5 + f4 * g4
+           + f5_2 * g3 + f6 * g2 + f7_2 * g1 + f8 * g0 + f9_2 * g9_19;
+    t[9] = f0 * g9 + f1 * g8 + f2 * g7 + f3 * g6 + f4 * g5
+           + f5 * g4 + f6 * g3 + f7 * g2 + f8 * g1 + f9 * g0;
+
+    fe_carry(h, t);
+}
+
+/// As fe_mul, with the symmetric products folded together:
+static void fe_sq(fe h, const fe f) {
+    int64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+    int64_t f5 = f[5], f6 = f[6], f7 = f[7], f8 = f[8], f9 = f[9];
+    int64_t t[10];
+
+    t[0] = f0 * f0 + f1 * f9 * 76 + f2 * f8 * 38 + f3 * f7 * 76 + f4 * f6 * 38
+           + f5 * f5 * 38;
+    t[1] = f0 * f1 * 2 + f2 * f9 * 38 + f3 * f8 * 38 + f4 * f7 * 38 + f5 * f6 * 38;
+    t[2] = f0 * f2 * 2 + f1 * f1 * 2 + f3 * f9 * 76 + f4 * f8 * 38 + f5 * f7 * 76
+           + f6 * f6 * 19;
+    t[3] = f0 * f3 * 2 + f1 * f2 * 2 + f4 * f9 * 38 + f5 * f8 * 38 + f6 * f7 * 38;
+    t[4] = f0 * f4 * 2 + f1 * f3 * 4 + f2 * f2 + f5 * f9 * 76 + f6 * f8 * 38
+           + f7 * f7 * 38;
+    t[5] = f0 * f5 * 2 + f1 * f4 * 2 + f2 * f3 * 2 + f6 * f9 * 38 + f7 * f8 * 38;
+    t[6] = f0 * f6 * 2 + f1 * f5 * 4 + f2 * f4 * 2 + f3 * f3 * 2 + f7 * f9 * 76
+           + f8 * f8 * 19;
+    t[7] = f0 * f7 * 2 + f1 * f6 * 2 + f2 * f5 * 2 + f3 * f4 * 2 + f8 * f9 * 38;
+    t[8] = f0 * f8 * 2 + f1 * f7 * 4 + f2 * f6 * 2 + f3 * f5 * 4 + f4 * f4
+           + f9 * f9 * 38;
+    t[9] = f0 * f9 * 2 + f1 * f8 * 2 + f2 * f7 * 2 + f3 * f6 * 2 + f4 * f5 * 2;
+
+    fe_carry(h, t);
+}
+
+static void fe_sqn(fe h, const fe f, int n) {
+    fe_sq(h, f);
+
+    for (int i = 1; i < n; i++) {
+        fe_sq(h, h);
+    }
+}
+
+static void fe_mul_small(fe h, const fe f, int32_t n) {
+    int64_t t[10];
+
+    for (int i = 0; i < 10; i++) {
+        t[i] = (int64_t) f[i] * n;
+    }
+
+    fe_carry(h, t);
+}
+
+/// Constant time, replaces f with g if b is 1:
+static void fe_cmov(fe f, const fe g, uint32_t b) {
+    int32_t mask = -(int32_t) b;
+
+    for (int i = 0; i < 10; i++) {
+        f[i] ^= (f[i] ^ g[i]) & mask;
+    }
+}
+
+/// Constant time, swaps f and g if b is 1:
+static void fe_cswap(fe f, fe g, uint32_t b) {
+    int32_t mask = -(int32_t) b;
+
+    for (int i = 0; i < 10; i++) {
+        int32_t x = (f[i] ^ g[i]) & mask;
+        f[i] ^= x;
+        g[i] ^= x;
+    }
+}
+
+static void fe_frombytes(fe h, const uint8_t s[32]) {
+    uint64_t accumulator = 0;
+    int bits = 0, k = 0;
+
+    for (int i = 0; i < 10; i++) {
+        int width = fe_width(i);
+
+        while (bits < width) {
+            // The top bit is not part of the field element:
+            uint8_t byte = (k == 31) ? (s[k] & 0x7F) : s[k];
+            accumulator |= (uint64_t) byte << bits;
+            bits += 8;
+            k++;
+        }
+
+        h[i] = (int32_t) (accumulator & ((1 << width) - 1));
+        accumulator >>= width;
+        bits -= width;
+    }
+}
+
+static void fe_tobytes(uint8_t s[32], const fe f) {
+    int64_t t[10];
+    int32_t h[10];
+    int32_t q, carry;
+
+    for (int i = 0; i < 10; i++) {
+        t[i] = f[i];
+    }
+
+    fe_carry(h, t);
+
+    // Work out whether h >= p (q = 1) by carrying h + 19 through the top limb:
+    q = (19 * h[9] + ((int32_t) 1 << 24)) >> 25;
+
+    for (int i = 0; i < 10; i++) {
+        q = (h[i] + q) >> fe_width(i);
+    }
+
+    h[0] += 19 * q;
+
+    // Now h - 2^255 q is h mod p, fully carry and drop the 2^255:
+    for (int i = 0; i < 10; i++) {
+        int width = fe_width(i);
+        carry = h[i] >> width;
+        h[i] -= carry * ((int32_t) 1 << width);
+
+        if (i < 9) {
+            h[i + 1] += carry;
+        }
+    }
+
+    uint64_t accumulator = 0;
+    int bits = 0, k = 0;
+
+    for (int i = 0; i < 10; i++) {
+        accumulator |= (uint64_t) h[i] << bits;
+        bits += fe_width(i);
+
+        while (bits >= 8) {
+            s[k++] = accumulator & 0xFF;
+            accumulator >>= 8;
+            bits -= 8;
+        }
+    }
+
+    s[k] = accumulator & 0xFF;
+}
+
+static int fe_isnegative(const fe f) {
+    uint8_t s[32];
+    fe_tobytes(s, f);
+
+    return s[0] & 1;
+}
+
+static int fe_isnonzero(const fe f) {
+    uint8_t s[32];
+    fe_tobytes(s, f);
+
+    uint8_t r = 0;
+
+    for (int i = 0; i < 32; i++) {
+        r |= s[i];
+    }
+
+    return r != 0;
+}
+
+/// Computes z^(2^250 - 1) and z^11, the shared head of the inversion and square root chains:
+static void fe_pow2_250_1(fe out, fe z11, const fe z) {
+    fe t0, t1, t2;
+
+    fe_sq(t0, z);                   // 2
+    fe_sqn(t1, t0, 2);              // 8
+    fe_mul(t1, z, t1);              // 9
+    fe_mul(z11, t0, t1);            // 11
+    fe_sq(t0, z11);                 // 22
+    fe_mul(t0, t1, t0);             // 2^5 - 1
+    fe_sqn(t1, t0, 5);
+    fe_mul(t0, t1, t0);             // 2^10 - 1
+    fe_sqn(t1, t0, 10);
+    fe_mul(t1, t1, t0);             // 2^20 - 1
+    fe_sqn(t2, t1, 20);
+    fe_mul(t1, t2, t1);             // 2^40 - 1
+    fe_sqn(t1, t1, 10);
+    fe_mul(t0, t1, t0);             // 2^50 - 1
+    fe_sqn(t1, t0, 50);
+    fe_mul(t1, t1, t0);             // 2^100 - 1
+    fe_sqn(t2, t1, 100);
+    fe_mul(t1, t2, t1);             // 2^200 - 1
+    fe_sqn(t1, t1, 50);
+    fe_mul(out, t1, t0);            // 2^250 - 1
+}
+
+/// z^(p - 2) = z^(2^255 - 21):
+static void fe_invert(fe out, const fe z) {
+    fe t, z11;
+
+    fe_pow2_250_1(t, z11, z);
+    fe_sqn(t, t, 5);
+    fe_mul(out, t, z11);
+}
+
+/// z^((p - 5) / 8) = z^(2^252 - 3):
+static void fe_pow22523(fe out, const fe z) {
+    fe t, z11;
+
+    fe_pow2_250_1(t, z11, z);
+    fe_sqn(t, t, 2);
+    fe_mul(out, t, z);
+}
+
+// Edwards points:
+
+// Points on -x^2 + y^2 = 1 + d x^2 y^2 in extended coordinates, x = X/Z, y = Y/Z, xy = T/Z.
+
+typedef struct {
+    fe X;
+    fe Y;
+    fe Z;
+    fe T;
+} ge;
+
+static const ge ge_base = {
+    {52811034, 25909283, 16144682, 17082669, 27570973, 30858332, 40966398, 8378388, 20764389, 8758491},
+    {40265304, 26843545, 13421772, 20132659, 26843545, 6710886, 53687091, 13421772, 40265318, 26843545},
+    {1, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {28827043, 27438313, 39759291, 244362, 8635006, 11264893, 19351346, 13413597, 16611511, 27139452}
+};
+
+static void ge_identity(ge *p) {
+    fe_0(p->X);
+    fe_1(p->Y);
+    fe_1(p->Z);
+    fe_0(p->T);
+}
+
+/// Complete addition, add-2008-hwcd-3, also correct for p == q and the identity:
+static void ge_add(ge *r, const ge *p, const ge *q) {
+    fe a, b, c, d, e, f, g, h, t;
+
+    fe_sub(a, p->Y, p->X);
+    fe_sub(t, q->Y, q->X);
+    fe_mul(a, a, t);
+    fe_add(b, p->Y, p->X);
+    fe_add(t, q->Y, q->X);
+    fe_mul(b, b, t);
+    fe_mul(c, p->T, q->T);
+    fe_mul(c, c, fe_d2);
+    fe_mul(d, p->Z, q->Z);
+    fe_add(d, d, d);
+    fe_sub(e, b, a);
+    fe_sub(f, d, c);
+    fe_add(g, d, c);
+    fe_add(h, b, a);
+
+    fe_mul(r->X, e, f);
+    fe_mul(r->Y, g, h);
+    fe_mul(r->T, e, h);
+    fe_mul(r->Z, f, g);
+}
+
+/// Doubling, dbl-2008-hwcd with a = -1:
+static void ge_double(ge *r, const ge *p) {
+    fe a, b, c, e, f, g, h;
+
+    fe_sq(a, p->X);
+    fe_sq(b, p->Y);
+    fe_sq(c, p->Z);
+    fe_add(c, c, c);
+    fe_add(e, p->X, p->Y);
+    fe_sq(e, e);
+    fe_sub(e, e, a);
+    fe_sub(e, e, b);
+    fe_sub(g, b, a);
+    fe_sub(f, g, c);
+    fe_neg(h, a);
+    fe_sub(h, h, b);
+
+    fe_mul(r->X, e, f);
+    fe_mul(r->Y, g, h);
+    fe_mul(r->T, e, h);
+    fe_mul(r->Z, f, g);
+}
+
+static void ge_neg(ge *r, const ge *p) {
+    fe_neg(r->X, p->X);
+    fe_copy(r->Y, p->Y);
+    fe_copy(r->Z, p->Z);
+    fe_neg(r->T, p->T);
+}
+
+static void ge_tobytes(uint8_t s[32], const ge *p) {
+    fe recip, x, y;
+
+    fe_invert(recip, p->Z);
+    fe_mul(x, p->X, recip);
+    fe_mul(y, p->Y, recip);
+    fe_tobytes(s, y);
+
+    s[31] ^= fe_isnegative(x) << 7;
+}
+
+/// Returns 0 if the encoding is not a point on the curve:
+static int ge_frombytes(ge *p, const uint8_t s[32]) {
+    fe u, v, v3, vxx, check;
+
+    fe_frombytes(p->Y, s);
+    fe_1(p->Z);
+
+    // x^2 = (y^2 - 1) / (d y^2 + 1), x = u v^3 (u v^7)^((p - 5) / 8):
+    fe_sq(u, p->Y);
+    fe_mul(v, u, fe_d);
+    fe_sub(u, u, p->Z);
+    fe_add(v, v, p->Z);
+
+    fe_sq(v3, v);
+    fe_mul(v3, v3, v);
+    fe_sq(p->X, v3);
+    fe_mul(p->X, p->X, v);
+    fe_mul(p->X, p->X, u);
+    fe_pow22523(p->X, p->X);
+    fe_mul(p->X, p->X, v3);
+    fe_mul(p->X, p->X, u);
+
+    fe_sq(vxx, p->X);
+    fe_mul(vxx, vxx, v);
+    fe_sub(check, vxx, u);
+
+    if (fe_isnonzero(check)) {
+        fe_add(check, vxx, u);
+
+        if (fe_isnonzero(check)) {
+            return 0;
+        }
+
+        fe_mul(p->X, p->X, fe_sqrtm1);
+    }
+
+    if (fe_isnegative(p->X) != (s[31] >> 7)) {
+        if (!fe_isnonzero(p->X)) {
+            return 0;
+        }
+
+        fe_neg(p->X, p->X);
+    }
+
+    fe_mul(p->T, p->X, p->Y);
+
+    return 1;
+}
+
+// Scalar multiplication:
+
+// Scalars are split into 64 signed four bit digits in [-8, 8], looked up in tables of [1]P..[8]P.
+
+typedef ge ge_table[8];
+
+static void ge_table_init(ge_table table, const ge *p) {
+    table[0] = *p;
+
+    for (int i = 1; i < 8; i++) {
+        ge_add(&table[i], &table[i - 1], p);
+    }
+}
+
+/// Constant time lookup of [digit]P, the secret digit doesn't show up in the memory access pattern:
+static void ge_table_select(ge *r, const ge_table table, int8_t digit) {
+    uint32_t negative = (uint8_t) digit >> 7;
+    uint32_t magnitude = (uint32_t) (digit - ((-negative & digit) << 1)) & 0xFF;
+    ge negated;
+
+    ge_identity(r);
+
+    for (uint32_t i = 0; i < 8; i++) {
+        uint32_t equal = (((i + 1) ^ magnitude) - 1) >> 31;
+        fe_cmov(r->X, table[i].X, equal);
+        fe_cmov(r->Y, table[i].Y, equal);
+        fe_cmov(r->Z, table[i].Z, equal);
+        fe_cmov(r->T, table[i].T, equal);
+    }
+
+    ge_neg(&negated, r);
+    fe_cmov(r->X, negated.X, negative);
+    fe_cmov(r->T, negated.T, negative);
+}
+
+/// a = sum of e[i] 16^i with every e[i] in [-8, 8], a[31] must be <= 127:
+static void scalar_digits(int8_t e[64], const uint8_t a[32]) {
+    int8_t carry = 0;
+
+    for (int i = 0; i < 32; i++) {
+        e[2 * i] = a[i] & 0x0F;
+        e[2 * i + 1] = (a[i] >> 4) & 0x0F;
+    }
+
+    for (int i = 0; i < 63; i++) {
+        e[i] += carry;
+        carry = (e[i] + 8) >> 4;
+        e[i] -= carry * 16;
+    }
+
+    e[63] += carry;
+}
+
+// The base point gets a table per pair of digits, [j]256^i B, which turns [a]B into 64 additions
+// and only four doublings. It costs 40KB, built on first use.
+static ge_table ge_base_tables[32];
+static pthread_once_t ge_base_tables_once = PTHREAD_ONCE_INIT;
+
+static void ge_base_tables_init(void) {
+    ge p = ge_base;
+
+    for (int i = 0; i < 32; i++) {
+        ge_table_init(ge_base_tables[i], &p);
+
+        for (int j = 0; j < 8; j++) {
+            ge_double(&p, &p);
+        }
+    }
+}
+
+/// r = [a]B:
+static void ge_scalarmult_base(ge *r, const uint8_t a[32]) {
+    int8_t e[64];
+    ge t;
+
+    pthread_once(&ge_base_tables_once, ge_base_tables_init);
+    scalar_digits(e, a);
+    ge_identity(r);
+
+    for (int i = 1; i < 64; i += 2) {
+        ge_table_select(&t, ge_base_tables[i / 2], e[i]);
+        ge_add(r, r, &t);
+    }
+
+    ge_double(r, r);
+    ge_double(r, r);
+    ge_double(r, r);
+    ge_double(r, r);
+
+    for (int i = 0; i < 64; i += 2) {
+        ge_table_select(&t, ge_base_tables[i / 2], e[i]);
+        ge_add(r, r, &t);
+    }
+}
+
+/// r = [a]B + [b]P, only used on public values:
+static void ge_double_scalarmult(ge *r, const uint8_t a[32], const uint8_t b[32], const ge *p) {
+    int8_t e[64];
+    ge_table table;
+    ge t;
+
+    ge_scalarmult_base(r, a);
+    ge_table_init(table, p);
+    scalar_digits(e, b);
+
+    ge_identity(&t);
+
+    for (int i = 63; i >= 0; i--) {
+        ge_double(&t, &t);
+        ge_double(&t, &t);
+        ge_double(&t, &t);
+        ge_double(&t, &t);
+
+        if (e[i] > 0) {
+            ge_add(&t, &t, &table[e[i] - 1]);
+        } else if (e[i] < 0) {
+            ge neg;
+            ge_neg(&neg, &table[-e[i] - 1]);
+            ge_add(&t, &t, &neg);
+        }
+    }
+
+    ge_add(r, r, &t);
+}
+
+// Scalars mod L:
+
+// L = 2^252 + 27742317777372353535851937790883648493, little endian:
+static const int64_t scalar_L[32] = {
+    0xED, 0xD3, 0xF5, 0x5C, 0x1A, 0x63, 0x12, 0x58,
+    0xD6, 0x9C, 0xF7, 0xA2, 0xDE, 0xF9, 0xDE, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+/// Reduces the 64 byte little endian number in x mod L into r:
+static void scalar_reduce_limbs(uint8_t r[32], int64_t x[64]) {
+    int64_t carry;
+    int i, j;
+
+    for (i = 63; i >= 32; i--) {
+        carry = 0;
+
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * scalar_L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+
+        x[j] += carry;
+        x[i] = 0;
+    }
+
+    carry = 0;
+
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * scalar_L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+
+    for (j = 0; j < 32; j++) {
+        x[j] -= carry * scalar_L[j];
+    }
+
+    for (i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+static void scalar_reduce(uint8_t r[32], const uint8_t s[64]) {
+    int64_t x[64];
+
+    for (int i = 0; i < 64; i++) {
+        x[i] = s[i];
+    }
+
+    scalar_reduce_limbs(r, x);
+}
+
+/// r = (a b + c) mod L:
+static void scalar_muladd(uint8_t r[32], const uint8_t a[32], const uint8_t b[32], const uint8_t c[32]) {
+    int64_t x[64] = {0};
+
+    for (int i = 0; i < 32; i++) {
+        x[i] = c[i];
+    }
+
+    for (int i = 0; i < 32; i++) {
+        for (int j = 0; j < 32; j++) {
+            x[i + j] += (int64_t) a[i] * b[j];
+        }
+    }
+
+    scalar_reduce_limbs(r, x);
+}
+
+/// Signatures with S >= L are malleable and rejected:
+static int scalar_is_canonical(const uint8_t s[32]) {
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] < scalar_L[i]) {
+            return 1;
+        } else if (s[i] > scalar_L[i]) {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+// Ed25519:
+
+static void ed25519_expand_seed(uint8_t expanded[64], const uint8_t seed[32]) {
+    SHA512(seed, 32, expanded);
+
+    expanded[0] &= 248;
+    expanded[31] &= 127;
+    expanded[31] |= 64;
+}
+
+/// h = SHA512(R || A || M) mod L:
+static void ed25519_challenge(uint8_t h[32], const uint8_t R[32], const uint8_t A[32],
+                              const uint8_t *message, size_t messageLength) {
+    SHA512_CTX context;
+    uint8_t digest[64];
+
+    SHA512_Init(&context);
+    SHA512_Update(&context, R, 32);
+    SHA512_Update(&context, A, 32);
+    SHA512_Update(&context, message, messageLength);
+    SHA512_Final(digest, &context);
+
+    scalar_reduce(h, digest);
+}
+
+void ed25519_public_key(uint8_t publicKey[ED25519_PUBLIC_KEY_LENGTH],
+                        const uint8_t seed[ED25519_SEED_LENGTH]) {
+    uint8_t expanded[64];
+    ge A;
+
+    ed25519_expand_seed(expanded, seed);
+    ge_scalarmult_base(&A, expanded);
+    ge_tobytes(publicKey, &A);
+
+    memset(expanded, 0, sizeof(expanded));
+}
+
+void ed25519_sign(uint8_t signature[ED25519_SIGNATURE_LENGTH],
+                  const uint8_t *message, size_t messageLength,
+                  const uint8_t seed[ED25519_SEED_LENGTH],
+                  const uint8_t publicKey[ED25519_PUBLIC_KEY_LENGTH]) {
+    uint8_t expanded[64], nonce[64], r[32], h[32];
+    SHA512_CTX context;
+    ge R;
+
+    ed25519_expand_seed(expanded, seed);
+
+    // r = SHA512(prefix || M) mod L:
+    SHA512_Init(&context);
+    SHA512_Update(&context, expanded + 32, 32);
+    SHA512_Update(&context, message, messageLength);
+    SHA512_Final(nonce, &context);
+    scalar_reduce(r, nonce);
+
+    ge_scalarmult_base(&R, r);
+    ge_tobytes(signature, &R);
+
+    // S = (r + h a) mod L:
+    ed25519_challenge(h, signature, publicKey, message, messageLength);
+    scalar_muladd(signature + 32, h, expanded, r);
+
+    memset(expanded, 0, sizeof(expanded));
+    memset(nonce, 0, sizeof(nonce));
+    memset(r, 0, sizeof(r));
+}
+
+int ed25519_verify(const uint8_t signature[ED25519_SIGNATURE_LENGTH],
+                   const uint8_t *message, size_t messageLength,
+                   const uint8_t publicKey[ED25519_PUBLIC_KEY_LENGTH]) {
+    uint8_t h[32], check[32];
+    ge A, R;
+
+    if (!scalar_is_canonical(signature + 32)) {
+        return 0;
+    }
+
+    if (!ge_frombytes(&A, publicKey)) {
+        return 0;
+    }
+
+    ed25519_challenge(h, signature, publicKey, message, messageLength);
+
+    // [S]B - [h]A should land back on R:
+    ge_neg(&A, &A);
+    ge_double_scalarmult(&R, signature + 32, h, &A);
+    ge_tobytes(check, &R);
+
+    return memcmp(check, signature, 32) == 0;
+}
+
+// X25519:
+
+static void x25519_clamp(uint8_t scalar[32], const uint8_t secretKey[32]) {
+    memcpy(scalar, secretKey, 32);
+
+    scalar[0] &= 248;
+    scalar[31] &= 127;
+    scalar[31] |= 64;
+}
+
+void x25519_public_key(uint8_t publicKey[X25519_KEY_LENGTH],
+                       const uint8_t secretKey[X25519_KEY_LENGTH]) {
+    uint8_t scalar[32];
+    fe u, denominator;
+    ge A;
+
+    // The base point table is on the birationally equivalent Edwards curve, so go through
+    // [k]B there and map across with u = (1 + y) / (1 - y) = (Z + Y) / (Z - Y):
+    x25519_clamp(scalar, secretKey);
+    ge_scalarmult_base(&A, scalar);
+
+    fe_add(u, A.Z, A.Y);
+    fe_sub(denominator, A.Z, A.Y);
+    fe_invert(denominator, denominator);
+    fe_mul(u, u, denominator);
+    fe_tobytes(publicKey, u);
+
+    memset(scalar, 0, sizeof(scalar));
+}
+
+int x25519_shared_secret(uint8_t sharedSecret[X25519_KEY_LENGTH],
+                         const uint8_t secretKey[X25519_KEY_LENGTH],
+                         const uint8_t publicKey[X25519_KEY_LENGTH]) {
+    uint8_t scalar[32];
+    fe x1, x2, z2, x3, z3, a, aa, b, bb, e, c, d, da, cb;
+    uint32_t swap = 0;
+
+    x25519_clamp(scalar, secretKey);
+
+    fe_frombytes(x1, publicKey);
+    fe_1(x2);
+    fe_0(z2);
+    fe_copy(x3, x1);
+    fe_1(z3);
+
+    // Montgomery ladder, RFC 7748 section 5:
+    for (int t = 254; t >= 0; t--) {
+        uint32_t bit = (scalar[t >> 3] >> (t & 7)) & 1;
+
+        swap ^= bit;
+        fe_cswap(x2, x3, swap);
+        fe_cswap(z2, z3, swap);
+        swap = bit;
+
+        fe_add(a, x2, z2);
+        fe_sq(aa, a);
+        fe_sub(b, x2, z2);
+        fe_sq(bb, b);
+        fe_sub(e, aa, bb);
+        fe_add(c, x3, z3);
+        fe_sub(d, x3, z3);
+        fe_mul(da, d, a);
+        fe_mul(cb, c, b);
+
+        fe_add(x3, da, cb);
+        fe_sq(x3, x3);
+        fe_sub(z3, da, cb);
+        fe_sq(z3, z3);
+        fe_mul(z3, z3, x1);
+
+        fe_mul(x2, aa, bb);
+        fe_mul_small(z2, e, 121665);
+        fe_add(z2, z2, aa);
+        fe_mul(z2, z2, e);
+    }
+
+    fe_cswap(x2, x3, swap);
+    fe_cswap(z2, z3, swap);
+
+    fe_invert(z2, z2);
+    fe_mul(x2, x2, z2);
+    fe_tobytes(sharedSecret, x2);
+
+    memset(scalar, 0, sizeof(scalar));
+
+    // A small order public key gives an all zero secret, which mustn't be used:
+    return fe_isnonzero(x2);
+}
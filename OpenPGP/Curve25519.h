@@ -0,0 +1,56 @@
+//
+//  Curve25519.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#ifndef OpenPGP_Curve25519_h
+#define OpenPGP_Curve25519_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The bundled OpenSSL predates Curve25519, so the curve arithmetic lives here.
+// Keys and signatures use the RFC 8032 and RFC 7748 little-endian encodings.
+
+#define ED25519_SEED_LENGTH 32
+#define ED25519_PUBLIC_KEY_LENGTH 32
+#define ED25519_SIGNATURE_LENGTH 64
+
+#define X25519_KEY_LENGTH 32
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Derives the public key A = [a]B from the 32 byte secret seed:
+void ed25519_public_key(uint8_t publicKey[ED25519_PUBLIC_KEY_LENGTH],
+                        const uint8_t seed[ED25519_SEED_LENGTH]);
+
+/// Writes the 64 byte signature R || S of the message:
+void ed25519_sign(uint8_t signature[ED25519_SIGNATURE_LENGTH],
+                  const uint8_t *message, size_t messageLength,
+                  const uint8_t seed[ED25519_SEED_LENGTH],
+                  const uint8_t publicKey[ED25519_PUBLIC_KEY_LENGTH]);
+
+/// Returns 1 if the signature is valid, 0 otherwise:
+int ed25519_verify(const uint8_t signature[ED25519_SIGNATURE_LENGTH],
+                   const uint8_t *message, size_t messageLength,
+                   const uint8_t publicKey[ED25519_PUBLIC_KEY_LENGTH]);
+
+/// Derives the X25519 public key [k]9 from the 32 byte secret key:
+void x25519_public_key(uint8_t publicKey[X25519_KEY_LENGTH],
+                       const uint8_t secretKey[X25519_KEY_LENGTH]);
+
+/// Diffie-Hellman with the other party's public key, returns 0 if the result is all zeros:
+int x25519_shared_secret(uint8_t sharedSecret[X25519_KEY_LENGTH],
+                         const uint8_t secretKey[X25519_KEY_LENGTH],
+                         const uint8_t publicKey[X25519_KEY_LENGTH]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,22 @@
+//
+//  DecryptionResult.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/// One message of a batch, either decrypted with the user IDs whose signatures verified, or the
+/// error it failed with:
+@interface DecryptionResult : NSObject
+
+@property (nonatomic, readonly) NSString *decryptedMessage;
+@property (nonatomic, readonly) NSArray *verifiedUserIds;
+@property (nonatomic, readonly) NSError *error;
+
++ (DecryptionResult *)resultWithDecryptedMessage:(NSString *)decryptedMessage verifiedUserIds:(NSArray *)verifiedUserIds;
++ (DecryptionResult *)resultWithError:(NSError *)error;
+
+@end
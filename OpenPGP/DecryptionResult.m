@@ -0,0 +1,43 @@
+//
+//  DecryptionResult.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "DecryptionResult.h"
+
+@interface DecryptionResult ()
+
+- (instancetype)initWithDecryptedMessage:(NSString *)decryptedMessage
+                         verifiedUserIds:(NSArray *)verifiedUserIds
+                                   error:(NSError *)error;
+
+@end
+
+@implementation DecryptionResult
+
++ (DecryptionResult *)resultWithDecryptedMessage:(NSString *)decryptedMessage verifiedUserIds:(NSArray *)verifiedUserIds {
+    return [[self alloc] initWithDecryptedMessage:decryptedMessage verifiedUserIds:verifiedUserIds error:nil];
+}
+
++ (DecryptionResult *)resultWithError:(NSError *)error {
+    return [[self alloc] initWithDecryptedMessage:nil verifiedUserIds:nil error:error];
+}
+
+- (instancetype)initWithDecryptedMessage:(NSString *)decryptedMessage
+                         verifiedUserIds:(NSArray *)verifiedUserIds
+                                   error:(NSError *)error {
+    self = [super init];
+    
+    if (self != nil) {
+        _decryptedMessage = decryptedMessage;
+        _verifiedUserIds = verifiedUserIds;
+        _error = error;
+    }
+    
+    return self;
+}
+
+@end
@@ -0,0 +1,30 @@
+//
+//  EmailIndex.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/// Maps the email addresses in user IDs to keyring record indexes. Addresses are lowercased
+/// on the way in and queries are lowercased too, so every lookup is case insensitive.
+@interface EmailIndex : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+
++ (EmailIndex *)index;
+
+/// The address out of a user ID like "Name <address>" (or a bare address), lowercased, nil if there isn't one:
++ (NSString *)normalizedEmailFromUserId:(NSString *)userId;
+
+- (void)addUserId:(NSString *)userId recordIndex:(NSUInteger)recordIndex;
+
+/// Exact, prefix and domain queries are binary searches, substring queries scan the addresses:
+- (NSIndexSet *)recordIndexesForEmail:(NSString *)email;
+- (NSIndexSet *)recordIndexesWithEmailPrefix:(NSString *)prefix;
+- (NSIndexSet *)recordIndexesForDomain:(NSString *)domain;
+- (NSIndexSet *)recordIndexesWithEmailContaining:(NSString *)substring;
+
+@end
@@ -0,0 +1,260 @@
+//
+//  EmailIndex.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "EmailIndex.h"
+
+#define EmailIndexInitialEntryCount 64
+#define EmailIndexInitialBufferLength 2048
+
+typedef struct {
+    uint32_t offset;
+    uint32_t recordIndex;
+} EmailIndexEntry;
+
+/// Sorted entries point straight into the address buffer, so they're rebuilt whenever it changes:
+typedef struct {
+    const char *email;
+    uint32_t recordIndex;
+} EmailIndexSortedEntry;
+
+static int EmailIndexCompareSortedEntries(const void *a, const void *b) {
+    return strcmp(((const EmailIndexSortedEntry *) a)->email, ((const EmailIndexSortedEntry *) b)->email);
+}
+
+@interface EmailIndex () {
+    
+    // Each address NUL terminated, with its reversed copy at the same offset in the other buffer:
+    char *_emails, *_reversedEmails;
+    NSUInteger _emailsLength, _emailsCapacity;
+    
+    EmailIndexEntry *_entries;
+    NSUInteger _entryCapacity;
+    
+    EmailIndexSortedEntry *_sortedEntries, *_reversedSortedEntries;
+    BOOL _sorted;
+}
+
+- (void)sortIfNeeded;
+
+- (NSIndexSet *)recordIndexesInSortedEntries:(EmailIndexSortedEntry *)sortedEntries
+                                  withPrefix:(const char *)prefix
+                                       exact:(BOOL)exact;
+
+@end
+
+@implementation EmailIndex
+
++ (EmailIndex *)index {
+    return [[self alloc] init];
+}
+
+- (instancetype)init {
+    self = [super init];
+    
+    if (self != nil) {
+        _count = 0;
+        _entryCapacity = EmailIndexInitialEntryCount;
+        _entries = malloc(_entryCapacity * sizeof(EmailIndexEntry));
+        
+        _emailsLength = 0;
+        _emailsCapacity = EmailIndexInitialBufferLength;
+        _emails = malloc(_emailsCapacity);
+        _reversedEmails = malloc(_emailsCapacity);
+        
+        _sortedEntries = _reversedSortedEntries = NULL;
+        _sorted = YES;
+    }
+    
+    return self;
+}
+
+- (void)dealloc {
+    free(_entries);
+    free(_emails);
+    free(_reversedEmails);
+    free(_sortedEntries);
+    free(_reversedSortedEntries);
+}
+
++ (NSString *)normalizedEmailFromUserId:(NSString *)userId {
+    NSRange openRange = [userId rangeOfString:@"<" options:NSBackwardsSearch];
+    NSString *email = nil;
+    
+    if (openRange.location != NSNotFound) {
+        NSUInteger start = NSMaxRange(openRange);
+        NSRange closeRange = [userId rangeOfString:@">" options:0 range:NSMakeRange(start, userId.length - start)];
+        
+        if (closeRange.location == NSNotFound) {
+            return nil;
+        }
+        
+        email = [userId substringWithRange:NSMakeRange(start, closeRange.location - start)];
+    } else {
+        email = userId;
+    }
+    
+    email = [email stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    
+    if ([email rangeOfString:@"@"].location == NSNotFound ||
+        [email rangeOfCharacterFromSet:[NSCharacterSet whitespaceCharacterSet]].location != NSNotFound) {
+        
+        return nil;
+    }
+    
+    return email.lowercaseString;
+}
+
+- (void)addUserId:(NSString *)userId recordIndex:(NSUInteger)recordIndex {
+    NSString *email = [EmailIndex normalizedEmailFromUserId:userId];
+    
+    if (email == nil) {
+        return;
+    }
+    
+    const char *emailString = email.UTF8String;
+    NSUInteger length = strlen(emailString);
+    
+    if (_emailsLength + length + 1 > _emailsCapacity) {
+        while (_emailsLength + length + 1 > _emailsCapacity) {
+            _emailsCapacity *= 2;
+        }
+        
+        _emails = realloc(_emails, _emailsCapacity);
+        _reversedEmails = realloc(_reversedEmails, _emailsCapacity);
+    }
+    
+    if (_count == _entryCapacity) {
+        _entryCapacity *= 2;
+        _entries = realloc(_entries, _entryCapacity * sizeof(EmailIndexEntry));
+    }
+    
+    char *forward = _emails + _emailsLength;
+    char *reversed = _reversedEmails + _emailsLength;
+    
+    memcpy(forward, emailString, length + 1);
+    
+    for (NSUInteger i = 0; i < length; i++) {
+        reversed[i] = emailString[length - 1 - i];
+    }
+    
+    reversed[length] = '\0';
+    
+    _entries[_count].offset = (uint32_t) _emailsLength;
+    _entries[_count].recordIndex = (uint32_t) recordIndex;
+    
+    _count++;
+    _emailsLength += length + 1;
+    _sorted = NO;
+}
+
+- (NSIndexSet *)recordIndexesForEmail:(NSString *)email {
+    NSString *query = [email stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]].lowercaseString;
+    
+    [self sortIfNeeded];
+    
+    return [self recordIndexesInSortedEntries:_sortedEntries withPrefix:query.UTF8String exact:YES];
+}
+
+- (NSIndexSet *)recordIndexesWithEmailPrefix:(NSString *)prefix {
+    NSString *query = prefix.lowercaseString;
+    
+    [self sortIfNeeded];
+    
+    return [self recordIndexesInSortedEntries:_sortedEntries withPrefix:query.UTF8String exact:NO];
+}
+
+- (NSIndexSet *)recordIndexesForDomain:(NSString *)domain {
+    
+    // A domain is a prefix of the reversed addresses, "@" included so it can't match the end of another domain:
+    const char *query = [@"@" stringByAppendingString:domain.lowercaseString].UTF8String;
+    NSUInteger length = strlen(query);
+    
+    char reversedQuery[length + 1];
+    
+    for (NSUInteger i = 0; i < length; i++) {
+        reversedQuery[i] = query[length - 1 - i];
+    }
+    
+    reversedQuery[length] = '\0';
+    
+    [self sortIfNeeded];
+    
+    return [self recordIndexesInSortedEntries:_reversedSortedEntries withPrefix:reversedQuery exact:NO];
+}
+
+- (NSIndexSet *)recordIndexesWithEmailContaining:(NSString *)substring {
+    const char *query = substring.lowercaseString.UTF8String;
+    NSMutableIndexSet *recordIndexes = [NSMutableIndexSet indexSet];
+    
+    for (NSUInteger i = 0; i < _count; i++) {
+        if (strstr(_emails + _entries[i].offset, query) != NULL) {
+            [recordIndexes addIndex:_entries[i].recordIndex];
+        }
+    }
+    
+    return recordIndexes;
+}
+
+#pragma mark Private
+
+- (void)sortIfNeeded {
+    if (_sorted) {
+        return;
+    }
+    
+    _sortedEntries = realloc(_sortedEntries, _count * sizeof(EmailIndexSortedEntry));
+    _reversedSortedEntries = realloc(_reversedSortedEntries, _count * sizeof(EmailIndexSortedEntry));
+    
+    for (NSUInteger i = 0; i < _count; i++) {
+        _sortedEntries[i].email = _emails + _entries[i].offset;
+        _sortedEntries[i].recordIndex = _entries[i].recordIndex;
+        
+        _reversedSortedEntries[i].email = _reversedEmails + _entries[i].offset;
+        _reversedSortedEntries[i].recordIndex = _entries[i].recordIndex;
+    }
+    
+    qsort(_sortedEntries, _count, sizeof(EmailIndexSortedEntry), EmailIndexCompareSortedEntries);
+    qsort(_reversedSortedEntries, _count, sizeof(EmailIndexSortedEntry), EmailIndexCompareSortedEntries);
+    
+    _sorted = YES;
+}
+
+- (NSIndexSet *)recordIndexesInSortedEntries:(EmailIndexSortedEntry *)sortedEntries
+                                  withPrefix:(const char *)prefix
+                                       exact:(BOOL)exact {
+    
+    NSMutableIndexSet *recordIndexes = [NSMutableIndexSet indexSet];
+    NSUInteger prefixLength = strlen(prefix);
+    
+    // Everything starting with the prefix sorts together, from the first entry not less than it:
+    NSUInteger low = 0, high = _count;
+    
+    while (low < high) {
+        NSUInteger middle = low + (high - low) / 2;
+        
+        if (strcmp(sortedEntries[middle].email, prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    for (NSUInteger i = low; i < _count; i++) {
+        const char *email = sortedEntries[i].email;
+        
+        if (exact ? strcmp(email, prefix) != 0 : strncmp(email, prefix, prefixLength) != 0) {
+            break;
+        }
+        
+        [recordIndexes addIndex:sortedEntries[i].recordIndex];
+    }
+    
+    return recordIndexes;
+}
+
+@end
@@ -0,0 +1,28 @@
+//
+//  HashContext.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Crypto.h"
+
+/// Incremental hash over any of the OpenPGP hash algorithms, so data can be
+/// fed through in pieces instead of being collected into one buffer first.
+@interface HashContext : NSObject
+
+@property (nonatomic, readonly) HashAlgorithm algorithm;
+@property (nonatomic, readonly) NSUInteger digestLength;
+
+/// Returns nil if the algorithm isn't supported:
++ (HashContext *)contextWithAlgorithm:(HashAlgorithm)algorithm;
+
+- (void)updateWithBytes:(const void *)bytes length:(NSUInteger)length;
+- (void)updateWithData:(NSData *)data;
+
+/// Finishes the hash, the context can't be updated afterwards:
+- (NSData *)finalDigest;
+
+@end
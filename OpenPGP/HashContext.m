@@ -0,0 +1,99 @@
+//
+//  HashContext.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <openssl/evp.h>
+#import "HashContext.h"
+
+@interface HashContext () {
+    EVP_MD_CTX *_context;
+}
+
+- (instancetype)initWithAlgorithm:(HashAlgorithm)algorithm digest:(const EVP_MD *)digest;
+
+@end
+
+@implementation HashContext
+
++ (HashContext *)contextWithAlgorithm:(HashAlgorithm)algorithm {
+    const EVP_MD *digest = NULL;
+    
+    switch (algorithm) {
+        case HashAlgorithmMD5:
+            digest = EVP_md5();
+            break;
+            
+        case HashAlgorithmSHA1:
+            digest = EVP_sha1();
+            break;
+            
+        case HashAlgorithmRipeMD:
+            digest = EVP_ripemd160();
+            break;
+            
+        case HashAlgorithmSHA224:
+            digest = EVP_sha224();
+            break;
+            
+        case HashAlgorithmSHA256:
+            digest = EVP_sha256();
+            break;
+            
+        case HashAlgorithmSHA384:
+            digest = EVP_sha384();
+            break;
+            
+        case HashAlgorithmSHA512:
+            digest = EVP_sha512();
+            break;
+            
+        default:
+            return nil;
+    }
+    
+    return [[self alloc] initWithAlgorithm:algorithm digest:digest];
+}
+
+- (instancetype)initWithAlgorithm:(HashAlgorithm)algorithm digest:(const EVP_MD *)digest {
+    self = [super init];
+    
+    if (self != nil) {
+        _algorithm = algorithm;
+        _digestLength = EVP_MD_size(digest);
+        
+        _context = EVP_MD_CTX_create();
+        EVP_DigestInit_ex(_context, digest, NULL);
+    }
+    
+    return self;
+}
+
+- (void)dealloc {
+    EVP_MD_CTX_destroy(_context);
+    _context = NULL;
+}
+
+- (void)updateWithBytes:(const void *)bytes length:(NSUInteger)length {
+    if (length > 0) {
+        EVP_DigestUpdate(_context, bytes, length);
+    }
+}
+
+- (void)updateWithData:(NSData *)data {
+    [self updateWithBytes:data.bytes length:data.length];
+}
+
+- (NSData *)finalDigest {
+    Byte digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLength = 0;
+    
+    EVP_DigestFinal_ex(_context, digest, &digestLength);
+    
+    return [NSData dataWithBytes:digest length:digestLength];
+}
+
+@end
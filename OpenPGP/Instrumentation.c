@@ -0,0 +1,205 @@
+//
+//  Instrumentation.c
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#include <os/signpost.h>
+#endif
+#include "Instrumentation.h"
+
+const pgp_instrumentation *volatile pgp_instrumentation_active = NULL;
+
+static const char *pgp_stage_names[PGP_STAGE_COUNT] = {
+    "armor",
+    "packets",
+    "rsa-private",
+    "rsa-public",
+    "symmetric",
+    "text"
+};
+
+static const char *pgp_counter_names[PGP_COUNTER_COUNT] = {
+    "rsa-operations",
+    "key-lookups",
+    "session-key-cache-hits",
+    "unlock-cache-hits"
+};
+
+void pgp_instrumentation_set(const pgp_instrumentation *instrumentation) {
+    pgp_instrumentation *copy = NULL;
+    
+    if (instrumentation != NULL) {
+        copy = malloc(sizeof(pgp_instrumentation));
+        
+        if (copy == NULL) {
+            return;
+        }
+        
+        *copy = *instrumentation;
+    }
+    
+    // The copy is complete before any thread can see it. The one it replaces is never freed,
+    // a thread may have just loaded it:
+    __sync_synchronize();
+    pgp_instrumentation_active = copy;
+}
+
+const char *pgp_stage_name(pgp_stage stage) {
+    return stage < PGP_STAGE_COUNT ? pgp_stage_names[stage] : "unknown";
+}
+
+const char *pgp_counter_name(pgp_counter counter) {
+    return counter < PGP_COUNTER_COUNT ? pgp_counter_names[counter] : "unknown";
+}
+
+uint64_t pgp_instrumentation_now(void) {
+#if defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void pgp_instrumentation_begin(pgp_stage stage) {
+    const pgp_instrumentation *instrumentation = pgp_instrumentation_active;
+    
+    if (instrumentation != NULL && instrumentation->stage_begin != NULL) {
+        instrumentation->stage_begin(instrumentation->context, stage, pgp_instrumentation_now());
+    }
+}
+
+void pgp_instrumentation_end(pgp_stage stage, size_t bytes) {
+    const pgp_instrumentation *instrumentation = pgp_instrumentation_active;
+    
+    if (instrumentation != NULL && instrumentation->stage_end != NULL) {
+        instrumentation->stage_end(instrumentation->context, stage, pgp_instrumentation_now(), bytes);
+    }
+}
+
+void pgp_instrumentation_count(pgp_counter counter, uint64_t value) {
+    const pgp_instrumentation *instrumentation = pgp_instrumentation_active;
+    
+    if (instrumentation != NULL && instrumentation->count != NULL) {
+        instrumentation->count(instrumentation->context, counter, value);
+    }
+}
+
+// Tracing:
+
+static pthread_once_t tracing_once = PTHREAD_ONCE_INIT;
+
+#if defined(__APPLE__)
+
+static os_log_t tracing_log;
+
+static void tracing_setup(void) {
+    tracing_log = os_log_create("co.gradient.OpenPGP", "Stages");
+}
+
+// Stages nest on a thread but never repeat, so the thread and stage make the interval unique:
+static os_signpost_id_t tracing_signpost_id(pgp_stage stage) {
+    return os_signpost_id_make_with_pointer(tracing_log, (const void *) ((uintptr_t) pthread_self() + stage));
+}
+
+static void tracing_begin(void *context, pgp_stage stage, uint64_t timestamp) {
+    (void) context;
+    (void) timestamp;
+    
+    pthread_once(&tracing_once, tracing_setup);
+    
+    if (__builtin_available(macOS 10.14, iOS 12.0, *)) {
+        os_signpost_interval_begin(tracing_log, tracing_signpost_id(stage), "Stage", "%{public}s", pgp_stage_name(stage));
+    }
+}
+
+static void tracing_end(void *context, pgp_stage stage, uint64_t timestamp, size_t bytes) {
+    (void) context;
+    (void) timestamp;
+    
+    pthread_once(&tracing_once, tracing_setup);
+    
+    if (__builtin_available(macOS 10.14, iOS 12.0, *)) {
+        os_signpost_interval_end(tracing_log, tracing_signpost_id(stage), "Stage", "%{public}s %zu bytes", pgp_stage_name(stage), bytes);
+    }
+}
+
+#else
+
+static int tracing_fd = -1;
+
+static void tracing_setup(void) {
+    tracing_fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+    
+    if (tracing_fd < 0) {
+        tracing_fd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+    }
+}
+
+// Markers are best effort, one that was truncated or can't be written is dropped:
+static void tracing_write(const char *marker, size_t size, int length) {
+    if (length > 0 && (size_t) length < size) {
+        ssize_t written = write(tracing_fd, marker, (size_t) length);
+        (void) written;
+    }
+}
+
+// The B|pid|name and E|pid lines are the ones Perfetto and systrace turn back into intervals:
+static void tracing_begin(void *context, pgp_stage stage, uint64_t timestamp) {
+    (void) context;
+    (void) timestamp;
+    
+    pthread_once(&tracing_once, tracing_setup);
+    
+    if (tracing_fd >= 0) {
+        char marker[64];
+        tracing_write(marker, sizeof(marker), snprintf(marker, sizeof(marker), "B|%d|openpgp.%s\n", (int) getpid(), pgp_stage_name(stage)));
+    }
+}
+
+static void tracing_end(void *context, pgp_stage stage, uint64_t timestamp, size_t bytes) {
+    (void) context;
+    (void) stage;
+    (void) timestamp;
+    (void) bytes;
+    
+    pthread_once(&tracing_once, tracing_setup);
+    
+    if (tracing_fd >= 0) {
+        char marker[32];
+        tracing_write(marker, sizeof(marker), snprintf(marker, sizeof(marker), "E|%d\n", (int) getpid()));
+    }
+}
+
+#endif
+
+static const pgp_instrumentation tracing_instrumentation = {
+    tracing_begin,
+    tracing_end,
+    NULL,
+    NULL
+};
+
+const pgp_instrumentation *pgp_instrumentation_tracing(void) {
+    return &tracing_instrumentation;
+}
@@ -0,0 +1,107 @@
+//
+//  Instrumentation.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#ifndef OpenPGP_Instrumentation_h
+#define OpenPGP_Instrumentation_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stage timings and counters from inside the library, for telling which part of a slow
+// operation was slow. Nothing is reported until callbacks are set, and then each hook costs a
+// load and a branch that's predicted not taken. Building with PGP_INSTRUMENTATION=0 removes the
+// hooks altogether.
+
+#ifndef PGP_INSTRUMENTATION
+#define PGP_INSTRUMENTATION 1
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    PGP_STAGE_ARMOR = 0,
+    PGP_STAGE_PACKETS,
+    PGP_STAGE_RSA_PRIVATE,
+    PGP_STAGE_RSA_PUBLIC,
+    PGP_STAGE_SYMMETRIC,
+    PGP_STAGE_TEXT,
+    PGP_STAGE_COUNT
+} pgp_stage;
+
+typedef enum {
+    PGP_COUNTER_RSA_OPERATIONS = 0,
+    PGP_COUNTER_KEY_LOOKUPS,
+    PGP_COUNTER_SESSION_KEY_CACHE_HITS,
+    PGP_COUNTER_UNLOCK_CACHE_HITS,
+    PGP_COUNTER_COUNT
+} pgp_counter;
+
+/// Any callback can be NULL. They're called on whichever thread did the work, with timestamps
+/// in nanoseconds from a monotonic clock, and bytes is how much the stage read:
+typedef struct {
+    void (*stage_begin)(void *context, pgp_stage stage, uint64_t timestamp);
+    void (*stage_end)(void *context, pgp_stage stage, uint64_t timestamp, size_t bytes);
+    void (*count)(void *context, pgp_counter counter, uint64_t value);
+    void *context;
+} pgp_instrumentation;
+
+/// Copies the callbacks, NULL turns reporting off. Copies that are replaced are kept around for
+/// threads still inside a stage, so an end can arrive without its begin around a change:
+void pgp_instrumentation_set(const pgp_instrumentation *instrumentation);
+
+/// Intervals as os_signpost events on Apple platforms and as ftrace markers elsewhere, which
+/// perf and trace-cmd record alongside everything else. Counters aren't traced:
+const pgp_instrumentation *pgp_instrumentation_tracing(void);
+
+const char *pgp_stage_name(pgp_stage stage);
+const char *pgp_counter_name(pgp_counter counter);
+
+uint64_t pgp_instrumentation_now(void);
+
+// For the hooks below, not to be called directly:
+extern const pgp_instrumentation *volatile pgp_instrumentation_active;
+
+void pgp_instrumentation_begin(pgp_stage stage);
+void pgp_instrumentation_end(pgp_stage stage, size_t bytes);
+void pgp_instrumentation_count(pgp_counter counter, uint64_t value);
+
+#if PGP_INSTRUMENTATION
+
+#define PGP_STAGE_BEGIN(stage) do {                                         \
+    if (__builtin_expect(pgp_instrumentation_active != NULL, 0)) {          \
+        pgp_instrumentation_begin(stage);                                   \
+    }                                                                       \
+} while (0)
+
+#define PGP_STAGE_END(stage, bytes) do {                                    \
+    if (__builtin_expect(pgp_instrumentation_active != NULL, 0)) {          \
+        pgp_instrumentation_end(stage, bytes);                              \
+    }                                                                       \
+} while (0)
+
+#define PGP_COUNT(counter) do {                                             \
+    if (__builtin_expect(pgp_instrumentation_active != NULL, 0)) {          \
+        pgp_instrumentation_count(counter, 1);                              \
+    }                                                                       \
+} while (0)
+
+#else
+
+#define PGP_STAGE_BEGIN(stage) do { } while (0)
+#define PGP_STAGE_END(stage, bytes) do { } while (0)
+#define PGP_COUNT(counter) do { } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,7 +7,10 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "Crypto.h"
 #import "MPI.h"
+#import "StringToKey.h"
+#import "Utility.h"
 
 @interface Key : NSObject
 
@@ -21,23 +24,58 @@
 @interface PublicKey : Key
 
 @property (nonatomic, readonly) NSUInteger creationTime;
+@property (nonatomic, readonly) PublicKeyAlgorithm publicKeyAlgorithm;
 
-@property (nonatomic, readonly) NSString *fingerprint;
-@property (nonatomic, readonly) NSString *keyID;
+@property (nonatomic, readonly) Fingerprint fingerprint;
+@property (nonatomic, readonly) KeyID keyID;
 
+/// The public key packet body, as parsed or serialized once, and what the fingerprint and
+/// certifications hash:
+@property (nonatomic, readonly) NSData *packetBody;
+
+/// RSA:
 @property (nonatomic, readonly) MPI *n;
 @property (nonatomic, readonly) MPI *e;
 
+/// Elliptic curve, q is the encoded public point:
+@property (nonatomic, readonly) NSData *curveOID;
+@property (nonatomic, readonly) MPI *q;
+
+/// ECDH, the hash and key wrap algorithm for deriving the key encryption key:
+@property (nonatomic, readonly) HashAlgorithm kdfHashAlgorithm;
+@property (nonatomic, readonly) SymmetricAlgorithm kdfSymmetricAlgorithm;
+
 + (PublicKey *)keyWithCreationTime:(NSUInteger)creationTime
                                  n:(MPI *)n
                                  e:(MPI *)e;
 
++ (PublicKey *)keyWithCreationTime:(NSUInteger)creationTime
+                publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
+                          curveOID:(NSData *)curveOID
+                                 q:(MPI *)q;
+
++ (PublicKey *)keyWithCreationTime:(NSUInteger)creationTime
+                          curveOID:(NSData *)curveOID
+                                 q:(MPI *)q
+                  kdfHashAlgorithm:(HashAlgorithm)kdfHashAlgorithm
+             kdfSymmetricAlgorithm:(SymmetricAlgorithm)kdfSymmetricAlgorithm;
+
+/// For parsers to hand over the bytes the key was read from, before the key is shared:
+- (void)cachePacketBody:(NSData *)packetBody;
+
 @end
 
 @interface SecretKey : Key
 
 @property (nonatomic, readonly) PublicKey *publicKey;
 
+/// The secret key packet body, the public key's body followed by the secret material:
+@property (nonatomic, readonly) NSData *packetBody;
+
+/// Nil for unprotected keys, the secret MPIs are only there once a protected key is unlocked:
+@property (nonatomic, readonly) StringToKey *stringToKey;
+@property (nonatomic, readonly) BOOL isLocked;
+
 @property (nonatomic, readonly) MPI *d;
 @property (nonatomic, readonly) MPI *p;
 @property (nonatomic, readonly) MPI *q;
@@ -49,5 +87,24 @@
                               q:(MPI *)q
                               u:(MPI *)u;
 
+/// Elliptic curve keys only have the secret scalar (the seed for EdDSA, big endian for ECDH):
++ (SecretKey *)keyWithPublicKey:(PublicKey *)publicKey d:(MPI *)d;
+
+/// A passphrase protected key, locked until unlockWithPassphrase: decrypts the material:
++ (SecretKey *)keyWithPublicKey:(PublicKey *)publicKey
+                    stringToKey:(StringToKey *)stringToKey
+                  encryptedData:(NSData *)encryptedData;
+
+/// Returns NO for a wrong passphrase. Subkeys are unlocked separately:
+- (BOOL)unlockWithPassphrase:(NSString *)passphrase;
+
+/// Forgets the decrypted material of a protected key, unprotected keys can't be locked:
+- (void)lock;
+
+/// Set by Crypto to what it derives from the secret MPIs once and reuses, dropped on lock:
+@property (atomic, strong) id preparedKey;
+
+- (void)cachePacketBody:(NSData *)packetBody;
+
 @end
 
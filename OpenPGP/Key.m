@@ -8,6 +8,7 @@
 
 #import <openssl/sha.h>
 #import "Key.h"
+#import "OpenPGPCore.h"
 #import "Utility.h"
 
 @interface Key () {
@@ -44,12 +45,28 @@
                                    n:(MPI *)n
                                    e:(MPI *)e;
 
+- (instancetype)initWithCreationTime:(NSUInteger)creationTime
+                  publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
+                            curveOID:(NSData *)curveOID
+                                   q:(MPI *)q;
+
+- (instancetype)initWithCreationTime:(NSUInteger)creationTime
+                            curveOID:(NSData *)curveOID
+                                   q:(MPI *)q
+                    kdfHashAlgorithm:(HashAlgorithm)kdfHashAlgorithm
+               kdfSymmetricAlgorithm:(SymmetricAlgorithm)kdfSymmetricAlgorithm;
+
 @end
 
 @interface PublicKey () {
-    NSString *_fingerprint, *_keyID;
+    NSData *_packetBody;
+    Fingerprint _fingerprint;
+    KeyID _keyID;
+    BOOL _hasFingerprint;
 }
 
+- (NSData *)serializedPacketBody;
+
 @end
 
 @implementation PublicKey
@@ -65,8 +82,9 @@
     self = [self init];
     
     if (self != nil) {
-        _fingerprint = _keyID = nil;
+        _hasFingerprint = NO;
         _creationTime = creationTime;
+        _publicKeyAlgorithm = PublicKeyAlgorithmRSAEncryptSign;
         _n = n;
         _e = e;
     }
@@ -74,51 +92,160 @@
     return self;
 }
 
-- (NSString *)fingerprint {
-    if (_fingerprint == nil) {
-        NSMutableData *keyData = [NSMutableData data];
-        
-        Byte header[6];
-        header[0] = 4;
-        
-        [Utility writeNumber:self.creationTime bytes:header + 1 length:4];
-        header[5] = 0x01;
-        
-        [keyData appendBytes:header length:6];
-        [keyData appendData:self.n.data];
-        [keyData appendData:self.e.data];
-        
-        NSMutableData *fingerprintData = [NSMutableData data];
-        
-        Byte fingerprintHeader[3];
-        fingerprintHeader[0] = 0x99;
-        fingerprintHeader[1] = (keyData.length >> 8) & 0xFF;
-        fingerprintHeader[2] = keyData.length & 0xFF;
++ (PublicKey *)keyWithCreationTime:(NSUInteger)creationTime
+                publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
+                          curveOID:(NSData *)curveOID
+                                 q:(MPI *)q {
+    
+    return [[self alloc] initWithCreationTime:creationTime
+                           publicKeyAlgorithm:publicKeyAlgorithm
+                                     curveOID:curveOID
+                                            q:q];
+}
+
+- (instancetype)initWithCreationTime:(NSUInteger)creationTime
+                  publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
+                            curveOID:(NSData *)curveOID
+                                   q:(MPI *)q {
+    
+    self = [self init];
+    
+    if (self != nil) {
+        _hasFingerprint = NO;
+        _creationTime = creationTime;
+        _publicKeyAlgorithm = publicKeyAlgorithm;
+        _curveOID = curveOID;
+        _q = q;
+    }
+    
+    return self;
+}
+
++ (PublicKey *)keyWithCreationTime:(NSUInteger)creationTime
+                          curveOID:(NSData *)curveOID
+                                 q:(MPI *)q
+                  kdfHashAlgorithm:(HashAlgorithm)kdfHashAlgorithm
+             kdfSymmetricAlgorithm:(SymmetricAlgorithm)kdfSymmetricAlgorithm {
+    
+    return [[self alloc] initWithCreationTime:creationTime
+                                     curveOID:curveOID
+                                            q:q
+                             kdfHashAlgorithm:kdfHashAlgorithm
+                        kdfSymmetricAlgorithm:kdfSymmetricAlgorithm];
+}
+
+- (instancetype)initWithCreationTime:(NSUInteger)creationTime
+                            curveOID:(NSData *)curveOID
+                                   q:(MPI *)q
+                    kdfHashAlgorithm:(HashAlgorithm)kdfHashAlgorithm
+               kdfSymmetricAlgorithm:(SymmetricAlgorithm)kdfSymmetricAlgorithm {
+    
+    self = [self initWithCreationTime:creationTime
+                   publicKeyAlgorithm:PublicKeyAlgorithmECDH
+                             curveOID:curveOID
+                                    q:q];
+    
+    if (self != nil) {
+        _kdfHashAlgorithm = kdfHashAlgorithm;
+        _kdfSymmetricAlgorithm = kdfSymmetricAlgorithm;
+    }
+    
+    return self;
+}
+
+- (NSData *)packetBody {
+    @synchronized (self) {
+        if (_packetBody == nil) {
+            _packetBody = [self serializedPacketBody];
+        }
         
-        [fingerprintData appendBytes:fingerprintHeader length:3];
-        [fingerprintData appendData:keyData];
+        return _packetBody;
+    }
+}
+
+- (void)cachePacketBody:(NSData *)packetBody {
+    @synchronized (self) {
+        _packetBody = packetBody;
+        _hasFingerprint = NO;
+    }
+}
+
+- (NSData *)serializedPacketBody {
+    NSMutableData *data = [NSMutableData data];
+    
+    Byte header[6];
+    header[0] = 4;
+    
+    [Utility writeNumber:self.creationTime bytes:header + 1 length:4];
+    header[5] = self.publicKeyAlgorithm;
+    
+    [data appendBytes:header length:6];
+    
+    if (self.curveOID != nil) {
+        Byte oidLength = self.curveOID.length;
         
-        Byte fingerprintOutput[SHA_DIGEST_LENGTH];
-        SHA1(fingerprintData.bytes, fingerprintData.length, fingerprintOutput);
+        [data appendBytes:&oidLength length:1];
+        [data appendData:self.curveOID];
+        [data appendData:self.q.data];
         
-        _fingerprint = [Utility hexStringFromBytes:fingerprintOutput length:SHA_DIGEST_LENGTH];
+        if (self.publicKeyAlgorithm == PublicKeyAlgorithmECDH) {
+            Byte kdfParameters[4] = {0x03, 0x01, self.kdfHashAlgorithm, self.kdfSymmetricAlgorithm};
+            [data appendBytes:kdfParameters length:4];
+        }
+    } else {
+        [data appendData:self.n.data];
+        [data appendData:self.e.data];
     }
     
-    return _fingerprint;
+    return [NSData dataWithData:data];
 }
 
-- (NSString *)keyID {
-    if (_keyID == nil) {
-        NSString *fingerprint = self.fingerprint;
-        _keyID = [fingerprint substringWithRange:NSMakeRange(fingerprint.length - 16, 16)];
+- (Fingerprint)fingerprint {
+    @synchronized (self) {
+        if (!_hasFingerprint) {
+            NSData *packetBody = self.packetBody;
+            
+            Byte header[3];
+            header[0] = 0x99;
+            header[1] = (packetBody.length >> 8) & 0xFF;
+            header[2] = packetBody.length & 0xFF;
+            
+            memset(&_fingerprint, 0, sizeof(Fingerprint));
+            _fingerprint.length = SHA_DIGEST_LENGTH;
+            
+            SHA_CTX context;
+            SHA1_Init(&context);
+            SHA1_Update(&context, header, 3);
+            SHA1_Update(&context, packetBody.bytes, packetBody.length);
+            SHA1_Final(_fingerprint.bytes, &context);
+            
+            // v4 key IDs are the last 8 bytes of the fingerprint:
+            _keyID = [Utility readKeyID:_fingerprint.bytes + SHA_DIGEST_LENGTH - KeyIDLength];
+            _hasFingerprint = YES;
+        }
+        
+        return _fingerprint;
+    }
+}
+
+- (KeyID)keyID {
+    @synchronized (self) {
+        if (!_hasFingerprint) {
+            [self fingerprint];
+        }
+        
+        return _keyID;
     }
-    
-    return _keyID;
 }
 
 @end
 
-@interface SecretKey ()
+@interface SecretKey () {
+    NSData *_packetBody;
+    NSData *_encryptedData;
+}
+
+- (NSData *)serializedPacketBody;
 
 - (instancetype)initWithPublicKey:(PublicKey *)publicKey
                                 d:(MPI *)d
@@ -126,6 +253,9 @@
                                 q:(MPI *)q
                                 u:(MPI *)u;
 
+/// Returns NO if the material doesn't hold the MPIs the key needs:
+- (BOOL)readMaterial:(NSData *)material;
+
 @end
 
 @implementation SecretKey
@@ -143,6 +273,30 @@
                                          u:u];
 }
 
++ (SecretKey *)keyWithPublicKey:(PublicKey *)publicKey d:(MPI *)d {
+    return [[self alloc] initWithPublicKey:publicKey
+                                         d:d
+                                         p:nil
+                                         q:nil
+                                         u:nil];
+}
+
++ (SecretKey *)keyWithPublicKey:(PublicKey *)publicKey
+                    stringToKey:(StringToKey *)stringToKey
+                  encryptedData:(NSData *)encryptedData {
+    
+    SecretKey *secretKey = [[self alloc] initWithPublicKey:publicKey
+                                                         d:nil
+                                                         p:nil
+                                                         q:nil
+                                                         u:nil];
+    
+    secretKey->_stringToKey = stringToKey;
+    secretKey->_encryptedData = encryptedData;
+    
+    return secretKey;
+}
+
 - (instancetype)initWithPublicKey:(PublicKey *)publicKey
                                 d:(MPI *)d
                                 p:(MPI *)p
@@ -162,6 +316,120 @@
     return self;
 }
 
+- (BOOL)isLocked {
+    @synchronized (self) {
+        return _stringToKey != nil && _d == nil;
+    }
+}
+
+- (BOOL)unlockWithPassphrase:(NSString *)passphrase {
+    if (!self.isLocked) {
+        return YES;
+    }
+    
+    // Outside the lock, the string to key is slow on purpose:
+    NSData *material = [self.stringToKey decryptData:_encryptedData withPassphrase:passphrase];
+    
+    if (material == nil) {
+        return NO;
+    }
+    
+    return [self readMaterial:material];
+}
+
+- (void)lock {
+    @synchronized (self) {
+        if (_stringToKey != nil) {
+            _d = nil;
+            _p = nil;
+            _q = nil;
+            _u = nil;
+            self.preparedKey = nil;
+        }
+    }
+}
+
+- (NSData *)packetBody {
+    @synchronized (self) {
+        if (_packetBody == nil) {
+            _packetBody = [self serializedPacketBody];
+        }
+        
+        return _packetBody;
+    }
+}
+
+- (void)cachePacketBody:(NSData *)packetBody {
+    @synchronized (self) {
+        _packetBody = packetBody;
+    }
+}
 
+- (NSData *)serializedPacketBody {
+    NSMutableData *data = [NSMutableData dataWithData:self.publicKey.packetBody];
+    NSUInteger secretIndex = data.length;
+    
+    // Protected keys are written back still encrypted:
+    if (self.stringToKey != nil) {
+        [data appendData:self.stringToKey.data];
+        [data appendData:_encryptedData];
+        
+        return [NSData dataWithData:data];
+    }
+    
+    // Unencrypted, no string to key:
+    Byte stringToKey = 0;
+    [data appendBytes:&stringToKey length:1];
+    
+    [data appendData:self.d.data];
+    
+    if (self.publicKey.curveOID == nil) {
+        [data appendData:self.p.data];
+        [data appendData:self.q.data];
+        [data appendData:self.u.data];
+    }
+    
+    // Checksum of the secret material, the sum of its bytes mod 65536:
+    const Byte *bytes = data.bytes;
+    NSUInteger sum = 0;
+    
+    for (NSUInteger i = secretIndex; i < data.length; ++i) {
+        sum += bytes[i];
+    }
+    
+    Byte checksum[2];
+    checksum[0] = (sum >> 8) & 0xFF;
+    checksum[1] = sum & 0xFF;
+    
+    [data appendBytes:checksum length:2];
+    
+    return [NSData dataWithData:data];
+}
 
-@end
\ No newline at end of file
+- (BOOL)readMaterial:(NSData *)material {
+    NSUInteger mpiCount = self.publicKey.curveOID == nil ? 4 : 1;
+    NSMutableArray *mpis = [NSMutableArray arrayWithCapacity:mpiCount];
+    size_t currentIndex = 0;
+    
+    for (NSUInteger i = 0; i < mpiCount; i++) {
+        size_t length = 0;
+    
+        if (pgp_mpi_read(material.bytes, material.length, currentIndex, &length) != PGP_OK) {
+            return NO;
+        }
+    
+        [mpis addObject:[MPI mpiFromData:material atIndex:currentIndex]];
+        currentIndex += length;
+    }
+    
+    @synchronized (self) {
+        _d = mpis[0];
+        _p = mpiCount > 1 ? mpis[1] : nil;
+        _q = mpiCount > 1 ? mpis[2] : nil;
+        _u = mpiCount > 1 ? mpis[3] : nil;
+    }
+    
+    return YES;
+}
+
+@end
@@ -0,0 +1,23 @@
+//
+//  KeyImporter.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Keyring;
+
+@interface KeyImporter : NSObject
+
+/// Imports a JSON array of armored public keys, or armored public keys back to back. Each key is
+/// decoded, parsed and checked against its self-signature in parallel, then the batch is added
+/// to the keyring at once. Keys that fail are skipped, errors are keyed by position in the input.
+/// Returns the number of keys imported:
++ (NSUInteger)importPublicKeysFromData:(NSData *)data
+                           intoKeyring:(Keyring *)keyring
+                                errors:(NSDictionary **)errors;
+
+@end
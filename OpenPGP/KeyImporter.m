@@ -0,0 +1,406 @@
+//
+//  KeyImporter.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <string.h>
+#import "KeyImporter.h"
+#import "ASCIIArmor.h"
+#import "Key.h"
+#import "KeyPacket.h"
+#import "Keyring.h"
+#import "OpenPGP.h"
+#import "Packet.h"
+#import "SignatureContext.h"
+#import "SignaturePacket.h"
+#import "UserIDPacket.h"
+#import "Utility.h"
+
+#define KeyImporterArmorHeader "-----BEGIN PGP PUBLIC KEY BLOCK-----"
+#define KeyImporterArmorFooter "-----END PGP PUBLIC KEY BLOCK-----"
+
+/// Where one armored key sits in the input, JSON strings still have their escapes:
+typedef struct {
+    NSUInteger location;
+    NSUInteger length;
+    BOOL escaped;
+} ArmoredKeyRange;
+
+static int HexDigitValue(Byte c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    
+    return -1;
+}
+
+@interface KeyImporter ()
+
++ (ArmoredKeyRange *)rangesInData:(NSData *)data count:(NSUInteger *)count;
++ (NSData *)unescapedJSONStringWithBytes:(const Byte *)bytes length:(NSUInteger)length;
+
++ (PublicKey *)publicKeyFromArmoredData:(NSData *)armoredData error:(NSError **)error;
++ (BOOL)verifySelfSignaturePacket:(SignaturePacket *)signaturePacket primaryKey:(PublicKey *)primaryKey packet:(Packet *)packet;
+
+@end
+
+@implementation KeyImporter
+
++ (NSUInteger)importPublicKeysFromData:(NSData *)data
+                           intoKeyring:(Keyring *)keyring
+                                errors:(NSDictionary **)errors {
+    NSUInteger count = 0;
+    ArmoredKeyRange *ranges = [self rangesInData:data count:&count];
+    
+    // Each worker fills in only its own slot with a key or an error, the keyring isn't
+    // touched until they've all finished:
+    void **results = calloc(MAX(count, 1), sizeof(void *));
+    
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        @autoreleasepool {
+            const Byte *bytes = (const Byte *) data.bytes + ranges[i].location;
+            NSData *armoredData = nil;
+            
+            if (ranges[i].escaped) {
+                armoredData = [self unescapedJSONStringWithBytes:bytes length:ranges[i].length];
+            } else {
+                armoredData = [NSData dataWithBytesNoCopy:(void *) bytes length:ranges[i].length freeWhenDone:NO];
+            }
+            
+            NSError *error = nil;
+            PublicKey *publicKey = nil;
+            
+            if (armoredData == nil) {
+                error = [OpenPGP errorWithCause:@"OpenPGP importPublicKeysFromData: JSON string is malformed."];
+            } else {
+                publicKey = [self publicKeyFromArmoredData:armoredData error:&error];
+            }
+            
+            results[i] = (void *) CFBridgingRetain(publicKey != nil ? publicKey : error);
+        }
+    });
+    
+    NSMutableArray *publicKeys = [NSMutableArray arrayWithCapacity:count];
+    NSMutableDictionary *failures = [NSMutableDictionary dictionary];
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        id result = CFBridgingRelease(results[i]);
+        
+        if ([result isKindOfClass:[PublicKey class]]) {
+            [publicKeys addObject:result];
+        } else {
+            failures[@(i)] = result;
+        }
+    }
+    
+    free(results);
+    free(ranges);
+    
+    [keyring addPublicKeys:publicKeys];
+    
+    if (errors != NULL) {
+        *errors = [NSDictionary dictionaryWithDictionary:failures];
+    }
+    
+    return publicKeys.count;
+}
+
+#pragma mark Private
+
++ (ArmoredKeyRange *)rangesInData:(NSData *)data count:(NSUInteger *)count {
+    const Byte *bytes = data.bytes;
+    NSUInteger length = data.length;
+    
+    NSUInteger capacity = 64;
+    ArmoredKeyRange *ranges = malloc(capacity * sizeof(ArmoredKeyRange));
+    *count = 0;
+    
+    NSUInteger index = 0;
+    
+    while (index < length && (bytes[index] == ' ' || bytes[index] == '\t' || bytes[index] == '\r' || bytes[index] == '\n')) {
+        index++;
+    }
+    
+    BOOL json = index < length && bytes[index] == '[';
+    
+    while (index < length) {
+        ArmoredKeyRange range;
+        
+        if (json) {
+            
+            // Only the strings matter, everything between them is punctuation:
+            if (bytes[index] != '"') {
+                index++;
+                continue;
+            }
+            
+            NSUInteger start = ++index;
+            
+            while (index < length && bytes[index] != '"') {
+                index += bytes[index] == '\\' ? 2 : 1;
+            }
+            
+            range = (ArmoredKeyRange) {start, MIN(index, length) - start, YES};
+            index++;
+            
+        } else {
+            
+            const Byte *header = memmem(bytes + index, length - index, KeyImporterArmorHeader, strlen(KeyImporterArmorHeader));
+            
+            if (header == NULL) {
+                break;
+            }
+            
+            NSUInteger start = header - bytes;
+            const Byte *footer = memmem(header, length - start, KeyImporterArmorFooter, strlen(KeyImporterArmorFooter));
+            
+            // A key with no footer runs to the end of the input and fails to decode on its own:
+            index = footer != NULL ? (footer - bytes) + strlen(KeyImporterArmorFooter) : length;
+            range = (ArmoredKeyRange) {start, index - start, NO};
+            
+        }
+        
+        if (*count == capacity) {
+            capacity *= 2;
+            ranges = realloc(ranges, capacity * sizeof(ArmoredKeyRange));
+        }
+        
+        ranges[(*count)++] = range;
+    }
+    
+    return ranges;
+}
+
++ (NSData *)unescapedJSONStringWithBytes:(const Byte *)bytes length:(NSUInteger)length {
+    
+    // Escapes only ever shrink, so the output fits in the input length:
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    Byte *output = data.mutableBytes;
+    NSUInteger outputLength = 0;
+    
+    for (NSUInteger i = 0; i < length; i++) {
+        if (bytes[i] != '\\') {
+            output[outputLength++] = bytes[i];
+            continue;
+        }
+        
+        if (++i == length) {
+            return nil;
+        }
+        
+        switch (bytes[i]) {
+            case 'n':
+                output[outputLength++] = '\n';
+                break;
+            
+            case 'r':
+                output[outputLength++] = '\r';
+                break;
+            
+            case 't':
+                output[outputLength++] = '\t';
+                break;
+            
+            case 'b':
+                output[outputLength++] = '\b';
+                break;
+            
+            case 'f':
+                output[outputLength++] = '\f';
+                break;
+            
+            case '"':
+            case '\\':
+            case '/':
+                output[outputLength++] = bytes[i];
+                break;
+            
+            case 'u': {
+                if (i + 4 >= length) {
+                    return nil;
+                }
+                
+                NSUInteger c = 0;
+                
+                for (NSUInteger j = 1; j <= 4; j++) {
+                    int digit = HexDigitValue(bytes[i + j]);
+                    
+                    if (digit < 0) {
+                        return nil;
+                    }
+                    
+                    c = (c << 4) | digit;
+                }
+                
+                i += 4;
+                
+                // Armor is ASCII, anything else can only be in a header so surrogate pairs aren't joined:
+                if (c < 0x80) {
+                    output[outputLength++] = c;
+                } else if (c < 0x800) {
+                    output[outputLength++] = 0xC0 | (c >> 6);
+                    output[outputLength++] = 0x80 | (c & 0x3F);
+                } else {
+                    output[outputLength++] = 0xE0 | (c >> 12);
+                    output[outputLength++] = 0x80 | ((c >> 6) & 0x3F);
+                    output[outputLength++] = 0x80 | (c & 0x3F);
+                }
+                break;
+            }
+            
+            default:
+                return nil;
+        }
+    }
+    
+    data.length = outputLength;
+    
+    return data;
+}
+
++ (PublicKey *)publicKeyFromArmoredData:(NSData *)armoredData error:(NSError **)error {
+    NSString *text = [[NSString alloc] initWithData:armoredData encoding:NSUTF8StringEncoding];
+    ASCIIArmor *armor = text != nil ? [ASCIIArmor armorFromText:text] : nil;
+    
+    if (armor == nil || armor.type != ASCIIArmorTypePublicKey) {
+        *error = [OpenPGP errorWithCause:@"OpenPGP importPublicKeysFromData: Key is not an armored public key."];
+        return nil;
+    }
+        
+    PacketList *packetList = [PacketList packetListFromData:armor.content error:NULL];
+    
+    if (packetList == nil) {
+        *error = [OpenPGP errorWithCause:@"OpenPGP importPublicKeysFromData: Key packets are malformed or not supported."];
+        return nil;
+    }
+    
+    KeyPacket *keyPacket = nil;
+    NSString *userId = nil;
+    NSMutableArray *subkeys = [NSMutableArray array];
+    
+    // Signatures apply to the user ID or subkey packet before them:
+    Packet *signedPacket = nil;
+    
+    for (Packet *packet in packetList.packets) {
+        switch (packet.packetType) {
+            case PacketTypePublicKey:
+                if (keyPacket == nil) {
+                    keyPacket = (KeyPacket *) packet;
+                }
+                
+                signedPacket = nil;
+                break;
+            
+            case PacketTypeUserID:
+            case PacketTypePublicSubkey:
+                signedPacket = packet;
+                break;
+            
+            case PacketTypeSignature: {
+                SignaturePacket *signaturePacket = (SignaturePacket *) packet;
+                SignatureType signatureType = signaturePacket.signatureType;
+                
+                if (keyPacket == nil || signedPacket == nil) {
+                    break;
+                }
+                
+                if (signedPacket.packetType == PacketTypeUserID) {
+                    BOOL certification = signatureType >= SignatureTypeUserIDCertificationGeneric &&
+                                         signatureType <= SignatureTypeUserIDCertificationPositive;
+                    
+                    // The first user ID the key has certified itself is the one it goes by:
+                    if (userId == nil && certification &&
+                        [self verifySelfSignaturePacket:signaturePacket primaryKey:keyPacket.publicKey packet:signedPacket]) {
+                        userId = ((UserIDPacket *) signedPacket).userId;
+                    }
+                } else if (signatureType == SignatureTypeBindingSubkey &&
+                           [self verifySelfSignaturePacket:signaturePacket primaryKey:keyPacket.publicKey packet:signedPacket]) {
+                    [subkeys addObject:((KeyPacket *) signedPacket).publicKey];
+                    signedPacket = nil;
+                }
+                break;
+            }
+            
+            default:
+                break;
+        }
+    }
+    
+    if (keyPacket == nil) {
+        *error = [OpenPGP errorWithCause:@"OpenPGP importPublicKeysFromData: Armor has no public key packet."];
+        return nil;
+    }
+    
+    if (userId == nil) {
+        *error = [OpenPGP errorWithCause:@"OpenPGP importPublicKeysFromData: Key has no valid self-signature."];
+        return nil;
+    }
+    
+    PublicKey *publicKey = keyPacket.publicKey;
+    publicKey.userId = userId;
+    
+    // Subkeys without a valid binding signature are dropped:
+    for (PublicKey *subkey in subkeys) {
+        subkey.userId = userId;
+        [publicKey addSubkey:subkey];
+    }
+    
+    return publicKey;
+}
+
++ (BOOL)verifySelfSignaturePacket:(SignaturePacket *)signaturePacket primaryKey:(PublicKey *)primaryKey packet:(Packet *)packet {
+    
+    // Newer signatures can name their issuer by fingerprint only, leaving the key ID empty:
+    if (signaturePacket.keyId != 0 && signaturePacket.keyId != primaryKey.keyID) {
+        return NO;
+    }
+    
+    SignatureVerifier *verifier = [SignatureVerifier verifierWithSignaturePacket:signaturePacket];
+    
+    if (verifier == nil) {
+        return NO;
+    }
+    
+    NSData *keyBody = primaryKey.packetBody;
+    
+    Byte keyHeader[3];
+    
+    keyHeader[0] = 0x99;
+    [Utility writeNumber:keyBody.length bytes:keyHeader + 1 length:2];
+    
+    [verifier updateWithBytes:keyHeader length:3];
+    [verifier updateWithData:keyBody];
+    
+    if (packet.packetType == PacketTypeUserID) {
+        NSData *userIdBody = packet.body;
+        
+        Byte userIdHeader[5];
+        
+        userIdHeader[0] = 0xB4;
+        [Utility writeNumber:userIdBody.length bytes:userIdHeader + 1 length:4];
+        
+        [verifier updateWithBytes:userIdHeader length:5];
+        [verifier updateWithData:userIdBody];
+    } else {
+        NSData *subkeyBody = ((KeyPacket *) packet).publicKey.packetBody;
+        
+        Byte subkeyHeader[3];
+        
+        subkeyHeader[0] = 0x99;
+        [Utility writeNumber:subkeyBody.length bytes:subkeyHeader + 1 length:2];
+        
+        [verifier updateWithBytes:subkeyHeader length:3];
+        [verifier updateWithData:subkeyBody];
+    }
+    
+    return [verifier verifySignaturePacket:signaturePacket withPublicKey:primaryKey];
+}
+
+@end
@@ -31,4 +31,7 @@ typedef NS_ENUM(NSUInteger, KeyType) {
 + (KeyPacket *)packetWithPublicKey:(PublicKey *)publicKey;
 + (KeyPacket *)packetWithSecretKey:(SecretKey *)secretKey;
 
++ (KeyPacket *)packetWithPublicSubkey:(PublicKey *)publicKey;
++ (KeyPacket *)packetWithSecretSubkey:(SecretKey *)secretKey;
+
 @end
\ No newline at end of file
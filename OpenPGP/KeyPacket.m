@@ -39,55 +39,134 @@
     currentIndex += 4;
     
     PublicKeyAlgorithm publicKeyAlgorithm = bytes[currentIndex++];
-    
-    if (publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign) {
-        @throw [NSException exceptionWithName:NSInternalInconsistencyException
-                                       reason:@"Public key algorithm not supported."
-                                     userInfo:@{@"publicKeyAlgorithm": @(publicKeyAlgorithm)}];
+    PublicKey *publicKey = nil;
+    
+    switch (publicKeyAlgorithm) {
+        case PublicKeyAlgorithmRSAEncryptSign: {
+            MPI *n = [MPI mpiFromData:body atIndex:currentIndex];
+            currentIndex += n.length;
+            
+            MPI *e = [MPI mpiFromData:body atIndex:currentIndex];
+            currentIndex += e.length;
+            
+            publicKey = [PublicKey keyWithCreationTime:creationTime
+                                                     n:n
+                                                     e:e];
+            break;
+        }
+            
+        case PublicKeyAlgorithmEdDSA: {
+            NSUInteger oidLength = bytes[currentIndex++];
+            NSData *curveOID = [body subdataWithRange:NSMakeRange(currentIndex, oidLength)];
+            currentIndex += oidLength;
+            
+            if (![curveOID isEqualToData:[Crypto ed25519CurveOID]]) {
+                @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                               reason:@"Curve not supported."
+                                             userInfo:@{@"curveOID": curveOID}];
+            }
+            
+            MPI *q = [MPI mpiFromData:body atIndex:currentIndex];
+            currentIndex += q.length;
+            
+            publicKey = [PublicKey keyWithCreationTime:creationTime
+                                    publicKeyAlgorithm:publicKeyAlgorithm
+                                              curveOID:curveOID
+                                                     q:q];
+            break;
+        }
+            
+        case PublicKeyAlgorithmECDH: {
+            NSUInteger oidLength = bytes[currentIndex++];
+            NSData *curveOID = [body subdataWithRange:NSMakeRange(currentIndex, oidLength)];
+            currentIndex += oidLength;
+            
+            if (![curveOID isEqualToData:[Crypto curve25519CurveOID]]) {
+                @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                               reason:@"Curve not supported."
+                                             userInfo:@{@"curveOID": curveOID}];
+            }
+            
+            MPI *q = [MPI mpiFromData:body atIndex:currentIndex];
+            currentIndex += q.length;
+            
+            // KDF parameters, the length (always 3), a reserved 1, then the hash and wrap algorithms:
+            NSUInteger kdfLength = bytes[currentIndex++];
+            
+            if (kdfLength != 3 || bytes[currentIndex] != 0x01) {
+                @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                               reason:@"KDF parameters not supported."
+                                             userInfo:@{@"kdfLength": @(kdfLength)}];
+            }
+            
+            HashAlgorithm kdfHashAlgorithm = bytes[currentIndex + 1];
+            SymmetricAlgorithm kdfSymmetricAlgorithm = bytes[currentIndex + 2];
+            currentIndex += kdfLength;
+            
+            publicKey = [PublicKey keyWithCreationTime:creationTime
+                                              curveOID:curveOID
+                                                     q:q
+                                      kdfHashAlgorithm:kdfHashAlgorithm
+                                 kdfSymmetricAlgorithm:kdfSymmetricAlgorithm];
+            break;
+        }
+            
+        default:
+            @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                           reason:@"Public key algorithm not supported."
+                                         userInfo:@{@"publicKeyAlgorithm": @(publicKeyAlgorithm)}];
     }
     
-    MPI *n = [MPI mpiFromBytes:bytes + currentIndex];
-    currentIndex += n.length;
-    
-    MPI *e = [MPI mpiFromBytes:bytes + currentIndex];
-    currentIndex += e.length;
-    
-    PublicKey *publicKey = [PublicKey keyWithCreationTime:creationTime
-                                                        n:n
-                                                        e:e];
-    
     // If we're at the end of the packet then we have just a public key:
     if (currentIndex == body.length) {
+        [publicKey cachePacketBody:body];
         return [[self alloc] initWithPublicKey:publicKey];
     }
     
-    // Finish secret key:
+    [publicKey cachePacketBody:[body subdataWithRange:NSMakeRange(0, currentIndex)]];
     
-    NSUInteger stringToKey = bytes[currentIndex++];
+    // Finish secret key:
     
-    if (stringToKey != 0) {
-        @throw [NSException exceptionWithName:NSInternalInconsistencyException
-                                       reason:@"String to key convention not supported."
-                                     userInfo:@{@"stringToKey": @(stringToKey)}];
+    // Passphrase protected, the material stays encrypted until the key is unlocked:
+    if (bytes[currentIndex] != StringToKeyUsageNone) {
+        StringToKey *stringToKey = [StringToKey stringToKeyFromData:body atIndex:currentIndex];
+        currentIndex += stringToKey.data.length;
+        
+        SecretKey *secretKey = [SecretKey keyWithPublicKey:publicKey
+                                               stringToKey:stringToKey
+                                             encryptedData:[body subdataWithRange:NSMakeRange(currentIndex, body.length - currentIndex)]];
+        
+        [secretKey cachePacketBody:body];
+        
+        return [[self alloc] initWithSecretKey:secretKey];
     }
     
+    currentIndex++;
     
-    MPI *d = [MPI mpiFromBytes:bytes + currentIndex];
+    MPI *d = [MPI mpiFromData:body atIndex:currentIndex];
     currentIndex += d.length;
     
-    MPI *p = [MPI mpiFromBytes:bytes + currentIndex];
-    currentIndex += p.length;
-    
-    MPI *q = [MPI mpiFromBytes:bytes + currentIndex];
-    currentIndex += q.length;
+    SecretKey *secretKey = nil;
     
-    MPI *u = [MPI mpiFromBytes:bytes + currentIndex];
+    if (publicKeyAlgorithm == PublicKeyAlgorithmEdDSA || publicKeyAlgorithm == PublicKeyAlgorithmECDH) {
+        secretKey = [SecretKey keyWithPublicKey:publicKey d:d];
+    } else {
+        MPI *p = [MPI mpiFromData:body atIndex:currentIndex];
+        currentIndex += p.length;
+        
+        MPI *q = [MPI mpiFromData:body atIndex:currentIndex];
+        currentIndex += q.length;
+        
+        MPI *u = [MPI mpiFromData:body atIndex:currentIndex];
+        
+        secretKey = [SecretKey keyWithPublicKey:publicKey
+                                              d:d
+                                              p:p
+                                              q:q
+                                              u:u];
+    }
     
-    SecretKey *secretKey = [SecretKey keyWithPublicKey:publicKey
-                                                     d:d
-                                                     p:p
-                                                     q:q
-                                                     u:u];
+    [secretKey cachePacketBody:body];
     
     return [[self alloc] initWithSecretKey:secretKey];
 }
@@ -101,6 +180,14 @@
     return [[self alloc] initWithSecretKey:secretKey];
 }
 
++ (KeyPacket *)packetWithPublicSubkey:(PublicKey *)publicKey {
+    return [[self alloc] initWithPublicKey:publicKey secretKey:nil type:PacketTypePublicSubkey];
+}
+
++ (KeyPacket *)packetWithSecretSubkey:(SecretKey *)secretKey {
+    return [[self alloc] initWithPublicKey:nil secretKey:secretKey type:PacketTypeSecretSubkey];
+}
+
 - (instancetype)initWithPublicKey:(PublicKey *)publicKey {
     return [self initWithPublicKey:publicKey secretKey:nil type:PacketTypePublicKey];
 }
@@ -136,62 +223,7 @@
 }
 
 - (NSData *)body {
-    NSMutableData *data = [NSMutableData data];
-    
-    if (_publicKey) {
-        
-        [KeyPacket writeData:data withPublicKey:_publicKey];
-        
-    } else if (_secretKey) {
-        
-        [KeyPacket writeData:data withPublicKey:_secretKey.publicKey];
-        [KeyPacket writeData:data withSecretKey:_secretKey];
-        
-    }
-    
-    return [NSData dataWithData:data];
-}
-
-+ (void)writeData:(NSMutableData *)data withPublicKey:(PublicKey *)publicKey {
-    Byte header[6];
-    header[0] = 4;
-    
-    [Utility writeNumber:publicKey.creationTime bytes:header + 1 length:4];
-    
-    header[5] = PublicKeyAlgorithmRSAEncryptSign;
-    
-    [data appendBytes:header length:6];
-    [data appendData:publicKey.n.data];
-    [data appendData:publicKey.e.data];
-}
-
-+ (void)writeData:(NSMutableData *)data withSecretKey:(SecretKey *)secretKey {
-    NSMutableData *keyData = [NSMutableData data];
-    
-    Byte header[1];
-    header[0] = 0;
-    
-    [keyData appendBytes:header length:1];
-    
-    [keyData appendData:secretKey.d.data];
-    [keyData appendData:secretKey.p.data];
-    [keyData appendData:secretKey.q.data];
-    [keyData appendData:secretKey.u.data];
-    
-    NSUInteger sum = 0;
-    const Byte *bytes = keyData.bytes;
-    
-    for (NSUInteger i = 0; i < keyData.length; ++i) {
-        sum += bytes[i];
-        sum %= 65536;
-    }
-    
-    Byte checksum[2];
-    checksum[0] = (sum >> 8) & 0xFF;
-    checksum[1] = sum & 0xff;
-    
-    [keyData appendBytes:checksum length:2];
-    [data appendData:keyData];
+    return _publicKey ? _publicKey.packetBody : _secretKey.packetBody;
 }
 
 @end
@@ -0,0 +1,29 @@
+//
+//  KeyUnlockCache.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SecretKey;
+
+/// Secret keys unlocked with their passphrase, so later operations on the same locked key reuse
+/// the decrypted material instead of running the string to key again. Keys stay until their
+/// timeout passes or they're locked, dropping a key leaves copies already handed out intact.
+@interface KeyUnlockCache : NSObject
+
++ (KeyUnlockCache *)sharedCache;
+
+/// The key and its subkeys should already be unlocked. A timeout of 0 keeps it until it's locked:
+- (void)addSecretKey:(SecretKey *)secretKey timeout:(NSTimeInterval)timeout;
+
+/// The unlocked key read from the same packet as this locked one, nil if there isn't one:
+- (SecretKey *)unlockedKeyForSecretKey:(SecretKey *)secretKey;
+
+- (void)lockSecretKey:(SecretKey *)secretKey;
+- (void)lockAllSecretKeys;
+
+@end
@@ -0,0 +1,117 @@
+//
+//  KeyUnlockCache.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "KeyUnlockCache.h"
+#import "Instrumentation.h"
+#import "Key.h"
+
+@interface KeyUnlockCache () {
+    NSMutableDictionary *_secretKeys;
+    NSMutableDictionary *_deadlines;
+}
+
+- (void)removeExpiredKeys;
+
+@end
+
+@implementation KeyUnlockCache
+
++ (KeyUnlockCache *)sharedCache {
+    static KeyUnlockCache *sharedCache = nil;
+    static dispatch_once_t onceToken;
+    
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[self alloc] init];
+    });
+    
+    return sharedCache;
+}
+
+- (instancetype)init {
+    self = [super init];
+    
+    if (self != nil) {
+        _secretKeys = [NSMutableDictionary dictionary];
+        _deadlines = [NSMutableDictionary dictionary];
+    }
+    
+    return self;
+}
+
+- (void)addSecretKey:(SecretKey *)secretKey timeout:(NSTimeInterval)timeout {
+    NSNumber *keyId = @(secretKey.publicKey.keyID);
+    
+    @synchronized (self) {
+        _secretKeys[keyId] = secretKey;
+        
+        if (timeout > 0) {
+            _deadlines[keyId] = [NSDate dateWithTimeIntervalSinceNow:timeout];
+        } else {
+            [_deadlines removeObjectForKey:keyId];
+        }
+    }
+    
+    // Don't leave the material around until the next lookup happens to notice it expired:
+    if (timeout > 0) {
+        __weak KeyUnlockCache *weakSelf = self;
+        
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (timeout * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [weakSelf removeExpiredKeys];
+        });
+    }
+}
+
+- (SecretKey *)unlockedKeyForSecretKey:(SecretKey *)secretKey {
+    NSNumber *keyId = @(secretKey.publicKey.keyID);
+    
+    @synchronized (self) {
+        [self removeExpiredKeys];
+        
+        SecretKey *unlockedKey = _secretKeys[keyId];
+        
+        // Same key ID isn't enough, it has to be the same packet:
+        if (unlockedKey == nil || ![unlockedKey.packetBody isEqualToData:secretKey.packetBody]) {
+            return nil;
+        }
+        
+        PGP_COUNT(PGP_COUNTER_UNLOCK_CACHE_HITS);
+        
+        return unlockedKey;
+    }
+}
+
+- (void)lockSecretKey:(SecretKey *)secretKey {
+    NSNumber *keyId = @(secretKey.publicKey.keyID);
+    
+    @synchronized (self) {
+        [_secretKeys removeObjectForKey:keyId];
+        [_deadlines removeObjectForKey:keyId];
+    }
+}
+
+- (void)lockAllSecretKeys {
+    @synchronized (self) {
+        [_secretKeys removeAllObjects];
+        [_deadlines removeAllObjects];
+    }
+}
+
+#pragma mark Private
+
+- (void)removeExpiredKeys {
+    @synchronized (self) {
+        for (NSNumber *keyId in _deadlines.allKeys) {
+            if ([_deadlines[keyId] timeIntervalSinceNow] <= 0) {
+                [_secretKeys removeObjectForKey:keyId];
+                [_deadlines removeObjectForKey:keyId];
+            }
+        }
+    }
+}
+
+@end
@@ -0,0 +1,37 @@
+//
+//  KeypairPool.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Keypair;
+
+/// RSA keys generated ahead of time on a background priority thread, so taking one only costs
+/// building the key objects. Keys get their creation time when they're taken, not when they
+/// were generated, and every take tops the pool back up to its depth.
+@interface KeypairPool : NSObject
+
+@property (nonatomic, readonly) int bits;
+@property (nonatomic, readonly) NSUInteger depth;
+
+/// Keys ready to be taken:
+@property (nonatomic, readonly) NSUInteger count;
+
+/// Takes served from the pool and takes that had to generate on the spot:
+@property (nonatomic, readonly) NSUInteger hits;
+@property (nonatomic, readonly) NSUInteger misses;
+
+/// Keys generated in the background, and how many per second while refilling:
+@property (nonatomic, readonly) NSUInteger generated;
+@property (nonatomic, readonly) double refillRate;
+
+/// Starts filling right away:
++ (KeypairPool *)poolWithBits:(int)bits depth:(NSUInteger)depth;
+
+- (Keypair *)takeKeypair;
+
+@end
@@ -0,0 +1,133 @@
+//
+//  KeypairPool.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "KeypairPool.h"
+#import "Crypto.h"
+#import "Key.h"
+#import "Keypair.h"
+
+@interface KeypairPool () {
+    NSMutableArray *_keypairs;
+    NSTimeInterval _generationTime;
+    BOOL _refilling;
+}
+
+- (instancetype)initWithBits:(int)bits depth:(NSUInteger)depth;
+
+- (void)refill;
+
+@end
+
+@implementation KeypairPool
+
++ (KeypairPool *)poolWithBits:(int)bits depth:(NSUInteger)depth {
+    return [[self alloc] initWithBits:bits depth:depth];
+}
+
+- (instancetype)initWithBits:(int)bits depth:(NSUInteger)depth {
+    self = [super init];
+    
+    if (self != nil) {
+        _bits = bits;
+        _depth = depth;
+        _keypairs = [NSMutableArray arrayWithCapacity:depth];
+        
+        [self refill];
+    }
+    
+    return self;
+}
+
+- (NSUInteger)count {
+    @synchronized (self) {
+        return _keypairs.count;
+    }
+}
+
+- (double)refillRate {
+    @synchronized (self) {
+        return _generationTime > 0 ? _generated / _generationTime : 0;
+    }
+}
+
+- (Keypair *)takeKeypair {
+    Keypair *pooled = nil;
+    
+    @synchronized (self) {
+        pooled = _keypairs.lastObject;
+        
+        if (pooled != nil) {
+            [_keypairs removeLastObject];
+            _hits++;
+        } else {
+            _misses++;
+        }
+    }
+    
+    [self refill];
+    
+    if (pooled == nil) {
+        return [Crypto generateKeypairWithBits:self.bits];
+    }
+    
+    // The creation time is part of the fingerprint, so the keys are built again for now:
+    NSUInteger timestamp = [[NSDate date] timeIntervalSince1970];
+    
+    PublicKey *publicKey = [PublicKey keyWithCreationTime:timestamp
+                                                        n:pooled.publicKey.n
+                                                        e:pooled.publicKey.e];
+    
+    SecretKey *secretKey = [SecretKey keyWithPublicKey:publicKey
+                                                     d:pooled.secretKey.d
+                                                     p:pooled.secretKey.p
+                                                     q:pooled.secretKey.q
+                                                     u:pooled.secretKey.u];
+    
+    return [Keypair keypairWithPublicKey:publicKey secretKey:secretKey];
+}
+
+#pragma mark Private
+
+- (void)refill {
+    @synchronized (self) {
+        if (_refilling || _keypairs.count >= _depth) {
+            return;
+        }
+        
+        _refilling = YES;
+    }
+    
+    __weak KeypairPool *weakSelf = self;
+    
+    // One key at a time, the prime search already takes two threads:
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        while (YES) {
+            KeypairPool *pool = weakSelf;
+            
+            if (pool == nil) {
+                return;
+            }
+            
+            NSDate *start = [NSDate date];
+            Keypair *keypair = [Crypto generateKeypairWithBits:pool.bits];
+            
+            @synchronized (pool) {
+                pool->_generationTime -= [start timeIntervalSinceNow];
+                pool->_generated++;
+                [pool->_keypairs addObject:keypair];
+                
+                if (pool->_keypairs.count >= pool->_depth) {
+                    pool->_refilling = NO;
+                    return;
+                }
+            }
+        }
+    });
+}
+
+@end
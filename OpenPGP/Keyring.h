@@ -11,18 +11,35 @@
 
 @interface Keyring : NSObject
 
+/// Primary keys and subkeys together, in the order they were added:
 @property (nonatomic, readonly) NSArray *publicKeys;
 @property (nonatomic, readonly) NSArray *secretKeys;
 
+/// Number of distinct key IDs, primary keys and subkeys:
+@property (nonatomic, readonly) NSUInteger count;
+
 + (Keyring *)keyring;
 
 - (void)addPublicKey:(PublicKey *)publicKey forUserId:(NSString *)userId;
 - (void)addSecretKey:(SecretKey *)secretKey forUserId:(NSString *)userId;
 
+/// Adds each key under its own user ID, sizing the table once for the whole batch:
+- (void)addPublicKeys:(NSArray *)publicKeys;
+
 - (NSArray *)publicKeysForUserId:(NSString *)userId;
-- (PublicKey *)publicKeyForKeyId:(NSString *)keyId;
+- (PublicKey *)publicKeyForKeyId:(KeyID)keyId;
+
+/// Matches against the email address in each user ID, ignoring case:
+- (NSArray *)publicKeysForEmail:(NSString *)email;
+- (NSArray *)publicKeysWithEmailPrefix:(NSString *)prefix;
+- (NSArray *)publicKeysForEmailDomain:(NSString *)domain;
+- (NSArray *)publicKeysWithEmailContaining:(NSString *)substring;
 
 - (NSArray *)secretKeysForUserId:(NSString *)userId;
-- (SecretKey *)secretKeyForKeyId:(NSString *)keyId;
+- (SecretKey *)secretKeyForKeyId:(KeyID)keyId;
+
+/// Walks the keys in the order they were added without building an array:
+- (void)enumeratePublicKeysUsingBlock:(void (^)(PublicKey *publicKey, BOOL *stop))block;
+- (void)enumerateSecretKeysUsingBlock:(void (^)(SecretKey *secretKey, BOOL *stop))block;
 
 @end
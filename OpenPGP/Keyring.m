@@ -6,18 +6,45 @@
 //  Copyright (c) 2015 Gradient. All rights reserved.
 //
 
+#import "EmailIndex.h"
 #import "Keyring.h"
+#import "Instrumentation.h"
+
+#define KeyringInitialSlotCount 64
+#define KeyringEmptySlot UINT32_MAX
+
+/// One record per key ID, the keys are retained through the bridged pointers:
+typedef struct {
+    KeyID keyID;
+    void *publicKey;
+    void *secretKey;
+} KeyringRecord;
 
 @interface Keyring () {
-    NSMutableDictionary *_publicKeysByUserId, *_publicKeysByKeyId;
-    NSMutableDictionary *_secretKeysByUserId, *_secretKeysByKeyId;
-    NSMutableDictionary *_publicSubkeysByKeyId, *_publicSubkeysByUserId;
-    NSMutableDictionary *_secretSubkeysByKeyId, *_secretSubkeysByUserId;
+    KeyringRecord *_records;
+    NSUInteger _recordCapacity;
+    
+    // Open addressing with linear probing, each slot holds a record index:
+    uint32_t *_slots;
+    NSUInteger _slotMask;
+    int _slotShift;
+    
+    NSMutableDictionary *_recordIndexesByUserId;
+    EmailIndex *_emailIndex;
+    
+    NSArray *_publicKeys, *_secretKeys;
 }
 
+- (NSUInteger)recordIndexForKeyId:(KeyID)keyId insert:(BOOL)insert;
+- (void)growSlots;
+- (void)resizeSlotsToCount:(NSUInteger)slotCount;
+
 - (void)addPublicSubkey:(PublicKey *)publicSubkey forUserId:(NSString *)userId;
 - (void)addSecretSubkey:(SecretKey *)secretSubkey forUserId:(NSString *)userId;
 
+- (void)addRecordIndex:(NSUInteger)index forUserId:(NSString *)userId;
+- (NSArray *)publicKeysForRecordIndexes:(NSIndexSet *)recordIndexes;
+
 @end
 
 @implementation Keyring
@@ -30,37 +57,77 @@
     self = [super init];
     
     if (self != nil) {
-        _publicKeysByUserId = [NSMutableDictionary dictionary];
-        _publicKeysByKeyId = [NSMutableDictionary dictionary];
+        _count = 0;
+        _recordCapacity = KeyringInitialSlotCount / 2;
+        _records = calloc(_recordCapacity, sizeof(KeyringRecord));
         
-        _secretKeysByUserId = [NSMutableDictionary dictionary];
-        _secretKeysByKeyId = [NSMutableDictionary dictionary];
+        _slotMask = KeyringInitialSlotCount - 1;
+        _slotShift = 64 - 6;
+        _slots = malloc(KeyringInitialSlotCount * sizeof(uint32_t));
+        memset(_slots, 0xFF, KeyringInitialSlotCount * sizeof(uint32_t));
         
-        _publicSubkeysByKeyId = [NSMutableDictionary dictionary];
-        _publicSubkeysByUserId = [NSMutableDictionary dictionary];
-        
-        _secretSubkeysByKeyId = [NSMutableDictionary dictionary];
-        _secretSubkeysByUserId = [NSMutableDictionary dictionary];
+        _recordIndexesByUserId = [NSMutableDictionary dictionary];
+        _emailIndex = [EmailIndex index];
     }
     
     return self;
 }
 
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _count; i++) {
+        if (_records[i].publicKey != NULL) {
+            CFRelease(_records[i].publicKey);
+        }
+        
+        if (_records[i].secretKey != NULL) {
+            CFRelease(_records[i].secretKey);
+        }
+    }
+    
+    free(_records);
+    free(_slots);
+}
+
 - (NSArray *)publicKeys {
-    return [[_publicKeysByKeyId allValues] arrayByAddingObjectsFromArray:[_publicSubkeysByKeyId allValues]];
+    if (_publicKeys == nil) {
+        NSMutableArray *publicKeys = [NSMutableArray arrayWithCapacity:_count];
+        
+        [self enumeratePublicKeysUsingBlock:^(PublicKey *publicKey, BOOL *stop) {
+            [publicKeys addObject:publicKey];
+        }];
+        
+        _publicKeys = [NSArray arrayWithArray:publicKeys];
+    }
+    
+    return _publicKeys;
 }
 
 - (NSArray *)secretKeys {
-    return [[_secretKeysByKeyId allValues] arrayByAddingObjectsFromArray:[_secretSubkeysByKeyId allValues]];
+    if (_secretKeys == nil) {
+        NSMutableArray *secretKeys = [NSMutableArray array];
+        
+        [self enumerateSecretKeysUsingBlock:^(SecretKey *secretKey, BOOL *stop) {
+            [secretKeys addObject:secretKey];
+        }];
+        
+        _secretKeys = [NSArray arrayWithArray:secretKeys];
+    }
+    
+    return _secretKeys;
 }
 
 - (void)addPublicKey:(PublicKey *)publicKey forUserId:(NSString *)userId {
-    if (_publicKeysByUserId[userId] == nil) {
-        _publicKeysByUserId[userId] = [NSMutableArray array];
+    NSUInteger index = [self recordIndexForKeyId:publicKey.keyID insert:YES];
+    KeyringRecord *record = &_records[index];
+    
+    if (record->publicKey != NULL) {
+        CFRelease(record->publicKey);
     }
     
-    [_publicKeysByUserId[userId] addObject:publicKey];
-    _publicKeysByKeyId[publicKey.keyID] = publicKey;
+    record->publicKey = (void *) CFBridgingRetain(publicKey);
+    _publicKeys = nil;
+    
+    [self addRecordIndex:index forUserId:userId];
     
     for (PublicKey *subkey in publicKey.subkeys) {
         [self addPublicSubkey:subkey forUserId:userId];
@@ -68,12 +135,15 @@
 }
 
 - (void)addSecretKey:(SecretKey *)secretKey forUserId:(NSString *)userId {
-    if (_secretKeysByUserId[userId] == nil) {
-        _secretKeysByUserId[userId] = [NSMutableArray array];
+    NSUInteger index = [self recordIndexForKeyId:secretKey.publicKey.keyID insert:YES];
+    KeyringRecord *record = &_records[index];
+    
+    if (record->secretKey != NULL) {
+        CFRelease(record->secretKey);
     }
     
-    [_secretKeysByUserId[userId] addObject:secretKey];
-    _secretKeysByKeyId[secretKey.publicKey.keyID] = secretKey;
+    record->secretKey = (void *) CFBridgingRetain(secretKey);
+    _secretKeys = nil;
     
     for (SecretKey *subkey in secretKey.subkeys) {
         [self addSecretSubkey:subkey forUserId:userId];
@@ -82,59 +152,232 @@
     [self addPublicKey:secretKey.publicKey forUserId:userId];
 }
 
+- (void)addPublicKeys:(NSArray *)publicKeys {
+    NSUInteger count = _count;
+    
+    for (PublicKey *publicKey in publicKeys) {
+        count += 1 + publicKey.subkeys.count;
+    }
+    
+    if (count > _recordCapacity) {
+        _recordCapacity = count;
+        _records = realloc(_records, _recordCapacity * sizeof(KeyringRecord));
+    }
+    
+    NSUInteger slotCount = _slotMask + 1;
+    
+    while (count * 2 > slotCount) {
+        slotCount *= 2;
+    }
+    
+    if (slotCount != _slotMask + 1) {
+        [self resizeSlotsToCount:slotCount];
+    }
+    
+    for (PublicKey *publicKey in publicKeys) {
+        [self addPublicKey:publicKey forUserId:publicKey.userId];
+    }
+}
 
 - (void)addPublicSubkey:(PublicKey *)publicSubkey forUserId:(NSString *)userId {
-    if (_publicSubkeysByUserId[userId] == nil) {
-        _publicSubkeysByUserId[userId] = [NSMutableArray array];
+    NSUInteger index = [self recordIndexForKeyId:publicSubkey.keyID insert:YES];
+    KeyringRecord *record = &_records[index];
+    
+    if (record->publicKey != NULL) {
+        CFRelease(record->publicKey);
     }
     
-    [_publicSubkeysByUserId[userId] addObject:publicSubkey];
-    _publicSubkeysByKeyId[publicSubkey.keyID] = publicSubkey;
+    record->publicKey = (void *) CFBridgingRetain(publicSubkey);
+    _publicKeys = nil;
+    
+    [self addRecordIndex:index forUserId:userId];
 }
 
 - (void)addSecretSubkey:(SecretKey *)secretSubkey forUserId:(NSString *)userId {
-    if (_secretSubkeysByUserId[userId] == nil) {
-        _secretSubkeysByUserId[userId] = [NSMutableArray array];
+    NSUInteger index = [self recordIndexForKeyId:secretSubkey.publicKey.keyID insert:YES];
+    KeyringRecord *record = &_records[index];
+    
+    if (record->secretKey != NULL) {
+        CFRelease(record->secretKey);
     }
     
-    [_secretSubkeysByUserId[userId] addObject:secretSubkey];
-    _secretSubkeysByKeyId[secretSubkey.publicKey.keyID] = secretSubkey;
+    record->secretKey = (void *) CFBridgingRetain(secretSubkey);
+    _secretKeys = nil;
+    
+    // The secret subkey's public half goes in the same record:
+    [self addPublicSubkey:secretSubkey.publicKey forUserId:userId];
 }
 
 - (NSArray *)publicKeysForUserId:(NSString *)userId {
-    NSMutableArray *publicKeys = [NSMutableArray array];
+    return [self publicKeysForRecordIndexes:_recordIndexesByUserId[userId]];
+}
+
+- (NSArray *)publicKeysForEmail:(NSString *)email {
+    return [self publicKeysForRecordIndexes:[_emailIndex recordIndexesForEmail:email]];
+}
+
+- (NSArray *)publicKeysWithEmailPrefix:(NSString *)prefix {
+    return [self publicKeysForRecordIndexes:[_emailIndex recordIndexesWithEmailPrefix:prefix]];
+}
+
+- (NSArray *)publicKeysForEmailDomain:(NSString *)domain {
+    return [self publicKeysForRecordIndexes:[_emailIndex recordIndexesForDomain:domain]];
+}
+
+- (NSArray *)publicKeysWithEmailContaining:(NSString *)substring {
+    return [self publicKeysForRecordIndexes:[_emailIndex recordIndexesWithEmailContaining:substring]];
+}
+
+- (PublicKey *)publicKeyForKeyId:(KeyID)keyId {
+    PGP_COUNT(PGP_COUNTER_KEY_LOOKUPS);
+    
+    NSUInteger index = [self recordIndexForKeyId:keyId insert:NO];
     
-    if (_publicKeysByUserId[userId]) {
-        [publicKeys addObjectsFromArray:_publicKeysByUserId[userId]];
+    if (index == NSNotFound) {
+        return nil;
     }
     
-    if (_publicSubkeysByUserId[userId]) {
-        [publicKeys addObjectsFromArray:_publicSubkeysByUserId[userId]];
+    return (__bridge PublicKey *) _records[index].publicKey;
+}
+
+- (NSArray *)secretKeysForUserId:(NSString *)userId {
+    NSMutableArray *secretKeys = [NSMutableArray array];
+    
+    [_recordIndexesByUserId[userId] enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        if (_records[index].secretKey != NULL) {
+            [secretKeys addObject:(__bridge SecretKey *) _records[index].secretKey];
+        }
+    }];
+    
+    return [NSArray arrayWithArray:secretKeys];
+}
+
+- (SecretKey *)secretKeyForKeyId:(KeyID)keyId {
+    PGP_COUNT(PGP_COUNTER_KEY_LOOKUPS);
+    
+    NSUInteger index = [self recordIndexForKeyId:keyId insert:NO];
+    
+    if (index == NSNotFound) {
+        return nil;
     }
     
-    return [NSArray arrayWithArray:publicKeys];
+    return (__bridge SecretKey *) _records[index].secretKey;
+}
+
+- (void)enumeratePublicKeysUsingBlock:(void (^)(PublicKey *publicKey, BOOL *stop))block {
+    BOOL stop = NO;
+    
+    for (NSUInteger i = 0; i < _count && !stop; i++) {
+        if (_records[i].publicKey != NULL) {
+            block((__bridge PublicKey *) _records[i].publicKey, &stop);
+        }
+    }
 }
 
-- (PublicKey *)publicKeyForKeyId:(NSString *)keyId {
-    return _publicKeysByKeyId[keyId] ?: _publicSubkeysByKeyId[keyId];
+- (void)enumerateSecretKeysUsingBlock:(void (^)(SecretKey *secretKey, BOOL *stop))block {
+    BOOL stop = NO;
+    
+    for (NSUInteger i = 0; i < _count && !stop; i++) {
+        if (_records[i].secretKey != NULL) {
+            block((__bridge SecretKey *) _records[i].secretKey, &stop);
+        }
+    }
 }
 
-- (NSArray *)secretKeysForUserId:(NSString *)userId {
-    NSMutableArray *secretKeys = [NSMutableArray array];
+#pragma mark Private
+
+- (NSUInteger)recordIndexForKeyId:(KeyID)keyId insert:(BOOL)insert {
     
-    if (_secretKeysByUserId[userId]) {
-        [secretKeys addObjectsFromArray:_secretKeysByUserId[userId]];
+    // Key IDs come from the fingerprint hash, but anyone can pick keys that collide in the
+    // low bits, so mix all of them in (Fibonacci hashing):
+    NSUInteger slot = (NSUInteger) ((keyId * 0x9E3779B97F4A7C15ull) >> _slotShift);
+    
+    while (_slots[slot] != KeyringEmptySlot) {
+        if (_records[_slots[slot]].keyID == keyId) {
+            return _slots[slot];
+        }
+        
+        slot = (slot + 1) & _slotMask;
     }
     
-    if (_secretKeysByUserId[userId]) {
-        [secretKeys addObjectsFromArray:_secretKeysByUserId[userId]];
+    if (!insert) {
+        return NSNotFound;
     }
     
-    return [NSArray arrayWithArray:secretKeys];
+    if (_count == _recordCapacity) {
+        _recordCapacity *= 2;
+        _records = realloc(_records, _recordCapacity * sizeof(KeyringRecord));
+    }
+    
+    NSUInteger index = _count++;
+    
+    _records[index].keyID = keyId;
+    _records[index].publicKey = NULL;
+    _records[index].secretKey = NULL;
+    
+    _slots[slot] = (uint32_t) index;
+    
+    // Keep the load factor at or under a half:
+    if (_count * 2 > _slotMask + 1) {
+        [self growSlots];
+    }
+    
+    return index;
 }
 
-- (SecretKey *)secretKeyForKeyId:(NSString *)keyId {
-    return _secretKeysByKeyId[keyId] ?: _secretSubkeysByKeyId[keyId];
+- (void)growSlots {
+    [self resizeSlotsToCount:(_slotMask + 1) * 2];
+}
+
+- (void)resizeSlotsToCount:(NSUInteger)slotCount {
+    free(_slots);
+    
+    _slots = malloc(slotCount * sizeof(uint32_t));
+    memset(_slots, 0xFF, slotCount * sizeof(uint32_t));
+    
+    // Slot counts are powers of two, the hash keeps the top log2(slotCount) bits:
+    _slotMask = slotCount - 1;
+    _slotShift = 64 - __builtin_ctzl(slotCount);
+    
+    for (NSUInteger i = 0; i < _count; i++) {
+        NSUInteger slot = (NSUInteger) ((_records[i].keyID * 0x9E3779B97F4A7C15ull) >> _slotShift);
+        
+        while (_slots[slot] != KeyringEmptySlot) {
+            slot = (slot + 1) & _slotMask;
+        }
+        
+        _slots[slot] = (uint32_t) i;
+    }
+}
+
+- (void)addRecordIndex:(NSUInteger)index forUserId:(NSString *)userId {
+    if (userId == nil) {
+        return;
+    }
+    
+    NSMutableIndexSet *indexes = _recordIndexesByUserId[userId];
+    
+    if (indexes == nil) {
+        indexes = [NSMutableIndexSet indexSet];
+        _recordIndexesByUserId[userId] = indexes;
+    }
+    
+    if (![indexes containsIndex:index]) {
+        [indexes addIndex:index];
+        [_emailIndex addUserId:userId recordIndex:index];
+    }
+}
+
+- (NSArray *)publicKeysForRecordIndexes:(NSIndexSet *)recordIndexes {
+    NSMutableArray *publicKeys = [NSMutableArray arrayWithCapacity:recordIndexes.count];
+    
+    [recordIndexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        if (_records[index].publicKey != NULL) {
+            [publicKeys addObject:(__bridge PublicKey *) _records[index].publicKey];
+        }
+    }];
+    
+    return [NSArray arrayWithArray:publicKeys];
 }
 
 @end
@@ -9,17 +9,23 @@
 #import <Foundation/Foundation.h>
 #import <openssl/BN.h>
 
+/// Keeps the wire encoding (two byte bit count then the big endian magnitude) and only makes a
+/// BIGNUM the first time bn is asked for, which for most keys is never.
 @interface MPI : NSObject
 
+/// Length on the wire, bit count included:
 @property (nonatomic, readonly) NSUInteger length;
 @property (nonatomic, readonly) BIGNUM *bn;
 
+/// The wire encoding:
 @property (nonatomic, readonly) NSData *data;
 
+/// From the magnitude bytes alone:
 + (MPI *)mpiFromData:(NSData *)data;
-
 + (MPI *)mpiFromBytes:(const Byte *)bytes byteCount:(NSUInteger)byteCount;
-+ (MPI *)mpiFromBytes:(const Byte *)bytes;
+
+/// From the wire encoding at index, sharing the data's storage where Foundation can. Throws if it runs off the end:
++ (MPI *)mpiFromData:(NSData *)data atIndex:(NSUInteger)index;
 
 + (MPI *)mpiWithBIGNUM:(BIGNUM *)bn;
 
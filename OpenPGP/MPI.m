@@ -7,12 +7,15 @@
 //
 
 #import "MPI.h"
+#import "OpenPGPCore.h"
 
 @interface MPI () {
     BIGNUM *_bn;
+    NSData *_data;
 }
 
-- (id)initWithBIGNUM:(BIGNUM *)bn length:(NSUInteger)length;
+- (id)initWithData:(NSData *)data;
+- (id)initWithBIGNUM:(BIGNUM *)bn;
 
 @end
 
@@ -23,33 +26,47 @@
 }
 
 + (MPI *)mpiFromBytes:(const Byte *)bytes byteCount:(NSUInteger)length {
-    BIGNUM *bn = BN_bin2bn(bytes, (int) length, NULL);
-    return [[self alloc] initWithBIGNUM:bn length:length];
+    NSMutableData *data = [NSMutableData dataWithLength:length + 2];
+    data.length = pgp_mpi_write(data.mutableBytes, bytes, length);
+    
+    return [[self alloc] initWithData:data];
 }
 
-+ (MPI *)mpiFromBytes:(const Byte *)bytes {
-    NSUInteger bitCount = (bytes[0] << 8) | bytes[1];
-    NSUInteger length = (bitCount + 7) / 8;  // Taken from NetPGP, poor man's CEIL.
-    
-    Byte mpiBytes[length];
-    memcpy(mpiBytes, bytes + 2, length);
++ (MPI *)mpiFromData:(NSData *)data atIndex:(NSUInteger)index {
+    size_t length = 0;
     
-    BIGNUM *bn = BN_bin2bn(mpiBytes, (int) length, NULL);
+    if (pgp_mpi_read(data.bytes, data.length, index, &length) != PGP_OK) {
+        @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                       reason:@"MPI is truncated."
+                                     userInfo:@{@"index": @(index)}];
+    }
     
-    return [[self alloc] initWithBIGNUM:bn length:length + 2];
+    return [[self alloc] initWithData:[data subdataWithRange:NSMakeRange(index, length)]];
 }
 
 + (MPI *)mpiWithBIGNUM:(BIGNUM *)bn {
-    return [[self alloc] initWithBIGNUM:bn length:BN_num_bytes(bn)];
+    return [[self alloc] initWithBIGNUM:bn];
 }
 
+- (id)initWithData:(NSData *)data {
+    self = [super init];
+    
+    if (self != nil) {
+        _bn = NULL;
+        _data = data;
+        _length = data.length;
+    }
+    
+    return self;
+}
 
-- (id)initWithBIGNUM:(BIGNUM *)bn length:(NSUInteger)length {
+- (id)initWithBIGNUM:(BIGNUM *)bn {
     self = [super init];
     
     if (self != nil) {
         _bn = BN_dup(bn);
-        _length = length;
+        _data = nil;
+        _length = BN_num_bytes(bn) + 2;
     }
     
     return self;
@@ -61,20 +78,33 @@
 }
 
 - (BIGNUM *)bn {
-    return _bn;
+    @synchronized (self) {
+        if (_bn == NULL) {
+            const Byte *bytes = _data.bytes;
+            _bn = BN_bin2bn(bytes + 2, (int) _data.length - 2, NULL);
+        }
+        
+        return _bn;
+    }
 }
 
 - (NSData *)data {
-    NSUInteger len = BN_num_bytes(_bn);
-    Byte *bytes = calloc(len + 2, sizeof(Byte));
-    
-    NSUInteger bitCount = BN_num_bits(_bn);
-    bytes[0] = (bitCount >> 8) & 0xFF;
-    bytes[1] = bitCount & 0xFF;
-    
-    BN_bn2bin(_bn, bytes + 2);
-    
-    return [NSData dataWithBytesNoCopy:bytes length:len + 2 freeWhenDone:YES];
+    @synchronized (self) {
+        if (_data == nil) {
+            NSUInteger len = BN_num_bytes(_bn);
+            Byte *bytes = calloc(len + 2, sizeof(Byte));
+            
+            NSUInteger bitCount = BN_num_bits(_bn);
+            bytes[0] = (bitCount >> 8) & 0xFF;
+            bytes[1] = bitCount & 0xFF;
+            
+            BN_bn2bin(_bn, bytes + 2);
+            
+            _data = [NSData dataWithBytesNoCopy:bytes length:len + 2 freeWhenDone:YES];
+        }
+        
+        return _data;
+    }
 }
 
 @end
@@ -0,0 +1,44 @@
+//
+//  MessageHeader.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Crypto.h"
+#import "Packet.h"
+#import "Utility.h"
+
+#pragma mark - MessageRecipient interface
+
+/// One public key encrypted session key packet, the key ID is 0 for anonymous recipients:
+@interface MessageRecipient : NSObject
+
+@property (nonatomic, readonly) KeyID keyId;
+@property (nonatomic, readonly) PublicKeyAlgorithm publicKeyAlgorithm;
+
+@end
+
+#pragma mark - MessageHeader interface
+
+/// The packets in front of an encrypted message's payload. Only as much armor and as many
+/// packet headers are decoded as it takes to reach the encrypted data packet, whose body is
+/// never read.
+@interface MessageHeader : NSObject
+
+@property (nonatomic, readonly) NSArray *recipients;
+
+/// PacketTypeSEData or PacketTypeSEIPData:
+@property (nonatomic, readonly) PacketType encryptedDataPacketType;
+
+/// Offset of the encrypted data packet body in the binary message, and its length, which is
+/// NSNotFound when only the packet's end says where it stops (partial or indeterminate lengths):
+@property (nonatomic, readonly) NSUInteger encryptedDataOffset;
+@property (nonatomic, readonly) NSUInteger encryptedDataLength;
+
++ (MessageHeader *)headerWithArmoredMessage:(NSString *)message error:(NSError **)error;
++ (MessageHeader *)headerWithData:(NSData *)data error:(NSError **)error;
+
+@end
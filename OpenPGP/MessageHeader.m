@@ -0,0 +1,245 @@
+//
+//  MessageHeader.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "MessageHeader.h"
+#import "OpenPGP.h"
+#import "OpenPGPCore.h"
+
+#define MessageHeaderArmorPrefixLength 4096
+#define MessageHeaderArmorLabel "PGP MESSAGE"
+#define MessageHeaderSessionKeyLength 10
+
+#pragma mark - MessageRecipient extension
+
+@interface MessageRecipient ()
+
+- (instancetype)initWithKeyId:(KeyID)keyId publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm;
+
+@end
+
+#pragma mark - MessageRecipient implementation
+
+@implementation MessageRecipient
+
+- (instancetype)initWithKeyId:(KeyID)keyId publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm {
+    self = [super init];
+    
+    if (self != nil) {
+        _keyId = keyId;
+        _publicKeyAlgorithm = publicKeyAlgorithm;
+    }
+    
+    return self;
+}
+
+@end
+
+#pragma mark - MessageHeader extension
+
+@interface MessageHeader ()
+
+/// Returns nil without an error if the bytes end before the encrypted data packet and aren't complete:
++ (MessageHeader *)headerWithBytes:(const Byte *)bytes length:(NSUInteger)length complete:(BOOL)complete error:(NSError **)error;
+
+- (instancetype)initWithRecipients:(NSArray *)recipients
+           encryptedDataPacketType:(PacketType)encryptedDataPacketType
+               encryptedDataOffset:(NSUInteger)encryptedDataOffset
+               encryptedDataLength:(NSUInteger)encryptedDataLength;
+
+@end
+
+#pragma mark - MessageHeader implementation
+
+@implementation MessageHeader
+
++ (MessageHeader *)headerWithArmoredMessage:(NSString *)message error:(NSError **)error {
+    NSData *textData = [message dataUsingEncoding:NSUTF8StringEncoding];
+    const char *characters = textData.bytes;
+    pgp_armor armor;
+    
+    // The same parse armorFromText: does, so a message that decrypts can always be peeked at.
+    // Everything after the headers can be missing, so running out before the footer is fine:
+    pgp_status armorStatus = textData != nil ? pgp_armor_parse(characters, textData.length, &armor) : PGP_ERROR_MALFORMED;
+    BOOL truncated = armorStatus == PGP_ERROR_TRUNCATED;
+    
+    if ((armorStatus != PGP_OK && !truncated) ||
+        armor.labelLength != strlen(MessageHeaderArmorLabel) ||
+        memcmp(characters + armor.labelOffset, MessageHeaderArmorLabel, armor.labelLength) != 0) {
+        
+        if (error != NULL) {
+            *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Message armor is malformed."];
+        }
+        
+        return nil;
+    }
+    
+    const char *content = characters + armor.contentOffset;
+    NSMutableData *data = [NSMutableData data];
+    size_t decodedLength = 0;
+    size_t textOffset = 0;
+    
+    // The headers are almost always in the first few KB, decode more only when they aren't. Each
+    // piece carries on from the whole groups the last one decoded:
+    for (size_t pieceLength = MessageHeaderArmorPrefixLength; ; pieceLength *= 2) {
+        size_t end = MIN(textOffset + pieceLength, armor.contentLength);
+        BOOL complete = end == armor.contentLength;
+        
+        data.length = decodedLength + (end - textOffset) * 3 / 4;
+        
+        size_t outputLength = 0;
+        size_t consumed = end - textOffset;
+        pgp_status status;
+        
+        // A cut off message can end part way through a group, which isn't padding:
+        if (complete && !truncated) {
+            status = pgp_base64_decode((uint8_t *) data.mutableBytes + decodedLength, &outputLength, content + textOffset, consumed);
+        } else {
+            status = pgp_base64_decode_groups((uint8_t *) data.mutableBytes + decodedLength, &outputLength, content + textOffset, consumed, &consumed);
+        }
+        
+        if (status != PGP_OK) {
+            if (error != NULL) {
+                *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Message armor is malformed."];
+            }
+            
+            return nil;
+        }
+        
+        decodedLength += outputLength;
+        textOffset += consumed;
+        
+        NSError *headerError = nil;
+        MessageHeader *header = [self headerWithBytes:data.bytes length:decodedLength complete:complete error:&headerError];
+        
+        if (header != nil || headerError != nil) {
+            if (error != NULL) {
+                *error = headerError;
+            }
+            
+            return header;
+        }
+    }
+}
+
++ (MessageHeader *)headerWithData:(NSData *)data error:(NSError **)error {
+    NSError *headerError = nil;
+    MessageHeader *header = [self headerWithBytes:data.bytes length:data.length complete:YES error:&headerError];
+    
+    if (error != NULL) {
+        *error = headerError;
+    }
+    
+    return header;
+}
+
+#pragma mark Private
+
++ (MessageHeader *)headerWithBytes:(const Byte *)bytes length:(NSUInteger)length complete:(BOOL)complete error:(NSError **)error {
+    NSMutableArray *recipients = [NSMutableArray array];
+    NSUInteger index = 0;
+    
+    while (YES) {
+        if (index + 1 >= length) {
+            if (complete) {
+                *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Message has no encrypted data."];
+            }
+            
+            return nil;
+        }
+        
+        pgp_packet packet;
+        pgp_status status = pgp_packet_read_header(bytes, length, index, &packet);
+        
+        if (status == PGP_ERROR_MALFORMED) {
+            *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Packet tag is malformed."];
+            return nil;
+        }
+        
+        if (status != PGP_OK) {
+            if (complete) {
+                *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Message is truncated."];
+            }
+            
+            return nil;
+        }
+        
+        PacketType packetType = packet.tag;
+        NSUInteger bodyIndex = packet.bodyOffset;
+        NSUInteger bodyLength = packet.bodyLength;
+        BOOL partial = packet.partial || packet.indeterminate;
+        
+        switch (packetType) {
+            case PacketTypePKESKey: {
+                if (partial || bodyLength < MessageHeaderSessionKeyLength) {
+                    *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Session key packet is malformed."];
+                    return nil;
+                }
+                
+                // Version, key ID, public key algorithm, the encrypted session key itself isn't needed:
+                if (bodyIndex + MessageHeaderSessionKeyLength > length) {
+                    if (complete) {
+                        *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Message is truncated."];
+                    }
+                    
+                    return nil;
+                }
+                
+                if (bytes[bodyIndex] != 3) {
+                    *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Session key packet version not supported."];
+                    return nil;
+                }
+                
+                [recipients addObject:[[MessageRecipient alloc] initWithKeyId:[Utility readKeyID:bytes + bodyIndex + 1]
+                                                           publicKeyAlgorithm:bytes[bodyIndex + 9]]];
+                
+                index = bodyIndex + bodyLength;
+                break;
+            }
+            
+            case PacketTypeSKESKey:
+            case PacketTypeMarker: {
+                if (partial) {
+                    *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Packet length is malformed."];
+                    return nil;
+                }
+                
+                index = bodyIndex + bodyLength;
+                break;
+            }
+            
+            case PacketTypeSEData:
+            case PacketTypeSEIPData:
+                return [[self alloc] initWithRecipients:[NSArray arrayWithArray:recipients]
+                                encryptedDataPacketType:packetType
+                                    encryptedDataOffset:bodyIndex
+                                    encryptedDataLength:partial ? NSNotFound : bodyLength];
+            
+            default:
+                *error = [OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Message is not encrypted."];
+                return nil;
+        }
+    }
+}
+
+- (instancetype)initWithRecipients:(NSArray *)recipients
+           encryptedDataPacketType:(PacketType)encryptedDataPacketType
+               encryptedDataOffset:(NSUInteger)encryptedDataOffset
+               encryptedDataLength:(NSUInteger)encryptedDataLength {
+    self = [super init];
+    
+    if (self != nil) {
+        _recipients = recipients;
+        _encryptedDataPacketType = encryptedDataPacketType;
+        _encryptedDataOffset = encryptedDataOffset;
+        _encryptedDataLength = encryptedDataLength;
+    }
+    
+    return self;
+}
+
+@end
@@ -12,7 +12,7 @@
 @interface OnePassSignaturePacket : Packet
 
 @property (nonatomic, readonly) SignatureType signatureType;
-@property (nonatomic, readonly) NSString *keyId;
+@property (nonatomic, readonly) KeyID keyId;
 
 @property (nonatomic, readonly) HashAlgorithm hashAlgorithm;
 @property (nonatomic, readonly) PublicKeyAlgorithm publicKeyAlgorithm;
@@ -21,4 +21,9 @@
 
 + (OnePassSignaturePacket *)packetWithSignature:(Signature *)signature;
 
++ (OnePassSignaturePacket *)packetWithSignatureType:(SignatureType)signatureType
+                                              keyId:(KeyID)keyId
+                                      hashAlgorithm:(HashAlgorithm)hashAlgorithm
+                                 publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm;
+
 @end
@@ -12,7 +12,7 @@
 @interface OnePassSignaturePacket ()
 
 - (instancetype)initWithSignatureType:(SignatureType)signatureType
-                                keyId:(NSString *)keyId
+                                keyId:(KeyID)keyId
                         hashAlgorithn:(HashAlgorithm)hashAlgorithm
                    publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
                              isNested:(BOOL)isNested;
@@ -36,14 +36,6 @@
     
     SignatureType signatureType = bytes[currentIndex++];
     
-    PublicKeyAlgorithm publicKeyAlgorithm = bytes[currentIndex++];
-    
-    if (publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign) {
-        [NSException exceptionWithName:NSInternalInconsistencyException
-                                reason:@"Public key algorithm not supported."
-                              userInfo:@{@"publicKeyAlgorithm": @(publicKeyAlgorithm)}];
-    }
-    
     HashAlgorithm hashAlgorithm = bytes[currentIndex++];
     
     if (hashAlgorithm != HashAlgorithmSHA256) {
@@ -52,7 +44,15 @@
                               userInfo:@{@"hashAlgorithm": @(hashAlgorithm)}];
     }
     
-    NSString *keyId = [Utility keyIDFromBytes:bytes + currentIndex];
+    PublicKeyAlgorithm publicKeyAlgorithm = bytes[currentIndex++];
+    
+    if (publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign && publicKeyAlgorithm != PublicKeyAlgorithmEdDSA) {
+        [NSException exceptionWithName:NSInternalInconsistencyException
+                                reason:@"Public key algorithm not supported."
+                              userInfo:@{@"publicKeyAlgorithm": @(publicKeyAlgorithm)}];
+    }
+    
+    KeyID keyId = [Utility readKeyID:bytes + currentIndex];
     currentIndex += 8;
     
     BOOL isNested = !(bytes[currentIndex]);
@@ -65,15 +65,25 @@
 }
 
 + (OnePassSignaturePacket *)packetWithSignature:(Signature *)signature {
-    return [[self alloc] initWithSignatureType:signature.type
-                                         keyId:signature.keyID
-                                 hashAlgorithn:HashAlgorithmSHA256
-                            publicKeyAlgorithm:PublicKeyAlgorithmRSAEncryptSign
+    return [self packetWithSignatureType:signature.type
+                                   keyId:signature.keyID
+                           hashAlgorithm:signature.hashAlgorithm
+                      publicKeyAlgorithm:signature.publicKeyAlgorithm];
+}
+
++ (OnePassSignaturePacket *)packetWithSignatureType:(SignatureType)signatureType
+                                              keyId:(KeyID)keyId
+                                      hashAlgorithm:(HashAlgorithm)hashAlgorithm
+                                 publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm {
+    return [[self alloc] initWithSignatureType:signatureType
+                                         keyId:keyId
+                                 hashAlgorithn:hashAlgorithm
+                            publicKeyAlgorithm:publicKeyAlgorithm
                                       isNested:NO];
 }
 
 - (instancetype)initWithSignatureType:(SignatureType)signatureType
-                                keyId:(NSString *)keyId
+                                keyId:(KeyID)keyId
                         hashAlgorithn:(HashAlgorithm)hashAlgorithm
                    publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
                              isNested:(BOOL)isNested {
@@ -103,7 +113,8 @@
     
     [Utility writeKeyID:self.keyId toBytes:body + 4];
     
-    body[12] = self.isNested;
+    // A zero flag means another one-pass signature follows:
+    body[12] = !self.isNested;
     
     return [NSData dataWithBytes:body length:13];
 }
@@ -8,14 +8,40 @@
 
 #import <Foundation/Foundation.h>
 
+@class KeypairPool, ScheduledOperation, SessionKeyCache;
+
 @interface OpenPGP : NSObject
 
+/// Off (nil) by default. When set, decryption looks up the session key here before doing any
+/// private key operation and adds the ones it recovers:
++ (SessionKeyCache *)sessionKeyCache;
++ (void)setSessionKeyCache:(SessionKeyCache *)sessionKeyCache;
+
+/// Off (nil) by default. When set, RSA keys of the pool's size are taken from it instead of
+/// being generated while the caller waits:
++ (KeypairPool *)keypairPool;
++ (void)setKeypairPool:(KeypairPool *)keypairPool;
+
+/// The error every part of the library reports failures with, cause is prefixed with the
+/// method that failed, e.g. "OpenPGP signFileAtPath: Failed to read file.":
++ (NSError *)errorWithCause:(NSString *)cause;
+
 + (void)decryptAndVerifyMessage:(NSString *)message
                      privateKey:(NSString *)privateKey
                      publicKeys:(NSArray *)publicKeys
                 completionBlock:(void (^)(NSString *decryptedMessage, NSArray *verifiedUserIds))completionBlock
                      errorBlock:(void (^)(NSError *))errorBlock;
 
+/// Decrypts a batch of messages, armored strings or binary NSData, to the same keys. The keys are
+/// read and prepared once for the batch, and a workerCount of 0 uses all active cores. Results are
+/// a DecryptionResult per message in input order, a message that fails doesn't fail the batch:
++ (void)decryptAndVerifyMessages:(NSArray *)messages
+                      privateKey:(NSString *)privateKey
+                      publicKeys:(NSArray *)publicKeys
+                     workerCount:(NSUInteger)workerCount
+                 completionBlock:(void (^)(NSArray *results))completionBlock
+                      errorBlock:(void (^)(NSError *))errorBlock;
+
 
 + (void)signAndEncryptMessage:(NSString *)message
                    privateKey:(NSString *)privateKey
@@ -24,8 +50,93 @@
                    errorBlock:(void (^)(NSError *))errorBlock;
 
 
++ (void)signFileAtPath:(NSString *)path
+            privateKey:(NSString *)privateKey
+       completionBlock:(void (^)(NSString *signature))completionBlock
+            errorBlock:(void (^)(NSError *))errorBlock;
+
+
++ (void)verifyFileAtPath:(NSString *)path
+               signature:(NSString *)signature
+              publicKeys:(NSArray *)publicKeys
+         completionBlock:(void (^)(NSArray *verifiedUserIds))completionBlock
+              errorBlock:(void (^)(NSError *))errorBlock;
+
+
+/// Decrypts a passphrase protected private key once and keeps it unlocked for timeout seconds
+/// (0 until it's locked), the operations above fail with a locked key until then:
++ (void)unlockPrivateKey:(NSString *)privateKey
+              passphrase:(NSString *)passphrase
+                 timeout:(NSTimeInterval)timeout
+         completionBlock:(void (^)(void))completionBlock
+              errorBlock:(void (^)(NSError *))errorBlock;
+
++ (void)lockPrivateKey:(NSString *)privateKey;
++ (void)lockAllPrivateKeys;
+
+
+/// Key IDs the message is encrypted to as hex strings, read from the packet headers without a
+/// private key and without touching the encrypted payload:
++ (void)recipientsOfMessage:(NSString *)message
+            completionBlock:(void (^)(NSArray *recipientKeyIds))completionBlock
+                 errorBlock:(void (^)(NSError *))errorBlock;
+
+
+/// Options are userId and either bits for an RSA key or algorithm @"ed25519" for an Ed25519 signing key
+/// with an X25519 encryption subkey:
 + (void)generateKeypairWithOptions:(NSDictionary *)options
                    completionBlock:(void(^)(NSString *publicKey, NSString *privateKey))completionBlock
                         errorBlock:(void(^)(NSError *error))errorBlock;
 
+
+#pragma mark Asynchronous
+
+/// The operations above run on the shared OperationScheduler, private key work and key generation
+/// in its expensive lane and the rest in its cheap one. Blocks are called on the completion queue
+/// (the main queue if it's NULL). When the lane is full these return nil and the error block gets
+/// called instead, so callers can back off:
++ (ScheduledOperation *)decryptAndVerifyMessage:(NSString *)message
+                                     privateKey:(NSString *)privateKey
+                                     publicKeys:(NSArray *)publicKeys
+                                completionQueue:(dispatch_queue_t)completionQueue
+                                completionBlock:(void (^)(NSString *decryptedMessage, NSArray *verifiedUserIds))completionBlock
+                                     errorBlock:(void (^)(NSError *))errorBlock;
+
++ (ScheduledOperation *)signAndEncryptMessage:(NSString *)message
+                                   privateKey:(NSString *)privateKey
+                                   publicKeys:(NSArray *)publicKeys
+                              completionQueue:(dispatch_queue_t)completionQueue
+                              completionBlock:(void (^)(NSString *encryptedMessage))completionBlock
+                                   errorBlock:(void (^)(NSError *))errorBlock;
+
++ (ScheduledOperation *)signFileAtPath:(NSString *)path
+                            privateKey:(NSString *)privateKey
+                       completionQueue:(dispatch_queue_t)completionQueue
+                       completionBlock:(void (^)(NSString *signature))completionBlock
+                            errorBlock:(void (^)(NSError *))errorBlock;
+
++ (ScheduledOperation *)verifyFileAtPath:(NSString *)path
+                               signature:(NSString *)signature
+                              publicKeys:(NSArray *)publicKeys
+                         completionQueue:(dispatch_queue_t)completionQueue
+                         completionBlock:(void (^)(NSArray *verifiedUserIds))completionBlock
+                              errorBlock:(void (^)(NSError *))errorBlock;
+
++ (ScheduledOperation *)unlockPrivateKey:(NSString *)privateKey
+                              passphrase:(NSString *)passphrase
+                                 timeout:(NSTimeInterval)timeout
+                         completionQueue:(dispatch_queue_t)completionQueue
+                         completionBlock:(void (^)(void))completionBlock
+                              errorBlock:(void (^)(NSError *))errorBlock;
+
++ (ScheduledOperation *)recipientsOfMessage:(NSString *)message
+                            completionQueue:(dispatch_queue_t)completionQueue
+                            completionBlock:(void (^)(NSArray *recipientKeyIds))completionBlock
+                                 errorBlock:(void (^)(NSError *))errorBlock;
+
++ (ScheduledOperation *)generateKeypairWithOptions:(NSDictionary *)options
+                                   completionQueue:(dispatch_queue_t)completionQueue
+                                   completionBlock:(void(^)(NSString *publicKey, NSString *privateKey))completionBlock
+                                        errorBlock:(void(^)(NSError *error))errorBlock;
+
 @end
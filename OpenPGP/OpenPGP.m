@@ -6,40 +6,98 @@
 //  Copyright (c) 2015 Gradient. All rights reserved.
 //
 
+#import <fcntl.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
 #import "OpenPGP.h"
 #import "ASCIIArmor.h"
+#import "DecryptionResult.h"
+#import "Instrumentation.h"
 #import "Key.h"
 #import "Keyring.h"
+#import "KeyUnlockCache.h"
 #import "Packet.h"
 #import "Signature.h"
 #import "PKESPacket.h"
 #import "KeyPacket.h"
 #import "Keypair.h"
+#import "KeypairPool.h"
 #import "LiteralDataPacket.h"
+#import "MessageHeader.h"
+#import "OperationScheduler.h"
 #import "OnePassSignaturePacket.h"
 #import "PacketReader.h"
 #import "SEDataPacket.h"
 #import "SEIPDataPacket.h"
+#import "SessionKeyCache.h"
+#import "SignatureContext.h"
 #import "SignaturePacket.h"
 #import "UserIDPacket.h"
 #import "Utility.h"
 
 @interface OpenPGP ()
 
-+ (NSError *)errorWithCause:(NSString *)cause;
++ (ScheduledOperation *)scheduleOnLane:(OperationLane)lane
+                       completionQueue:(dispatch_queue_t)completionQueue
+                            errorBlock:(void (^)(NSError *))errorBlock
+                                 block:(void (^)(ScheduledOperation *operation))block;
 
 + (void)readPublicKeyMessages:(NSArray *)publicKeyMessages intoKeyring:(Keyring *)keyring;
 + (void)readSecretKeyMessages:(NSArray *)secretKeyMessages intoKeyring:(Keyring *)keyring;
 
 + (void)readPublicKeyMessage:(NSString *)publicKeyMessage intoKeyring:(Keyring *)keyring;
-+ (void)readSecretKeyMessage:(NSString *)secretKeyMessage intoKeyring:(Keyring *)keyring;
++ (SecretKey *)readSecretKeyMessage:(NSString *)secretKeyMessage intoKeyring:(Keyring *)keyring;
++ (SecretKey *)secretKeyFromMessage:(NSString *)secretKeyMessage;
+
++ (BOOL)isSecretKeyLocked:(SecretKey *)secretKey;
+
+/// Message is armored text or binary packets:
++ (NSString *)decryptAndVerifyMessage:(id)message
+                          withKeyring:(Keyring *)keyring
+                      verifiedUserIds:(NSArray **)verifiedUserIds
+                                error:(NSError **)error;
 
 + (PacketList *)decryptPacketList:(PacketList *)packetList withKeyring:(Keyring *)keyring;
 
++ (NSData *)trialDecryptSessionKeyPackets:(NSArray *)sessionKeyPackets
+                          withSecretKeys:(NSArray *)secretKeys
+                              dataPacket:(id<EncryptedDataPacket>)dataPacket
+                        sessionKeyPacket:(PKESKeyPacket **)sessionKeyPacket
+                                   keyId:(KeyID *)keyId;
+
++ (BOOL)readFileAtPath:(NSString *)path intoContexts:(NSArray *)contexts;
+
 @end
 
+static SessionKeyCache *OpenPGPSessionKeyCache = nil;
+static KeypairPool *OpenPGPKeypairPool = nil;
+
 @implementation OpenPGP
 
++ (SessionKeyCache *)sessionKeyCache {
+    @synchronized (self) {
+        return OpenPGPSessionKeyCache;
+    }
+}
+
++ (void)setSessionKeyCache:(SessionKeyCache *)sessionKeyCache {
+    @synchronized (self) {
+        OpenPGPSessionKeyCache = sessionKeyCache;
+    }
+}
+
++ (KeypairPool *)keypairPool {
+    @synchronized (self) {
+        return OpenPGPKeypairPool;
+    }
+}
+
++ (void)setKeypairPool:(KeypairPool *)keypairPool {
+    @synchronized (self) {
+        OpenPGPKeypairPool = keypairPool;
+    }
+}
 
 + (void)decryptAndVerifyMessage:(NSString *)message
                      privateKey:(NSString *)privateKey
@@ -58,38 +116,97 @@
     
     Keyring *keyring = [Keyring keyring];
     
-    [self readSecretKeyMessage:privateKey intoKeyring:keyring];
+    if ([self isSecretKeyLocked:[self readSecretKeyMessage:privateKey intoKeyring:keyring]]) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP decryptAndVerifyMessage: Private key is locked."]);
+        return;
+    }
+    
     [self readPublicKeyMessages:publicKeys intoKeyring:keyring];
     
-    ASCIIArmor *asciiArmor = [ASCIIArmor armorFromText:message];
-    PacketList *packetList = [PacketList packetListFromData:asciiArmor.content];
+    NSArray *verifiedUserIds = nil;
+    NSError *error = nil;
+    NSString *decryptedMessage = [self decryptAndVerifyMessage:message withKeyring:keyring verifiedUserIds:&verifiedUserIds error:&error];
     
-    PacketList *decryptedPacketList =  [self decryptPacketList:packetList withKeyring:keyring];
+    if (error != nil) {
+        errorBlock(error);
+        return;
+    }
     
-    LiteralDataPacket *literalDataPacket = nil;
-    SignaturePacket *signaturePacket = nil;
+    completionBlock(decryptedMessage, verifiedUserIds);
+}
+
++ (void)decryptAndVerifyMessages:(NSArray *)messages
+                      privateKey:(NSString *)privateKey
+                      publicKeys:(NSArray *)publicKeys
+                     workerCount:(NSUInteger)workerCount
+                 completionBlock:(void (^)(NSArray *results))completionBlock
+                      errorBlock:(void (^)(NSError *))errorBlock {
+    if (messages == nil || publicKeys == nil || privateKey == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP decryptAndVerifyMessages: Neither messages, publicKeys, nor privateKey can be nil."]);
+        return;
+    }
     
-    for (Packet *packet in decryptedPacketList.packets) {
-        switch (packet.packetType) {
-            case PacketTypeLiteralData:
-                literalDataPacket = (LiteralDataPacket *) packet;
-                break;
-            
-            case PacketTypeSignature:
-                signaturePacket = (SignaturePacket *) packet;
-                break;
+    if (publicKeys.count < 1) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP decryptAndVerifyMessages: Public keys is empty."]);
+        return;
+    }
+    
+    // Read once for the whole batch and shared by the workers:
+    Keyring *keyring = [Keyring keyring];
+    
+    if ([self isSecretKeyLocked:[self readSecretKeyMessage:privateKey intoKeyring:keyring]]) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP decryptAndVerifyMessages: Private key is locked."]);
+        return;
+    }
+    
+    [self readPublicKeyMessages:publicKeys intoKeyring:keyring];
+    
+    // The key lists are built lazily and unsynchronized, build them now so the workers only read:
+    [keyring publicKeys];
+    [keyring secretKeys];
+    
+    NSUInteger count = messages.count;
+    NSUInteger workers = workerCount > 0 ? workerCount : [NSProcessInfo processInfo].activeProcessorCount;
+    workers = MAX(MIN(workers, count), 1);
+    
+    // Each message fills in only its own slot, so results keep the input order however the
+    // workers get through them:
+    void **results = calloc(MAX(count, 1), sizeof(void *));
+    
+    // Workers take the next message as they free up, one slow message doesn't hold up a
+    // whole share of the batch:
+    NSUInteger nextIndex = 0;
+    NSUInteger *next = &nextIndex;
+    
+    dispatch_apply(workers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+        for (NSUInteger i = __sync_fetch_and_add(next, 1); i < count; i = __sync_fetch_and_add(next, 1)) {
+            @autoreleasepool {
+                NSArray *verifiedUserIds = nil;
+                NSError *error = nil;
+                NSString *decryptedMessage = [self decryptAndVerifyMessage:messages[i] withKeyring:keyring verifiedUserIds:&verifiedUserIds error:&error];
                 
-            default:
-                break;
+                DecryptionResult *result = nil;
+                
+                if (error != nil) {
+                    result = [DecryptionResult resultWithError:error];
+                } else {
+                    result = [DecryptionResult resultWithDecryptedMessage:decryptedMessage verifiedUserIds:verifiedUserIds];
+                }
+                
+                results[i] = (void *) CFBridgingRetain(result);
+            }
         }
-    }
+    });
     
-    NSString *decryptedMessage = [[NSString alloc] initWithData:literalDataPacket.literalData encoding:NSUTF8StringEncoding];
-    NSString *signatureKeyId = signaturePacket.keyId;
+    NSMutableArray *decryptionResults = [NSMutableArray arrayWithCapacity:count];
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        [decryptionResults addObject:CFBridgingRelease(results[i])];
+    }
     
-    PublicKey *publicKey = [keyring publicKeyForKeyId:signatureKeyId];
+    free(results);
     
-    completionBlock(decryptedMessage, @[publicKey.userId]);
+    completionBlock([NSArray arrayWithArray:decryptionResults]);
 }
 
 
@@ -111,13 +228,28 @@
     
     Keyring *keyring = [Keyring keyring];
     
-    [self readSecretKeyMessage:privateKey intoKeyring:keyring];
+    if ([self isSecretKeyLocked:[self readSecretKeyMessage:privateKey intoKeyring:keyring]]) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP signAndEncryptMessage: Private key is locked."]);
+        return;
+    }
+    
     [self readPublicKeyMessages:publicKeys intoKeyring:keyring];
     
     LiteralDataPacket *literalDataPacket = [LiteralDataPacket packetWithText:message];
-    Signature *signature = [Signature signatureForLiteralDataPacket:literalDataPacket signatureKey:keyring.secretKeys.firstObject];
     
-    OnePassSignaturePacket *onePassPacket = [OnePassSignaturePacket packetWithSignature:signature];
+    SignatureGenerator *generator = [SignatureGenerator generatorWithSignatureType:SignatureTypeCanonicalText
+                                                                      signatureKey:keyring.secretKeys.firstObject];
+    
+    OnePassSignaturePacket *onePassPacket = generator.onePassSignaturePacket;
+    
+    [generator updateWithData:literalDataPacket.literalData];
+    Signature *signature = [generator finishSignature];
+    
+    if (signature == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP signAndEncryptMessage: Failed to sign message."]);
+        return;
+    }
+    
     SignaturePacket *signaturePacket = [SignaturePacket packetWithSignature:signature];
     
     PacketList *interiorPacketList = [PacketList packetListWithPackets:@[onePassPacket, literalDataPacket, signaturePacket]];
@@ -131,6 +263,12 @@
     NSMutableArray *packets = [NSMutableArray array];
     
     for (PublicKey *publicKey in keyring.publicKeys) {
+        
+        // EdDSA keys can only sign, their encryption key is an ECDH subkey:
+        if (publicKey.publicKeyAlgorithm == PublicKeyAlgorithmEdDSA) {
+            continue;
+        }
+        
         PKESKeyPacket *keyPacket = [PKESKeyPacket packetWithPublicKey:publicKey sessionKey:sessionKey];
         [packets addObject:keyPacket];
     }
@@ -144,10 +282,188 @@
 }
 
 
++ (void)signFileAtPath:(NSString *)path
+            privateKey:(NSString *)privateKey
+       completionBlock:(void (^)(NSString *signature))completionBlock
+            errorBlock:(void (^)(NSError *))errorBlock {
+    
+    if (path == nil || privateKey == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP signFileAtPath: Neither path nor privateKey can be nil."]);
+        return;
+    }
+    
+    Keyring *keyring = [Keyring keyring];
+    
+    if ([self isSecretKeyLocked:[self readSecretKeyMessage:privateKey intoKeyring:keyring]]) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP signFileAtPath: Private key is locked."]);
+        return;
+    }
+    
+    SignatureGenerator *generator = [SignatureGenerator generatorWithSignatureType:SignatureTypeBinary
+                                                                      signatureKey:keyring.secretKeys.firstObject];
+    
+    if (![self readFileAtPath:path intoContexts:@[generator]]) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP signFileAtPath: Failed to read file."]);
+        return;
+    }
+    
+    Signature *signature = [generator finishSignature];
+    
+    if (signature == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP signFileAtPath: Failed to sign file."]);
+        return;
+    }
+    
+    PacketList *signaturePacketList = [PacketList packetListWithPackets:@[[SignaturePacket packetWithSignature:signature]]];
+    ASCIIArmor *signatureArmor = [ASCIIArmor armorFromPacketList:signaturePacketList type:ASCIIArmorTypeSignature];
+    
+    completionBlock(signatureArmor.text);
+}
+
+
++ (void)verifyFileAtPath:(NSString *)path
+               signature:(NSString *)signature
+              publicKeys:(NSArray *)publicKeys
+         completionBlock:(void (^)(NSArray *verifiedUserIds))completionBlock
+              errorBlock:(void (^)(NSError *))errorBlock {
+    
+    if (path == nil || signature == nil || publicKeys == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP verifyFileAtPath: Neither path, signature, nor publicKeys can be nil."]);
+        return;
+    }
+    
+    Keyring *keyring = [Keyring keyring];
+    
+    [self readPublicKeyMessages:publicKeys intoKeyring:keyring];
+    
+    ASCIIArmor *signatureArmor = [ASCIIArmor armorFromText:signature];
+    PacketList *packetList = [PacketList packetListFromData:signatureArmor.content];
+    
+    NSMutableArray *signaturePackets = [NSMutableArray array];
+    NSMutableArray *verifiers = [NSMutableArray array];
+    
+    for (Packet *packet in packetList.packets) {
+        if (packet.packetType != PacketTypeSignature) {
+            continue;
+        }
+        
+        SignatureVerifier *verifier = [SignatureVerifier verifierWithSignaturePacket:(SignaturePacket *) packet];
+        
+        if (verifier != nil) {
+            [signaturePackets addObject:packet];
+            [verifiers addObject:verifier];
+        }
+    }
+    
+    if (verifiers.count < 1) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP verifyFileAtPath: No supported signatures found."]);
+        return;
+    }
+    
+    // Every signature is checked in the same pass over the file:
+    if (![self readFileAtPath:path intoContexts:verifiers]) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP verifyFileAtPath: Failed to read file."]);
+        return;
+    }
+    
+    NSMutableArray *verifiedUserIds = [NSMutableArray array];
+    
+    for (NSUInteger i = 0; i < verifiers.count; ++i) {
+        SignatureVerifier *verifier = verifiers[i];
+        SignaturePacket *signaturePacket = signaturePackets[i];
+        
+        PublicKey *publicKey = [keyring publicKeyForKeyId:signaturePacket.keyId];
+        
+        if ([verifier verifySignaturePacket:signaturePacket withPublicKey:publicKey] && publicKey.userId != nil) {
+            [verifiedUserIds addObject:publicKey.userId];
+        }
+    }
+    
+    completionBlock([NSArray arrayWithArray:verifiedUserIds]);
+}
+
+
++ (void)unlockPrivateKey:(NSString *)privateKey
+              passphrase:(NSString *)passphrase
+                 timeout:(NSTimeInterval)timeout
+         completionBlock:(void (^)(void))completionBlock
+              errorBlock:(void (^)(NSError *))errorBlock {
+    
+    if (privateKey == nil || passphrase == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP unlockPrivateKey: Neither privateKey nor passphrase can be nil."]);
+        return;
+    }
+    
+    // Freshly parsed rather than the cached copy, so the passphrase is always checked:
+    SecretKey *secretKey = [self secretKeyFromMessage:privateKey];
+    
+    if (secretKey == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP unlockPrivateKey: Failed to read private key."]);
+        return;
+    }
+    
+    NSMutableArray *secretKeys = [NSMutableArray arrayWithObject:secretKey];
+    [secretKeys addObjectsFromArray:secretKey.subkeys];
+    
+    for (SecretKey *key in secretKeys) {
+        if (![key unlockWithPassphrase:passphrase]) {
+            errorBlock([OpenPGP errorWithCause:@"OpenPGP unlockPrivateKey: Wrong passphrase."]);
+            return;
+        }
+    }
+    
+    [[KeyUnlockCache sharedCache] addSecretKey:secretKey timeout:timeout];
+    
+    completionBlock();
+}
+
+
++ (void)lockPrivateKey:(NSString *)privateKey {
+    SecretKey *secretKey = [self secretKeyFromMessage:privateKey];
+    
+    if (secretKey != nil) {
+        [[KeyUnlockCache sharedCache] lockSecretKey:secretKey];
+    }
+}
+
+
++ (void)lockAllPrivateKeys {
+    [[KeyUnlockCache sharedCache] lockAllSecretKeys];
+}
+
+
++ (void)recipientsOfMessage:(NSString *)message
+            completionBlock:(void (^)(NSArray *recipientKeyIds))completionBlock
+                 errorBlock:(void (^)(NSError *))errorBlock {
+    if (message == nil) {
+        errorBlock([OpenPGP errorWithCause:@"OpenPGP recipientsOfMessage: Message can't be nil."]);
+        return;
+    }
+    
+    NSError *error = nil;
+    MessageHeader *header = [MessageHeader headerWithArmoredMessage:message error:&error];
+    
+    if (header == nil) {
+        errorBlock(error);
+        return;
+    }
+    
+    NSMutableArray *recipientKeyIds = [NSMutableArray arrayWithCapacity:header.recipients.count];
+    
+    for (MessageRecipient *recipient in header.recipients) {
+        [recipientKeyIds addObject:[Utility hexStringFromKeyID:recipient.keyId]];
+    }
+    
+    completionBlock([NSArray arrayWithArray:recipientKeyIds]);
+}
+
+
 + (void)generateKeypairWithOptions:(NSDictionary *)options
                    completionBlock:(void(^)(NSString *publicKey, NSString *privateKey))completionBlock
                         errorBlock:(void(^)(NSError *error))errorBlock {
-    if (!options[@"bits"] || !options[@"userId"]) {
+    BOOL ed25519 = [options[@"algorithm"] isEqual:@"ed25519"];
+    
+    if ((!ed25519 && !options[@"bits"]) || !options[@"userId"]) {
         errorBlock([OpenPGP errorWithCause:@"Options needs bits and userId"]);
         return;
     }
@@ -155,13 +471,27 @@
     NSNumber *bits = options[@"bits"];
     NSString *userId = options[@"userId"];
     
-    Keypair *keypair = [Crypto generateKeypairWithBits:bits.intValue];
+    KeypairPool *keypairPool = self.keypairPool;
+    Keypair *keypair = nil;
+    
+    if (ed25519) {
+        keypair = [Crypto generateEd25519Keypair];
+    } else if (keypairPool.bits == bits.intValue) {
+        keypair = [keypairPool takeKeypair];
+    } else {
+        keypair = [Crypto generateKeypairWithBits:bits.intValue];
+    }
+    
+    // Ed25519 can't encrypt, so it gets an X25519 subkey for that:
+    Keypair *subkeypair = ed25519 ? [Crypto generateX25519Keypair] : nil;
     
     PacketList *publicKeyPacketList = [self exportPublicKey:keypair.publicKey
+                                                     subkey:subkeypair.publicKey
                                                      userId:userId
                                                signatureKey:keypair.secretKey];
     
     PacketList *secretKeyPacketList = [self exportSecretKey:keypair.secretKey
+                                                     subkey:subkeypair.secretKey
                                                      userId:userId];
     
     ASCIIArmor *publicKeyArmor = [ASCIIArmor armorFromPacketList:publicKeyPacketList type:ASCIIArmorTypePublicKey];
@@ -174,26 +504,190 @@
 }
 
 
+#pragma mark - Asynchronous
+
++ (ScheduledOperation *)decryptAndVerifyMessage:(NSString *)message
+                                     privateKey:(NSString *)privateKey
+                                     publicKeys:(NSArray *)publicKeys
+                                completionQueue:(dispatch_queue_t)completionQueue
+                                completionBlock:(void (^)(NSString *decryptedMessage, NSArray *verifiedUserIds))completionBlock
+                                     errorBlock:(void (^)(NSError *))errorBlock {
+    
+    return [self scheduleOnLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:errorBlock block:^(ScheduledOperation *operation) {
+        [self decryptAndVerifyMessage:message privateKey:privateKey publicKeys:publicKeys completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+            [operation finishWithBlock:^{
+                completionBlock(decryptedMessage, verifiedUserIds);
+            }];
+        } errorBlock:^(NSError *error) {
+            [operation failWithError:error];
+        }];
+    }];
+}
+
++ (ScheduledOperation *)signAndEncryptMessage:(NSString *)message
+                                   privateKey:(NSString *)privateKey
+                                   publicKeys:(NSArray *)publicKeys
+                              completionQueue:(dispatch_queue_t)completionQueue
+                              completionBlock:(void (^)(NSString *encryptedMessage))completionBlock
+                                   errorBlock:(void (^)(NSError *))errorBlock {
+    
+    return [self scheduleOnLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:errorBlock block:^(ScheduledOperation *operation) {
+        [self signAndEncryptMessage:message privateKey:privateKey publicKeys:publicKeys completionBlock:^(NSString *encryptedMessage) {
+            [operation finishWithBlock:^{
+                completionBlock(encryptedMessage);
+            }];
+        } errorBlock:^(NSError *error) {
+            [operation failWithError:error];
+        }];
+    }];
+}
+
++ (ScheduledOperation *)signFileAtPath:(NSString *)path
+                            privateKey:(NSString *)privateKey
+                       completionQueue:(dispatch_queue_t)completionQueue
+                       completionBlock:(void (^)(NSString *signature))completionBlock
+                            errorBlock:(void (^)(NSError *))errorBlock {
+    
+    return [self scheduleOnLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:errorBlock block:^(ScheduledOperation *operation) {
+        [self signFileAtPath:path privateKey:privateKey completionBlock:^(NSString *signature) {
+            [operation finishWithBlock:^{
+                completionBlock(signature);
+            }];
+        } errorBlock:^(NSError *error) {
+            [operation failWithError:error];
+        }];
+    }];
+}
+
++ (ScheduledOperation *)verifyFileAtPath:(NSString *)path
+                               signature:(NSString *)signature
+                              publicKeys:(NSArray *)publicKeys
+                         completionQueue:(dispatch_queue_t)completionQueue
+                         completionBlock:(void (^)(NSArray *verifiedUserIds))completionBlock
+                              errorBlock:(void (^)(NSError *))errorBlock {
+    
+    return [self scheduleOnLane:OperationLaneCheap completionQueue:completionQueue errorBlock:errorBlock block:^(ScheduledOperation *operation) {
+        [self verifyFileAtPath:path signature:signature publicKeys:publicKeys completionBlock:^(NSArray *verifiedUserIds) {
+            [operation finishWithBlock:^{
+                completionBlock(verifiedUserIds);
+            }];
+        } errorBlock:^(NSError *error) {
+            [operation failWithError:error];
+        }];
+    }];
+}
+
++ (ScheduledOperation *)unlockPrivateKey:(NSString *)privateKey
+                              passphrase:(NSString *)passphrase
+                                 timeout:(NSTimeInterval)timeout
+                         completionQueue:(dispatch_queue_t)completionQueue
+                         completionBlock:(void (^)(void))completionBlock
+                              errorBlock:(void (^)(NSError *))errorBlock {
+    
+    // String-to-key is slow on purpose, so this goes with the private key operations:
+    return [self scheduleOnLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:errorBlock block:^(ScheduledOperation *operation) {
+        [self unlockPrivateKey:privateKey passphrase:passphrase timeout:timeout completionBlock:^{
+            [operation finishWithBlock:completionBlock];
+        } errorBlock:^(NSError *error) {
+            [operation failWithError:error];
+        }];
+    }];
+}
+
++ (ScheduledOperation *)recipientsOfMessage:(NSString *)message
+                            completionQueue:(dispatch_queue_t)completionQueue
+                            completionBlock:(void (^)(NSArray *recipientKeyIds))completionBlock
+                                 errorBlock:(void (^)(NSError *))errorBlock {
+    
+    return [self scheduleOnLane:OperationLaneCheap completionQueue:completionQueue errorBlock:errorBlock block:^(ScheduledOperation *operation) {
+        [self recipientsOfMessage:message completionBlock:^(NSArray *recipientKeyIds) {
+            [operation finishWithBlock:^{
+                completionBlock(recipientKeyIds);
+            }];
+        } errorBlock:^(NSError *error) {
+            [operation failWithError:error];
+        }];
+    }];
+}
+
++ (ScheduledOperation *)generateKeypairWithOptions:(NSDictionary *)options
+                                   completionQueue:(dispatch_queue_t)completionQueue
+                                   completionBlock:(void(^)(NSString *publicKey, NSString *privateKey))completionBlock
+                                        errorBlock:(void(^)(NSError *error))errorBlock {
+    
+    return [self scheduleOnLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:errorBlock block:^(ScheduledOperation *operation) {
+        [self generateKeypairWithOptions:options completionBlock:^(NSString *publicKey, NSString *privateKey) {
+            [operation finishWithBlock:^{
+                completionBlock(publicKey, privateKey);
+            }];
+        } errorBlock:^(NSError *error) {
+            [operation failWithError:error];
+        }];
+    }];
+}
+
+
 #pragma mark - Private
 
-+ (PacketList *)exportPublicKey:(PublicKey *)publicKey userId:(NSString *)userId signatureKey:(SecretKey *)signatureKey {
++ (ScheduledOperation *)scheduleOnLane:(OperationLane)lane
+                       completionQueue:(dispatch_queue_t)completionQueue
+                            errorBlock:(void (^)(NSError *))errorBlock
+                                 block:(void (^)(ScheduledOperation *operation))block {
+    
+    ScheduledOperation *operation = [[OperationScheduler sharedScheduler] addOperationToLane:lane
+                                                                             completionQueue:completionQueue
+                                                                                  errorBlock:errorBlock
+                                                                                       block:block];
+    
+    if (operation == nil) {
+        dispatch_async(completionQueue ?: dispatch_get_main_queue(), ^{
+            errorBlock([OpenPGP errorWithCause:@"OpenPGP: Too many operations are queued, try again later."]);
+        });
+    }
+    
+    return operation;
+}
+
++ (PacketList *)exportPublicKey:(PublicKey *)publicKey
+                         subkey:(PublicKey *)subkey
+                         userId:(NSString *)userId
+                   signatureKey:(SecretKey *)signatureKey {
+    
     KeyPacket *publicKeyPacket = [KeyPacket packetWithPublicKey:publicKey];
     UserIDPacket *userIdPacket = [UserIDPacket packetWithUserId:userId];
     
     Signature *signature = [Signature signatureForKeyPacket:publicKeyPacket userIdPacket:userIdPacket signatureKey:signatureKey];
     SignaturePacket *signaturePacket = [SignaturePacket packetWithSignature:signature];
     
-    return [PacketList packetListWithPackets:@[publicKeyPacket, userIdPacket, signaturePacket]];
+    if (subkey == nil) {
+        return [PacketList packetListWithPackets:@[publicKeyPacket, userIdPacket, signaturePacket]];
+    }
+    
+    KeyPacket *subkeyPacket = [KeyPacket packetWithPublicSubkey:subkey];
+    
+    Signature *bindingSignature = [Signature signatureForSubkey:subkey signatureKey:signatureKey];
+    SignaturePacket *bindingSignaturePacket = [SignaturePacket packetWithSignature:bindingSignature];
+    
+    return [PacketList packetListWithPackets:@[publicKeyPacket, userIdPacket, signaturePacket, subkeyPacket, bindingSignaturePacket]];
 }
 
-+ (PacketList *)exportSecretKey:(SecretKey *)secretKey userId:(NSString *)userId {
++ (PacketList *)exportSecretKey:(SecretKey *)secretKey subkey:(SecretKey *)subkey userId:(NSString *)userId {
     KeyPacket *secretKeyPacket = [KeyPacket packetWithSecretKey:secretKey];
     UserIDPacket *userIdPacket = [UserIDPacket packetWithUserId:userId];
     
     Signature *signature = [Signature signatureForKeyPacket:secretKeyPacket userIdPacket:userIdPacket signatureKey:secretKey];
     SignaturePacket *signaturePacket = [SignaturePacket packetWithSignature:signature];
     
-    return [PacketList packetListWithPackets:@[secretKeyPacket, userIdPacket, signaturePacket]];
+    if (subkey == nil) {
+        return [PacketList packetListWithPackets:@[secretKeyPacket, userIdPacket, signaturePacket]];
+    }
+    
+    KeyPacket *subkeyPacket = [KeyPacket packetWithSecretSubkey:subkey];
+    
+    Signature *bindingSignature = [Signature signatureForSubkey:subkey.publicKey signatureKey:secretKey];
+    SignaturePacket *bindingSignaturePacket = [SignaturePacket packetWithSignature:bindingSignature];
+    
+    return [PacketList packetListWithPackets:@[secretKeyPacket, userIdPacket, signaturePacket, subkeyPacket, bindingSignaturePacket]];
 }
 
 + (void)readPublicKeyMessages:(NSArray *)publicKeyMessages intoKeyring:(Keyring *)keyring {
@@ -264,15 +758,28 @@
     if (publicSubkey) {
         [publicKey addSubkey:publicSubkey];
         publicSubkey.userId = userId;
-        
-        [keyring addPublicKey:publicSubkey forUserId:userId];
     }
     
     // TODO: Verify key.
     [keyring addPublicKey:publicKey forUserId:userId];
 }
 
-+ (void)readSecretKeyMessage:(NSString *)secretKeyMessage intoKeyring:(Keyring *)keyring {
++ (SecretKey *)readSecretKeyMessage:(NSString *)secretKeyMessage intoKeyring:(Keyring *)keyring {
+    SecretKey *secretKey = [self secretKeyFromMessage:secretKeyMessage];
+    
+    // A key unlocked earlier stands in for its locked packets, subkeys included:
+    if (secretKey.isLocked) {
+        secretKey = [[KeyUnlockCache sharedCache] unlockedKeyForSecretKey:secretKey] ?: secretKey;
+    }
+    
+    // TODO: Verify key.
+    
+    [keyring addSecretKey:secretKey forUserId:secretKey.userId];
+    
+    return secretKey;
+}
+
++ (SecretKey *)secretKeyFromMessage:(NSString *)secretKeyMessage {
     
     ASCIIArmor *armor = [ASCIIArmor armorFromText:secretKeyMessage];
     PacketList *packetList = [PacketList packetListFromData:armor.content];
@@ -318,12 +825,112 @@
         secretSubkey.userId = userId;
     }
     
-    // TODO: Verify key.
+    return secretKey;
+}
+
++ (BOOL)isSecretKeyLocked:(SecretKey *)secretKey {
+    if (secretKey.isLocked) {
+        return YES;
+    }
     
-    [keyring addSecretKey:secretKey forUserId:userId];
+    for (SecretKey *subkey in secretKey.subkeys) {
+        if (subkey.isLocked) {
+            return YES;
+        }
+    }
+    
+    return NO;
 }
 
 
++ (NSString *)decryptAndVerifyMessage:(id)message
+                          withKeyring:(Keyring *)keyring
+                      verifiedUserIds:(NSArray **)verifiedUserIds
+                                error:(NSError **)error {
+    
+    // Binary messages skip the armor:
+    NSData *content = [message isKindOfClass:[NSData class]] ? message : [ASCIIArmor armorFromText:message].content;
+    PacketList *packetList = [PacketList packetListFromData:content error:NULL];
+    
+    if (packetList == nil) {
+        *error = [OpenPGP errorWithCause:@"OpenPGP decryptAndVerifyMessage: Message packets are malformed or not supported."];
+        return nil;
+    }
+    
+    PacketList *decryptedPacketList =  [self decryptPacketList:packetList withKeyring:keyring];
+    
+    if (decryptedPacketList == nil) {
+        *error = [OpenPGP errorWithCause:@"OpenPGP decryptAndVerifyMessage: Failed to decrypt message."];
+        return nil;
+    }
+    
+    LiteralDataPacket *literalDataPacket = nil;
+    
+    // One-pass signatures bracket the literal data, the last one opened is the first one closed:
+    NSMutableArray *verifiers = [NSMutableArray array];
+    NSMutableArray *userIds = [NSMutableArray array];
+    
+    for (Packet *packet in decryptedPacketList.packets) {
+        switch (packet.packetType) {
+            case PacketTypeOnePassSig: {
+                SignatureVerifier *verifier = [SignatureVerifier verifierWithOnePassSignaturePacket:(OnePassSignaturePacket *) packet];
+                
+                if (verifier != nil) {
+                    [verifiers addObject:verifier];
+                } else {
+                    [verifiers addObject:[NSNull null]];
+                }
+                
+                break;
+            }
+            
+            case PacketTypeLiteralData: {
+                literalDataPacket = (LiteralDataPacket *) packet;
+                
+                for (SignatureVerifier *verifier in verifiers) {
+                    if (verifier != (id) [NSNull null]) {
+                        [verifier updateWithData:literalDataPacket.literalData];
+                    }
+                }
+                
+                break;
+            }
+            
+            case PacketTypeSignature: {
+                SignatureVerifier *verifier = verifiers.lastObject;
+                
+                if (verifier == nil) {
+                    break;
+                }
+                
+                [verifiers removeLastObject];
+                
+                SignaturePacket *signaturePacket = (SignaturePacket *) packet;
+                PublicKey *publicKey = [keyring publicKeyForKeyId:signaturePacket.keyId];
+                
+                if (verifier != (id) [NSNull null]
+                    && [verifier verifySignaturePacket:signaturePacket withPublicKey:publicKey]
+                    && publicKey.userId != nil) {
+                    [userIds addObject:publicKey.userId];
+                }
+                
+                break;
+            }
+            
+            default:
+                break;
+        }
+    }
+    
+    *verifiedUserIds = [NSArray arrayWithArray:userIds];
+    
+    PGP_STAGE_BEGIN(PGP_STAGE_TEXT);
+    NSString *decryptedMessage = [[NSString alloc] initWithData:literalDataPacket.literalData encoding:NSUTF8StringEncoding];
+    PGP_STAGE_END(PGP_STAGE_TEXT, literalDataPacket.literalData.length);
+    
+    return decryptedMessage;
+}
+
 + (PacketList *)decryptPacketList:(PacketList *)packetList withKeyring:(Keyring *)keyring {
     NSMutableArray *sessionKeyPackets = [NSMutableArray array];
     
@@ -349,47 +956,70 @@
         }
     }
     
-    SecretKey *decryptionKey = nil;
-    PKESKeyPacket *keyPacket = nil;
+    if (dataPacket == nil) {
+        return nil;
+    }
+    
+    // A message opened before skips the private key operation:
+    SessionKeyCache *sessionKeyCache = [self sessionKeyCache];
+    NSData *sessionKey = [sessionKeyCache sessionKeyForPackets:sessionKeyPackets keyring:keyring symmetricAlgorithm:NULL];
+    
+    PKESKeyPacket *sessionKeyPacket = nil;
+    KeyID keyId = 0;
+    
+    NSMutableArray *wildcardPackets = [NSMutableArray array];
     
     for (PKESKeyPacket *packet in sessionKeyPackets) {
-        decryptionKey = [keyring secretKeyForKeyId:packet.keyId];
+        if (sessionKey != nil) {
+            break;
+        }
+        
+        if (packet.keyId == 0) {
+            [wildcardPackets addObject:packet];
+            continue;
+        }
+        
+        SecretKey *decryptionKey = [keyring secretKeyForKeyId:packet.keyId];
         
         if (decryptionKey != nil) {
-            keyPacket = packet;
-            break;
+            sessionKey = [packet sessionKeyWithSecretKey:decryptionKey];
+            sessionKeyPacket = packet;
+            keyId = packet.keyId;
         }
     }
     
-    if (decryptionKey == nil) {
-        return nil;
+    // Hidden recipients don't say which key they're for, every secret key has to be tried:
+    if (sessionKey == nil && wildcardPackets.count > 0) {
+        sessionKey = [self trialDecryptSessionKeyPackets:wildcardPackets
+                                          withSecretKeys:keyring.secretKeys
+                                              dataPacket:dataPacket
+                                        sessionKeyPacket:&sessionKeyPacket
+                                                   keyId:&keyId];
     }
     
-    NSData *message = [Crypto decryptMessage:keyPacket.encryptedM withSecretKey:decryptionKey];
-    
-    const Byte *bytes = message.bytes;
-    
-    SymmetricAlgorithm symmetricAlgorithm = bytes[0];
-    
-    if (symmetricAlgorithm != SymmetricAlgorithmAES256) {
-        @throw [NSException exceptionWithName:NSInternalInconsistencyException
-                                       reason:@"Unsupported symmetric algorithm."
-                                     userInfo:@{@"symmetricAlgorithm": @(symmetricAlgorithm)}];
+    if (sessionKey == nil) {
+        return nil;
     }
     
-//    NSUInteger checksum = [Utility readNumber:bytes + currentIndex length:2];
-//    currentIndex += 2;
-    
-    // TODO: CHECK CHECKSUM.
-    
-    const Byte *sessionKey = bytes + 1;
-    NSData *decryptedData = [Crypto decryptData:dataPacket.encryptedData withSymmetricKey:sessionKey];
+    if (sessionKeyPacket != nil) {
+        [sessionKeyCache setSessionKey:sessionKey
+                    symmetricAlgorithm:SymmetricAlgorithmAES256
+                             forPacket:sessionKeyPacket
+                                 keyId:keyId];
+    }
+
+    NSData *decryptedData = [Crypto decryptData:dataPacket.encryptedData withSymmetricKey:sessionKey.bytes];
     
     if (((Packet *)dataPacket).packetType == PacketTypeSEIPData) {
         
         NSUInteger sz_pre = kCCBlockSizeAES128 + 2;
         NSUInteger sz_mdc_hash = 20; // SHA1
         NSUInteger sz_mdc = 2 + sz_mdc_hash;
+        
+        if (decryptedData.length < sz_pre + sz_mdc) {
+            return nil;
+        }
+        
         NSUInteger sz_plaintext =  decryptedData.length - sz_pre - sz_mdc;
         
         // TODO: Verify plaintext integrity.
@@ -397,7 +1027,117 @@
         decryptedData = [decryptedData subdataWithRange:NSMakeRange(sz_pre, sz_plaintext)];
     }
     
-    return [PacketList packetListFromData:decryptedData];
+    return [PacketList packetListFromData:decryptedData error:NULL];
+}
+
++ (NSData *)trialDecryptSessionKeyPackets:(NSArray *)sessionKeyPackets
+                          withSecretKeys:(NSArray *)secretKeys
+                              dataPacket:(id<EncryptedDataPacket>)dataPacket
+                        sessionKeyPacket:(PKESKeyPacket **)sessionKeyPacket
+                                   keyId:(KeyID *)keyId {
+    NSMutableArray *packets = [NSMutableArray array];
+    NSMutableArray *keys = [NSMutableArray array];
+    
+    for (PKESKeyPacket *packet in sessionKeyPackets) {
+        BOOL ecdh = packet.publicKeyAlgorithm == PublicKeyAlgorithmECDH;
+        
+        for (SecretKey *secretKey in secretKeys) {
+            PublicKeyAlgorithm algorithm = secretKey.publicKey.publicKeyAlgorithm;
+            
+            if (ecdh ? algorithm == PublicKeyAlgorithmECDH : (algorithm == PublicKeyAlgorithmRSAEncryptSign || algorithm == PublicKeyAlgorithmRSAEncrypt)) {
+                [packets addObject:packet];
+                [keys addObject:secretKey];
+            }
+        }
+    }
+    
+    // The session key checksum lets one wrong key in 65536 through, the integrity protected
+    // prefix catches those without decrypting the rest:
+    BOOL quickCheck = ((Packet *) dataPacket).packetType == PacketTypeSEIPData;
+    NSData *encryptedData = dataPacket.encryptedData;
+    
+    NSObject *lock = [[NSObject alloc] init];
+    __block NSData *sessionKey = nil;
+    __block NSUInteger sessionKeyIndex = NSNotFound;
+    
+    // Every attempt is a private key operation, so they're spread across cores, and any that
+    // haven't started yet are skipped once one of them succeeds:
+    dispatch_apply(packets.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        @synchronized (lock) {
+            if (sessionKey != nil) {
+                return;
+            }
+        }
+        
+        @autoreleasepool {
+            NSData *candidate = [packets[i] sessionKeyWithSecretKey:keys[i]];
+            
+            if (candidate == nil || (quickCheck && ![Crypto quickCheckData:encryptedData withSymmetricKey:candidate.bytes])) {
+                return;
+            }
+            
+            @synchronized (lock) {
+                if (sessionKey == nil) {
+                    sessionKey = candidate;
+                    sessionKeyIndex = i;
+                }
+            }
+        }
+    });
+    
+    if (sessionKey != nil) {
+        *sessionKeyPacket = packets[sessionKeyIndex];
+        *keyId = ((SecretKey *) keys[sessionKeyIndex]).publicKey.keyID;
+    }
+    
+    return sessionKey;
+}
+
++ (BOOL)readFileAtPath:(NSString *)path intoContexts:(NSArray *)contexts {
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    
+    if (fd < 0) {
+        return NO;
+    }
+    
+    struct stat fileStat;
+    
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return NO;
+    }
+    
+    size_t length = (size_t) fileStat.st_size;
+    
+    // Nothing to map, the signature is over the empty string:
+    if (length == 0) {
+        close(fd);
+        return YES;
+    }
+    
+    void *bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    
+    if (bytes == MAP_FAILED) {
+        return NO;
+    }
+    
+    madvise(bytes, length, MADV_SEQUENTIAL);
+    
+    // Every context sees a chunk while it's still in cache:
+    const size_t chunkLength = 1 << 20;
+    
+    for (size_t offset = 0; offset < length; offset += chunkLength) {
+        size_t currentLength = MIN(chunkLength, length - offset);
+        
+        for (SignatureContext *context in contexts) {
+            [context updateWithBytes:(const Byte *) bytes + offset length:currentLength];
+        }
+    }
+    
+    munmap(bytes, length);
+    
+    return YES;
 }
 
 + (NSError *)errorWithCause:(NSString *)cause {
@@ -0,0 +1,1061 @@
+//
+//  OpenPGPCore.c
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#include <string.h>
+#include <openssl/aes.h>
+#include <openssl/cast.h>
+#include <openssl/md5.h>
+#include <openssl/ripemd.h>
+#include <openssl/sha.h>
+#include "OpenPGPCore.h"
+
+#define PGP_CRC24_POLY 0x1864CFB
+#define PGP_BASE64_INVALID 0xFF
+
+static const char pgp_base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Numbers:
+
+uint64_t pgp_read_number(const uint8_t *bytes, size_t length) {
+    uint64_t number = 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        number = (number << 8) | bytes[i];
+    }
+    
+    return number;
+}
+
+void pgp_write_number(uint8_t *bytes, uint64_t number, size_t length) {
+    for (size_t i = length; i > 0; i--) {
+        bytes[i - 1] = number & 0xFF;
+        number >>= 8;
+    }
+}
+
+// Armor:
+
+uint32_t pgp_crc24(uint32_t crc, const uint8_t *bytes, size_t length) {
+    while (length--) {
+        crc ^= (uint32_t) (*bytes++) << 16;
+        
+        for (int i = 0; i < 8; i++) {
+            crc <<= 1;
+            
+            if (crc & 0x1000000) {
+                crc ^= PGP_CRC24_POLY;
+            }
+        }
+    }
+    
+    return crc & 0xFFFFFF;
+}
+
+size_t pgp_base64_encoded_length(size_t length, size_t lineLength) {
+    size_t characters = (length + 2) / 3 * 4;
+    
+    if (lineLength == 0 || characters == 0) {
+        return characters;
+    }
+    
+    return characters + (characters - 1) / lineLength * 2;
+}
+
+size_t pgp_base64_encode(char *output, const uint8_t *bytes, size_t length, size_t lineLength) {
+    char *start = output;
+    size_t lineCharacters = 0;
+    
+    for (size_t i = 0; i < length; i += 3) {
+        if (lineLength != 0 && lineCharacters == lineLength) {
+            *output++ = '\r';
+            *output++ = '\n';
+            lineCharacters = 0;
+        }
+        
+        size_t remaining = length - i;
+        uint32_t group = (uint32_t) bytes[i] << 16;
+        
+        if (remaining > 1) {
+            group |= (uint32_t) bytes[i + 1] << 8;
+        }
+        
+        if (remaining > 2) {
+            group |= bytes[i + 2];
+        }
+        
+        output[0] = pgp_base64_alphabet[(group >> 18) & 0x3F];
+        output[1] = pgp_base64_alphabet[(group >> 12) & 0x3F];
+        output[2] = remaining > 1 ? pgp_base64_alphabet[(group >> 6) & 0x3F] : '=';
+        output[3] = remaining > 2 ? pgp_base64_alphabet[group & 0x3F] : '=';
+        
+        output += 4;
+        lineCharacters += 4;
+    }
+    
+    return output - start;
+}
+
+static uint8_t pgp_base64_value(char character) {
+    if (character >= 'A' && character <= 'Z') {
+        return character - 'A';
+    } else if (character >= 'a' && character <= 'z') {
+        return character - 'a' + 26;
+    } else if (character >= '0' && character <= '9') {
+        return character - '0' + 52;
+    } else if (character == '+') {
+        return 62;
+    } else if (character == '/') {
+        return 63;
+    }
+    
+    return PGP_BASE64_INVALID;
+}
+
+static int pgp_is_whitespace(char character) {
+    return character == ' ' || character == '\t' || character == '\r' || character == '\n';
+}
+
+pgp_status pgp_base64_decode(uint8_t *output, size_t *outputLength, const char *text, size_t length) {
+    uint32_t group = 0;
+    size_t groupCharacters = 0;
+    size_t written = 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        char character = text[i];
+        
+        if (pgp_is_whitespace(character)) {
+            continue;
+        }
+        
+        if (character == '=') {
+            break;
+        }
+        
+        uint8_t value = pgp_base64_value(character);
+        
+        if (value == PGP_BASE64_INVALID) {
+            return PGP_ERROR_MALFORMED;
+        }
+        
+        group = (group << 6) | value;
+        
+        if (++groupCharacters == 4) {
+            output[written++] = (group >> 16) & 0xFF;
+            output[written++] = (group >> 8) & 0xFF;
+            output[written++] = group & 0xFF;
+            
+            group = 0;
+            groupCharacters = 0;
+        }
+    }
+    
+    // A padded final group, one character can't make a byte:
+    if (groupCharacters == 1) {
+        return PGP_ERROR_MALFORMED;
+    } else if (groupCharacters == 2) {
+        output[written++] = (group >> 4) & 0xFF;
+    } else if (groupCharacters == 3) {
+        output[written++] = (group >> 10) & 0xFF;
+        output[written++] = (group >> 2) & 0xFF;
+    }
+    
+    *outputLength = written;
+    
+    return PGP_OK;
+}
+
+pgp_status pgp_base64_decode_groups(uint8_t *output, size_t *outputLength, const char *text, size_t length, size_t *consumed) {
+    uint32_t group = 0;
+    size_t groupCharacters = 0;
+    size_t groupsEnd = 0;
+    size_t written = 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        char character = text[i];
+        
+        if (pgp_is_whitespace(character)) {
+            if (groupCharacters == 0) {
+                groupsEnd = i + 1;
+            }
+            
+            continue;
+        }
+        
+        if (character == '=') {
+            break;
+        }
+        
+        uint8_t value = pgp_base64_value(character);
+        
+        if (value == PGP_BASE64_INVALID) {
+            return PGP_ERROR_MALFORMED;
+        }
+        
+        group = (group << 6) | value;
+        
+        if (++groupCharacters == 4) {
+            output[written++] = (group >> 16) & 0xFF;
+            output[written++] = (group >> 8) & 0xFF;
+            output[written++] = group & 0xFF;
+            
+            group = 0;
+            groupCharacters = 0;
+            groupsEnd = i + 1;
+        }
+    }
+    
+    *outputLength = written;
+    *consumed = groupsEnd;
+    
+    return PGP_OK;
+}
+
+/// The line starting at offset without its line break, returns where the next line starts:
+static size_t pgp_next_line(const char *text, size_t length, size_t offset, size_t *lineLength) {
+    size_t end = offset;
+    
+    while (end < length && text[end] != '\n') {
+        end++;
+    }
+    
+    size_t next = end < length ? end + 1 : end;
+    
+    while (end > offset && pgp_is_whitespace(text[end - 1])) {
+        end--;
+    }
+    
+    *lineLength = end - offset;
+    
+    return next;
+}
+
+static int pgp_has_prefix(const char *text, size_t length, const char *prefix) {
+    size_t prefixLength = strlen(prefix);
+    
+    return length >= prefixLength && memcmp(text, prefix, prefixLength) == 0;
+}
+
+pgp_status pgp_armor_parse(const char *text, size_t length, pgp_armor *armor) {
+    memset(armor, 0, sizeof(pgp_armor));
+    
+    size_t offset = 0;
+    size_t lineLength = 0;
+    size_t next = 0;
+    
+    // Anything before the armor header line is ignored:
+    for (;;) {
+        if (offset >= length) {
+            return PGP_ERROR_MALFORMED;
+        }
+        
+        next = pgp_next_line(text, length, offset, &lineLength);
+        
+        if (pgp_has_prefix(text + offset, lineLength, "-----BEGIN ")) {
+            break;
+        }
+        
+        offset = next;
+    }
+    
+    if (lineLength < 16 || memcmp(text + offset + lineLength - 5, "-----", 5) != 0) {
+        return PGP_ERROR_MALFORMED;
+    }
+    
+    armor->labelOffset = offset + 11;
+    armor->labelLength = lineLength - 16;
+    
+    // Headers run to a blank line. A line without a colon means there were none and no blank line either:
+    offset = next;
+    armor->headersOffset = offset;
+    
+    while (offset < length) {
+        next = pgp_next_line(text, length, offset, &lineLength);
+        
+        if (lineLength == 0) {
+            armor->headersLength = offset - armor->headersOffset;
+            offset = next;
+            break;
+        }
+        
+        if (memchr(text + offset, ':', lineLength) == NULL) {
+            armor->headersLength = offset - armor->headersOffset;
+            break;
+        }
+        
+        offset = next;
+    }
+    
+    // Content runs to the checksum or the footer:
+    armor->contentOffset = offset;
+    
+    for (;;) {
+        if (offset >= length) {
+            armor->contentLength = length - armor->contentOffset;
+            return PGP_ERROR_TRUNCATED;
+        }
+        
+        next = pgp_next_line(text, length, offset, &lineLength);
+        
+        if (pgp_has_prefix(text + offset, lineLength, "-----END ")) {
+            armor->contentLength = offset - armor->contentOffset;
+            return PGP_OK;
+        }
+        
+        if (lineLength > 0 && text[offset] == '=') {
+            armor->contentLength = offset - armor->contentOffset;
+            
+            uint8_t checksum[3];
+            size_t checksumLength = 0;
+            
+            // Exactly four characters, anything longer would decode past the buffer:
+            if (lineLength - 1 != 4) {
+                return PGP_ERROR_MALFORMED;
+            }
+            
+            if (pgp_base64_decode(checksum, &checksumLength, text + offset + 1, lineLength - 1) != PGP_OK || checksumLength != 3) {
+                return PGP_ERROR_MALFORMED;
+            }
+            
+            armor->hasChecksum = 1;
+            armor->checksum = (uint32_t) pgp_read_number(checksum, 3);
+            
+            return PGP_OK;
+        }
+        
+        offset = next;
+    }
+}
+
+pgp_status pgp_armor_decode(const char *text, const pgp_armor *armor, uint8_t *output, size_t *outputLength) {
+    pgp_status status = pgp_base64_decode(output, outputLength, text + armor->contentOffset, armor->contentLength);
+    
+    if (status != PGP_OK) {
+        return status;
+    }
+    
+    if (armor->hasChecksum && pgp_crc24(PGP_CRC24_INIT, output, *outputLength) != armor->checksum) {
+        return PGP_ERROR_CHECKSUM;
+    }
+    
+    return PGP_OK;
+}
+
+// Packets:
+
+/// A new format body length at offset. Partial lengths are flagged rather than returned:
+static pgp_status pgp_read_body_length(const uint8_t *bytes, size_t length, size_t *offset, size_t *bodyLength, int *partial) {
+    if (*offset >= length) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    uint8_t firstOctet = bytes[*offset];
+    *partial = 0;
+    
+    if (firstOctet < 192) {
+        *bodyLength = firstOctet;
+        *offset += 1;
+    } else if (firstOctet < 224) {
+        if (*offset + 2 > length) {
+            return PGP_ERROR_TRUNCATED;
+        }
+        
+        *bodyLength = ((size_t) (firstOctet - 192) << 8) + bytes[*offset + 1] + 192;
+        *offset += 2;
+    } else if (firstOctet < 255) {
+        *bodyLength = (size_t) 1 << (firstOctet & 0x1F);
+        *partial = 1;
+        *offset += 1;
+    } else {
+        if (*offset + 5 > length) {
+            return PGP_ERROR_TRUNCATED;
+        }
+        
+        *bodyLength = (size_t) pgp_read_number(bytes + *offset + 1, 4);
+        *offset += 5;
+    }
+    
+    return PGP_OK;
+}
+
+pgp_status pgp_packet_read_header(const uint8_t *bytes, size_t length, size_t offset, pgp_packet *packet) {
+    memset(packet, 0, sizeof(pgp_packet));
+    
+    if (offset >= length) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    uint8_t tag = bytes[offset];
+    
+    if (!(tag & 0x80)) {
+        return PGP_ERROR_MALFORMED;
+    }
+    
+    size_t index = offset + 1;
+    
+    if (tag & 0x40) {
+        packet->tag = tag & 0x3F;
+        
+        pgp_status status = pgp_read_body_length(bytes, length, &index, &packet->bodyLength, &packet->partial);
+        
+        if (status != PGP_OK) {
+            return status;
+        }
+    } else {
+        packet->tag = (tag >> 2) & 0x0F;
+        
+        size_t lengthOctets = 0;
+        
+        switch (tag & 0x03) {
+            case 0:
+                lengthOctets = 1;
+                break;
+            
+            case 1:
+                lengthOctets = 2;
+                break;
+            
+            case 2:
+                lengthOctets = 4;
+                break;
+            
+            default:
+                packet->indeterminate = 1;
+                break;
+        }
+        
+        if (index + lengthOctets > length) {
+            return PGP_ERROR_TRUNCATED;
+        }
+        
+        packet->bodyLength = packet->indeterminate ? length - index : (size_t) pgp_read_number(bytes + index, lengthOctets);
+        index += lengthOctets;
+    }
+    
+    packet->bodyOffset = index;
+    
+    return PGP_OK;
+}
+
+pgp_status pgp_packet_next(const uint8_t *bytes, size_t length, size_t offset, pgp_packet *packet) {
+    pgp_status status = pgp_packet_read_header(bytes, length, offset, packet);
+    
+    if (status != PGP_OK) {
+        return status;
+    }
+    
+    size_t index = packet->bodyOffset;
+    size_t chunkLength = packet->bodyLength;
+    int partial = packet->partial;
+    
+    packet->firstChunkLength = chunkLength;
+    packet->bodyLength = 0;
+    
+    // Every chunk but the last is followed by another length:
+    for (;;) {
+        if (chunkLength > length - index) {
+            return PGP_ERROR_TRUNCATED;
+        }
+        
+        index += chunkLength;
+        packet->bodyLength += chunkLength;
+        
+        if (!partial) {
+            break;
+        }
+        
+        status = pgp_read_body_length(bytes, length, &index, &chunkLength, &partial);
+        
+        if (status != PGP_OK) {
+            return status;
+        }
+    }
+    
+    packet->end = index;
+    
+    return PGP_OK;
+}
+
+void pgp_packet_copy_body(const uint8_t *bytes, const pgp_packet *packet, uint8_t *output) {
+    size_t index = packet->bodyOffset;
+    size_t chunkLength = packet->partial ? packet->firstChunkLength : packet->bodyLength;
+    size_t copied = 0;
+    int partial = packet->partial;
+    
+    // Already walked by pgp_packet_next, so the chunk lengths are known to be in bounds:
+    for (;;) {
+        memcpy(output + copied, bytes + index, chunkLength);
+        copied += chunkLength;
+        index += chunkLength;
+        
+        if (!partial) {
+            break;
+        }
+        
+        pgp_read_body_length(bytes, packet->end, &index, &chunkLength, &partial);
+    }
+}
+
+size_t pgp_packet_write_header(uint8_t output[PGP_PACKET_MAX_HEADER_LENGTH], unsigned tag, size_t bodyLength) {
+    
+    // The "always set" and "new format" bits:
+    output[0] = 0x80 | 0x40 | (tag & 0x3F);
+    
+    if (bodyLength <= 191) {
+        output[1] = bodyLength & 0xFF;
+        return 2;
+    } else if (bodyLength <= 8383) {
+        output[1] = (((bodyLength - 192) >> 8) & 0xFF) + 192;
+        output[2] = (bodyLength - 192) & 0xFF;
+        return 3;
+    }
+    
+    output[1] = 0xFF;
+    pgp_write_number(output + 2, bodyLength, 4);
+    
+    return 6;
+}
+
+// MPIs:
+
+pgp_status pgp_mpi_read(const uint8_t *bytes, size_t length, size_t offset, size_t *mpiLength) {
+    if (offset > length || length - offset < 2) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    size_t bitCount = (size_t) pgp_read_number(bytes + offset, 2);
+    size_t byteCount = (bitCount + 7) / 8;
+    
+    if (byteCount > length - offset - 2) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    *mpiLength = byteCount + 2;
+    
+    return PGP_OK;
+}
+
+size_t pgp_mpi_write(uint8_t *output, const uint8_t *magnitude, size_t length) {
+    
+    // The wire form has no leading zero bytes and counts bits from the top set one:
+    while (length > 0 && magnitude[0] == 0) {
+        magnitude++;
+        length--;
+    }
+    
+    size_t bitCount = 0;
+    
+    if (length > 0) {
+        bitCount = (length - 1) * 8;
+        
+        for (uint8_t top = magnitude[0]; top != 0; top >>= 1) {
+            bitCount++;
+        }
+    }
+    
+    pgp_write_number(output, bitCount, 2);
+    memmove(output + 2, magnitude, length);
+    
+    return length + 2;
+}
+
+// Hashes and ciphers:
+
+size_t pgp_hash(unsigned algorithm, const uint8_t *bytes, size_t length, uint8_t digest[PGP_MAX_DIGEST_LENGTH]) {
+    switch (algorithm) {
+        case 1:
+            MD5(bytes, length, digest);
+            return MD5_DIGEST_LENGTH;
+        
+        case 2:
+            SHA1(bytes, length, digest);
+            return SHA_DIGEST_LENGTH;
+        
+        case 3:
+            RIPEMD160(bytes, length, digest);
+            return RIPEMD160_DIGEST_LENGTH;
+        
+        case 8:
+            SHA256(bytes, length, digest);
+            return SHA256_DIGEST_LENGTH;
+        
+        case 9:
+            SHA384(bytes, length, digest);
+            return SHA384_DIGEST_LENGTH;
+        
+        case 10:
+            SHA512(bytes, length, digest);
+            return SHA512_DIGEST_LENGTH;
+        
+        case 11:
+            SHA224(bytes, length, digest);
+            return SHA224_DIGEST_LENGTH;
+        
+        default:
+            return 0;
+    }
+}
+
+size_t pgp_cipher_key_length(unsigned algorithm) {
+    switch (algorithm) {
+        case 3:
+            return CAST_KEY_LENGTH;
+        
+        case 7:
+            return 16;
+        
+        case 8:
+            return 24;
+        
+        case 9:
+            return 32;
+        
+        default:
+            return 0;
+    }
+}
+
+size_t pgp_cipher_block_size(unsigned algorithm) {
+    switch (algorithm) {
+        case 3:
+            return CAST_BLOCK;
+        
+        case 7:
+        case 8:
+        case 9:
+            return AES_BLOCK_SIZE;
+        
+        default:
+            return 0;
+    }
+}
+
+static pgp_status pgp_cfb(unsigned algorithm, const uint8_t *key, const uint8_t *iv,
+                          const uint8_t *input, uint8_t *output, size_t length, int encrypt) {
+    size_t keyLength = pgp_cipher_key_length(algorithm);
+    size_t blockSize = pgp_cipher_block_size(algorithm);
+    
+    if (keyLength == 0) {
+        return PGP_ERROR_UNSUPPORTED;
+    }
+    
+    // The IV is updated as it goes, so work on a copy:
+    uint8_t ivec[AES_BLOCK_SIZE];
+    memcpy(ivec, iv, blockSize);
+    int num = 0;
+    
+    if (algorithm == 3) {
+        CAST_KEY castKey;
+        CAST_set_key(&castKey, (int) keyLength, key);
+        CAST_cfb64_encrypt(input, output, (long) length, &castKey, ivec, &num, encrypt ? CAST_ENCRYPT : CAST_DECRYPT);
+        memset(&castKey, 0, sizeof(castKey));
+    } else {
+        AES_KEY aesKey;
+        
+        // CFB only ever runs the block cipher forwards:
+        AES_set_encrypt_key(key, (int) keyLength * 8, &aesKey);
+        AES_cfb128_encrypt(input, output, length, &aesKey, ivec, &num, encrypt ? AES_ENCRYPT : AES_DECRYPT);
+        memset(&aesKey, 0, sizeof(aesKey));
+    }
+    
+    return PGP_OK;
+}
+
+pgp_status pgp_cfb_encrypt(unsigned algorithm, const uint8_t *key, const uint8_t *iv,
+                           const uint8_t *input, uint8_t *output, size_t length) {
+    return pgp_cfb(algorithm, key, iv, input, output, length, 1);
+}
+
+pgp_status pgp_cfb_decrypt(unsigned algorithm, const uint8_t *key, const uint8_t *iv,
+                           const uint8_t *input, uint8_t *output, size_t length) {
+    return pgp_cfb(algorithm, key, iv, input, output, length, 0);
+}
+
+// Packet bodies:
+
+static const uint8_t pgp_ed25519_oid[] = {0x2B, 0x06, 0x01, 0x04, 0x01, 0xDA, 0x47, 0x0F, 0x01};
+static const uint8_t pgp_curve25519_oid[] = {0x2B, 0x06, 0x01, 0x04, 0x01, 0x97, 0x55, 0x01, 0x05, 0x01};
+
+/// Steps offset over n MPIs:
+static pgp_status pgp_skip_mpis(const uint8_t *body, size_t length, size_t *offset, int n) {
+    for (int i = 0; i < n; i++) {
+        size_t mpiLength = 0;
+        pgp_status status = pgp_mpi_read(body, length, *offset, &mpiLength);
+        
+        if (status != PGP_OK) {
+            return status;
+        }
+        
+        *offset += mpiLength;
+    }
+    
+    return PGP_OK;
+}
+
+/// Steps offset over a curve OID, which has to be the one expected:
+static pgp_status pgp_skip_curve_oid(const uint8_t *body, size_t length, size_t *offset,
+                                     const uint8_t *oid, size_t oidLength) {
+    if (*offset >= length || body[*offset] > length - *offset - 1) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    if (body[*offset] != oidLength || memcmp(body + *offset + 1, oid, oidLength) != 0) {
+        return PGP_ERROR_UNSUPPORTED;
+    }
+    
+    *offset += 1 + oidLength;
+    
+    return PGP_OK;
+}
+
+static int pgp_hash_is_supported(unsigned algorithm) {
+    switch (algorithm) {
+        case 1:
+        case 2:
+        case 3:
+        case 8:
+        case 9:
+        case 10:
+        case 11:
+            return 1;
+        
+        default:
+            return 0;
+    }
+}
+
+static pgp_status pgp_check_session_key(const uint8_t *body, size_t length) {
+    if (length < 10) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    if (body[0] != 3) {
+        return PGP_ERROR_UNSUPPORTED;
+    }
+    
+    size_t offset = 10;
+    
+    switch (body[9]) {
+        case 1:
+        case 2:
+            return pgp_skip_mpis(body, length, &offset, 1);
+        
+        case 18: {
+            pgp_status status = pgp_skip_mpis(body, length, &offset, 1);
+            
+            if (status != PGP_OK) {
+                return status;
+            }
+            
+            // Then the wrapped key, with a one byte length:
+            if (offset >= length || body[offset] > length - offset - 1) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            return PGP_OK;
+        }
+        
+        default:
+            return PGP_ERROR_UNSUPPORTED;
+    }
+}
+
+/// Every subpacket has to fit, and the ones read as numbers have to be long enough for them:
+static pgp_status pgp_check_subpackets(const uint8_t *bytes, size_t length) {
+    size_t offset = 0;
+    
+    while (offset < length) {
+        size_t subpacketLength = 0;
+        uint8_t firstOctet = bytes[offset];
+        
+        if (firstOctet < 192) {
+            subpacketLength = firstOctet;
+            offset += 1;
+        } else if (firstOctet < 255) {
+            if (length - offset < 2) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            subpacketLength = ((size_t) (firstOctet - 192) << 8) + bytes[offset + 1] + 192;
+            offset += 2;
+        } else {
+            if (length - offset < 5) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            subpacketLength = (size_t) pgp_read_number(bytes + offset + 1, 4);
+            offset += 5;
+        }
+        
+        // The length counts the type byte:
+        if (subpacketLength == 0 || subpacketLength > length - offset) {
+            return PGP_ERROR_MALFORMED;
+        }
+        
+        switch (bytes[offset] & 0x7F) {
+            case 2:
+                if (subpacketLength < 5) {
+                    return PGP_ERROR_MALFORMED;
+                }
+                break;
+            
+            case 16:
+                if (subpacketLength < 9) {
+                    return PGP_ERROR_MALFORMED;
+                }
+                break;
+            
+            default:
+                break;
+        }
+        
+        offset += subpacketLength;
+    }
+    
+    return PGP_OK;
+}
+
+static pgp_status pgp_check_signature(const uint8_t *body, size_t length) {
+    if (length < 1) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    size_t offset = 0;
+    unsigned publicKeyAlgorithm = 0;
+    
+    switch (body[0]) {
+        case 3:
+            if (length < 19) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            publicKeyAlgorithm = body[15];
+            offset = 19;
+            break;
+        
+        case 4: {
+            if (length < 6) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            publicKeyAlgorithm = body[2];
+            
+            size_t hashedLength = (size_t) pgp_read_number(body + 4, 2);
+            
+            if (hashedLength + 2 > length - 6) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            size_t unhashedOffset = 6 + hashedLength;
+            size_t unhashedLength = (size_t) pgp_read_number(body + unhashedOffset, 2);
+            
+            // Then the two byte signed hash value:
+            if (unhashedLength + 2 > length - unhashedOffset - 2) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            pgp_status status = pgp_check_subpackets(body + 6, hashedLength);
+            
+            if (status == PGP_OK) {
+                status = pgp_check_subpackets(body + unhashedOffset + 2, unhashedLength);
+            }
+            
+            if (status != PGP_OK) {
+                return status;
+            }
+            
+            offset = unhashedOffset + 2 + unhashedLength + 2;
+            break;
+        }
+        
+        default:
+            return PGP_ERROR_UNSUPPORTED;
+    }
+    
+    // EdDSA signs with R and S, everything else read has the one MPI:
+    return pgp_skip_mpis(body, length, &offset, publicKeyAlgorithm == 22 ? 2 : 1);
+}
+
+static pgp_status pgp_check_string_to_key(const uint8_t *body, size_t length, size_t offset) {
+    uint8_t usage = body[offset++];
+    unsigned symmetricAlgorithm = usage;
+    
+    if (usage == 254 || usage == 255) {
+        if (length - offset < 3) {
+            return PGP_ERROR_TRUNCATED;
+        }
+        
+        symmetricAlgorithm = body[offset];
+        
+        uint8_t type = body[offset + 1];
+        uint8_t hashAlgorithm = body[offset + 2];
+        offset += 3;
+        
+        switch (type) {
+            case 0:
+                break;
+            
+            case 1:
+            case 3: {
+                
+                // An eight byte salt, and the coded count when iterated:
+                size_t specifierLength = type == 3 ? 9 : 8;
+                
+                if (length - offset < specifierLength) {
+                    return PGP_ERROR_TRUNCATED;
+                }
+                
+                offset += specifierLength;
+                break;
+            }
+            
+            default:
+                return PGP_ERROR_UNSUPPORTED;
+        }
+        
+        if (!pgp_hash_is_supported(hashAlgorithm)) {
+            return PGP_ERROR_UNSUPPORTED;
+        }
+    }
+    
+    size_t blockSize = pgp_cipher_block_size(symmetricAlgorithm);
+    
+    if (blockSize == 0) {
+        return PGP_ERROR_UNSUPPORTED;
+    }
+    
+    return length - offset < blockSize ? PGP_ERROR_TRUNCATED : PGP_OK;
+}
+
+static pgp_status pgp_check_key(const uint8_t *body, size_t length) {
+    if (length < 6) {
+        return PGP_ERROR_TRUNCATED;
+    }
+    
+    if (body[0] != 4) {
+        return PGP_ERROR_UNSUPPORTED;
+    }
+    
+    unsigned publicKeyAlgorithm = body[5];
+    size_t offset = 6;
+    pgp_status status;
+    
+    switch (publicKeyAlgorithm) {
+        case 1:
+            status = pgp_skip_mpis(body, length, &offset, 2);
+            break;
+        
+        case 22:
+            status = pgp_skip_curve_oid(body, length, &offset, pgp_ed25519_oid, sizeof(pgp_ed25519_oid));
+            
+            if (status == PGP_OK) {
+                status = pgp_skip_mpis(body, length, &offset, 1);
+            }
+            break;
+        
+        case 18:
+            status = pgp_skip_curve_oid(body, length, &offset, pgp_curve25519_oid, sizeof(pgp_curve25519_oid));
+            
+            if (status == PGP_OK) {
+                status = pgp_skip_mpis(body, length, &offset, 1);
+            }
+            
+            // KDF parameters, the length (always 3), a reserved 1, then the hash and wrap algorithms:
+            if (status == PGP_OK) {
+                if (length - offset < 4) {
+                    status = PGP_ERROR_TRUNCATED;
+                } else if (body[offset] != 3 || body[offset + 1] != 0x01) {
+                    status = PGP_ERROR_UNSUPPORTED;
+                } else {
+                    offset += 4;
+                }
+            }
+            break;
+        
+        default:
+            return PGP_ERROR_UNSUPPORTED;
+    }
+    
+    if (status != PGP_OK || offset == length) {
+        return status;
+    }
+    
+    // Secret key material, left encrypted behind a string to key or in the clear:
+    if (body[offset] != 0) {
+        return pgp_check_string_to_key(body, length, offset);
+    }
+    
+    offset++;
+    
+    return pgp_skip_mpis(body, length, &offset, publicKeyAlgorithm == 1 ? 4 : 1);
+}
+
+int pgp_packet_is_supported(unsigned tag) {
+    switch (tag) {
+        case 1:
+        case 2:
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 9:
+        case 11:
+        case 13:
+        case 14:
+        case 18:
+            return 1;
+        
+        default:
+            return 0;
+    }
+}
+
+pgp_status pgp_packet_check_body(unsigned tag, const uint8_t *body, size_t length) {
+    switch (tag) {
+        case 1:
+            return pgp_check_session_key(body, length);
+        
+        case 2:
+            return pgp_check_signature(body, length);
+        
+        case 4:
+            if (length < 13) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            return body[0] == 3 ? PGP_OK : PGP_ERROR_UNSUPPORTED;
+        
+        case 5:
+        case 6:
+        case 7:
+        case 14:
+            return pgp_check_key(body, length);
+        
+        case 11:
+            
+            // Format, a file name with its one byte length, then a four byte date:
+            if (length < 2 || body[1] > length - 2 || length - 2 - body[1] < 4) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            return PGP_OK;
+        
+        case 18:
+            if (length < 1) {
+                return PGP_ERROR_TRUNCATED;
+            }
+            
+            return body[0] == 1 ? PGP_OK : PGP_ERROR_UNSUPPORTED;
+        
+        case 9:
+        case 13:
+            return PGP_OK;
+        
+        default:
+            return PGP_ERROR_UNSUPPORTED;
+    }
+}
@@ -0,0 +1,154 @@
+//
+//  OpenPGPCore.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#ifndef OpenPGP_OpenPGPCore_h
+#define OpenPGP_OpenPGPCore_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The byte level work under the Objective-C classes: armor, packet framing, MPIs, and hashing
+// and CFB encryption through OpenSSL. Everything reads and writes buffers the caller owns and
+// reports failures as status codes, with no Foundation or Objective-C runtime involved, so it
+// also builds into plain C services.
+
+#define PGP_PACKET_MAX_HEADER_LENGTH 6
+#define PGP_MAX_DIGEST_LENGTH 64
+#define PGP_CRC24_INIT 0xB704CE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    PGP_OK = 0,
+    PGP_ERROR_TRUNCATED = -1,
+    PGP_ERROR_MALFORMED = -2,
+    PGP_ERROR_CHECKSUM = -3,
+    PGP_ERROR_UNSUPPORTED = -4
+} pgp_status;
+
+// Numbers:
+
+/// Big endian, length is at most 8:
+uint64_t pgp_read_number(const uint8_t *bytes, size_t length);
+void pgp_write_number(uint8_t *bytes, uint64_t number, size_t length);
+
+// Armor:
+
+uint32_t pgp_crc24(uint32_t crc, const uint8_t *bytes, size_t length);
+
+/// Characters pgp_base64_encode writes, with a CRLF between lines of lineLength characters
+/// (0 for a single line):
+size_t pgp_base64_encoded_length(size_t length, size_t lineLength);
+size_t pgp_base64_encode(char *output, const uint8_t *bytes, size_t length, size_t lineLength);
+
+/// Skips whitespace and stops at padding. Output needs room for length * 3 / 4 bytes:
+pgp_status pgp_base64_decode(uint8_t *output, size_t *outputLength, const char *text, size_t length);
+
+/// Decodes only whole groups, stopping before a partial one or padding. consumed is how much of
+/// the text they took, so a long text can be decoded a piece at a time:
+pgp_status pgp_base64_decode_groups(uint8_t *output, size_t *outputLength, const char *text, size_t length, size_t *consumed);
+
+/// Where the parts of an armored block are in its text:
+typedef struct {
+    
+    /// Between "-----BEGIN " and the closing dashes, e.g. "PGP MESSAGE":
+    size_t labelOffset;
+    size_t labelLength;
+    
+    /// "Key: Value" lines, possibly none:
+    size_t headersOffset;
+    size_t headersLength;
+    
+    /// The base64 lines:
+    size_t contentOffset;
+    size_t contentLength;
+    
+    int hasChecksum;
+    uint32_t checksum;
+} pgp_armor;
+
+/// PGP_ERROR_TRUNCATED when the text ends before the footer, the content then runs to the end
+/// of the text so what there is of it can still be read:
+pgp_status pgp_armor_parse(const char *text, size_t length, pgp_armor *armor);
+
+/// Decodes the content and checks it against the checksum, if there is one:
+pgp_status pgp_armor_decode(const char *text, const pgp_armor *armor, uint8_t *output, size_t *outputLength);
+
+// Packets:
+
+typedef struct {
+    unsigned tag;
+    
+    /// The first body byte, and the whole body's length with partial chunks added together:
+    size_t bodyOffset;
+    size_t bodyLength;
+    
+    /// Just past the packet:
+    size_t end;
+    
+    /// The body is split into chunks with length headers between them, starting with this long one:
+    int partial;
+    size_t firstChunkLength;
+    
+    /// Old format without a length, the body runs to the end of the input:
+    int indeterminate;
+} pgp_packet;
+
+/// Only the header at offset. For partial lengths bodyLength is the first chunk, end isn't set
+/// and none of the body has to be there yet:
+pgp_status pgp_packet_read_header(const uint8_t *bytes, size_t length, size_t offset, pgp_packet *packet);
+
+/// The whole packet at offset, all of which has to be within length:
+pgp_status pgp_packet_next(const uint8_t *bytes, size_t length, size_t offset, pgp_packet *packet);
+
+/// Joins a packet's body into output, which needs bodyLength bytes:
+void pgp_packet_copy_body(const uint8_t *bytes, const pgp_packet *packet, uint8_t *output);
+
+/// New format header, returns its length:
+size_t pgp_packet_write_header(uint8_t output[PGP_PACKET_MAX_HEADER_LENGTH], unsigned tag, size_t bodyLength);
+
+// MPIs:
+
+/// Length of the MPI at offset, counting its two byte bit count:
+pgp_status pgp_mpi_read(const uint8_t *bytes, size_t length, size_t offset, size_t *mpiLength);
+
+/// Encodes a big endian magnitude without its leading zeros. Output needs length + 2 bytes,
+/// returns the bytes written:
+size_t pgp_mpi_write(uint8_t *output, const uint8_t *magnitude, size_t length);
+
+// Packet bodies:
+
+/// Whether the tag is one of the packets the Objective-C classes read, others are skipped:
+int pgp_packet_is_supported(unsigned tag);
+
+/// Checks everything the packet's class will read from the body: that it's in bounds, and the
+/// versions, algorithms and curves are ones it handles. Bodies that pass parse without throwing:
+pgp_status pgp_packet_check_body(unsigned tag, const uint8_t *body, size_t length);
+
+// Hashes and ciphers, by their OpenPGP algorithm IDs:
+
+/// Returns the digest length, 0 if the algorithm isn't supported:
+size_t pgp_hash(unsigned algorithm, const uint8_t *bytes, size_t length, uint8_t digest[PGP_MAX_DIGEST_LENGTH]);
+
+/// 0 if the algorithm isn't supported:
+size_t pgp_cipher_key_length(unsigned algorithm);
+size_t pgp_cipher_block_size(unsigned algorithm);
+
+/// CFB without OpenPGP's resynchronization, for AES and CAST5. Input and output may be the same:
+pgp_status pgp_cfb_encrypt(unsigned algorithm, const uint8_t *key, const uint8_t *iv,
+                           const uint8_t *input, uint8_t *output, size_t length);
+pgp_status pgp_cfb_decrypt(unsigned algorithm, const uint8_t *key, const uint8_t *iv,
+                           const uint8_t *input, uint8_t *output, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+//
+//  OperationScheduler.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSUInteger, OperationLane) {
+    
+    /// Private key operations and key generation:
+    OperationLaneExpensive,
+    
+    /// Parsing and public key operations:
+    OperationLaneCheap
+};
+
+#pragma mark - ScheduledOperation interface
+
+/// Handle for work added to a scheduler. Cancelling is cooperative: work that hasn't started
+/// never runs, and work that has gets its result dropped. Either way the error block is called
+/// with a cancellation error instead of the completion block.
+@interface ScheduledOperation : NSObject
+
+@property (nonatomic, readonly) OperationLane lane;
+@property (nonatomic, readonly) BOOL isCancelled;
+@property (nonatomic, readonly) BOOL isFinished;
+
+- (void)cancel;
+
+/// Blocks until the completion or error block has been handed to the completion queue:
+- (void)waitUntilFinished;
+
+/// For the work block, true once it's worth stopping early:
+- (BOOL)shouldStop;
+
+/// Called by the work block with its result, exactly one of them once:
+- (void)finishWithBlock:(dispatch_block_t)completion;
+- (void)failWithError:(NSError *)error;
+
+@end
+
+#pragma mark - OperationScheduler interface
+
+/// Runs work on two lanes with their own concurrency limits, so cheap parsing never queues
+/// behind private key operations. Each lane holds at most capacity operations, running or
+/// waiting, and turns new ones away past that rather than queueing without bound.
+@interface OperationScheduler : NSObject
+
+@property (nonatomic, readonly) NSUInteger expensiveWidth;
+@property (nonatomic, readonly) NSUInteger cheapWidth;
+@property (nonatomic, readonly) NSUInteger capacity;
+
+/// Both lanes as wide as there are active cores, with capacity for 64 operations per core:
++ (OperationScheduler *)sharedScheduler;
+
++ (OperationScheduler *)schedulerWithExpensiveWidth:(NSUInteger)expensiveWidth
+                                         cheapWidth:(NSUInteger)cheapWidth
+                                           capacity:(NSUInteger)capacity;
+
+/// Running and waiting operations in the lane:
+- (NSUInteger)countForLane:(OperationLane)lane;
+
+/// Returns nil if the lane is at capacity, nothing is run or called then. Blocks go to the
+/// completion queue, the main queue if it's NULL:
+- (ScheduledOperation *)addOperationToLane:(OperationLane)lane
+                           completionQueue:(dispatch_queue_t)completionQueue
+                                errorBlock:(void (^)(NSError *error))errorBlock
+                                     block:(void (^)(ScheduledOperation *operation))block;
+
+@end
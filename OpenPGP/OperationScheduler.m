@@ -0,0 +1,243 @@
+//
+//  OperationScheduler.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "OperationScheduler.h"
+#import "OpenPGP.h"
+
+#define OperationSchedulerLaneCount 2
+#define OperationSchedulerCapacityPerCore 64
+
+#pragma mark - ScheduledOperation extension
+
+@interface ScheduledOperation () {
+    dispatch_queue_t _completionQueue;
+    void (^_errorBlock)(NSError *error);
+    dispatch_group_t _group;
+    BOOL _cancelled;
+    BOOL _finished;
+}
+
+- (instancetype)initWithLane:(OperationLane)lane
+             completionQueue:(dispatch_queue_t)completionQueue
+                  errorBlock:(void (^)(NSError *error))errorBlock;
+
+/// Hands the block to the completion queue unless something already was:
+- (void)deliverBlock:(dispatch_block_t)block;
+
+@end
+
+#pragma mark - ScheduledOperation implementation
+
+@implementation ScheduledOperation
+
+- (instancetype)initWithLane:(OperationLane)lane
+             completionQueue:(dispatch_queue_t)completionQueue
+                  errorBlock:(void (^)(NSError *error))errorBlock {
+    self = [super init];
+    
+    if (self != nil) {
+        _lane = lane;
+        _completionQueue = completionQueue;
+        _errorBlock = [errorBlock copy];
+        _group = dispatch_group_create();
+        
+        dispatch_group_enter(_group);
+    }
+    
+    return self;
+}
+
+- (BOOL)isCancelled {
+    @synchronized (self) {
+        return _cancelled;
+    }
+}
+
+- (BOOL)isFinished {
+    @synchronized (self) {
+        return _finished;
+    }
+}
+
+- (void)cancel {
+    @synchronized (self) {
+        _cancelled = YES;
+    }
+    
+    // The caller hears about it now, not when the lane gets to it:
+    [self failWithError:[OpenPGP errorWithCause:@"OpenPGP: Operation was cancelled."]];
+}
+
+- (void)waitUntilFinished {
+    dispatch_group_wait(_group, DISPATCH_TIME_FOREVER);
+}
+
+- (BOOL)shouldStop {
+    return self.isCancelled;
+}
+
+- (void)finishWithBlock:(dispatch_block_t)completion {
+    [self deliverBlock:completion];
+}
+
+- (void)failWithError:(NSError *)error {
+    void (^errorBlock)(NSError *) = _errorBlock;
+    
+    [self deliverBlock:^{
+        if (errorBlock != nil) {
+            errorBlock(error);
+        }
+    }];
+}
+
+#pragma mark Private
+
+- (void)deliverBlock:(dispatch_block_t)block {
+    @synchronized (self) {
+        if (_finished) {
+            return;
+        }
+        
+        _finished = YES;
+    }
+    
+    dispatch_async(_completionQueue, block);
+    dispatch_group_leave(_group);
+}
+
+@end
+
+#pragma mark - OperationScheduler extension
+
+@interface OperationScheduler () {
+    dispatch_queue_t _feeders[OperationSchedulerLaneCount];
+    dispatch_semaphore_t _slots[OperationSchedulerLaneCount];
+    NSUInteger _counts[OperationSchedulerLaneCount];
+}
+
+- (instancetype)initWithExpensiveWidth:(NSUInteger)expensiveWidth
+                            cheapWidth:(NSUInteger)cheapWidth
+                              capacity:(NSUInteger)capacity;
+
+- (void)runOperation:(ScheduledOperation *)operation block:(void (^)(ScheduledOperation *operation))block;
+- (void)removeOperationFromLane:(OperationLane)lane;
+
+@end
+
+#pragma mark - OperationScheduler implementation
+
+@implementation OperationScheduler
+
++ (OperationScheduler *)sharedScheduler {
+    static OperationScheduler *sharedScheduler = nil;
+    static dispatch_once_t onceToken;
+    
+    dispatch_once(&onceToken, ^{
+        NSUInteger cores = MAX([NSProcessInfo processInfo].activeProcessorCount, 1);
+        
+        sharedScheduler = [[self alloc] initWithExpensiveWidth:cores
+                                                    cheapWidth:cores
+                                                      capacity:cores * OperationSchedulerCapacityPerCore];
+    });
+    
+    return sharedScheduler;
+}
+
++ (OperationScheduler *)schedulerWithExpensiveWidth:(NSUInteger)expensiveWidth
+                                         cheapWidth:(NSUInteger)cheapWidth
+                                           capacity:(NSUInteger)capacity {
+    
+    return [[self alloc] initWithExpensiveWidth:expensiveWidth cheapWidth:cheapWidth capacity:capacity];
+}
+
+- (instancetype)initWithExpensiveWidth:(NSUInteger)expensiveWidth
+                            cheapWidth:(NSUInteger)cheapWidth
+                              capacity:(NSUInteger)capacity {
+    self = [super init];
+    
+    if (self != nil) {
+        _expensiveWidth = MAX(expensiveWidth, 1);
+        _cheapWidth = MAX(cheapWidth, 1);
+        _capacity = MAX(capacity, 1);
+        
+        _feeders[OperationLaneExpensive] = dispatch_queue_create("OpenPGP.OperationScheduler.expensive", DISPATCH_QUEUE_SERIAL);
+        _feeders[OperationLaneCheap] = dispatch_queue_create("OpenPGP.OperationScheduler.cheap", DISPATCH_QUEUE_SERIAL);
+        
+        _slots[OperationLaneExpensive] = dispatch_semaphore_create(_expensiveWidth);
+        _slots[OperationLaneCheap] = dispatch_semaphore_create(_cheapWidth);
+    }
+    
+    return self;
+}
+
+- (NSUInteger)countForLane:(OperationLane)lane {
+    @synchronized (self) {
+        return _counts[lane];
+    }
+}
+
+- (ScheduledOperation *)addOperationToLane:(OperationLane)lane
+                           completionQueue:(dispatch_queue_t)completionQueue
+                                errorBlock:(void (^)(NSError *error))errorBlock
+                                     block:(void (^)(ScheduledOperation *operation))block {
+    @synchronized (self) {
+        if (_counts[lane] >= _capacity) {
+            return nil;
+        }
+        
+        _counts[lane]++;
+    }
+    
+    ScheduledOperation *operation = [[ScheduledOperation alloc] initWithLane:lane
+                                                             completionQueue:completionQueue ?: dispatch_get_main_queue()
+                                                                  errorBlock:errorBlock];
+    
+    dispatch_semaphore_t slots = _slots[lane];
+    
+    // The feeder waits for a free slot so the workers never block, only one thread per lane does:
+    dispatch_async(_feeders[lane], ^{
+        if (operation.isCancelled) {
+            [self removeOperationFromLane:lane];
+            return;
+        }
+        
+        dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+        
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [self runOperation:operation block:block];
+            
+            dispatch_semaphore_signal(slots);
+            [self removeOperationFromLane:lane];
+        });
+    });
+    
+    return operation;
+}
+
+#pragma mark Private
+
+- (void)runOperation:(ScheduledOperation *)operation block:(void (^)(ScheduledOperation *operation))block {
+    if (operation.isCancelled) {
+        return;
+    }
+    
+    @autoreleasepool {
+        block(operation);
+    }
+    
+    // Does nothing if the block finished it, as it should have:
+    [operation failWithError:[OpenPGP errorWithCause:@"OpenPGP: Operation ended without a result."]];
+}
+
+- (void)removeOperationFromLane:(OperationLane)lane {
+    @synchronized (self) {
+        _counts[lane]--;
+    }
+}
+
+@end
@@ -12,9 +12,19 @@
 
 @interface PKESKeyPacket : Packet
 
-@property (nonatomic, readonly) NSString *keyId;
+@property (nonatomic, readonly) KeyID keyId;
+@property (nonatomic, readonly) PublicKeyAlgorithm publicKeyAlgorithm;
+
+/// RSA:
 @property (nonatomic, readonly) MPI *encryptedM;
 
+/// ECDH, the sender's ephemeral point and the AES wrapped session key:
+@property (nonatomic, readonly) MPI *ephemeralPoint;
+@property (nonatomic, readonly) NSData *wrappedKey;
+
 + (PKESKeyPacket *)packetWithPublicKey:(PublicKey *)publicKey sessionKey:(NSData *)sessionKey;
 
+/// The AES256 session key, or nil if the packet wasn't encrypted to this key:
+- (NSData *)sessionKeyWithSecretKey:(SecretKey *)secretKey;
+
 @end
\ No newline at end of file
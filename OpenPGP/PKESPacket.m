@@ -20,15 +20,18 @@
 #define PKESKeyPacketPKAIndex 9
 #define PKESKeyPacketMPIIndex 10
 
-#define PKESKeyPacketKeyIDLength 8
-
 #pragma mark - PKESKeyPacket extension
 
 @interface PKESKeyPacket ()
 
-- (instancetype)initWithKeyId:(NSString *)keyId
+- (instancetype)initWithKeyId:(KeyID)keyId
+           publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
                    encryptedM:(MPI *)encryptedM;
 
+- (instancetype)initWithKeyId:(KeyID)keyId
+               ephemeralPoint:(MPI *)ephemeralPoint
+                   wrappedKey:(NSData *)wrappedKey;
+
 @end
 
 #pragma mark - PKESKeyPacket implementation
@@ -48,10 +51,7 @@
     }
     
     // Get key ID:
-    Byte keyIdBytes[PKESKeyPacketKeyIDLength];
-    memcpy(keyIdBytes, bytes + PKESKeyPacketKeyIDIndex, sizeof(Byte) * PKESKeyPacketKeyIDLength);
-    
-    NSString *keyId = [Utility keyIDFromBytes:keyIdBytes];
+    KeyID keyId = [Utility readKeyID:bytes + PKESKeyPacketKeyIDIndex];
     
     // Get key algorithms out:
     PublicKeyAlgorithm publicKeyAlgorithm = bytes[PKESKeyPacketPKAIndex];
@@ -59,12 +59,32 @@
     switch (publicKeyAlgorithm) {
         case PublicKeyAlgorithmRSAEncryptSign:
         case PublicKeyAlgorithmRSAEncrypt: {
-            MPI *encryptedM = [MPI mpiFromBytes:(bytes + PKESKeyPacketMPIIndex)];
+            MPI *encryptedM = [MPI mpiFromData:body atIndex:PKESKeyPacketMPIIndex];
             
             return [[self alloc] initWithKeyId:keyId
+                            publicKeyAlgorithm:publicKeyAlgorithm
                                     encryptedM:encryptedM];
         }
             
+        case PublicKeyAlgorithmECDH: {
+            MPI *ephemeralPoint = [MPI mpiFromData:body atIndex:PKESKeyPacketMPIIndex];
+            NSUInteger wrappedKeyIndex = PKESKeyPacketMPIIndex + ephemeralPoint.length;
+            
+            NSUInteger wrappedKeyLength = bytes[wrappedKeyIndex++];
+            
+            if (wrappedKeyIndex + wrappedKeyLength > body.length) {
+                @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                               reason:@"Wrapped session key is truncated."
+                                             userInfo:@{@"wrappedKeyLength": @(wrappedKeyLength)}];
+            }
+            
+            NSData *wrappedKey = [body subdataWithRange:NSMakeRange(wrappedKeyIndex, wrappedKeyLength)];
+            
+            return [[self alloc] initWithKeyId:keyId
+                                ephemeralPoint:ephemeralPoint
+                                    wrappedKey:wrappedKey];
+        }
+            
         default: {
             @throw [NSException exceptionWithName:NSInternalInconsistencyException
                                            reason:@"Invalid public key algorithm."
@@ -75,20 +95,48 @@
 
 + (PKESKeyPacket *)packetWithPublicKey:(PublicKey *)publicKey sessionKey:(NSData *)sessionKey {
     
-    NSMutableData *message = [NSMutableData dataWithCapacity:sessionKey.length + 1];
-    SymmetricAlgorithm algorithm = SymmetricAlgorithmAES256;
+    NSMutableData *message = [NSMutableData dataWithCapacity:sessionKey.length + 3];
+    Byte algorithm = SymmetricAlgorithmAES256;
     
     [message appendBytes:&algorithm length:1];
     [message appendData:sessionKey];
     
+    // Two octet checksum of the session key, the sum of its bytes mod 65536:
+    const Byte *sessionKeyBytes = sessionKey.bytes;
+    NSUInteger sum = 0;
+    
+    for (NSUInteger i = 0; i < sessionKey.length; ++i) {
+        sum += sessionKeyBytes[i];
+    }
+    
+    Byte checksum[2];
+    checksum[0] = (sum >> 8) & 0xFF;
+    checksum[1] = sum & 0xFF;
+    
+    [message appendBytes:checksum length:2];
+    
+    if (publicKey.publicKeyAlgorithm == PublicKeyAlgorithmECDH) {
+        MPI *ephemeralPoint = nil;
+        NSData *wrappedKey = [Crypto ecdhEncryptMessage:message withPublicKey:publicKey ephemeralPoint:&ephemeralPoint];
+        
+        if (wrappedKey == nil) {
+            @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                           reason:@"Failed to wrap the session key."
+                                         userInfo:@{@"keyId": @(publicKey.keyID)}];
+        }
+        
+        return [[self alloc] initWithKeyId:publicKey.keyID ephemeralPoint:ephemeralPoint wrappedKey:wrappedKey];
+    }
+    
     NSData *encryptedData = [Crypto encryptData:message withPublicKey:publicKey];
     
     MPI *encryptedM = [MPI mpiFromData:encryptedData];
     
-    return [[self alloc] initWithKeyId:publicKey.keyID encryptedM:encryptedM];
+    return [[self alloc] initWithKeyId:publicKey.keyID publicKeyAlgorithm:publicKey.publicKeyAlgorithm encryptedM:encryptedM];
 }
 
-- (instancetype)initWithKeyId:(NSString *)keyId
+- (instancetype)initWithKeyId:(KeyID)keyId
+           publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
                    encryptedM:(MPI *)encryptedM {
     
     self = [super initWithType:PacketTypePKESKey];
@@ -96,22 +144,86 @@
     if (self != nil) {
         _encryptedM = encryptedM;
         _keyId = keyId;
+        _publicKeyAlgorithm = publicKeyAlgorithm;
     }
     
     return self;
 }
 
+- (instancetype)initWithKeyId:(KeyID)keyId
+               ephemeralPoint:(MPI *)ephemeralPoint
+                   wrappedKey:(NSData *)wrappedKey {
+    
+    self = [super initWithType:PacketTypePKESKey];
+    
+    if (self != nil) {
+        _keyId = keyId;
+        _publicKeyAlgorithm = PublicKeyAlgorithmECDH;
+        _ephemeralPoint = ephemeralPoint;
+        _wrappedKey = wrappedKey;
+    }
+    
+    return self;
+}
+
+- (NSData *)sessionKeyWithSecretKey:(SecretKey *)secretKey {
+    NSData *message = nil;
+    
+    if (self.publicKeyAlgorithm == PublicKeyAlgorithmECDH) {
+        message = [Crypto ecdhDecryptMessage:self.wrappedKey
+                              ephemeralPoint:self.ephemeralPoint
+                               withSecretKey:secretKey];
+    } else {
+        message = [Crypto decryptMessage:self.encryptedM withSecretKey:secretKey];
+    }
+    
+    // Algorithm, the 32 byte AES256 key and its checksum:
+    if (message.length != 1 + kCCKeySizeAES256 + 2) {
+        return nil;
+    }
+    
+    const Byte *bytes = message.bytes;
+    
+    if (bytes[0] != SymmetricAlgorithmAES256) {
+        return nil;
+    }
+    
+    const Byte *sessionKey = bytes + 1;
+    
+    NSUInteger checksum = [Utility readNumber:sessionKey + kCCKeySizeAES256 length:2];
+    NSUInteger sum = 0;
+    
+    for (NSUInteger i = 0; i < kCCKeySizeAES256; ++i) {
+        sum += sessionKey[i];
+    }
+    
+    if (checksum != sum % 65536) {
+        return nil;
+    }
+    
+    return [NSData dataWithBytes:sessionKey length:kCCKeySizeAES256];
+}
+
 - (NSData *)body {
     // TODO: Add PKCS encoding.
     Byte header[10];
     
     header[0] = 0x03;
     [Utility writeKeyID:self.keyId toBytes:header + 1];
-    header[9] = PublicKeyAlgorithmRSAEncryptSign;
+    header[9] = self.publicKeyAlgorithm;
     
     NSMutableData *body = [NSMutableData data];
     [body appendBytes:header length:10];
-    [body appendData:self.encryptedM.data];
+    
+    if (self.publicKeyAlgorithm == PublicKeyAlgorithmECDH) {
+        Byte wrappedKeyLength = self.wrappedKey.length;
+        
+        [body appendData:self.ephemeralPoint.data];
+        [body appendBytes:&wrappedKeyLength length:1];
+        [body appendData:self.wrappedKey];
+    } else {
+        [body appendData:self.encryptedM.data];
+    }
     
     return [NSData dataWithData:body];
 }
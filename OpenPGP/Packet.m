@@ -14,6 +14,7 @@
 #import "SEIPDataPacket.h"
 #import "SignaturePacket.h"
 #import "UserIDPacket.h"
+#import "OpenPGPCore.h"
 
 @interface Packet ()
 
@@ -30,38 +31,38 @@
         case PacketTypePKESKey:
             packet = [PKESKeyPacket packetWithBody:body];
             break;
-            
+        
         case PacketTypeSEIPData:
             packet = [SEIPDataPacket packetWithBody:body];
             break;
-            
+        
         case PacketTypeSEData:
             packet = [SEDataPacket packetWithBody:body];
             break;
-            
+        
         case PacketTypeSignature:
             packet = [SignaturePacket packetWithBody:body];
             break;
-            
+        
         case PacketTypePublicKey:
         case PacketTypePublicSubkey:
         case PacketTypeSecretKey:
         case PacketTypeSecretSubkey:
             packet = [KeyPacket packetWithBody:body];
             break;
-            
+        
         case PacketTypeUserID:
             packet = [UserIDPacket packetWithBody:body];
             break;
-            
+        
         case PacketTypeOnePassSig:
             packet = [OnePassSignaturePacket packetWithBody:body];
             break;
-            
+        
         case PacketTypeLiteralData:
             packet = [LiteralDataPacket packetWithBody:body];
             break;
-            
+        
         case PacketTypeSKESKey:
         case PacketTypeCompressedData:        case PacketTypeMarker:
         case PacketTypeTrust:
@@ -90,33 +91,6 @@
                                  userInfo:@{@"method": NSStringFromSelector(_cmd)}];
 }
 
-+ (void)writePacketLength:(NSUInteger)length toData:(NSMutableData *)data {
-    if (length <= 191) {
-        Byte bytes[1];
-        
-        bytes[0] = length & 0xFF;
-        
-        [data appendBytes:bytes length:1];
-        
-    } else if (length >= 192 && length <= 8383) {
-        Byte bytes[2];
-        
-        bytes[0] = (((length - 192) >> 8) & 0xFF) + 192;
-        bytes[1] = (length - 192) & 0xFF;
-        
-        [data appendBytes:bytes length:2];
-        
-    } else {
-        Byte bytes[5];
-        
-        bytes[0] = 0xFF;
-        bytes[1] = (length >> 24) & 0xFF;
-        bytes[2] = (length >> 16) & 0xFF;
-        bytes[3] = (length >> 8) & 0xFF;
-        bytes[4] = length & 0xFF;
-    }
-}
-
 - (instancetype)initWithType:(PacketType)type {
     self = [super init];
     
@@ -134,15 +108,13 @@
 }
 
 - (NSData *)data {
-    NSMutableData *data = [NSMutableData data];
-    
-    // Write the "always set" and "format 4" bits:
-    Byte packetTag[1] = {0x80 | 0x40 | self.packetType};
-    [data appendBytes:packetTag length:1];
-    
     NSData *body = self.body;
-    [Packet writePacketLength:body.length toData:data];
     
+    Byte header[PGP_PACKET_MAX_HEADER_LENGTH];
+    size_t headerLength = pgp_packet_write_header(header, self.packetType, body.length);
+    
+    NSMutableData *data = [NSMutableData dataWithCapacity:headerLength + body.length];
+    [data appendBytes:header length:headerLength];
     [data appendData:body];
     
     return [NSData dataWithData:data];
@@ -7,6 +7,7 @@
 //
 
 #import "PacketList.h"
+#import "Instrumentation.h"
 #import "Packet.h"
 #import "PacketReader.h"
 
@@ -21,34 +22,43 @@
 @implementation PacketList
 
 + (instancetype)packetListFromData:(NSData *)data {
-    PacketList *packetList = nil;
+    NSError *error = nil;
+    PacketList *packetList = [self packetListFromData:data error:&error];
     
-    @try {
-        PacketReader *reader = [PacketReader readerWithData:data];
-        
-        NSMutableArray *packets = [NSMutableArray array];
-        
-        while (!reader.isComplete) {
-            NSError *error = nil;
-            Packet *packet = [reader readPacketWithError:&error];
+    if (packetList == nil) {
+        NSLog(@"Failed to read packet list: %@", error);
+    }
+    
+    return packetList;
+}
+
++ (instancetype)packetListFromData:(NSData *)data error:(NSError **)error {
+    PGP_STAGE_BEGIN(PGP_STAGE_PACKETS);
+    
+    PacketReader *reader = [PacketReader readerWithData:data];
+    NSMutableArray *packets = [NSMutableArray array];
+    
+    while (!reader.isComplete) {
+        NSError *packetError = nil;
+        Packet *packet = [reader readPacketWithError:&packetError];
             
-            if (error != nil) {
-                NSLog(@"Error reading packet: %@", error);
-                continue;
+        if (packetError != nil) {
+            if (error != NULL) {
+                *error = packetError;
             }
             
-            if (packet != nil) {
-                [packets addObject:packet];
-            }
+            PGP_STAGE_END(PGP_STAGE_PACKETS, data.length);
+            return nil;
         }
         
-        packetList = [self packetListWithPackets:[NSArray arrayWithArray:packets]];
-    }
-    @catch (NSException *exception) {
-        NSLog(@"Failed to read packet list: %@", exception);
+        if (packet != nil) {
+            [packets addObject:packet];
+        }
     }
     
-    return packetList;
+    PGP_STAGE_END(PGP_STAGE_PACKETS, data.length);
+        
+    return [self packetListWithPackets:[NSArray arrayWithArray:packets]];
 }
 
 + (instancetype)packetListWithPackets:(NSArray *)packets {
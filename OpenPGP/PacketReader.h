@@ -18,6 +18,9 @@ FOUNDATION_EXPORT NSString *const PacketReaderErrorDomain;
 
 + (instancetype)readerWithData:(NSData *)data;
 
+/// Returns nil without an error for packet types that aren't read, and with one for packets
+/// that are malformed or use versions or algorithms that aren't supported. Bodies are checked
+/// before any packet class sees them, so nothing here throws:
 - (Packet *)readPacketWithError:(NSError **)error;
 
 @end
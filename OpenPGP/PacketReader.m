@@ -8,32 +8,23 @@
 
 #import "PacketReader.h"
 #import "Packet.h"
+#import "OpenPGPCore.h"
 
 NSString *const PacketReaderErrorDomain = @"PacketReaderErrorDomain";
 
 typedef NS_ENUM(NSInteger, PacketReaderErrorCodes) {
     PacketReaderErrorPtagFormat = -1,
-    PacketReaderErrorReadPastEnd = -2
-};
-
-typedef NS_ENUM(NSUInteger, PacketLength) {
-    PacketLengthOneOctet,
-    PacketLengthTwoOctet,
-    PacketLengthFiveOctet,
-    PacketLengthPartialBody
+    PacketReaderErrorReadPastEnd = -2,
+    PacketReaderErrorMalformedBody = -3,
+    PacketReaderErrorUnsupportedBody = -4
 };
 
 @interface PacketReader ()
 
-@property (nonatomic, readonly) const Byte *bytes;
-
 @property (nonatomic, strong) NSData *data;
 @property (nonatomic, assign) NSUInteger currentIndex;
 
-@property (nonatomic, assign) BOOL usesPartialBodyLengths;
-
 - (id)initWithData:(NSData *)data;
-- (const Byte)nextByte;
 
 @end
 
@@ -49,88 +40,66 @@ typedef NS_ENUM(NSUInteger, PacketLength) {
     if (self != nil) {
         self.data = data;
         self.currentIndex = 0;
-        self.usesPartialBodyLengths = NO;
     }
     
     return self;
 }
 
-- (Packet *)readPacketWithError:(NSError *__autoreleasing *)error {    
-    PacketType type = [self readPacketTagWithError:error];
-    if (*error) return nil;
+- (Packet *)readPacketWithError:(NSError *__autoreleasing *)error {
+    pgp_packet packet;
+    pgp_status status = pgp_packet_next(self.data.bytes, self.data.length, self.currentIndex, &packet);
     
-    NSUInteger packetLength = [self readPacketLengthWithError:error];
-    if (*error) return nil;
-    
-    NSMutableData *content = [NSMutableData data];
-    
-    while (packetLength > 0xFFFFFFFF) {
-        NSData *partialBody = [self.data subdataWithRange:NSMakeRange(self.currentIndex, packetLength)];
-        [content appendData:partialBody];
+    if (status != PGP_OK) {
+        NSUInteger index = self.currentIndex;
         
-        self.currentIndex += packetLength;
-        packetLength = [self readPacketLengthWithError:error];
+        // Nothing after a broken packet can be framed, so the reader is done:
+        self.currentIndex = self.data.length;
         
-        if (error) return nil;
-    }
-    
-    if (packetLength > 0) {
-        NSData *body = [self.data subdataWithRange:NSMakeRange(self.currentIndex, packetLength)];
-        [content appendData:body];
+        *error = [NSError errorWithDomain:PacketReaderErrorDomain
+                                     code:status == PGP_ERROR_MALFORMED ? PacketReaderErrorPtagFormat : PacketReaderErrorReadPastEnd
+                                 userInfo:@{@"index": @(index)}];
         
-        self.currentIndex += packetLength;
+        return nil;
     }
     
-    return [Packet packetWithType:type body:[NSData dataWithData:content]];
-}
-
-- (BOOL)isComplete {
-    return self.currentIndex >= self.data.length;
-}
-
-- (PacketType)readPacketTagWithError:(NSError **)error {
-    Byte ptag = [self nextByte];
+    self.currentIndex = packet.end;
     
-    if (!(ptag & 0x80)) {
-        *error = [NSError errorWithDomain:PacketReaderErrorDomain
-                                     code:PacketReaderErrorPtagFormat
-                                 userInfo:@{@"ptag": @(ptag)}];
-        
-        return PacketTypeUnknown;
+    // Packet types nothing reads are stepped over without touching their bodies:
+    if (!pgp_packet_is_supported(packet.tag)) {
+        return nil;
     }
     
-    return ptag & 0x1F;
-}
-
-- (NSUInteger)readPacketLengthWithError:(NSError **)error {
-    
-    const Byte firstOctet = [self nextByte];
+    NSData *body = nil;
+    const Byte *bodyBytes = (const Byte *) self.data.bytes + packet.bodyOffset;
     
-    if (firstOctet >= 0 && firstOctet <= 191) {
-        return firstOctet;
-    } else if (firstOctet >= 224 && firstOctet <= 254) {
-        return 1 << (firstOctet * 0x1F);
+    // Partial bodies have to be joined first, whole ones are checked in place before any copy:
+    if (packet.partial) {
+        NSMutableData *content = [NSMutableData dataWithLength:packet.bodyLength];
+        pgp_packet_copy_body(self.data.bytes, &packet, content.mutableBytes);
+        
+        body = content;
+        bodyBytes = content.bytes;
     }
     
-    const Byte secondOctet = [self nextByte];
+    status = pgp_packet_check_body(packet.tag, bodyBytes, packet.bodyLength);
     
-    if (firstOctet >= 192 && firstOctet <= 223) {
-        return ((firstOctet - 192) << 8) + secondOctet + 192;
+    if (status != PGP_OK) {
+        *error = [NSError errorWithDomain:PacketReaderErrorDomain
+                                     code:status == PGP_ERROR_UNSUPPORTED ? PacketReaderErrorUnsupportedBody : PacketReaderErrorMalformedBody
+                                 userInfo:@{@"tag": @(packet.tag)}];
+        
+        return nil;
     }
     
-    const Byte thirdOctet = [self nextByte];
-    const Byte fourthOctet = [self nextByte];
-    const Byte fifthOctet = [self nextByte];
+    if (body == nil) {
+        body = [self.data subdataWithRange:NSMakeRange(packet.bodyOffset, packet.bodyLength)];
+    }
     
-    return (secondOctet << 24) | (thirdOctet << 16) | (fourthOctet << 8) | fifthOctet;
+    return [Packet packetWithType:packet.tag body:body];
 }
 
-- (const Byte *)bytes {
-    return self.data.bytes;
-}
-
-- (const Byte)nextByte {
-    return self.bytes[self.currentIndex++];
+- (BOOL)isComplete {
+    return self.currentIndex >= self.data.length;
 }
 
 @end
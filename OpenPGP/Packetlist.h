@@ -14,6 +14,10 @@
 @property (nonatomic, readonly) NSArray *packets;
 
 + (instancetype)packetListFromData:(NSData *)data;
+
+/// Unknown packet types are skipped. Returns nil with the reader's error for the first packet
+/// that is malformed or not supported:
++ (instancetype)packetListFromData:(NSData *)data error:(NSError **)error;
 + (instancetype)packetListWithPackets:(NSArray *)packets;
 
 + (instancetype)emptyPacketList;
@@ -0,0 +1,214 @@
+//
+//  Random.c
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <sys/random.h>
+#endif
+#include "Random.h"
+
+#define RANDOM_KEY_LENGTH 32
+#define RANDOM_BLOCK_LENGTH 64
+#define RANDOM_BUFFER_LENGTH (16 * RANDOM_BLOCK_LENGTH)
+#define RANDOM_RESEED_INTERVAL (1 << 20)
+
+typedef struct {
+    uint32_t input[16];
+    uint8_t buffer[RANDOM_BUFFER_LENGTH];
+    
+    // Unused output is at the end of the buffer:
+    size_t available;
+    size_t untilReseed;
+    unsigned long forkGeneration;
+} random_state;
+
+static pthread_once_t random_once = PTHREAD_ONCE_INIT;
+static pthread_key_t random_key;
+
+// Bumped in forked children, which would otherwise repeat their parent's output:
+static volatile unsigned long random_fork_generation = 0;
+
+// ChaCha20:
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(x, a, b, c, d) do {                 \
+    x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 16);        \
+    x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 12);        \
+    x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 8);         \
+    x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 7);         \
+} while (0)
+
+static uint32_t load32(const uint8_t *bytes) {
+    return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static void store32(uint8_t *bytes, uint32_t value) {
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+}
+
+/// One 64 byte block of RFC 8439 ChaCha20 for the key, counter and nonce in input:
+static void chacha20_block(uint8_t output[RANDOM_BLOCK_LENGTH], const uint32_t input[16]) {
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+    
+    for (int i = 0; i < 10; i++) {
+        QUARTERROUND(x, 0, 4, 8, 12);
+        QUARTERROUND(x, 1, 5, 9, 13);
+        QUARTERROUND(x, 2, 6, 10, 14);
+        QUARTERROUND(x, 3, 7, 11, 15);
+        QUARTERROUND(x, 0, 5, 10, 15);
+        QUARTERROUND(x, 1, 6, 11, 12);
+        QUARTERROUND(x, 2, 7, 8, 13);
+        QUARTERROUND(x, 3, 4, 9, 14);
+    }
+    
+    for (int i = 0; i < 16; i++) {
+        store32(output + 4 * i, x[i] + input[i]);
+    }
+}
+
+/// Key words 4 to 11, the counter and nonce start again at zero under each new key:
+static void chacha20_set_key(uint32_t input[16], const uint8_t key[RANDOM_KEY_LENGTH]) {
+    input[0] = 0x61707865;
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    
+    for (int i = 0; i < 8; i++) {
+        input[4 + i] = load32(key + 4 * i);
+    }
+    
+    for (int i = 12; i < 16; i++) {
+        input[i] = 0;
+    }
+}
+
+// Generator:
+
+static void random_os_bytes(uint8_t *bytes, size_t length) {
+    
+    // Without the OS there's nothing safe to fall back on:
+    if (getentropy(bytes, length) != 0) {
+        abort();
+    }
+}
+
+static void random_after_fork(void) {
+    random_fork_generation++;
+}
+
+static void random_destroy_state(void *state) {
+    memset(state, 0, sizeof(random_state));
+    free(state);
+}
+
+static void random_init(void) {
+    pthread_key_create(&random_key, random_destroy_state);
+    pthread_atfork(NULL, NULL, random_after_fork);
+}
+
+/// Mixes fresh OS entropy into the key:
+static void random_reseed(random_state *state) {
+    uint8_t seed[RANDOM_KEY_LENGTH];
+    uint8_t key[RANDOM_KEY_LENGTH];
+    random_os_bytes(seed, RANDOM_KEY_LENGTH);
+    
+    for (int i = 0; i < 8; i++) {
+        store32(key + 4 * i, state->input[4 + i] ^ load32(seed + 4 * i));
+    }
+    
+    chacha20_set_key(state->input, key);
+    
+    memset(seed, 0, RANDOM_KEY_LENGTH);
+    memset(key, 0, RANDOM_KEY_LENGTH);
+    
+    state->available = 0;
+    state->untilReseed = RANDOM_RESEED_INTERVAL;
+    state->forkGeneration = random_fork_generation;
+}
+
+/// The first 32 bytes of each buffer become the next key and are never handed out, so the state
+/// can't be wound back to output already used:
+static void random_refill(random_state *state) {
+    if (state->untilReseed == 0 || state->forkGeneration != random_fork_generation) {
+        random_reseed(state);
+    }
+    
+    for (size_t offset = 0; offset < RANDOM_BUFFER_LENGTH; offset += RANDOM_BLOCK_LENGTH) {
+        chacha20_block(state->buffer + offset, state->input);
+        state->input[12]++;
+    }
+    
+    chacha20_set_key(state->input, state->buffer);
+    memset(state->buffer, 0, RANDOM_KEY_LENGTH);
+    
+    state->available = RANDOM_BUFFER_LENGTH - RANDOM_KEY_LENGTH;
+    state->untilReseed -= state->untilReseed < state->available ? state->untilReseed : state->available;
+}
+
+static random_state *random_thread_state(void) {
+    pthread_once(&random_once, random_init);
+    random_state *state = pthread_getspecific(random_key);
+    
+    if (state == NULL) {
+        state = calloc(1, sizeof(random_state));
+        
+        if (state == NULL) {
+            abort();
+        }
+        
+        random_reseed(state);
+        pthread_setspecific(random_key, state);
+    }
+    
+    return state;
+}
+
+// Public:
+
+void random_bytes(uint8_t *bytes, size_t length) {
+    random_state *state = random_thread_state();
+    
+    // Output already buffered before a fork would be shared with the child:
+    if (state->forkGeneration != random_fork_generation) {
+        state->available = 0;
+    }
+    
+    while (length > 0) {
+        if (state->available == 0) {
+            random_refill(state);
+        }
+        
+        size_t count = length < state->available ? length : state->available;
+        uint8_t *source = state->buffer + RANDOM_BUFFER_LENGTH - state->available;
+        
+        memcpy(bytes, source, count);
+        memset(source, 0, count);
+        
+        bytes += count;
+        length -= count;
+        state->available -= count;
+    }
+}
+
+void random_nonzero_bytes(uint8_t *bytes, size_t length) {
+    random_bytes(bytes, length);
+    
+    for (size_t i = 0; i < length; i++) {
+        while (bytes[i] == 0) {
+            random_bytes(bytes + i, 1);
+        }
+    }
+}
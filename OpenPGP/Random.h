@@ -0,0 +1,33 @@
+//
+//  Random.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#ifndef OpenPGP_Random_h
+#define OpenPGP_Random_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every random byte the library uses comes from here: session keys, EME padding, ephemeral and
+// generated curve keys, and encryption prefixes. Each thread runs its own ChaCha20 generator
+// over a buffer of output, seeded from the OS and reseeded after every megabyte and in forked
+// children, so drawing bytes takes no locks and rarely a system call.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void random_bytes(uint8_t *bytes, size_t length);
+
+/// As random_bytes with every zero byte drawn again, for EME-PKCS1-v1_5 padding:
+void random_nonzero_bytes(uint8_t *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+//
+//  SessionKeyCache.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Crypto.h"
+#import "Utility.h"
+
+@class Keyring, PKESKeyPacket;
+
+/// Remembers the session keys recovered from session key packets, so reopening a message skips
+/// the private key operation. Entries are keyed by a SHA256 digest of the packet and only
+/// handed out when the keyring still holds the secret key that recovered them. Least recently
+/// used entries are evicted past the capacity.
+@interface SessionKeyCache : NSObject
+
+@property (nonatomic, readonly) NSUInteger capacity;
+@property (nonatomic, readonly) NSUInteger count;
+
+@property (nonatomic, readonly) NSUInteger hits;
+@property (nonatomic, readonly) NSUInteger misses;
+
++ (SessionKeyCache *)cacheWithCapacity:(NSUInteger)capacity;
+
+/// Loads and saves the entries encrypted under the 32 byte AES256 storage key. A file that
+/// doesn't decrypt under the key is ignored:
++ (SessionKeyCache *)cacheWithCapacity:(NSUInteger)capacity path:(NSString *)path storageKey:(NSData *)storageKey;
+
+/// Counts a hit or a miss for the message these packets came from:
+- (NSData *)sessionKeyForPackets:(NSArray *)sessionKeyPackets
+                      keyring:(Keyring *)keyring
+           symmetricAlgorithm:(SymmetricAlgorithm *)symmetricAlgorithm;
+
+- (void)setSessionKey:(NSData *)sessionKey
+   symmetricAlgorithm:(SymmetricAlgorithm)symmetricAlgorithm
+            forPacket:(PKESKeyPacket *)sessionKeyPacket
+                keyId:(KeyID)keyId;
+
+- (void)removeAllSessionKeys;
+
+/// Writes the entries to the cache's path, returns NO if it has none or the write fails:
+- (BOOL)synchronize;
+
+@end
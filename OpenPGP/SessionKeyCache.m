@@ -0,0 +1,237 @@
+//
+//  SessionKeyCache.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <openssl/sha.h>
+#import "SessionKeyCache.h"
+#import "Instrumentation.h"
+#import "Key.h"
+#import "Keyring.h"
+#import "PKESPacket.h"
+#import "Random.h"
+
+#define SessionKeyCacheMaxKeyLength 32
+
+/// Key ID, symmetric algorithm, key length and the key, zero padded:
+#define SessionKeyCacheEntryLength (KeyIDLength + 2 + SessionKeyCacheMaxKeyLength)
+#define SessionKeyCacheRecordLength (SHA256_DIGEST_LENGTH + SessionKeyCacheEntryLength)
+
+/// Random block plus its last two bytes repeated, like integrity protected data:
+#define SessionKeyCachePrefixLength (kCCBlockSizeAES128 + 2)
+
+@interface SessionKeyCache () {
+    NSMutableDictionary *_entries;
+    NSMutableOrderedSet *_digests;
+}
+
+@property (nonatomic, strong) NSString *path;
+@property (nonatomic, strong) NSData *storageKey;
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity path:(NSString *)path storageKey:(NSData *)storageKey;
+
+- (void)readFile;
+- (void)addEntry:(NSData *)entry forDigest:(NSData *)digest;
+
+@end
+
+@implementation SessionKeyCache
+
++ (SessionKeyCache *)cacheWithCapacity:(NSUInteger)capacity {
+    return [[self alloc] initWithCapacity:capacity path:nil storageKey:nil];
+}
+
++ (SessionKeyCache *)cacheWithCapacity:(NSUInteger)capacity path:(NSString *)path storageKey:(NSData *)storageKey {
+    if (storageKey.length != kCCKeySizeAES256) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException
+                                       reason:@"Storage key must be a 32 byte AES256 key."
+                                     userInfo:@{@"length": @(storageKey.length)}];
+    }
+    
+    return [[self alloc] initWithCapacity:capacity path:path storageKey:storageKey];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity path:(NSString *)path storageKey:(NSData *)storageKey {
+    self = [super init];
+    
+    if (self != nil) {
+        _capacity = MAX(capacity, 1);
+        _entries = [NSMutableDictionary dictionaryWithCapacity:_capacity];
+        _digests = [NSMutableOrderedSet orderedSetWithCapacity:_capacity];
+        
+        _path = path;
+        _storageKey = storageKey;
+        
+        if (path != nil) {
+            [self readFile];
+        }
+    }
+    
+    return self;
+}
+
+- (NSUInteger)count {
+    @synchronized (self) {
+        return _digests.count;
+    }
+}
+
+- (NSData *)sessionKeyForPackets:(NSArray *)sessionKeyPackets
+                      keyring:(Keyring *)keyring
+           symmetricAlgorithm:(SymmetricAlgorithm *)symmetricAlgorithm {
+    
+    // Digests outside the lock, they're the only real work here:
+    NSMutableArray *digests = [NSMutableArray arrayWithCapacity:sessionKeyPackets.count];
+    
+    for (PKESKeyPacket *packet in sessionKeyPackets) {
+        [digests addObject:[Crypto hashData:packet.body]];
+    }
+    
+    @synchronized (self) {
+        for (NSData *digest in digests) {
+            NSData *entry = _entries[digest];
+            
+            if (entry == nil) {
+                continue;
+            }
+            
+            const Byte *bytes = entry.bytes;
+            
+            // Only for whoever could have decrypted it themselves:
+            if ([keyring secretKeyForKeyId:[Utility readKeyID:bytes]] == nil) {
+                continue;
+            }
+            
+            [_digests removeObject:digest];
+            [_digests addObject:digest];
+            
+            _hits++;
+            PGP_COUNT(PGP_COUNTER_SESSION_KEY_CACHE_HITS);
+            
+            if (symmetricAlgorithm != NULL) {
+                *symmetricAlgorithm = bytes[KeyIDLength];
+            }
+            
+            return [NSData dataWithBytes:bytes + KeyIDLength + 2 length:bytes[KeyIDLength + 1]];
+        }
+        
+        _misses++;
+        
+        return nil;
+    }
+}
+
+- (void)setSessionKey:(NSData *)sessionKey
+   symmetricAlgorithm:(SymmetricAlgorithm)symmetricAlgorithm
+            forPacket:(PKESKeyPacket *)sessionKeyPacket
+                keyId:(KeyID)keyId {
+    if (sessionKey.length > SessionKeyCacheMaxKeyLength) {
+        return;
+    }
+    
+    Byte entry[SessionKeyCacheEntryLength];
+    memset(entry, 0, SessionKeyCacheEntryLength);
+    
+    [Utility writeKeyID:keyId toBytes:entry];
+    entry[KeyIDLength] = symmetricAlgorithm;
+    entry[KeyIDLength + 1] = sessionKey.length;
+    memcpy(entry + KeyIDLength + 2, sessionKey.bytes, sessionKey.length);
+    
+    NSData *digest = [Crypto hashData:sessionKeyPacket.body];
+    
+    @synchronized (self) {
+        [self addEntry:[NSData dataWithBytes:entry length:SessionKeyCacheEntryLength] forDigest:digest];
+    }
+}
+
+- (void)removeAllSessionKeys {
+    @synchronized (self) {
+        [_entries removeAllObjects];
+        [_digests removeAllObjects];
+    }
+}
+
+- (BOOL)synchronize {
+    if (self.path == nil) {
+        return NO;
+    }
+    
+    NSMutableData *plaintext = [NSMutableData data];
+    
+    Byte prefix[SessionKeyCachePrefixLength];
+    random_bytes(prefix, kCCBlockSizeAES128);
+    prefix[kCCBlockSizeAES128] = prefix[kCCBlockSizeAES128 - 2];
+    prefix[kCCBlockSizeAES128 + 1] = prefix[kCCBlockSizeAES128 - 1];
+    
+    [plaintext appendBytes:prefix length:SessionKeyCachePrefixLength];
+    
+    // Least recently used first, so reading the file back keeps the order:
+    @synchronized (self) {
+        for (NSData *digest in _digests) {
+            [plaintext appendData:digest];
+            [plaintext appendData:_entries[digest]];
+        }
+    }
+    
+    NSData *records = [plaintext subdataWithRange:NSMakeRange(SessionKeyCachePrefixLength, plaintext.length - SessionKeyCachePrefixLength)];
+    [plaintext appendData:[Crypto hashData:records]];
+    
+    NSData *ciphertext = [Crypto encryptData:plaintext withSymmetricKey:self.storageKey.bytes];
+    
+    return [ciphertext writeToFile:self.path atomically:YES];
+}
+
+#pragma mark Private
+
+- (void)readFile {
+    NSData *ciphertext = [NSData dataWithContentsOfFile:self.path];
+    
+    if (ciphertext == nil || ![Crypto quickCheckData:ciphertext withSymmetricKey:self.storageKey.bytes]) {
+        return;
+    }
+    
+    NSData *plaintext = [Crypto decryptData:ciphertext withSymmetricKey:self.storageKey.bytes];
+    
+    if (plaintext.length < SessionKeyCachePrefixLength + SHA256_DIGEST_LENGTH) {
+        return;
+    }
+    
+    NSUInteger recordsLength = plaintext.length - SessionKeyCachePrefixLength - SHA256_DIGEST_LENGTH;
+    
+    if (recordsLength % SessionKeyCacheRecordLength != 0) {
+        return;
+    }
+    
+    NSData *records = [plaintext subdataWithRange:NSMakeRange(SessionKeyCachePrefixLength, recordsLength)];
+    NSData *digest = [plaintext subdataWithRange:NSMakeRange(SessionKeyCachePrefixLength + recordsLength, SHA256_DIGEST_LENGTH)];
+    
+    if (![[Crypto hashData:records] isEqualToData:digest]) {
+        return;
+    }
+    
+    const Byte *bytes = records.bytes;
+    
+    for (NSUInteger i = 0; i < recordsLength; i += SessionKeyCacheRecordLength) {
+        [self addEntry:[NSData dataWithBytes:bytes + i + SHA256_DIGEST_LENGTH length:SessionKeyCacheEntryLength]
+             forDigest:[NSData dataWithBytes:bytes + i length:SHA256_DIGEST_LENGTH]];
+    }
+}
+
+- (void)addEntry:(NSData *)entry forDigest:(NSData *)digest {
+    if (_entries[digest] != nil) {
+        [_digests removeObject:digest];
+    }
+    
+    _entries[digest] = entry;
+    [_digests addObject:digest];
+    
+    while (_digests.count > _capacity) {
+        [_entries removeObjectForKey:_digests.firstObject];
+        [_digests removeObjectAtIndex:0];
+    }
+}
+
+@end
@@ -7,7 +7,10 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "Crypto.h"
+#import "Utility.h"
 
+@class HashContext;
 @class PublicKey;
 @class KeyPacket, LiteralDataPacket, SignaturePacket, UserIDPacket;
 
@@ -38,16 +41,39 @@ typedef NS_ENUM(NSUInteger, SignatureType) {
 @interface Signature : NSObject
 
 @property (nonatomic, readonly) SignatureType type;
+@property (nonatomic, readonly) PublicKeyAlgorithm publicKeyAlgorithm;
+@property (nonatomic, readonly) HashAlgorithm hashAlgorithm;
+
+@property (nonatomic, readonly) NSData *hashedSubpackets;
+@property (nonatomic, readonly) NSUInteger signedHashValue;
+
 @property (nonatomic, readonly) NSData *data;
-@property (nonatomic, readonly) NSString *keyID;
+@property (nonatomic, readonly) KeyID keyID;
 
 + (Signature *)signatureForKeyPacket:(KeyPacket *)keyPacket
                         userIdPacket:(UserIDPacket *)userIdPacket
                         signatureKey:(SecretKey *)signatureKey;
 
+/// Binds the subkey to the signature key's public key:
++ (Signature *)signatureForSubkey:(PublicKey *)subkey
+                     signatureKey:(SecretKey *)signatureKey;
+
 + (Signature *)signatureForLiteralDataPacket:(LiteralDataPacket *)literalDataPacket
                                 signatureKey:(SecretKey *)signatureKey;
 
 + (Signature *)signatureForSignaturePacket:(SignaturePacket *)signaturePacket;
 
+/// Finishes a v4 signature over whatever has already been fed into the hash context:
++ (Signature *)signatureWithType:(SignatureType)type
+                     hashContext:(HashContext *)hashContext
+                hashedSubpackets:(NSData *)hashedSubpackets
+                    signatureKey:(SecretKey *)signatureKey;
+
+/// Same, with the trailer for the hashed subpackets built beforehand so it can be reused:
++ (Signature *)signatureWithType:(SignatureType)type
+                     hashContext:(HashContext *)hashContext
+                hashedSubpackets:(NSData *)hashedSubpackets
+                         trailer:(NSData *)trailer
+                    signatureKey:(SecretKey *)signatureKey;
+
 @end
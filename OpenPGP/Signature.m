@@ -7,7 +7,9 @@
 //
 
 #import "Crypto.h"
+#import "HashContext.h"
 #import "Signature.h"
+#import "SignatureContext.h"
 #import "KeyPacket.h"
 #import "LiteralDataPacket.h"
 #import "SignaturePacket.h"
@@ -19,17 +21,18 @@
 + (Signature *)signatureForKeyPacket:(KeyPacket *)keyPacket
                         userIdPacket:(UserIDPacket *)userIdPacket
                         signatureKey:(SecretKey *)signatureKey {
-    NSMutableData *signatureBody = [NSMutableData data];
+    HashContext *hashContext = [HashContext contextWithAlgorithm:HashAlgorithmSHA256];
     
-    NSData *keyBody = keyPacket.body;
+    // Certifications always hash the public key packet, even when exporting the secret key:
+    NSData *keyBody = (keyPacket.publicKey ?: keyPacket.secretKey.publicKey).packetBody;
     
     Byte keyHeader[3];
     
     keyHeader[0] = 0x99;
     [Utility writeNumber:keyBody.length bytes:keyHeader + 1 length:2];
     
-    [signatureBody appendBytes:keyHeader length:3];
-    [signatureBody appendData:keyBody];
+    [hashContext updateWithBytes:keyHeader length:3];
+    [hashContext updateWithData:keyBody];
     
     NSData *userIdBody = userIdPacket.body;
     
@@ -38,37 +41,126 @@
     userIdHeader[0] = 0xB4;
     [Utility writeNumber:userIdBody.length bytes:userIdHeader + 1 length:4];
     
-    [signatureBody appendBytes:userIdHeader length:5];
-    [signatureBody appendData:userIdBody];
+    [hashContext updateWithBytes:userIdHeader length:5];
+    [hashContext updateWithData:userIdBody];
     
-    NSData *hashData = [Crypto hashData:signatureBody];
-    NSData *signatureData = [Crypto signData:hashData withSecretKey:signatureKey];
+    NSUInteger creationTime = [[NSDate date] timeIntervalSince1970];
+    NSData *hashedSubpackets = [SignaturePacket hashedSubpacketDataForCertificationWithCreationTime:creationTime
+                                                                                               keyId:signatureKey.publicKey.keyID];
+    
+    return [self signatureWithType:SignatureTypeUserIDCertificationGeneric
+                       hashContext:hashContext
+                  hashedSubpackets:hashedSubpackets
+                      signatureKey:signatureKey];
+}
 
-    return [[self alloc] initWithType:SignatureTypeUserIDCertificationGeneric
-                                 data:signatureData
-                                keyID:signatureKey.publicKey.keyID];
++ (Signature *)signatureForSubkey:(PublicKey *)subkey
+                     signatureKey:(SecretKey *)signatureKey {
+    HashContext *hashContext = [HashContext contextWithAlgorithm:HashAlgorithmSHA256];
+    
+    // Both keys are hashed as public key packets, primary key first:
+    for (PublicKey *key in @[signatureKey.publicKey, subkey]) {
+        NSData *keyBody = key.packetBody;
+        
+        Byte keyHeader[3];
+        
+        keyHeader[0] = 0x99;
+        [Utility writeNumber:keyBody.length bytes:keyHeader + 1 length:2];
+        
+        [hashContext updateWithBytes:keyHeader length:3];
+        [hashContext updateWithData:keyBody];
+    }
+    
+    NSUInteger creationTime = [[NSDate date] timeIntervalSince1970];
+    NSData *hashedSubpackets = [SignaturePacket hashedSubpacketDataForSubkeyBindingWithCreationTime:creationTime
+                                                                                               keyId:signatureKey.publicKey.keyID];
+    
+    return [self signatureWithType:SignatureTypeBindingSubkey
+                       hashContext:hashContext
+                  hashedSubpackets:hashedSubpackets
+                      signatureKey:signatureKey];
 }
 
 + (Signature *)signatureForLiteralDataPacket:(LiteralDataPacket *)literalDataPacket
                                 signatureKey:(SecretKey *)signatureKey {
     
-    NSData *hashData = [Crypto hashData:literalDataPacket.literalData];
-    NSData *signatureData = [Crypto signData:hashData withSecretKey:signatureKey];
-    
     SignatureType signatureType = literalDataPacket.dataFormat == DataFormatBinary ? SignatureTypeBinary : SignatureTypeCanonicalText;
     
-    return [[Signature alloc] initWithType:signatureType data:signatureData keyID:signatureKey.publicKey.keyID];
+    SignatureGenerator *generator = [SignatureGenerator generatorWithSignatureType:signatureType signatureKey:signatureKey];
+    [generator updateWithData:literalDataPacket.literalData];
+    
+    return [generator finishSignature];
 }
 
 + (Signature *)signatureForSignaturePacket:(SignaturePacket *)signaturePacket {
-    return [[self alloc] initWithType:signaturePacket.signatureType data:signaturePacket.signatureData keyID:signaturePacket.keyId];
+    return [[self alloc] initWithType:signaturePacket.signatureType
+                   publicKeyAlgorithm:signaturePacket.publicKeyAlgorithm
+                        hashAlgorithm:signaturePacket.hashAlgorithm
+                     hashedSubpackets:signaturePacket.hashedSubpackets
+                      signedHashValue:signaturePacket.signedHashValue
+                                 data:signaturePacket.signatureData
+                                keyID:signaturePacket.keyId];
+}
+
++ (Signature *)signatureWithType:(SignatureType)type
+                     hashContext:(HashContext *)hashContext
+                hashedSubpackets:(NSData *)hashedSubpackets
+                    signatureKey:(SecretKey *)signatureKey {
+    
+    NSData *hashData = [SignaturePacket hashDataWithSignatureType:type
+                                               publicKeyAlgorithm:signatureKey.publicKey.publicKeyAlgorithm
+                                                    hashAlgorithm:hashContext.algorithm
+                                                 hashedSubpackets:hashedSubpackets];
+    
+    return [self signatureWithType:type
+                       hashContext:hashContext
+                  hashedSubpackets:hashedSubpackets
+                           trailer:[SignaturePacket trailerForHashData:hashData]
+                      signatureKey:signatureKey];
+}
+
++ (Signature *)signatureWithType:(SignatureType)type
+                     hashContext:(HashContext *)hashContext
+                hashedSubpackets:(NSData *)hashedSubpackets
+                         trailer:(NSData *)trailer
+                    signatureKey:(SecretKey *)signatureKey {
+    
+    [hashContext updateWithData:trailer];
+    
+    NSData *digest = [hashContext finalDigest];
+    NSData *signatureData = [Crypto signDigest:digest algorithm:hashContext.algorithm withSecretKey:signatureKey];
+    
+    if (signatureData == nil) {
+        return nil;
+    }
+    
+    const Byte *digestBytes = digest.bytes;
+    NSUInteger signedHashValue = (digestBytes[0] << 8) | digestBytes[1];
+    
+    return [[self alloc] initWithType:type
+                   publicKeyAlgorithm:signatureKey.publicKey.publicKeyAlgorithm
+                        hashAlgorithm:hashContext.algorithm
+                     hashedSubpackets:hashedSubpackets
+                      signedHashValue:signedHashValue
+                                 data:signatureData
+                                keyID:signatureKey.publicKey.keyID];
 }
 
-- (instancetype)initWithType:(SignatureType)type data:(NSData *)data keyID:(NSString *)keyID {
+- (instancetype)initWithType:(SignatureType)type
+          publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
+               hashAlgorithm:(HashAlgorithm)hashAlgorithm
+            hashedSubpackets:(NSData *)hashedSubpackets
+             signedHashValue:(NSUInteger)signedHashValue
+                        data:(NSData *)data
+                       keyID:(KeyID)keyID {
     self = [super init];
     
     if (self != nil) {
         _type = type;
+        _publicKeyAlgorithm = publicKeyAlgorithm;
+        _hashAlgorithm = hashAlgorithm;
+        _hashedSubpackets = hashedSubpackets;
+        _signedHashValue = signedHashValue;
         _data = data;
         _keyID = keyID;
     }
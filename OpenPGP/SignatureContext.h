@@ -0,0 +1,64 @@
+//
+//  SignatureContext.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Crypto.h"
+#import "Signature.h"
+
+@class HashContext, OnePassSignaturePacket, PublicKey, SecretKey, SignaturePacket;
+
+#pragma mark - SignatureContext interface
+
+/// Hashes signed data as it arrives, canonicalizing line endings for text signatures:
+@interface SignatureContext : NSObject
+
+@property (nonatomic, readonly) SignatureType signatureType;
+@property (nonatomic, readonly) HashContext *hashContext;
+
+/// Returns nil if the hash algorithm isn't supported:
++ (SignatureContext *)contextWithSignatureType:(SignatureType)signatureType hashAlgorithm:(HashAlgorithm)hashAlgorithm;
+
+- (void)updateWithBytes:(const Byte *)bytes length:(NSUInteger)length;
+- (void)updateWithData:(NSData *)data;
+
+@end
+
+#pragma mark - SignatureVerifier interface
+
+/// One-pass verification: set up from the one-pass signature packet, fed the
+/// literal data, then checked against the signature packet that trails it.
+@interface SignatureVerifier : SignatureContext
+
+@property (nonatomic, readonly) KeyID keyId;
+
++ (SignatureVerifier *)verifierWithOnePassSignaturePacket:(OnePassSignaturePacket *)onePassSignaturePacket;
+
+/// Detached signatures have no one-pass packet, the signature packet comes first:
++ (SignatureVerifier *)verifierWithSignaturePacket:(SignaturePacket *)signaturePacket;
+
+- (BOOL)verifySignaturePacket:(SignaturePacket *)signaturePacket withPublicKey:(PublicKey *)publicKey;
+
+@end
+
+#pragma mark - SignatureGenerator interface
+
+/// One-pass signing: the one-pass signature packet can be written before any
+/// data, the data is hashed as it's fed in, and the signature comes at the end.
+@interface SignatureGenerator : SignatureContext
+
+@property (nonatomic, readonly) SecretKey *signatureKey;
+@property (nonatomic, readonly) NSUInteger creationTime;
+
+@property (nonatomic, readonly) OnePassSignaturePacket *onePassSignaturePacket;
+
++ (SignatureGenerator *)generatorWithSignatureType:(SignatureType)signatureType signatureKey:(SecretKey *)signatureKey;
+
+/// Signs everything fed in so far, the generator can't be updated afterwards:
+- (Signature *)finishSignature;
+
+@end
@@ -0,0 +1,227 @@
+//
+//  SignatureContext.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import "SignatureContext.h"
+#import "HashContext.h"
+#import "Key.h"
+#import "OnePassSignaturePacket.h"
+#import "SignaturePacket.h"
+
+#pragma mark - SignatureContext extension
+
+@interface SignatureContext () {
+    Byte _lastByte;
+}
+
+- (instancetype)initWithSignatureType:(SignatureType)signatureType hashContext:(HashContext *)hashContext;
+
+@end
+
+#pragma mark - SignatureContext implementation
+
+@implementation SignatureContext
+
++ (SignatureContext *)contextWithSignatureType:(SignatureType)signatureType hashAlgorithm:(HashAlgorithm)hashAlgorithm {
+    HashContext *hashContext = [HashContext contextWithAlgorithm:hashAlgorithm];
+    
+    if (hashContext == nil) {
+        return nil;
+    }
+    
+    return [[self alloc] initWithSignatureType:signatureType hashContext:hashContext];
+}
+
+- (instancetype)initWithSignatureType:(SignatureType)signatureType hashContext:(HashContext *)hashContext {
+    self = [super init];
+    
+    if (self != nil) {
+        _signatureType = signatureType;
+        _hashContext = hashContext;
+        _lastByte = 0;
+    }
+    
+    return self;
+}
+
+- (void)updateWithBytes:(const Byte *)bytes length:(NSUInteger)length {
+    if (length == 0) {
+        return;
+    }
+    
+    if (self.signatureType != SignatureTypeCanonicalText) {
+        [self.hashContext updateWithBytes:bytes length:length];
+        return;
+    }
+    
+    // Text signatures are made over <CR><LF> line endings, so bare <LF>s get a <CR> in front:
+    static const Byte carriageReturn = '\r';
+    
+    const Byte *current = bytes;
+    const Byte *end = bytes + length;
+    Byte previous = _lastByte;
+    
+    while (current < end) {
+        const Byte *lineFeed = memchr(current, '\n', end - current);
+        
+        if (lineFeed == NULL) {
+            [self.hashContext updateWithBytes:current length:end - current];
+            break;
+        }
+        
+        if (lineFeed > current) {
+            previous = lineFeed[-1];
+        }
+        
+        if (previous != carriageReturn) {
+            [self.hashContext updateWithBytes:current length:lineFeed - current];
+            [self.hashContext updateWithBytes:&carriageReturn length:1];
+            [self.hashContext updateWithBytes:lineFeed length:1];
+        } else {
+            [self.hashContext updateWithBytes:current length:lineFeed - current + 1];
+        }
+        
+        previous = '\n';
+        current = lineFeed + 1;
+    }
+    
+    _lastByte = bytes[length - 1];
+}
+
+- (void)updateWithData:(NSData *)data {
+    [self updateWithBytes:data.bytes length:data.length];
+}
+
+@end
+
+#pragma mark - SignatureVerifier extension
+
+@interface SignatureVerifier () {
+    BOOL _finished;
+}
+
+@end
+
+#pragma mark - SignatureVerifier implementation
+
+@implementation SignatureVerifier
+
++ (SignatureVerifier *)verifierWithOnePassSignaturePacket:(OnePassSignaturePacket *)onePassSignaturePacket {
+    SignatureVerifier *verifier = (SignatureVerifier *) [self contextWithSignatureType:onePassSignaturePacket.signatureType
+                                                                         hashAlgorithm:onePassSignaturePacket.hashAlgorithm];
+    
+    if (verifier != nil) {
+        verifier->_keyId = onePassSignaturePacket.keyId;
+        verifier->_finished = NO;
+    }
+    
+    return verifier;
+}
+
++ (SignatureVerifier *)verifierWithSignaturePacket:(SignaturePacket *)signaturePacket {
+    SignatureVerifier *verifier = (SignatureVerifier *) [self contextWithSignatureType:signaturePacket.signatureType
+                                                                         hashAlgorithm:signaturePacket.hashAlgorithm];
+    
+    if (verifier != nil) {
+        verifier->_keyId = signaturePacket.keyId;
+        verifier->_finished = NO;
+    }
+    
+    return verifier;
+}
+
+- (BOOL)verifySignaturePacket:(SignaturePacket *)signaturePacket withPublicKey:(PublicKey *)publicKey {
+    if (_finished || publicKey == nil) {
+        return NO;
+    }
+    
+    _finished = YES;
+    
+    if (signaturePacket.signatureType != self.signatureType || signaturePacket.hashAlgorithm != self.hashContext.algorithm) {
+        return NO;
+    }
+    
+    // The issuer key ID can name an encryption subkey, only a key of the signature's own
+    // algorithm can check it:
+    if (publicKey.publicKeyAlgorithm != signaturePacket.publicKeyAlgorithm) {
+        return NO;
+    }
+    
+    if (publicKey.publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign && publicKey.publicKeyAlgorithm != PublicKeyAlgorithmEdDSA) {
+        return NO;
+    }
+    
+    NSData *trailer = signaturePacket.trailer;
+    
+    if (trailer == nil) {
+        return NO;
+    }
+    
+    [self.hashContext updateWithData:trailer];
+    
+    NSData *digest = [self.hashContext finalDigest];
+    const Byte *digestBytes = digest.bytes;
+    
+    // The left 16 bits of the hash are in the clear, skip the RSA operation if they don't match:
+    NSUInteger signedHashValue = (digestBytes[0] << 8) | digestBytes[1];
+    
+    if (signedHashValue != signaturePacket.signedHashValue) {
+        return NO;
+    }
+    
+    return [Crypto verifyDigest:digest
+                      algorithm:self.hashContext.algorithm
+              withSignatureData:signaturePacket.signatureData
+                  withPublicKey:publicKey];
+}
+
+@end
+
+#pragma mark - SignatureGenerator extension
+
+@interface SignatureGenerator () {
+    Signature *_signature;
+}
+
+@end
+
+#pragma mark - SignatureGenerator implementation
+
+@implementation SignatureGenerator
+
++ (SignatureGenerator *)generatorWithSignatureType:(SignatureType)signatureType signatureKey:(SecretKey *)signatureKey {
+    SignatureGenerator *generator = (SignatureGenerator *) [self contextWithSignatureType:signatureType
+                                                                            hashAlgorithm:HashAlgorithmSHA256];
+    
+    if (generator != nil) {
+        generator->_signatureKey = signatureKey;
+        generator->_creationTime = [[NSDate date] timeIntervalSince1970];
+        
+        generator->_onePassSignaturePacket = [OnePassSignaturePacket packetWithSignatureType:signatureType
+                                                                                      keyId:signatureKey.publicKey.keyID
+                                                                              hashAlgorithm:HashAlgorithmSHA256
+                                                                         publicKeyAlgorithm:signatureKey.publicKey.publicKeyAlgorithm];
+    }
+    
+    return generator;
+}
+
+- (Signature *)finishSignature {
+    if (_signature == nil) {
+        NSData *hashedSubpackets = [SignaturePacket hashedSubpacketDataWithCreationTime:self.creationTime
+                                                                                   keyId:self.signatureKey.publicKey.keyID];
+        
+        _signature = [Signature signatureWithType:self.signatureType
+                                      hashContext:self.hashContext
+                                 hashedSubpackets:hashedSubpackets
+                                     signatureKey:self.signatureKey];
+    }
+    
+    return _signature;
+}
+
+@end
@@ -21,9 +21,17 @@
 @property (nonatomic, readonly) NSUInteger signedHashValue;
 @property (nonatomic, readonly) NSData *signatureData;
 
+/// Hashed portion of the packet (version through hashed subpackets), and the
+/// trailer that follows the signed data into the hash, RFC 4880 section 5.2.4:
+@property (nonatomic, readonly) NSData *hashData;
+@property (nonatomic, readonly) NSData *trailer;
+
+@property (nonatomic, readonly) NSData *hashedSubpackets;
+@property (nonatomic, readonly) NSData *unhashedSubpackets;
+
 /// Type dependent properties:
 @property (nonatomic, readonly) NSUInteger creationTime;
-@property (nonatomic, readonly) NSString *keyId;
+@property (nonatomic, readonly) KeyID keyId;
 @property (nonatomic, readonly) NSUInteger keyExpirationTime;
 
 @property (nonatomic, readonly) NSArray *preferredSymmetricAlgorithms;
@@ -37,4 +45,17 @@
 
 + (SignaturePacket *)packetWithSignature:(Signature *)signature;
 
+/// V4 hashed data and trailer for a signature that's about to be made:
++ (NSData *)hashDataWithSignatureType:(SignatureType)signatureType
+                   publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
+                        hashAlgorithm:(HashAlgorithm)hashAlgorithm
+                     hashedSubpackets:(NSData *)hashedSubpackets;
+
++ (NSData *)trailerForHashData:(NSData *)hashData;
+
+/// Hashed subpackets for a key certification (with key preferences), a subkey binding and a data signature:
++ (NSData *)hashedSubpacketDataForCertificationWithCreationTime:(NSUInteger)creationTime keyId:(KeyID)keyId;
++ (NSData *)hashedSubpacketDataForSubkeyBindingWithCreationTime:(NSUInteger)creationTime keyId:(KeyID)keyId;
++ (NSData *)hashedSubpacketDataWithCreationTime:(NSUInteger)creationTime keyId:(KeyID)keyId;
+
 @end
@@ -7,6 +7,7 @@
 //
 
 #import "SignaturePacket.h"
+#import "Curve25519.h"
 #import "MPI.h"
 #import "Utility.h"
 
@@ -88,8 +89,6 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
 
 @interface SignaturePacket ()
 
-@property (nonatomic, readonly) NSData *hashData;
-
 + (NSUInteger)readPacketLength:(const Byte *)bytes index:(NSUInteger *)index;
 
 - (void)readSubpackets:(NSData *)subpackets;
@@ -122,11 +121,11 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
             NSUInteger creationTime = [Utility readNumber:bytes + SignaturePacketV3CreationTimeIndex
                                                   length:4];
             
-            NSString *keyId = [Utility keyIDFromBytes:bytes + SignaturePacketV3KeyIDIndex];
+            KeyID keyId = [Utility readKeyID:bytes + SignaturePacketV3KeyIDIndex];
             
             PublicKeyAlgorithm publicKeyAlgorithm = bytes[SignaturePacketV3PKAlgorithmIndex];
             
-            if (publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign) {
+            if (publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign && publicKeyAlgorithm != PublicKeyAlgorithmEdDSA) {
                 [NSException exceptionWithName:NSInternalInconsistencyException
                                         reason:@"Public key algorithm not supported."
                                       userInfo:@{@"publicKeyAlgorithm": @(publicKeyAlgorithm)}];
@@ -143,7 +142,8 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
             NSUInteger signedHashValue = [Utility readNumber:bytes + SignaturePacketV3SignedHashIndex
                                                       length:2];
             
-            MPI *encryptedM = [MPI mpiFromBytes:(bytes + SignaturePacketV3MPIIndex)];
+            NSData *signatureData = [self signatureDataFromBytes:(bytes + SignaturePacketV3MPIIndex)
+                                                 publicKeyAlgorithm:publicKeyAlgorithm];
             
             return [[self alloc] initV3WithSignatureType:signatureType
                                       publicKeyAlgorithm:publicKeyAlgorithm
@@ -151,7 +151,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
                                             creationTime:creationTime
                                                    keyId:keyId
                                          signedHashValue:signedHashValue
-                                                    data:encryptedM.data];
+                                                    data:signatureData];
         }
             
         case 4: {
@@ -159,7 +159,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
             
             PublicKeyAlgorithm publicKeyAlgorithm = bytes[SignaturePacketV4PKAlgorithmIndex];
             
-            if (publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign) {
+            if (publicKeyAlgorithm != PublicKeyAlgorithmRSAEncryptSign && publicKeyAlgorithm != PublicKeyAlgorithmEdDSA) {
                 [NSException exceptionWithName:NSInternalInconsistencyException
                                         reason:@"Public key algorithm not supported."
                                       userInfo:@{@"publicKeyAlgorithm": @(publicKeyAlgorithm)}];
@@ -200,8 +200,9 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
             NSUInteger hashValueIndex = unhashedSubpacketIndex + unhashedSubpacketLength;
             NSUInteger signedHashValue = [Utility readNumber:(bytes + hashValueIndex) length:2];
             
-            // Get MPI:
-            MPI *encryptedM = [MPI mpiFromBytes:(bytes + hashValueIndex + 2)];
+            // Get MPIs:
+            NSData *signatureData = [self signatureDataFromBytes:(bytes + hashValueIndex + 2)
+                                              publicKeyAlgorithm:publicKeyAlgorithm];
             
             return [[self alloc] initV4WithSignatureType:signatureType
                                       publicKeyAlgorithm:publicKeyAlgorithm
@@ -210,8 +211,8 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
                                         hashedSubpackets:hashedSubpackets
                                       unhashedSubpackets:unhashedSubpackets
                                          signedHashValue:signedHashValue
-                                                    data:encryptedM.data
-                                                   keyID:nil];
+                                                    data:signatureData
+                                                   keyID:0];
         }
             
         default: {
@@ -226,55 +227,64 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
 
 + (SignaturePacket *)packetWithSignature:(Signature *)signature {
     
-    NSMutableData *hashData = [NSMutableData data];
+    NSData *hashData = [self hashDataWithSignatureType:signature.type
+                                    publicKeyAlgorithm:signature.publicKeyAlgorithm
+                                         hashAlgorithm:signature.hashAlgorithm
+                                      hashedSubpackets:signature.hashedSubpackets];
+    
+    return [[self alloc] initV4WithSignatureType:signature.type
+                              publicKeyAlgorithm:signature.publicKeyAlgorithm
+                                   hashAlgorithm:signature.hashAlgorithm
+                                        hashData:hashData
+                                hashedSubpackets:signature.hashedSubpackets
+                              unhashedSubpackets:[NSData data]
+                                 signedHashValue:signature.signedHashValue
+                                            data:signature.data
+                                           keyID:signature.keyID];
+    
+}
+
++ (NSData *)hashDataWithSignatureType:(SignatureType)signatureType
+                   publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
+                        hashAlgorithm:(HashAlgorithm)hashAlgorithm
+                     hashedSubpackets:(NSData *)hashedSubpackets {
+    
+    NSMutableData *hashData = [NSMutableData dataWithCapacity:hashedSubpackets.length + 6];
     Byte header[6];
     
     header[0] = 4;
-    header[1] = signature.type;
-    header[2] = PublicKeyAlgorithmRSAEncryptSign;
-    header[3] = HashAlgorithmSHA256;
+    header[1] = signatureType;
+    header[2] = publicKeyAlgorithm;
+    header[3] = hashAlgorithm;
     
-    NSData *hashedSubpackets = [self hashedSubpacketDataForSignature:signature];
     [Utility writeNumber:hashedSubpackets.length bytes:header + 4 length:2];
     
     [hashData appendBytes:header length:6];
     [hashData appendData:hashedSubpackets];
     
-    Byte unhashedHeader[2] = {0, 0};
-    [hashData appendBytes:unhashedHeader length:2];
+    return [NSData dataWithData:hashData];
+}
+
++ (NSData *)trailerForHashData:(NSData *)hashData {
+    NSMutableData *trailer = [NSMutableData dataWithCapacity:hashData.length + 6];
     
-    NSData *hashedData = [Crypto hashData:hashData];
-    const Byte *hashedBytes = hashedData.bytes;
+    [trailer appendData:hashData];
     
-    NSUInteger signedHashValue = (hashedBytes[0] << 8) | hashedBytes[1];
-
-    // TODO: PKCS Encode the signature data.
+    Byte finalTrailer[6];
     
-    return [[self alloc] initV4WithSignatureType:signature.type
-                              publicKeyAlgorithm:PublicKeyAlgorithmRSAEncryptSign
-                                   hashAlgorithm:HashAlgorithmSHA256
-                                        hashData:hashData
-                                hashedSubpackets:hashedSubpackets
-                              unhashedSubpackets:[NSData data]
-                                 signedHashValue:signedHashValue
-                                            data:signature.data
-                                           keyID:signature.keyID];
+    finalTrailer[0] = 4;
+    finalTrailer[1] = 0xFF;
+    [Utility writeNumber:hashData.length bytes:finalTrailer + 2 length:4];
     
+    [trailer appendBytes:finalTrailer length:6];
+    
+    return [NSData dataWithData:trailer];
 }
 
-+ (NSData *)hashedSubpacketDataForSignature:(Signature *)signature {
++ (NSData *)hashedSubpacketDataForCertificationWithCreationTime:(NSUInteger)creationTime keyId:(KeyID)keyId {
     NSMutableData *data = [NSMutableData data];
     
-    // Creation time subpacket:
-    Byte creationTimeSubpacket[6];
-    
-    creationTimeSubpacket[0] = 5;
-    creationTimeSubpacket[1] = SignatureSubpacketCreationTime;
-    
-    NSUInteger creationTime = [[NSDate date] timeIntervalSince1970];
-    [Utility writeNumber:creationTime bytes:creationTimeSubpacket + 2 length:4];
-    
-    [data appendBytes:creationTimeSubpacket length:6];
+    [data appendData:[self hashedSubpacketDataWithCreationTime:creationTime keyId:keyId]];
     
     // Symmetric algorithms subpacket:
     Byte preferredSymmetricAlgorithmsSubpacket[3];
@@ -325,6 +335,80 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
     return [NSData dataWithData:data];
 }
 
++ (NSData *)hashedSubpacketDataForSubkeyBindingWithCreationTime:(NSUInteger)creationTime keyId:(KeyID)keyId {
+    NSMutableData *data = [NSMutableData data];
+    
+    [data appendData:[self hashedSubpacketDataWithCreationTime:creationTime keyId:keyId]];
+    
+    // Key Flags, the subkey is only for encryption:
+    Byte keyFlagsSubpacket[3];
+    
+    keyFlagsSubpacket[0] = 2;
+    keyFlagsSubpacket[1] = SignatureSubpacketKeyFlags;
+    keyFlagsSubpacket[2] = 0x04 | 0x08;
+    
+    [data appendBytes:keyFlagsSubpacket length:3];
+    
+    return [NSData dataWithData:data];
+}
+
++ (NSData *)hashedSubpacketDataWithCreationTime:(NSUInteger)creationTime keyId:(KeyID)keyId {
+    NSMutableData *data = [NSMutableData data];
+    
+    // Creation time subpacket:
+    Byte creationTimeSubpacket[6];
+    
+    creationTimeSubpacket[0] = 5;
+    creationTimeSubpacket[1] = SignatureSubpacketCreationTime;
+    
+    [Utility writeNumber:creationTime bytes:creationTimeSubpacket + 2 length:4];
+    
+    [data appendBytes:creationTimeSubpacket length:6];
+    
+    // Issuer subpacket:
+    Byte issuerSubpacket[11];
+    
+    issuerSubpacket[0] = 9;
+    issuerSubpacket[1] = SignatureSubpacketIssuer;
+    
+    [Utility writeKeyID:keyId toBytes:issuerSubpacket + 2];
+    
+    [data appendBytes:issuerSubpacket length:10];
+    
+    return [NSData dataWithData:data];
+}
+
++ (NSData *)signatureDataFromBytes:(const Byte *)bytes publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm {
+    
+    // EdDSA signatures are the two MPIs R and S, kept as the 64 byte R || S that Ed25519 works with:
+    if (publicKeyAlgorithm == PublicKeyAlgorithmEdDSA) {
+        NSMutableData *signatureData = [NSMutableData dataWithCapacity:ED25519_SIGNATURE_LENGTH];
+        
+        NSData *r = [self mpiBytesFromBytes:bytes];
+        NSData *s = [self mpiBytesFromBytes:bytes + 2 + r.length];
+        
+        if (r.length > ED25519_SIGNATURE_LENGTH / 2 || s.length > ED25519_SIGNATURE_LENGTH / 2) {
+            return [NSData data];
+        }
+        
+        [signatureData increaseLengthBy:ED25519_SIGNATURE_LENGTH / 2 - r.length];
+        [signatureData appendData:r];
+        [signatureData increaseLengthBy:ED25519_SIGNATURE_LENGTH / 2 - s.length];
+        [signatureData appendData:s];
+        
+        return [NSData dataWithData:signatureData];
+    }
+    
+    return [self mpiBytesFromBytes:bytes];
+}
+
++ (NSData *)mpiBytesFromBytes:(const Byte *)bytes {
+    NSUInteger bitCount = (bytes[0] << 8) | bytes[1];
+    NSUInteger length = (bitCount + 7) / 8;
+    
+    return [NSData dataWithBytes:bytes + 2 length:length];
+}
+
 + (NSUInteger)readPacketLength:(const Byte *)bytes index:(NSUInteger *)index {
     
     NSUInteger currentIndex = *index;
@@ -354,7 +438,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
                      publicKeyAlgorithm:(PublicKeyAlgorithm)publicKeyAlgorithm
                           hashAlgorithm:(HashAlgorithm)hashAlgorithm
                            creationTime:(NSUInteger)creationTime
-                                  keyId:(NSString *)keyId
+                                  keyId:(KeyID)keyId
                         signedHashValue:(NSUInteger)signedHashValue
                                    data:(NSData *)data {
     
@@ -364,7 +448,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
                          hashAlgorithm:hashAlgorithm
                        signedHashValue:signedHashValue
                                   data:data
-                                 keyID:nil];
+                                 keyID:0];
     
     if (self != nil) {
         _keyId = keyId;
@@ -382,7 +466,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
                      unhashedSubpackets:(NSData *)unhashedSubpackets
                         signedHashValue:(NSUInteger)signedHashValue
                                    data:(NSData *)data
-                                  keyID:(NSString *)keyID {
+                                  keyID:(KeyID)keyID {
     
     self = [self initWithVersionNumber:4
                          signatureType:signatureType
@@ -393,6 +477,10 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
                                  keyID:keyID];
     
     if (self != nil) {
+        _hashData = hashData;
+        _hashedSubpackets = hashedSubpackets;
+        _unhashedSubpackets = unhashedSubpackets;
+        
         [self readSubpackets:hashedSubpackets];
         [self readSubpackets:unhashedSubpackets];
     }
@@ -406,7 +494,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
                         hashAlgorithm:(HashAlgorithm)hashAlgorithm
                       signedHashValue:(NSUInteger)signedHashValue
                                  data:(NSData *)data
-                                keyID:(NSString *)keyID {
+                                keyID:(KeyID)keyID {
     self = [super initWithType:PacketTypeSignature];
     
     if (self != nil) {
@@ -439,7 +527,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
             }
                 
             case SignatureSubpacketIssuer: {
-                _keyId = [Utility keyIDFromBytes:packetBytes];
+                _keyId = [Utility readKeyID:packetBytes];
                 
                 break;
             }
@@ -486,10 +574,7 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
             }
                 
             case SignatureSubpacketUserID: {
-                char userID[packetLength];
-                strcpy(userID, (const char *) packetBytes);
-                
-                _userId = [NSString stringWithCString:userID encoding:NSUTF8StringEncoding];
+                _userId = [Utility readString:packetBytes maxLength:packetLength - 1];
                 
                 break;
             }
@@ -528,202 +613,51 @@ typedef NS_ENUM(NSUInteger, SignatureSubpacketType) {
     }
 }
 
-- (NSData *)body {
-    NSMutableData *data = [NSMutableData data];
-    
-    Byte header[6];
-    
-    header[0] = 4;
-    header[1] = self.signatureType;
-    header[2] = self.publicKeyAlgorithm;
-    header[3] = self.hashAlgorithm;
-    
-    NSData *hashedSubpacketData = [self hashedSubpacketData];
-    
-    header[4] = (hashedSubpacketData.length >> 8) & 0xFF;
-    header[5] = hashedSubpacketData.length & 0xFF;
-    
-    [data appendBytes:header length:6];
-    [data appendData:hashedSubpacketData];
-    
-    Byte secondHeader[4];
-    
-    // Unhashed length:
-    secondHeader[0] = 0;
-    secondHeader[1] = 0;
-    
-    // Left 16 bits of signed hash:
-    secondHeader[2] = (self.signedHashValue >> 8) & 0xFF;
-    secondHeader[3] = self.signedHashValue & 0xFF;
-    
-    [data appendBytes:secondHeader length:4];
-    
-    MPI *mpi = [MPI mpiFromData:self.signatureData];
-    [data appendData:mpi.data];
-    
-    return [NSData dataWithData:data];
-}
-
-- (NSData *)hashedSubpacketData {
-    NSMutableData *data = [NSMutableData data];
-    
-    [self writeCreationTime:data];
-    
-    if (self.preferredSymmetricAlgorithms) {
-        [self writeSymmetricAlgorithms:data];
-    }
-    
-    if (self.keyId) {
-        [self writeKeyID:data];        
-    }
-    
-    if (self.preferredHashAlgorithms) {
-        [self writeHashAlgorithms:data];
-    }
-    
-    if (self.preferredCompressionAlgorithms) {
-        [self writeCompressionAlgorithms:data];
-    }
-    
-    if (self.keyFlags) {
-        [self writeKeyFlags:data];
-    }
-    
-    if (self.features) {
-        [self writeFeatures:data];
-    }
-    
-    return [NSData dataWithData:data];
-}
-
-- (void)writeKeyID:(NSMutableData *)data {
-    Byte subpacket[11];
-    
-    subpacket[0] = 9;
-    subpacket[1] = SignatureSubpacketIssuer;
-    
-    [Utility writeKeyID:self.keyId toBytes:subpacket + 2];
-    
-    [data appendBytes:subpacket length:10];
-}
-
-- (void)writeCreationTime:(NSMutableData *)data {
-    Byte subpacket[6];
-    
-    subpacket[0] = 5;
-    subpacket[1] = SignatureSubpacketCreationTime;
-    
-    [Utility writeNumber:self.creationTime bytes:subpacket + 2 length:4];
-    
-    [data appendBytes:subpacket length:6];
-}
-
-- (void)writeSymmetricAlgorithms:(NSMutableData *)data {
-    NSUInteger algorithmCount = self.preferredSymmetricAlgorithms.count;
-    NSUInteger byteCount = algorithmCount + 2;
-    
-    Byte *subpacket = calloc(byteCount, sizeof(Byte));
-    
-    subpacket[0] = algorithmCount + 1;
-    subpacket[1] = SignatureSubpacketPreferredSymmetricAlgorithms;
-    
-    for (int i = 0; i < algorithmCount; ++i) {
-        NSNumber *number = self.preferredSymmetricAlgorithms[i];
-        SymmetricAlgorithm algorithm = (SymmetricAlgorithm) number.unsignedIntegerValue;
+- (NSData *)trailer {
+    if (self.versionNumber == 3) {
+        Byte trailer[SignaturePacketV3HashLength];
         
-        subpacket[i + 2] = algorithm;
-    }
-    
-    [data appendBytes:subpacket length:byteCount];
-    
-    free(subpacket);
-}
-
-- (void)writeHashAlgorithms:(NSMutableData *)data {
-    
-    NSUInteger algorithmCount = self.preferredHashAlgorithms.count;
-    NSUInteger byteCount = algorithmCount + 2;
-    
-    Byte *subpacket = calloc(byteCount, sizeof(Byte));
-    
-    subpacket[0] = algorithmCount + 1;
-    subpacket[1] = SignatureSubpacketPreferredHashAlgorithms;
-    
-    for (int i = 0; i < algorithmCount; ++i) {
-        NSNumber *number = self.preferredHashAlgorithms[i];
-        HashAlgorithm algorithm = (HashAlgorithm) number.unsignedIntegerValue;
+        trailer[0] = self.signatureType;
+        [Utility writeNumber:self.creationTime bytes:trailer + 1 length:4];
         
-        subpacket[i + 2] = algorithm;
+        return [NSData dataWithBytes:trailer length:SignaturePacketV3HashLength];
     }
     
-    [data appendBytes:subpacket length:byteCount];
-    
-    free(subpacket);
+    return [SignaturePacket trailerForHashData:self.hashData];
 }
 
-
-- (void)writeCompressionAlgorithms:(NSMutableData *)data {
-    
-    NSUInteger algorithmCount = self.preferredCompressionAlgorithms.count;
-    NSUInteger byteCount = algorithmCount + 2;
-    
-    Byte *subpacket = calloc(byteCount, sizeof(Byte));
-    
-    subpacket[0] = algorithmCount + 1;
-    subpacket[1] = SignatureSubpacketPreferredCompressionAlgorithms;
-    
-    for (int i = 0; i < algorithmCount; ++i) {
-        NSNumber *number = self.preferredCompressionAlgorithms[i];
-        CompressionAlgorithm algorithm = (CompressionAlgorithm) number.unsignedIntegerValue;
-        
-        subpacket[i + 2] = algorithm;
-    }
-    
-    [data appendBytes:subpacket length:byteCount];
-    
-    free(subpacket);
-}
-
-- (void)writeKeyFlags:(NSMutableData *)data {
-    
-    NSUInteger flagCount = self.keyFlags.count;
-    NSUInteger byteCount = flagCount + 2;
-    
-    Byte *subpacket = calloc(byteCount, sizeof(Byte));
-    
-    subpacket[0] = flagCount + 1;
-    subpacket[1] = SignatureSubpacketKeyFlags;
+- (NSData *)body {
+    NSMutableData *data = [NSMutableData data];
     
-    for (int i = 0; i < flagCount; ++i) {
-        subpacket[i + 2] = ((NSNumber *) self.keyFlags[i]).unsignedIntegerValue;
-    }
+    // Subpackets are written back exactly as they were signed:
+    [data appendData:self.hashData];
     
-    [data appendBytes:subpacket length:byteCount];
+    Byte unhashedHeader[2];
+    [Utility writeNumber:self.unhashedSubpackets.length bytes:unhashedHeader length:2];
     
-    free(subpacket);
-}
-
-- (void)writeFeatures:(NSMutableData *)data {
+    [data appendBytes:unhashedHeader length:2];
+    [data appendData:self.unhashedSubpackets];
     
-    NSUInteger featureCount = self.features.count;
-    NSUInteger byteCount = featureCount + 2;
+    // Left 16 bits of signed hash:
+    Byte signedHashValue[2];
     
-    Byte *subpacket = calloc(byteCount, sizeof(Byte));
+    signedHashValue[0] = (self.signedHashValue >> 8) & 0xFF;
+    signedHashValue[1] = self.signedHashValue & 0xFF;
     
-    subpacket[0] = featureCount + 1;
-    subpacket[1] = SignatureSubpacketFeatures;
+    [data appendBytes:signedHashValue length:2];
     
-    for (int i = 0; i < featureCount; ++i) {
-        subpacket[i + 2] = ((NSNumber *) self.features[i]).unsignedIntegerValue;
+    if (self.publicKeyAlgorithm == PublicKeyAlgorithmEdDSA) {
+        NSUInteger half = self.signatureData.length / 2;
+        const Byte *signatureBytes = self.signatureData.bytes;
+        
+        [data appendData:[MPI mpiFromBytes:signatureBytes byteCount:half].data];
+        [data appendData:[MPI mpiFromBytes:signatureBytes + half byteCount:half].data];
+    } else {
+        MPI *mpi = [MPI mpiFromData:self.signatureData];
+        [data appendData:mpi.data];
     }
     
-    [data appendBytes:subpacket length:byteCount];
-    
-    free(subpacket);
+    return [NSData dataWithData:data];
 }
 
 @end
-
-
-
-
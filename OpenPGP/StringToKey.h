@@ -0,0 +1,54 @@
+//
+//  StringToKey.h
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Crypto.h"
+
+typedef NS_ENUM(NSUInteger, StringToKeyType) {
+    StringToKeyTypeSimple = 0,
+    StringToKeyTypeSalted = 1,
+    StringToKeyTypeIteratedSalted = 3,
+    StringToKeyTypeArgon2 = 4
+};
+
+/// The octet in front of a secret key's material saying how it's protected. Any other non-zero
+/// value is a legacy symmetric algorithm with a simple MD5 string to key and a checksum:
+typedef NS_ENUM(NSUInteger, StringToKeyUsage) {
+    StringToKeyUsageNone = 0,
+    StringToKeyUsageSHA1 = 254,
+    StringToKeyUsageChecksum = 255
+};
+
+/// How a secret key's material is encrypted under a passphrase, from the usage octet through the IV.
+@interface StringToKey : NSObject
+
+@property (nonatomic, readonly) StringToKeyUsage usage;
+@property (nonatomic, readonly) SymmetricAlgorithm symmetricAlgorithm;
+
+@property (nonatomic, readonly) StringToKeyType type;
+@property (nonatomic, readonly) HashAlgorithm hashAlgorithm;
+@property (nonatomic, readonly) NSData *salt;
+
+/// Octets of salt and passphrase hashed by the iterated type:
+@property (nonatomic, readonly) NSUInteger count;
+
+@property (nonatomic, readonly) NSData *iv;
+
+/// The bytes as read, for writing the secret key packet back out:
+@property (nonatomic, readonly) NSData *data;
+
+/// Throws for Argon2, which only protects keys with AEAD, and anything else unsupported:
++ (StringToKey *)stringToKeyFromData:(NSData *)data atIndex:(NSUInteger)index;
+
+/// The expensive part, the iterated type hashes count octets for each digest the key needs:
+- (NSData *)keyForPassphrase:(NSString *)passphrase;
+
+/// The plaintext secret material without its checksum or SHA1 hash, nil if the passphrase is wrong:
+- (NSData *)decryptData:(NSData *)encryptedData withPassphrase:(NSString *)passphrase;
+
+@end
@@ -0,0 +1,256 @@
+//
+//  StringToKey.m
+//  OpenPGP
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <openssl/sha.h>
+#import "StringToKey.h"
+#import "HashContext.h"
+#import "Utility.h"
+
+#define StringToKeySaltLength 8
+
+/// Salt and passphrase are repeated into a buffer about this long, so the iterated type hashes
+/// in a few large updates instead of one per repetition:
+#define StringToKeyIterationBufferLength 65536
+
+@interface StringToKey ()
+
+- (instancetype)initWithUsage:(StringToKeyUsage)usage
+           symmetricAlgorithm:(SymmetricAlgorithm)symmetricAlgorithm
+                         type:(StringToKeyType)type
+                hashAlgorithm:(HashAlgorithm)hashAlgorithm
+                         salt:(NSData *)salt
+                        count:(NSUInteger)count
+                           iv:(NSData *)iv
+                         data:(NSData *)data;
+
+@end
+
+@implementation StringToKey
+
++ (StringToKey *)stringToKeyFromData:(NSData *)data atIndex:(NSUInteger)index {
+    const Byte *bytes = data.bytes;
+    NSUInteger currentIndex = index;
+    
+    StringToKeyUsage usage = bytes[currentIndex++];
+    SymmetricAlgorithm symmetricAlgorithm;
+    
+    StringToKeyType type = StringToKeyTypeSimple;
+    HashAlgorithm hashAlgorithm = HashAlgorithmMD5;
+    NSData *salt = nil;
+    NSUInteger count = 0;
+    
+    if (usage == StringToKeyUsageSHA1 || usage == StringToKeyUsageChecksum) {
+        if (currentIndex + 3 > data.length) {
+            @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                           reason:@"String to key is truncated."
+                                         userInfo:@{@"index": @(index)}];
+        }
+        
+        symmetricAlgorithm = bytes[currentIndex++];
+        type = bytes[currentIndex++];
+        hashAlgorithm = bytes[currentIndex++];
+        
+        switch (type) {
+            case StringToKeyTypeSimple:
+                break;
+            
+            case StringToKeyTypeSalted:
+            case StringToKeyTypeIteratedSalted: {
+                NSUInteger specifierLength = StringToKeySaltLength + (type == StringToKeyTypeIteratedSalted ? 1 : 0);
+                
+                if (currentIndex + specifierLength > data.length) {
+                    @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                                   reason:@"String to key is truncated."
+                                                 userInfo:@{@"index": @(index)}];
+                }
+                
+                salt = [data subdataWithRange:NSMakeRange(currentIndex, StringToKeySaltLength)];
+                currentIndex += StringToKeySaltLength;
+                
+                if (type == StringToKeyTypeIteratedSalted) {
+                    Byte coded = bytes[currentIndex++];
+                    count = (NSUInteger) (16 + (coded & 15)) << ((coded >> 4) + 6);
+                }
+                
+                break;
+            }
+            
+            case StringToKeyTypeArgon2:
+                @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                               reason:@"Argon2 string to key requires AEAD protection, which is not supported."
+                                             userInfo:@{@"type": @(type)}];
+            
+            default:
+                @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                               reason:@"String to key type not supported."
+                                             userInfo:@{@"type": @(type)}];
+        }
+    } else {
+        symmetricAlgorithm = (SymmetricAlgorithm) usage;
+    }
+    
+    if ([HashContext contextWithAlgorithm:hashAlgorithm] == nil) {
+        @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                       reason:@"String to key hash algorithm not supported."
+                                     userInfo:@{@"hashAlgorithm": @(hashAlgorithm)}];
+    }
+    
+    NSUInteger blockSize = [Crypto blockSizeForSymmetricAlgorithm:symmetricAlgorithm];
+    
+    if (blockSize == 0) {
+        @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                       reason:@"Secret key symmetric algorithm not supported."
+                                     userInfo:@{@"symmetricAlgorithm": @(symmetricAlgorithm)}];
+    }
+    
+    if (currentIndex + blockSize > data.length) {
+        @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                       reason:@"String to key is truncated."
+                                     userInfo:@{@"index": @(index)}];
+    }
+    
+    NSData *iv = [data subdataWithRange:NSMakeRange(currentIndex, blockSize)];
+    currentIndex += blockSize;
+    
+    return [[self alloc] initWithUsage:usage
+                    symmetricAlgorithm:symmetricAlgorithm
+                                  type:type
+                         hashAlgorithm:hashAlgorithm
+                                  salt:salt
+                                 count:count
+                                    iv:iv
+                                  data:[data subdataWithRange:NSMakeRange(index, currentIndex - index)]];
+}
+
+- (instancetype)initWithUsage:(StringToKeyUsage)usage
+           symmetricAlgorithm:(SymmetricAlgorithm)symmetricAlgorithm
+                         type:(StringToKeyType)type
+                hashAlgorithm:(HashAlgorithm)hashAlgorithm
+                         salt:(NSData *)salt
+                        count:(NSUInteger)count
+                           iv:(NSData *)iv
+                         data:(NSData *)data {
+    self = [super init];
+    
+    if (self != nil) {
+        _usage = usage;
+        _symmetricAlgorithm = symmetricAlgorithm;
+        _type = type;
+        _hashAlgorithm = hashAlgorithm;
+        _salt = salt;
+        _count = count;
+        _iv = iv;
+        _data = data;
+    }
+    
+    return self;
+}
+
+- (NSData *)keyForPassphrase:(NSString *)passphrase {
+    NSData *passphraseData = [passphrase dataUsingEncoding:NSUTF8StringEncoding];
+    NSUInteger keyLength = [Crypto keyLengthForSymmetricAlgorithm:self.symmetricAlgorithm];
+    
+    // Each further context starts with one more zero octet, they all hash the same input:
+    NSMutableArray *contexts = [NSMutableArray array];
+    NSUInteger contextsLength = 0;
+    Byte zero = 0;
+    
+    while (contextsLength < keyLength) {
+        HashContext *context = [HashContext contextWithAlgorithm:self.hashAlgorithm];
+        
+        for (NSUInteger i = 0; i < contexts.count; i++) {
+            [context updateWithBytes:&zero length:1];
+        }
+        
+        [contexts addObject:context];
+        contextsLength += context.digestLength;
+    }
+    
+    NSMutableData *unit = [NSMutableData data];
+    
+    if (self.salt != nil) {
+        [unit appendData:self.salt];
+    }
+    
+    [unit appendData:passphraseData];
+    
+    if (self.type == StringToKeyTypeIteratedSalted) {
+        
+        // The count covers at least one whole salt and passphrase:
+        NSUInteger remaining = MAX(self.count, unit.length);
+        NSUInteger repetitions = MAX(StringToKeyIterationBufferLength / MAX(unit.length, 1), 1);
+        NSMutableData *buffer = [NSMutableData dataWithCapacity:repetitions * unit.length];
+        
+        for (NSUInteger i = 0; i < repetitions; i++) {
+            [buffer appendData:unit];
+        }
+        
+        while (remaining > 0) {
+            NSUInteger length = MIN(remaining, buffer.length);
+            
+            for (HashContext *context in contexts) {
+                [context updateWithBytes:buffer.bytes length:length];
+            }
+            
+            remaining -= length;
+        }
+    } else {
+        for (HashContext *context in contexts) {
+            [context updateWithData:unit];
+        }
+    }
+    
+    NSMutableData *key = [NSMutableData dataWithCapacity:contextsLength];
+    
+    for (HashContext *context in contexts) {
+        [key appendData:[context finalDigest]];
+    }
+    
+    key.length = keyLength;
+    
+    return key;
+}
+
+- (NSData *)decryptData:(NSData *)encryptedData withPassphrase:(NSString *)passphrase {
+    NSData *plaintext = [Crypto decryptData:encryptedData
+                         symmetricAlgorithm:self.symmetricAlgorithm
+                                        key:[self keyForPassphrase:passphrase]
+                                         iv:self.iv];
+    
+    NSUInteger checkLength = self.usage == StringToKeyUsageSHA1 ? SHA_DIGEST_LENGTH : 2;
+    
+    if (plaintext.length < checkLength) {
+        return nil;
+    }
+    
+    const Byte *bytes = plaintext.bytes;
+    NSUInteger materialLength = plaintext.length - checkLength;
+    
+    if (self.usage == StringToKeyUsageSHA1) {
+        Byte digest[SHA_DIGEST_LENGTH];
+        SHA1(bytes, materialLength, digest);
+        
+        if (memcmp(digest, bytes + materialLength, SHA_DIGEST_LENGTH) != 0) {
+            return nil;
+        }
+    } else {
+        NSUInteger sum = 0;
+        
+        for (NSUInteger i = 0; i < materialLength; ++i) {
+            sum += bytes[i];
+        }
+        
+        if ((sum & 0xFFFF) != [Utility readNumber:bytes + materialLength length:2]) {
+            return nil;
+        }
+    }
+    
+    return [plaintext subdataWithRange:NSMakeRange(0, materialLength)];
+}
+
+@end
@@ -8,10 +8,26 @@
 
 #import <Foundation/Foundation.h>
 
+/// The low 64 bits of a key's fingerprint, big endian on the wire:
+typedef uint64_t KeyID;
+
+#define KeyIDLength 8
+#define FingerprintMaxLength 32
+
+/// 20 bytes (SHA-1) for v4 keys, 32 for v5/v6:
+typedef struct {
+    NSUInteger length;
+    Byte bytes[FingerprintMaxLength];
+} Fingerprint;
+
 @interface Utility : NSObject
 
-+ (NSString *)keyIDFromBytes:(const Byte *)bytes;
-+ (void)writeKeyID:(NSString *)keyId toBytes:(Byte *)bytes;
++ (KeyID)readKeyID:(const Byte *)bytes;
++ (void)writeKeyID:(KeyID)keyID toBytes:(Byte *)bytes;
+
+/// Hex is only for showing key identity to people:
++ (NSString *)hexStringFromKeyID:(KeyID)keyID;
++ (NSString *)hexStringFromFingerprint:(Fingerprint)fingerprint;
 
 + (NSUInteger)readNumber:(const Byte *)bytes length:(NSUInteger)length;
 + (NSString *)readString:(const Byte *)bytes maxLength:(NSUInteger)maxLength;
@@ -7,100 +7,67 @@
 //
 
 #import "Utility.h"
+#import "OpenPGPCore.h"
 
 @implementation Utility
 
-+ (NSString *)keyIDFromBytes:(const Byte *)bytes {
-    static const char *hexes = "0123456789abcdef";
-    
-    char keyId[17];
++ (KeyID)readKeyID:(const Byte *)bytes {
+    KeyID keyID = 0;
     
-    for (int i = 0; i < 8 ; i++) {
-        keyId[i * 2] = hexes[(unsigned)(bytes[i] & 0xf0) >> 4];
-        keyId[(i * 2) + 1] = hexes[bytes[i] & 0xf];
+    for (int i = 0; i < KeyIDLength; i++) {
+        keyID = (keyID << 8) | bytes[i];
     }
     
-    keyId[8 * 2] = 0x0;
-    
-    
-    return [NSString stringWithCString:keyId encoding:NSUTF8StringEncoding];
+    return keyID;
 }
 
-+ (void)writeKeyID:(NSString *)keyId toBytes:(Byte *)bytes {
-    
-    static const char	*uppers = "0123456789ABCDEF";
-    static const char	*lowers = "0123456789abcdef";
-    
-    const char		*hi;
-    const char		*lo;
-    
-    uint8_t			 hichar;
-    uint8_t			 lochar;
-    
-    size_t			 j;
-    int			 i;
-    
-    const char *userid = [keyId cStringUsingEncoding:NSUTF8StringEncoding];
-    size_t len = keyId.length;
-    
-    for (i = 0, j = 0 ; j < len && userid[i] && userid[i + 1] ; i += 2, j++) {
-        if ((hi = strchr(uppers, userid[i])) == NULL) {
-            if ((hi = strchr(lowers, userid[i])) == NULL) {
-                break;
-            }
-            hichar = (uint8_t)(hi - lowers);
-        } else {
-            hichar = (uint8_t)(hi - uppers);
-        }
-        if ((lo = strchr(uppers, userid[i + 1])) == NULL) {
-            if ((lo = strchr(lowers, userid[i + 1])) == NULL) {
-                break;
-            }
-            lochar = (uint8_t)(lo - lowers);
-        } else {
-            lochar = (uint8_t)(lo - uppers);
-        }
-        bytes[j] = (hichar << 4) | (lochar);
++ (void)writeKeyID:(KeyID)keyID toBytes:(Byte *)bytes {
+    for (int i = KeyIDLength - 1; i >= 0; i--) {
+        bytes[i] = keyID & 0xFF;
+        keyID >>= 8;
     }
+}
+
++ (NSString *)hexStringFromKeyID:(KeyID)keyID {
+    Byte bytes[KeyIDLength];
+    [self writeKeyID:keyID toBytes:bytes];
     
-    bytes[j] = 0x0;
+    return [self hexStringFromBytes:bytes length:KeyIDLength];
+}
+
++ (NSString *)hexStringFromFingerprint:(Fingerprint)fingerprint {
+    return [self hexStringFromBytes:fingerprint.bytes length:fingerprint.length];
 }
 
 + (NSUInteger)readNumber:(const Byte *)bytes length:(NSUInteger)length {
-    NSUInteger number = 0;
-    
-    for (int i = 0; i < length; i++) {
-        number <<= 8;
-        number += bytes[i];
-    }
-    
-    return number;
+    return (NSUInteger) pgp_read_number(bytes, length);
 }
 
 + (NSString *)readString:(const Byte *)bytes maxLength:(NSUInteger)maxLength {
-    char cString[maxLength + 1];
-    strcpy(cString, (const char *) bytes);
     
-    return [NSString stringWithCString:cString encoding:NSUTF8StringEncoding];
+    // Stops at a terminator if there is one, never past maxLength:
+    return [[NSString alloc] initWithBytes:bytes
+                                    length:strnlen((const char *) bytes, maxLength)
+                                  encoding:NSUTF8StringEncoding];
 }
 
 + (NSString *)hexStringFromBytes:(const Byte *)bytes length:(NSUInteger)length {
-    char output[length * 2 + 1];
-    char *poutput = output;
+    static const char *hexes = "0123456789abcdef";
     
-    for (int i = 0; i < length; i++) {
-        poutput += sprintf(poutput, "%02x", bytes[i]);
-    }
+    char output[length * 2];
     
-    *poutput = '\0';
+    for (NSUInteger i = 0; i < length; i++) {
+        output[i * 2] = hexes[bytes[i] >> 4];
+        output[i * 2 + 1] = hexes[bytes[i] & 0xF];
+    }
     
-    return [NSString stringWithCString:output encoding:NSUTF8StringEncoding];
+    return [[NSString alloc] initWithBytes:output length:length * 2 encoding:NSASCIIStringEncoding];
 }
 
 + (void)writeNumber:(NSUInteger)number bytes:(Byte *)bytes length:(NSUInteger)length {
     NSUInteger index = 0;
     NSUInteger shift = (length - 1) * 8;
-        
+    
     while (length-- > 0) {
         bytes[index++] = (number >> shift) & 0xFF;
         shift -= 8;
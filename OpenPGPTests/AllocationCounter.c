@@ -0,0 +1,85 @@
+//
+//  AllocationCounter.c
+//  OpenPGPTests
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#include <pthread.h>
+#include <stddef.h>
+#include "AllocationCounter.h"
+
+static volatile int counting_active = 0;
+static volatile uint64_t counted_allocations = 0;
+static volatile uint64_t counted_bytes = 0;
+
+#if defined(__APPLE__)
+
+// The hook libmalloc calls on every allocation for stack logging, declared in its private
+// stack_logging.h. It's set to NULL unless something like Instruments is attached:
+typedef void (malloc_logger_t)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t num_hot_frames_to_skip);
+
+extern malloc_logger_t *malloc_logger;
+
+#define MALLOC_LOG_TYPE_ALLOCATE 2
+#define MALLOC_LOG_TYPE_DEALLOCATE 4
+
+static malloc_logger_t *previous_logger = NULL;
+static pthread_once_t logger_once = PTHREAD_ONCE_INIT;
+
+// Allocations pass the size in arg2, reallocations pass the old pointer there and the new size in
+// arg3. This runs inside malloc, so it mustn't allocate:
+static void counting_logger(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t num_hot_frames_to_skip) {
+    if (counting_active && (type & MALLOC_LOG_TYPE_ALLOCATE)) {
+        uint64_t size = (type & MALLOC_LOG_TYPE_DEALLOCATE) ? arg3 : arg2;
+        
+        __sync_fetch_and_add(&counted_allocations, 1);
+        __sync_fetch_and_add(&counted_bytes, size);
+    }
+    
+    if (previous_logger != NULL) {
+        previous_logger(type, arg1, arg2, arg3, result, num_hot_frames_to_skip + 1);
+    }
+}
+
+static void install_logger(void) {
+    previous_logger = malloc_logger;
+    malloc_logger = counting_logger;
+}
+
+bool pgp_allocation_counting_available(void) {
+    return true;
+}
+
+void pgp_allocation_counting_begin(void) {
+    pthread_once(&logger_once, install_logger);
+    
+    counted_allocations = 0;
+    counted_bytes = 0;
+    
+    __sync_synchronize();
+    counting_active = 1;
+}
+
+#else
+
+bool pgp_allocation_counting_available(void) {
+    return false;
+}
+
+void pgp_allocation_counting_begin(void) {
+    counted_allocations = 0;
+    counted_bytes = 0;
+}
+
+#endif
+
+pgp_allocation_counts pgp_allocation_counting_end(void) {
+    counting_active = 0;
+    __sync_synchronize();
+    
+    pgp_allocation_counts counts = { counted_allocations, counted_bytes };
+    
+    return counts;
+}
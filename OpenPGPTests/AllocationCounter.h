@@ -0,0 +1,39 @@
+//
+//  AllocationCounter.h
+//  OpenPGPTests
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#ifndef OpenPGP_AllocationCounter_h
+#define OpenPGP_AllocationCounter_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Counts heap allocations and the bytes they ask for, through the hook malloc calls for every
+// allocation and reallocation in the process. Counting covers all threads, so work handed off
+// to a dispatch queue is included, and so is anything else running at the time.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t allocations;
+    uint64_t bytes;
+} pgp_allocation_counts;
+
+/// False where malloc has no hook to count through, the counts stay zero then:
+bool pgp_allocation_counting_available(void);
+
+/// Counting doesn't nest, begin zeroes the counts and end returns them:
+void pgp_allocation_counting_begin(void);
+pgp_allocation_counts pgp_allocation_counting_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+//
+//  OpenPGPAllocationTests.m
+//  OpenPGPTests
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AllocationCounter.h"
+#import "KeyImporter.h"
+#import "Keyring.h"
+#import "OpenPGP.h"
+
+/// Set to a path to write the measured counts there as a new baseline instead of checking them:
+#define AllocationRecordVariable @"OPENPGP_ALLOCATION_RECORD"
+
+#define AllocationMeasurementRuns 5
+
+static NSMutableDictionary *AllocationMeasurements = nil;
+
+/// Heap allocations and bytes allocated by each public operation, checked against the counts in
+/// allocation-baseline.json so allocations that were taken out of a hot path stay out. Counts
+/// come from a run on a reference machine, re-record with OPENPGP_ALLOCATION_RECORD set when an
+/// operation gets cheaper or is meant to get more expensive.
+@interface OpenPGPAllocationTests : XCTestCase
+
+@property (nonatomic, strong) NSString *publicKey;
+@property (nonatomic, strong) NSString *privateKey;
+@property (nonatomic, strong) NSDictionary *baseline;
+
+@end
+
+@implementation OpenPGPAllocationTests
+
++ (void)setUp {
+    [super setUp];
+    
+    AllocationMeasurements = [NSMutableDictionary dictionary];
+}
+
++ (void)tearDown {
+    NSString *path = [NSProcessInfo processInfo].environment[AllocationRecordVariable];
+    
+    if (path != nil) {
+        NSDictionary *baseline = @{@"tolerance": @0.05, @"operations": AllocationMeasurements};
+        
+        NSData *json = [NSJSONSerialization dataWithJSONObject:baseline options:NSJSONWritingPrettyPrinted error:nil];
+        [json writeToFile:path atomically:YES];
+        
+        NSLog(@"Allocation baseline written to %@", path);
+    }
+    
+    [super tearDown];
+}
+
+- (void)setUp {
+    [super setUp];
+    
+    NSString *publicPath = [[NSBundle bundleForClass:[self class]] pathForResource:@"public-key" ofType:@"gpg"];
+    NSString *privatePath = [[NSBundle bundleForClass:[self class]] pathForResource:@"private-key" ofType:@"gpg"];
+    NSString *baselinePath = [[NSBundle bundleForClass:[self class]] pathForResource:@"allocation-baseline" ofType:@"json"];
+    
+    self.publicKey = [NSString stringWithContentsOfFile:publicPath encoding:NSUTF8StringEncoding error:nil];
+    self.privateKey = [NSString stringWithContentsOfFile:privatePath encoding:NSUTF8StringEncoding error:nil];
+    self.baseline = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:baselinePath] options:0 error:nil];
+}
+
+- (void)testEncryptAllocations {
+    [self checkAllocationsForOperation:@"encrypt" block:^{
+        [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+            XCTAssertNotNil(encryptedMessage);
+        } errorBlock:^(NSError *error) {
+            XCTFail(@"Failed signing and encrypting message: %@", error);
+        }];
+    }];
+}
+
+- (void)testDecryptAllocations {
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    [self checkAllocationsForOperation:@"decrypt" block:^{
+        [OpenPGP decryptAndVerifyMessage:_encryptedMessage privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+            XCTAssertEqualObjects(decryptedMessage, @"Hello!");
+        } errorBlock:^(NSError *error) {
+            XCTFail(@"Failed decrypting and verifying message: %@", error);
+        }];
+    }];
+}
+
+- (void)testImportKeyAllocations {
+    NSData *armoredKey = [self.publicKey dataUsingEncoding:NSUTF8StringEncoding];
+    
+    [self checkAllocationsForOperation:@"importKey" block:^{
+        NSDictionary *errors = nil;
+        XCTAssertEqual([KeyImporter importPublicKeysFromData:armoredKey intoKeyring:[Keyring keyring] errors:&errors], 1);
+    }];
+}
+
+#pragma mark Private
+
+/// The first run warms up lazily built state. The fewest of the runs after it is what's compared,
+/// since the counts include anything else that allocated at the same time:
+- (void)checkAllocationsForOperation:(NSString *)operation block:(void (^)(void))block {
+    if (!pgp_allocation_counting_available()) {
+        NSLog(@"Allocation counting isn't available, skipping %@", operation);
+        return;
+    }
+    
+    @autoreleasepool {
+        block();
+    }
+    
+    pgp_allocation_counts fewest = { UINT64_MAX, UINT64_MAX };
+    
+    for (NSUInteger i = 0; i < AllocationMeasurementRuns; i++) {
+        @autoreleasepool {
+            pgp_allocation_counting_begin();
+            block();
+            pgp_allocation_counts counts = pgp_allocation_counting_end();
+            
+            fewest.allocations = MIN(fewest.allocations, counts.allocations);
+            fewest.bytes = MIN(fewest.bytes, counts.bytes);
+        }
+    }
+    
+    AllocationMeasurements[operation] = @{@"allocations": @(fewest.allocations), @"bytes": @(fewest.bytes)};
+    NSLog(@"%@: %@ allocations, %@ bytes", operation, @(fewest.allocations), @(fewest.bytes));
+    
+    NSDictionary *expected = self.baseline[@"operations"][operation];
+    
+    if ([NSProcessInfo processInfo].environment[AllocationRecordVariable] != nil) {
+        return;
+    }
+    
+    // Nothing is checked until a baseline has been recorded, after that every operation needs
+    // its entry so one can't drop out of the gate unnoticed:
+    if ([self.baseline[@"operations"] count] == 0) {
+        NSLog(@"No allocation baseline recorded yet, record one with %@ set", AllocationRecordVariable);
+        return;
+    }
+    
+    if (expected == nil) {
+        XCTFail(@"No allocation baseline for %@, record one with %@ set", operation, AllocationRecordVariable);
+        return;
+    }
+    
+    double limit = 1 + [self.baseline[@"tolerance"] doubleValue];
+    uint64_t expectedAllocations = [expected[@"allocations"] unsignedLongLongValue];
+    uint64_t expectedBytes = [expected[@"bytes"] unsignedLongLongValue];
+    
+    XCTAssertLessThanOrEqual(fewest.allocations, expectedAllocations * limit, @"%@ allocates more often than its baseline of %@", operation, expected[@"allocations"]);
+    XCTAssertLessThanOrEqual(fewest.bytes, expectedBytes * limit, @"%@ allocates more bytes than its baseline of %@", operation, expected[@"bytes"]);
+    
+    // A lower count only stays locked in once it's recorded:
+    if (fewest.allocations * limit < expectedAllocations) {
+        NSLog(@"%@ allocates well under its baseline of %@, consider recording a new one", operation, expected[@"allocations"]);
+    }
+}
+
+@end
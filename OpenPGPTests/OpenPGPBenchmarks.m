@@ -0,0 +1,326 @@
+//
+//  OpenPGPBenchmarks.m
+//  OpenPGPTests
+//
+//  Created by James Knight on 8/14/15.
+//  Copyright (c) 2015 Gradient. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ASCIIArmor.h"
+#import "Crypto.h"
+#import "Key.h"
+#import "KeyImporter.h"
+#import "Keypair.h"
+#import "Keyring.h"
+#import "LiteralDataPacket.h"
+#import "MPI.h"
+#import "OpenPGP.h"
+#import "OpenPGPCore.h"
+#import "PacketList.h"
+#import "Random.h"
+
+/// Set to run the suite, it's skipped otherwise so it stays out of the unit test runs:
+#define BenchmarkEnabledVariable @"OPENPGP_BENCHMARKS"
+
+/// Where the JSON goes, the temporary directory if unset:
+#define BenchmarkOutputVariable @"OPENPGP_BENCHMARK_OUTPUT"
+
+/// Largest end to end payload in bytes, up to 1 GB:
+#define BenchmarkMaxPayloadVariable @"OPENPGP_BENCHMARK_MAX_PAYLOAD"
+
+#define BenchmarkDefaultMaxPayload (16 << 20)
+#define BenchmarkLargestPayload (1 << 30)
+
+#define BenchmarkMinimumDuration 0.5
+#define BenchmarkMinimumIterations 3
+
+static NSMutableArray *BenchmarkResults = nil;
+
+/// Micro and macro benchmarks for each stage of the pipeline. Every measurement is recorded with
+/// its parameters and the whole run is written out as JSON when the suite finishes, for tracking
+/// over time. Runs headless, e.g. with xcodebuild test -only-testing:OpenPGPTests/OpenPGPBenchmarks
+/// and OPENPGP_BENCHMARKS=1 in the scheme's environment.
+@interface OpenPGPBenchmarks : XCTestCase
+
+@property (nonatomic, strong) NSString *message;
+@property (nonatomic, strong) NSString *publicKey;
+@property (nonatomic, strong) NSString *privateKey;
+
+@end
+
+@implementation OpenPGPBenchmarks
+
++ (XCTestSuite *)defaultTestSuite {
+    if ([NSProcessInfo processInfo].environment[BenchmarkEnabledVariable] == nil) {
+        return [XCTestSuite testSuiteWithName:NSStringFromClass(self)];
+    }
+    
+    return [super defaultTestSuite];
+}
+
++ (void)setUp {
+    [super setUp];
+    
+    BenchmarkResults = [NSMutableArray array];
+}
+
++ (void)tearDown {
+    NSDictionary *report = @{@"suite": @"OpenPGP",
+                             @"date": @((NSUInteger) [[NSDate date] timeIntervalSince1970]),
+                             @"processorCount": @([NSProcessInfo processInfo].activeProcessorCount),
+                             @"results": BenchmarkResults};
+    
+    NSData *json = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:nil];
+    NSString *path = [NSProcessInfo processInfo].environment[BenchmarkOutputVariable];
+    
+    if (path == nil) {
+        path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"OpenPGPBenchmarks.json"];
+    }
+    
+    [json writeToFile:path atomically:YES];
+    NSLog(@"Benchmarks written to %@", path);
+    
+    [super tearDown];
+}
+
+- (void)setUp {
+    [super setUp];
+    
+    NSString *messagePath = [[NSBundle bundleForClass:[self class]] pathForResource:@"message" ofType:@"txt"];
+    NSString *publicPath = [[NSBundle bundleForClass:[self class]] pathForResource:@"public-key" ofType:@"gpg"];
+    NSString *privatePath = [[NSBundle bundleForClass:[self class]] pathForResource:@"private-key" ofType:@"gpg"];
+    
+    self.message = [NSString stringWithContentsOfFile:messagePath encoding:NSUTF8StringEncoding error:nil];
+    self.publicKey = [NSString stringWithContentsOfFile:publicPath encoding:NSUTF8StringEncoding error:nil];
+    self.privateKey = [NSString stringWithContentsOfFile:privatePath encoding:NSUTF8StringEncoding error:nil];
+}
+
+#pragma mark Micro
+
+- (void)testArmorBenchmarks {
+    for (NSNumber *size in @[@(1 << 10), @(64 << 10), @(1 << 20)]) {
+        NSData *payload = [self randomDataWithLength:size.unsignedIntegerValue];
+        PacketList *packetList = [PacketList packetListWithPackets:@[[LiteralDataPacket packetWithData:payload]]];
+        
+        __block NSString *text = nil;
+        
+        [self measure:@"armor.encode" parameters:@{@"bytes": size} bytes:size.unsignedIntegerValue block:^{
+            text = [ASCIIArmor armorFromPacketList:packetList type:ASCIIArmorTypeMessage].text;
+        }];
+        
+        [self measure:@"armor.decode" parameters:@{@"bytes": size} bytes:size.unsignedIntegerValue block:^{
+            XCTAssertNotNil([ASCIIArmor armorFromText:text].content);
+        }];
+    }
+}
+
+- (void)testCRC24Benchmark {
+    for (NSNumber *size in @[@(1 << 10), @(1 << 20), @(16 << 20)]) {
+        NSData *payload = [self randomDataWithLength:size.unsignedIntegerValue];
+        
+        [self measure:@"crc24" parameters:@{@"bytes": size} bytes:payload.length block:^{
+            pgp_crc24(PGP_CRC24_INIT, payload.bytes, payload.length);
+        }];
+    }
+}
+
+- (void)testPacketParseBenchmark {
+    NSDictionary *inputs = @{@"message": [ASCIIArmor armorFromText:self.message].content,
+                             @"privateKey": [ASCIIArmor armorFromText:self.privateKey].content,
+                             @"publicKey": [ASCIIArmor armorFromText:self.publicKey].content};
+    
+    for (NSString *input in inputs) {
+        NSData *content = inputs[input];
+        
+        [self measure:@"packet.parse" parameters:@{@"input": input} bytes:content.length block:^{
+            XCTAssertNotNil([PacketList packetListFromData:content error:NULL]);
+        }];
+    }
+}
+
+- (void)testMPIAndFingerprintBenchmarks {
+    for (NSNumber *bits in @[@1024, @2048, @4096]) {
+        PublicKey *publicKey = [Crypto generateKeypairWithBits:bits.intValue].publicKey;
+        NSData *wire = publicKey.n.data;
+        
+        [self measure:@"mpi.decode" parameters:@{@"bits": bits} bytes:wire.length block:^{
+            XCTAssertTrue([MPI mpiFromData:wire atIndex:0].bn != NULL);
+        }];
+        
+        // A new key each time, the fingerprint is cached after the first:
+        [self measure:@"key.fingerprint" parameters:@{@"bits": bits} bytes:0 block:^{
+            PublicKey *key = [PublicKey keyWithCreationTime:publicKey.creationTime n:publicKey.n e:publicKey.e];
+            XCTAssertNotEqual(key.fingerprint.length, 0);
+        }];
+    }
+}
+
+- (void)testRSABenchmarks {
+    for (NSNumber *bits in @[@1024, @2048, @4096]) {
+        Keypair *keypair = [Crypto generateKeypairWithBits:bits.intValue];
+        
+        NSData *digest = [Crypto hashData:[self randomDataWithLength:64]];
+        NSData *sessionKey = [Crypto generateSessionKey];
+        
+        __block NSData *signature = nil;
+        __block NSData *encrypted = nil;
+        
+        [self measure:@"rsa.sign" parameters:@{@"bits": bits} bytes:0 block:^{
+            signature = [Crypto signDigest:digest algorithm:HashAlgorithmSHA256 withSecretKey:keypair.secretKey];
+        }];
+        
+        [self measure:@"rsa.verify" parameters:@{@"bits": bits} bytes:0 block:^{
+            XCTAssertTrue([Crypto verifyDigest:digest algorithm:HashAlgorithmSHA256 withSignatureData:signature withPublicKey:keypair.publicKey]);
+        }];
+        
+        [self measure:@"rsa.encrypt" parameters:@{@"bits": bits} bytes:0 block:^{
+            encrypted = [Crypto encryptData:sessionKey withPublicKey:keypair.publicKey];
+        }];
+        
+        [self measure:@"rsa.decrypt" parameters:@{@"bits": bits} bytes:0 block:^{
+            XCTAssertEqualObjects([Crypto decryptData:encrypted withSecretKey:keypair.secretKey], sessionKey);
+        }];
+    }
+}
+
+- (void)testAESBenchmarks {
+    NSData *sessionKey = [Crypto generateSessionKey];
+    
+    for (NSNumber *size in @[@(1 << 10), @(64 << 10), @(1 << 20), @(16 << 20)]) {
+        NSData *payload = [self randomDataWithLength:size.unsignedIntegerValue];
+        
+        __block NSData *encrypted = nil;
+        
+        [self measure:@"aes256.encrypt" parameters:@{@"bytes": size} bytes:payload.length block:^{
+            encrypted = [Crypto encryptData:payload withSymmetricKey:sessionKey.bytes];
+        }];
+        
+        [self measure:@"aes256.decrypt" parameters:@{@"bytes": size} bytes:payload.length block:^{
+            XCTAssertNotNil([Crypto decryptData:encrypted withSymmetricKey:sessionKey.bytes]);
+        }];
+    }
+}
+
+#pragma mark Macro
+
+- (void)testKeyringImportBenchmark {
+    NSArray *counts = @[@100, @1000, @10000];
+    
+    // Every key is distinct, so the keyring grows to the full count instead of replacing one
+    // record. Ed25519 keeps generating them quick:
+    NSMutableArray *armoredKeys = [NSMutableArray arrayWithCapacity:[counts.lastObject unsignedIntegerValue]];
+    
+    for (NSUInteger i = 0; i < [counts.lastObject unsignedIntegerValue]; i++) {
+        NSString *userId = [NSString stringWithFormat:@"Benchmark %lu <benchmark%lu@example.com>", (unsigned long) i, (unsigned long) i];
+        
+        [OpenPGP generateKeypairWithOptions:@{@"algorithm": @"ed25519", @"userId": userId} completionBlock:^(NSString *publicKey, NSString *privateKey) {
+            [armoredKeys addObject:[publicKey dataUsingEncoding:NSUTF8StringEncoding]];
+        } errorBlock:^(NSError *error) {
+            XCTFail(@"Failed generating keys: %@", error);
+        }];
+    }
+    
+    for (NSNumber *count in counts) {
+        NSMutableData *keys = [NSMutableData data];
+        
+        for (NSUInteger i = 0; i < count.unsignedIntegerValue; i++) {
+            [keys appendData:armoredKeys[i]];
+        }
+        
+        [self measure:@"keyring.import" parameters:@{@"keys": count, @"algorithm": @"ed25519"} bytes:keys.length block:^{
+            NSDictionary *errors = nil;
+            XCTAssertEqual([KeyImporter importPublicKeysFromData:keys intoKeyring:[Keyring keyring] errors:&errors], count.unsignedIntegerValue);
+        }];
+    }
+}
+
+- (void)testEndToEndBenchmarks {
+    __block NSString *publicKey = nil;
+    __block NSString *privateKey = nil;
+    
+    [OpenPGP generateKeypairWithOptions:@{@"bits": @2048, @"userId": @"Benchmark <benchmark@example.com>"} completionBlock:^(NSString *generatedPublicKey, NSString *generatedPrivateKey) {
+        
+        publicKey = generatedPublicKey;
+        privateKey = generatedPrivateKey;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed generating keys: %@", error);
+    }];
+    
+    NSUInteger maxPayload = MIN([[NSProcessInfo processInfo].environment[BenchmarkMaxPayloadVariable] integerValue] ?: BenchmarkDefaultMaxPayload, BenchmarkLargestPayload);
+    
+    for (NSUInteger size = 1 << 10; size <= maxPayload; size <<= 4) {
+        NSMutableData *text = [NSMutableData dataWithLength:size];
+        memset(text.mutableBytes, 'a', size);
+        
+        NSString *message = [[NSString alloc] initWithData:text encoding:NSUTF8StringEncoding];
+        text = nil;
+        
+        __block NSString *encryptedMessage = nil;
+        
+        [self measure:@"signAndEncrypt" parameters:@{@"bytes": @(size)} bytes:size block:^{
+            [OpenPGP signAndEncryptMessage:message privateKey:privateKey publicKeys:@[publicKey] completionBlock:^(NSString *result) {
+                encryptedMessage = result;
+            } errorBlock:^(NSError *error) {
+                XCTFail(@"Failed signing and encrypting message: %@", error);
+            }];
+        }];
+        
+        [self measure:@"decryptAndVerify" parameters:@{@"bytes": @(size)} bytes:size block:^{
+            [OpenPGP decryptAndVerifyMessage:encryptedMessage privateKey:privateKey publicKeys:@[publicKey] completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+                XCTAssertEqual(decryptedMessage.length, size);
+            } errorBlock:^(NSError *error) {
+                XCTFail(@"Failed decrypting and verifying message: %@", error);
+            }];
+        }];
+    }
+}
+
+#pragma mark Private
+
+/// The first run warms up, and is the measurement too when it's already long enough. Otherwise
+/// the block runs until both minimums are met:
+- (void)measure:(NSString *)name parameters:(NSDictionary *)parameters bytes:(NSUInteger)bytes block:(void (^)(void))block {
+    NSDate *start = [NSDate date];
+    
+    @autoreleasepool {
+        block();
+    }
+    
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    NSUInteger iterations = 1;
+    
+    if (elapsed < BenchmarkMinimumDuration) {
+        start = [NSDate date];
+        iterations = 0;
+        
+        do {
+            @autoreleasepool {
+                block();
+            }
+            
+            iterations++;
+            elapsed = -[start timeIntervalSinceNow];
+        } while (elapsed < BenchmarkMinimumDuration || iterations < BenchmarkMinimumIterations);
+    }
+    
+    NSDictionary *result = @{@"name": name,
+                             @"parameters": parameters,
+                             @"iterations": @(iterations),
+                             @"seconds": @(elapsed),
+                             @"operationsPerSecond": @(iterations / elapsed),
+                             @"bytesPerSecond": @(bytes * iterations / elapsed)};
+    
+    [BenchmarkResults addObject:result];
+    NSLog(@"%@ %@: %.1f ops/s, %.1f MB/s", name, parameters, iterations / elapsed, bytes * iterations / elapsed / (1 << 20));
+}
+
+- (NSData *)randomDataWithLength:(NSUInteger)length {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    random_bytes(data.mutableBytes, length);
+    
+    return [NSData dataWithData:data];
+}
+
+@end
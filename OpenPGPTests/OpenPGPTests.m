@@ -6,10 +6,53 @@
 //  Copyright (c) 2015 Gradient. All rights reserved.
 //
 
+#import <mach/mach.h>
 #import <UIKit/UIKit.h>
 #import <XCTest/XCTest.h>
 #import "ASCIIArmor.h"
+#import "BatchSigner.h"
+#import "DecryptionResult.h"
+#import "Crypto.h"
+#import "Instrumentation.h"
+#import "Key.h"
+#import "KeyImporter.h"
+#import "KeyPacket.h"
+#import "Keypair.h"
+#import "KeypairPool.h"
+#import "Keyring.h"
+#import "MessageHeader.h"
 #import "OpenPGP.h"
+#import "OpenPGPCore.h"
+#import "OperationScheduler.h"
+#import "Packet.h"
+#import "PacketList.h"
+#import "Random.h"
+#import "SessionKeyCache.h"
+#import "SignatureContext.h"
+#import "SignaturePacket.h"
+
+#define KeyringBenchmarkKeyCount 100000
+#define RandomBenchmarkThreadCount 8
+#define RandomBenchmarkBytesPerThread (16 << 20)
+#define MalformedCorpusCorruptionsPerInput 2000
+#define BatchBenchmarkMessageCount 256
+#define BatchBenchmarkPayloadCount 512
+
+static NSUInteger instrumentationBegins[PGP_STAGE_COUNT];
+static NSUInteger instrumentationEnds[PGP_STAGE_COUNT];
+static uint64_t instrumentationCounts[PGP_COUNTER_COUNT];
+
+static void recordStageBegin(void *context, pgp_stage stage, uint64_t timestamp) {
+    __sync_fetch_and_add(&instrumentationBegins[stage], 1);
+}
+
+static void recordStageEnd(void *context, pgp_stage stage, uint64_t timestamp, size_t bytes) {
+    __sync_fetch_and_add(&instrumentationEnds[stage], 1);
+}
+
+static void recordCount(void *context, pgp_counter counter, uint64_t value) {
+    __sync_fetch_and_add(&instrumentationCounts[counter], value);
+}
 
 @interface OpenPGPTests : XCTestCase
 
@@ -179,7 +222,998 @@
     } errorBlock:^(NSError *error) {
         XCTFail(@"Failed decrypting and verifying message: %@", error);
     }];
+    
+    XCTAssertEqualObjects(_decryptedMessage, @"Hello!");
+    XCTAssertEqualObjects(_verifiedUserIds, @[@"James Knight <james@jknight.co>"]);
+}
+
+- (void)testDetachedSignature {
+    
+    __block NSString *_generatedPublicKey;
+    __block NSString *_generatedPrivateKey;
+    
+    [OpenPGP generateKeypairWithOptions:@{@"bits": @(1024), @"userId": @"James Knight <james@jknight.co>"} completionBlock:^(NSString *publicKey, NSString *privateKey) {
+        
+        _generatedPublicKey = publicKey;
+        _generatedPrivateKey = privateKey;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed generating keys: %@", error);
+    }];
+    
+    NSString *messagePath = [[NSBundle bundleForClass:[self class]] pathForResource:@"message" ofType:@"txt"];
+    
+    __block NSString *_signature;
+    
+    [OpenPGP signFileAtPath:messagePath privateKey:_generatedPrivateKey completionBlock:^(NSString *signature) {
+        
+        _signature = signature;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing file: %@", error);
+    }];
+    
+    XCTAssertTrue([_signature hasPrefix:@"-----BEGIN PGP SIGNATURE-----"]);
+    
+    __block NSArray *_verifiedUserIds;
+    
+    [OpenPGP verifyFileAtPath:messagePath signature:_signature publicKeys:@[_generatedPublicKey] completionBlock:^(NSArray *verifiedUserIds) {
+        
+        _verifiedUserIds = verifiedUserIds;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed verifying file: %@", error);
+    }];
+    
+    XCTAssertEqualObjects(_verifiedUserIds, @[@"James Knight <james@jknight.co>"]);
+}
+
+
+- (void)testEd25519DetachedSignature {
+    
+    __block NSString *_generatedPublicKey;
+    __block NSString *_generatedPrivateKey;
+    
+    [OpenPGP generateKeypairWithOptions:@{@"algorithm": @"ed25519", @"userId": @"James Knight <james@jknight.co>"} completionBlock:^(NSString *publicKey, NSString *privateKey) {
+        
+        _generatedPublicKey = publicKey;
+        _generatedPrivateKey = privateKey;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed generating keys: %@", error);
+    }];
+    
+    NSString *messagePath = [[NSBundle bundleForClass:[self class]] pathForResource:@"message" ofType:@"txt"];
+    
+    __block NSString *_signature;
+    
+    [OpenPGP signFileAtPath:messagePath privateKey:_generatedPrivateKey completionBlock:^(NSString *signature) {
+        
+        _signature = signature;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing file: %@", error);
+    }];
+    
+    __block NSArray *_verifiedUserIds;
+    
+    [OpenPGP verifyFileAtPath:messagePath signature:_signature publicKeys:@[_generatedPublicKey] completionBlock:^(NSArray *verifiedUserIds) {
+        
+        _verifiedUserIds = verifiedUserIds;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed verifying file: %@", error);
+    }];
+    
+    XCTAssertEqualObjects(_verifiedUserIds, @[@"James Knight <james@jknight.co>"]);
+}
+
+- (void)testEd25519Full {
+    
+    __block NSString *_generatedPublicKey;
+    __block NSString *_generatedPrivateKey;
+    
+    [OpenPGP generateKeypairWithOptions:@{@"algorithm": @"ed25519", @"userId": @"James Knight <james@jknight.co>"} completionBlock:^(NSString *publicKey, NSString *privateKey) {
+        
+        _generatedPublicKey = publicKey;
+        _generatedPrivateKey = privateKey;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed generating keys: %@", error);
+    }];
+    
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:_generatedPrivateKey publicKeys:@[_generatedPublicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error ) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    __block NSString *_decryptedMessage;
+    __block NSArray *_verifiedUserIds;
+    
+    [OpenPGP decryptAndVerifyMessage:_encryptedMessage privateKey:_generatedPrivateKey publicKeys:@[_generatedPublicKey] completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+        
+        _decryptedMessage = decryptedMessage;
+        _verifiedUserIds = verifiedUserIds;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed decrypting and verifying message: %@", error);
+    }];
+    
+    XCTAssertEqualObjects(_decryptedMessage, @"Hello!");
+    XCTAssertEqualObjects(_verifiedUserIds, @[@"James Knight <james@jknight.co>"]);
+}
+
+- (void)testVerifyWithEncryptionKey {
+    
+    // A signature whose issuer resolves to an X25519 subkey is rejected rather than checked as RSA:
+    Keypair *keypair = [Crypto generateX25519Keypair];
+    NSData *digest = [Crypto hashData:[@"Hello!" dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    XCTAssertFalse([Crypto verifyDigest:digest algorithm:HashAlgorithmSHA256 withSignatureData:digest withPublicKey:keypair.publicKey]);
+}
+
+- (void)testMPIEncoding {
+    
+    // Wire bytes come back exactly as they were read:
+    const Byte wire[] = {0x00, 0x09, 0x01, 0xFF, 0xAA};
+    NSData *body = [NSData dataWithBytes:wire length:sizeof(wire)];
+    
+    MPI *mpi = [MPI mpiFromData:body atIndex:0];
+    
+    XCTAssertEqual(mpi.length, 4);
+    XCTAssertEqualObjects(mpi.data, [body subdataWithRange:NSMakeRange(0, 4)]);
+    XCTAssertEqual(BN_get_word(mpi.bn), 0x1FF);
+    
+    // Magnitude bytes lose their leading zeros:
+    const Byte magnitude[] = {0x00, 0x00, 0x40, 0x01};
+    
+    MPI *point = [MPI mpiFromBytes:magnitude byteCount:sizeof(magnitude)];
+    const Byte expected[] = {0x00, 0x0F, 0x40, 0x01};
+    
+    XCTAssertEqualObjects(point.data, [NSData dataWithBytes:expected length:sizeof(expected)]);
+    XCTAssertThrows([MPI mpiFromData:body atIndex:3]);
+}
+
+- (void)testCorePackets {
+    
+    // A user ID split into a 512 byte partial chunk and a 3 byte final one:
+    NSMutableData *packetData = [NSMutableData data];
+    const Byte header[] = {0xC0 | PacketTypeUserID, 0xE9};
+    const Byte trailer[] = {0x03, 'a', 'b', 'c'};
+    
+    [packetData appendBytes:header length:sizeof(header)];
+    [packetData appendData:[NSMutableData dataWithLength:512]];
+    [packetData appendBytes:trailer length:sizeof(trailer)];
+    
+    pgp_packet packet;
+    
+    XCTAssertEqual(pgp_packet_next(packetData.bytes, packetData.length, 0, &packet), PGP_OK);
+    XCTAssertEqual(packet.tag, PacketTypeUserID);
+    XCTAssertEqual(packet.bodyLength, 515);
+    XCTAssertEqual(packet.end, packetData.length);
+    XCTAssertEqual(pgp_packet_next(packetData.bytes, packetData.length - 1, 0, &packet), PGP_ERROR_TRUNCATED);
+    
+    // gpg writes old format packets:
+    NSString *lockedPath = [[NSBundle bundleForClass:[self class]] pathForResource:@"locked-private-key" ofType:@"gpg"];
+    NSString *lockedPrivateKey = [NSString stringWithContentsOfFile:lockedPath encoding:NSUTF8StringEncoding error:nil];
+    
+    ASCIIArmor *armor = [ASCIIArmor armorFromText:lockedPrivateKey];
+    const Byte *bytes = armor.content.bytes;
+    
+    XCTAssertEqual(armor.type, ASCIIArmorTypePrivateKey);
+    XCTAssertEqual(bytes[0] & 0x40, 0);
+    XCTAssertEqual(pgp_packet_next(bytes, armor.content.length, 0, &packet), PGP_OK);
+    XCTAssertEqual(packet.tag, PacketTypeSecretKey);
+    
+    // Armor round trips through the core's base64 and checksum:
+    ASCIIArmor *rearmored = [ASCIIArmor armorFromText:armor.text];
+    
+    XCTAssertEqualObjects(rearmored.content, armor.content);
+    XCTAssertEqual(pgp_crc24(PGP_CRC24_INIT, (const uint8_t *) "", 0), PGP_CRC24_INIT);
+}
+
+- (void)testArmorChecksumLine {
+    
+    NSString *armored = @"-----BEGIN PGP MESSAGE-----\n\nwAA=\n%@\n-----END PGP MESSAGE-----\n";
+    
+    // Oversized checksum lines used to be decoded into a three byte buffer:
+    for (NSString *checksum in @[@"=AAAAAAAAAAAA", @"=AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA", @"=AA!A", @"=AAA"]) {
+        NSString *text = [NSString stringWithFormat:armored, checksum];
+        NSData *textData = [text dataUsingEncoding:NSUTF8StringEncoding];
+        pgp_armor armor;
+        
+        XCTAssertEqual(pgp_armor_parse(textData.bytes, textData.length, &armor), PGP_ERROR_MALFORMED, @"Checksum line: %@", checksum);
+        XCTAssertNil([ASCIIArmor armorFromText:text]);
+    }
+}
+
+- (void)testKeyPacketBody {
+    
+    Keypair *keypair = [Crypto generateX25519Keypair];
+    NSData *secretBody = [KeyPacket packetWithSecretKey:keypair.secretKey].body;
+    
+    // Parsed keys keep the bytes they were read from, and fingerprint the same as the original:
+    KeyPacket *packet = [KeyPacket packetWithBody:secretBody];
+    
+    XCTAssertEqualObjects(packet.body, secretBody);
+    XCTAssertEqualObjects(packet.secretKey.publicKey.packetBody, keypair.publicKey.packetBody);
+    XCTAssertEqual(packet.secretKey.publicKey.keyID, keypair.publicKey.keyID);
+}
+
+- (void)testBulkKeyImport {
+    
+    NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:@"all-public-keys" ofType:@"json"];
+    
+    Keyring *jsonKeyring = [Keyring keyring];
+    NSDictionary *jsonErrors = nil;
+    NSUInteger jsonCount = [KeyImporter importPublicKeysFromData:[NSData dataWithContentsOfFile:path] intoKeyring:jsonKeyring errors:&jsonErrors];
+    
+    XCTAssertEqual(jsonCount + jsonErrors.count, self.publicKeys.count);
+    XCTAssertGreaterThan(jsonCount, 0);
+    
+    // The same keys armored back to back import the same way:
+    NSData *armoredData = [[self.publicKeys componentsJoinedByString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding];
+    
+    Keyring *armorKeyring = [Keyring keyring];
+    NSDictionary *armorErrors = nil;
+    NSUInteger armorCount = [KeyImporter importPublicKeysFromData:armoredData intoKeyring:armorKeyring errors:&armorErrors];
+    
+    XCTAssertEqual(armorCount, jsonCount);
+    XCTAssertEqualObjects([NSSet setWithArray:armorErrors.allKeys], [NSSet setWithArray:jsonErrors.allKeys]);
+    XCTAssertEqual(armorKeyring.count, jsonKeyring.count);
+    
+    // Bad entries are reported by position without stopping the rest:
+    NSData *mixedData = [NSJSONSerialization dataWithJSONObject:@[@"not a key", self.publicKey] options:0 error:nil];
+    
+    NSDictionary *mixedErrors = nil;
+    NSUInteger mixedCount = [KeyImporter importPublicKeysFromData:mixedData intoKeyring:[Keyring keyring] errors:&mixedErrors];
+    
+    XCTAssertEqual(mixedCount, 1);
+    XCTAssertNotNil(mixedErrors[@0]);
+}
+
+- (void)testRecipientPeek {
+    
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    NSError *error = nil;
+    MessageHeader *header = [MessageHeader headerWithArmoredMessage:_encryptedMessage error:&error];
+    
+    XCTAssertNil(error);
+    XCTAssertGreaterThan(header.recipients.count, 0);
+    XCTAssertEqual(header.encryptedDataPacketType, PacketTypeSEData);
+    
+    // Everything after the headers can be missing:
+    NSString *truncatedMessage = [_encryptedMessage substringToIndex:[_encryptedMessage rangeOfString:@"\n\r\n"].location + 400];
+    MessageHeader *truncatedHeader = [MessageHeader headerWithArmoredMessage:truncatedMessage error:&error];
+    
+    XCTAssertEqual(truncatedHeader.recipients.count, header.recipients.count);
+    XCTAssertEqual(truncatedHeader.encryptedDataOffset, header.encryptedDataOffset);
+    
+    // Text before the armor is skipped the way decryption skips it:
+    NSString *quotedMessage = [@"Forwarded message:\n\n" stringByAppendingString:_encryptedMessage];
+    MessageHeader *quotedHeader = [MessageHeader headerWithArmoredMessage:quotedMessage error:&error];
+    
+    XCTAssertNil(error);
+    XCTAssertEqual(quotedHeader.recipients.count, header.recipients.count);
+    
+    __block NSArray *_recipientKeyIds;
+    
+    [OpenPGP recipientsOfMessage:self.message completionBlock:^(NSArray *recipientKeyIds) {
+        
+        _recipientKeyIds = recipientKeyIds;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed reading recipients: %@", error);
+    }];
+    
+    XCTAssertGreaterThan(_recipientKeyIds.count, 0);
+}
+
+- (void)testWildcardRecipient {
+    
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    // Hide every recipient behind the wildcard key ID:
+    PacketList *packetList = [PacketList packetListFromData:[ASCIIArmor armorFromText:_encryptedMessage].content];
+    NSMutableArray *packets = [NSMutableArray array];
+    
+    for (Packet *packet in packetList.packets) {
+        if (packet.packetType == PacketTypePKESKey) {
+            NSMutableData *body = [packet.body mutableCopy];
+            memset((Byte *) body.mutableBytes + 1, 0, 8);
+            
+            [packets addObject:[Packet packetWithType:PacketTypePKESKey body:body]];
+        } else {
+            [packets addObject:packet];
+        }
+    }
+    
+    NSString *hiddenMessage = [ASCIIArmor armorFromPacketList:[PacketList packetListWithPackets:packets] type:ASCIIArmorTypeMessage].text;
+    
+    __block NSString *_recipientKeyId;
+    
+    [OpenPGP recipientsOfMessage:hiddenMessage completionBlock:^(NSArray *recipientKeyIds) {
+        _recipientKeyId = recipientKeyIds.firstObject;
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed reading recipients: %@", error);
+    }];
+    
+    XCTAssertEqualObjects(_recipientKeyId, @"0000000000000000");
+    
+    __block NSString *_decryptedMessage;
+    
+    [OpenPGP decryptAndVerifyMessage:hiddenMessage privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+        
+        _decryptedMessage = decryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed decrypting message: %@", error);
+    }];
+    
+    XCTAssertEqualObjects(_decryptedMessage, @"Hello!");
+}
+
+- (void)testSessionKeyCache {
+    
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"session-keys"];
+    NSData *storageKey = [Crypto generateSessionKey];
+    
+    SessionKeyCache *cache = [SessionKeyCache cacheWithCapacity:16 path:path storageKey:storageKey];
+    [OpenPGP setSessionKeyCache:cache];
+    
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    // The second open is served from the cache:
+    for (NSUInteger i = 0; i < 2; i++) {
+        __block NSString *_decryptedMessage;
+        
+        [OpenPGP decryptAndVerifyMessage:_encryptedMessage privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+            
+            _decryptedMessage = decryptedMessage;
+            
+        } errorBlock:^(NSError *error) {
+            XCTFail(@"Failed decrypting message: %@", error);
+        }];
+        
+        XCTAssertEqualObjects(_decryptedMessage, @"Hello!");
+    }
+    
+    XCTAssertEqual(cache.misses, 1);
+    XCTAssertEqual(cache.hits, 1);
+    
+    // Only readable with the storage key it was written under:
+    XCTAssertTrue([cache synchronize]);
+    XCTAssertEqual([SessionKeyCache cacheWithCapacity:16 path:path storageKey:storageKey].count, 1);
+    XCTAssertEqual([SessionKeyCache cacheWithCapacity:16 path:path storageKey:[Crypto generateSessionKey]].count, 0);
+    
+    [OpenPGP setSessionKeyCache:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testUnlockPrivateKey {
+    
+    NSString *lockedPath = [[NSBundle bundleForClass:[self class]] pathForResource:@"locked-private-key" ofType:@"gpg"];
+    NSString *lockedPrivateKey = [NSString stringWithContentsOfFile:lockedPath encoding:NSUTF8StringEncoding error:nil];
+    NSString *messagePath = [[NSBundle bundleForClass:[self class]] pathForResource:@"message" ofType:@"txt"];
+    
+    [OpenPGP lockAllPrivateKeys];
+    
+    __block NSError *_error;
+    
+    [OpenPGP signFileAtPath:messagePath privateKey:lockedPrivateKey completionBlock:^(NSString *signature) {
+        XCTFail(@"Signed with a locked key.");
+    } errorBlock:^(NSError *error) {
+        _error = error;
+    }];
+    
+    XCTAssertNotNil(_error);
+    _error = nil;
+    
+    [OpenPGP unlockPrivateKey:lockedPrivateKey passphrase:@"wrong" timeout:0 completionBlock:^{
+        XCTFail(@"Unlocked with the wrong passphrase.");
+    } errorBlock:^(NSError *error) {
+        _error = error;
+    }];
+    
+    XCTAssertNotNil(_error);
+    
+    [OpenPGP unlockPrivateKey:lockedPrivateKey passphrase:@"hunter2" timeout:0 completionBlock:^{
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed unlocking key: %@", error);
+    }];
+    
+    // Served from the unlock cache, no passphrase needed:
+    __block NSString *_signature;
+    
+    [OpenPGP signFileAtPath:messagePath privateKey:lockedPrivateKey completionBlock:^(NSString *signature) {
+        
+        _signature = signature;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing file: %@", error);
+    }];
+    
+    XCTAssertTrue([_signature hasPrefix:@"-----BEGIN PGP SIGNATURE-----"]);
+    
+    [OpenPGP lockPrivateKey:lockedPrivateKey];
+    _error = nil;
+    
+    [OpenPGP signFileAtPath:messagePath privateKey:lockedPrivateKey completionBlock:^(NSString *signature) {
+        XCTFail(@"Signed with a locked key.");
+    } errorBlock:^(NSError *error) {
+        _error = error;
+    }];
+    
+    XCTAssertNotNil(_error);
+}
+
+- (void)testKeypairPool {
+    
+    KeypairPool *pool = [KeypairPool poolWithBits:1024 depth:2];
+    [OpenPGP setKeypairPool:pool];
+    
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:60];
+    
+    while (pool.count < 2 && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.05];
+    }
+    
+    XCTAssertEqual(pool.count, 2);
+    XCTAssertGreaterThan(pool.refillRate, 0);
+    
+    __block NSString *_generatedPublicKey;
+    __block NSString *_generatedPrivateKey;
+    
+    [OpenPGP generateKeypairWithOptions:@{@"bits": @(1024), @"userId": @"James Knight <james@jknight.co>"} completionBlock:^(NSString *publicKey, NSString *privateKey) {
+        
+        _generatedPublicKey = publicKey;
+        _generatedPrivateKey = privateKey;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed generating keys: %@", error);
+    }];
+    
+    XCTAssertEqual(pool.hits, 1);
+    XCTAssertEqual(pool.misses, 0);
+    
+    // The pooled key still signs and encrypts like a fresh one:
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:_generatedPrivateKey publicKeys:@[_generatedPublicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    __block NSArray *_verifiedUserIds;
+    
+    [OpenPGP decryptAndVerifyMessage:_encryptedMessage privateKey:_generatedPrivateKey publicKeys:@[_generatedPublicKey] completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+        
+        _verifiedUserIds = verifiedUserIds;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed decrypting and verifying message: %@", error);
+    }];
+    
+    XCTAssertEqualObjects(_verifiedUserIds, @[@"James Knight <james@jknight.co>"]);
+    
+    [OpenPGP setKeypairPool:nil];
+}
+
+- (void)testAsyncOperations {
+    
+    dispatch_queue_t completionQueue = dispatch_queue_create("OpenPGPTests.completion", DISPATCH_QUEUE_SERIAL);
+    
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    __block NSString *_decryptedMessage;
+    
+    ScheduledOperation *decryption = [OpenPGP decryptAndVerifyMessage:_encryptedMessage privateKey:self.privateKey publicKeys:@[self.publicKey] completionQueue:completionQueue completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+        
+        _decryptedMessage = decryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed decrypting and verifying message: %@", error);
+    }];
+    
+    __block NSArray *_recipientKeyIds;
+    
+    ScheduledOperation *peek = [OpenPGP recipientsOfMessage:self.message completionQueue:completionQueue completionBlock:^(NSArray *recipientKeyIds) {
+        
+        _recipientKeyIds = recipientKeyIds;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed reading recipients: %@", error);
+    }];
+    
+    XCTAssertEqual(decryption.lane, OperationLaneExpensive);
+    XCTAssertEqual(peek.lane, OperationLaneCheap);
+    
+    [decryption waitUntilFinished];
+    [peek waitUntilFinished];
+    dispatch_sync(completionQueue, ^{});
+    
+    XCTAssertEqualObjects(_decryptedMessage, @"Hello!");
+    XCTAssertGreaterThan(_recipientKeyIds.count, 0);
+    
+    // One slot and room for two: the second waits behind the first, a third is turned away:
+    OperationScheduler *scheduler = [OperationScheduler schedulerWithExpensiveWidth:1 cheapWidth:1 capacity:2];
+    dispatch_semaphore_t release = dispatch_semaphore_create(0);
+    
+    __block BOOL _ranCancelled = NO;
+    __block NSError *_cancelError;
+    
+    ScheduledOperation *running = [scheduler addOperationToLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:nil block:^(ScheduledOperation *operation) {
+        dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+        [operation finishWithBlock:^{}];
+    }];
+    
+    ScheduledOperation *waiting = [scheduler addOperationToLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:^(NSError *error) {
+        _cancelError = error;
+    } block:^(ScheduledOperation *operation) {
+        _ranCancelled = YES;
+        [operation finishWithBlock:^{}];
+    }];
+    
+    XCTAssertNotNil(running);
+    XCTAssertNotNil(waiting);
+    XCTAssertNil([scheduler addOperationToLane:OperationLaneExpensive completionQueue:completionQueue errorBlock:nil block:^(ScheduledOperation *operation) {}]);
+    
+    // The other lane isn't held up by a full one:
+    ScheduledOperation *cheap = [scheduler addOperationToLane:OperationLaneCheap completionQueue:completionQueue errorBlock:nil block:^(ScheduledOperation *operation) {
+        [operation finishWithBlock:^{}];
+    }];
+    
+    [cheap waitUntilFinished];
+    XCTAssertTrue(cheap.isFinished);
+    
+    [waiting cancel];
+    [waiting waitUntilFinished];
+    dispatch_semaphore_signal(release);
+    [running waitUntilFinished];
+    
+    while ([scheduler countForLane:OperationLaneExpensive] > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+    
+    dispatch_sync(completionQueue, ^{});
+    
+    XCTAssertTrue(waiting.isCancelled);
+    XCTAssertFalse(_ranCancelled);
+    XCTAssertNotNil(_cancelError);
 }
 
+- (void)testInstrumentation {
+    
+    __block NSString *_encryptedMessage;
+    
+    [OpenPGP signAndEncryptMessage:@"Hello!" privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+        
+        _encryptedMessage = encryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed signing and encrypting message: %@", error);
+    }];
+    
+    memset(instrumentationBegins, 0, sizeof(instrumentationBegins));
+    memset(instrumentationEnds, 0, sizeof(instrumentationEnds));
+    memset(instrumentationCounts, 0, sizeof(instrumentationCounts));
+    
+    pgp_instrumentation instrumentation = { recordStageBegin, recordStageEnd, recordCount, NULL };
+    pgp_instrumentation_set(&instrumentation);
+    
+    __block NSString *_decryptedMessage;
+    
+    [OpenPGP decryptAndVerifyMessage:_encryptedMessage privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *decryptedMessage, NSArray *verifiedUserIds) {
+        
+        _decryptedMessage = decryptedMessage;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed decrypting message: %@", error);
+    }];
+    
+    pgp_instrumentation_set(NULL);
+    
+    XCTAssertEqualObjects(_decryptedMessage, @"Hello!");
+    
+    for (pgp_stage stage = PGP_STAGE_ARMOR; stage < PGP_STAGE_COUNT; stage++) {
+        XCTAssertEqual(instrumentationBegins[stage], instrumentationEnds[stage], @"Unbalanced stage: %s", pgp_stage_name(stage));
+    }
+    
+    // Decrypting the session key and checking the signature are the expensive parts of a decrypt:
+    XCTAssertGreaterThan(instrumentationEnds[PGP_STAGE_ARMOR], 0);
+    XCTAssertGreaterThan(instrumentationEnds[PGP_STAGE_PACKETS], 0);
+    XCTAssertGreaterThan(instrumentationEnds[PGP_STAGE_RSA_PRIVATE], 0);
+    XCTAssertGreaterThan(instrumentationEnds[PGP_STAGE_RSA_PUBLIC], 0);
+    XCTAssertGreaterThan(instrumentationEnds[PGP_STAGE_SYMMETRIC], 0);
+    XCTAssertGreaterThan(instrumentationEnds[PGP_STAGE_TEXT], 0);
+    XCTAssertGreaterThan(instrumentationCounts[PGP_COUNTER_RSA_OPERATIONS], 1);
+    XCTAssertGreaterThan(instrumentationCounts[PGP_COUNTER_KEY_LOOKUPS], 0);
+}
+
+- (void)testRSASignPerformance {
+    [self measureSigningWithKeypair:[Crypto generateKeypairWithBits:2048]];
+}
+
+- (void)testEd25519SignPerformance {
+    [self measureSigningWithKeypair:[Crypto generateEd25519Keypair]];
+}
+
+- (void)testRandomBytesPerformance {
+    
+    // Session key sized draws from every thread at once:
+    [self measureBlock:^{
+        NSDate *start = [NSDate date];
+        
+        dispatch_apply(RandomBenchmarkThreadCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+            Byte bytes[kCCKeySizeAES256];
+            
+            for (NSUInteger i = 0; i < RandomBenchmarkBytesPerThread; i += kCCKeySizeAES256) {
+                random_bytes(bytes, kCCKeySizeAES256);
+            }
+        });
+        
+        NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+        NSLog(@"Random bytes: %.0f MB/s", RandomBenchmarkThreadCount * RandomBenchmarkBytesPerThread / elapsed / (1 << 20));
+    }];
+    
+    Byte padding[256];
+    random_nonzero_bytes(padding, sizeof(padding));
+    
+    for (NSUInteger i = 0; i < sizeof(padding); i++) {
+        XCTAssertNotEqual(padding[i], 0);
+    }
+}
+
+- (void)testBatchDecryptionPerformance {
+    NSMutableArray *messages = [NSMutableArray arrayWithCapacity:BatchBenchmarkMessageCount];
+    
+    for (NSUInteger i = 0; i < BatchBenchmarkMessageCount; i++) {
+        [OpenPGP signAndEncryptMessage:[NSString stringWithFormat:@"Message %lu", (unsigned long) i] privateKey:self.privateKey publicKeys:@[self.publicKey] completionBlock:^(NSString *encryptedMessage) {
+            
+            [messages addObject:encryptedMessage];
+            
+        } errorBlock:^(NSError *error) {
+            XCTFail(@"Failed signing and encrypting message: %@", error);
+        }];
+    }
+    
+    // Binary messages and broken ones mixed in, a broken one only fails its own result:
+    messages[1] = [ASCIIArmor armorFromText:messages[1]].content;
+    messages[2] = @"Not a message";
+    
+    __block NSArray *_results;
+    
+    [OpenPGP decryptAndVerifyMessages:messages privateKey:self.privateKey publicKeys:@[self.publicKey] workerCount:0 completionBlock:^(NSArray *results) {
+        
+        _results = results;
+        
+    } errorBlock:^(NSError *error) {
+        XCTFail(@"Failed decrypting batch: %@", error);
+    }];
+    
+    XCTAssertEqual(_results.count, BatchBenchmarkMessageCount);
+    
+    for (NSUInteger i = 0; i < _results.count; i++) {
+        DecryptionResult *result = _results[i];
+        
+        if (i == 2) {
+            XCTAssertNotNil(result.error);
+        } else {
+            XCTAssertEqualObjects(result.decryptedMessage, ([NSString stringWithFormat:@"Message %lu", (unsigned long) i]));
+            XCTAssertNotNil(result.verifiedUserIds);
+        }
+    }
+    
+    // Throughput from one worker up to every core:
+    NSUInteger cores = [NSProcessInfo processInfo].activeProcessorCount;
+    
+    NSUInteger workers = 1;
+    
+    while (YES) {
+        NSDate *start = [NSDate date];
+        
+        [OpenPGP decryptAndVerifyMessages:messages privateKey:self.privateKey publicKeys:@[self.publicKey] workerCount:workers completionBlock:^(NSArray *results) {
+            
+            XCTAssertEqual(results.count, BatchBenchmarkMessageCount);
+            
+        } errorBlock:^(NSError *error) {
+            XCTFail(@"Failed decrypting batch: %@", error);
+        }];
+        
+        NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+        NSLog(@"Batch decryption: %lu workers, %.0f messages/s", (unsigned long) workers, BatchBenchmarkMessageCount / elapsed);
+        
+        if (workers == cores) {
+            break;
+        }
+        
+        workers = MIN(workers * 2, cores);
+    }
+}
+
+- (void)testBatchSigningPerformance {
+    Keypair *keypair = [Crypto generateKeypairWithBits:2048];
+    NSMutableArray *payloads = [NSMutableArray arrayWithCapacity:BatchBenchmarkPayloadCount];
+    
+    for (NSUInteger i = 0; i < BatchBenchmarkPayloadCount; i++) {
+        [payloads addObject:[[NSString stringWithFormat:@"Receipt %lu", (unsigned long) i] dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+    
+    BatchSigner *signer = [BatchSigner signerWithSignatureKey:keypair.secretKey signatureType:SignatureTypeBinary];
+    NSArray *signatures = [signer signPayloads:payloads workerCount:0];
+    
+    XCTAssertEqual(signatures.count, BatchBenchmarkPayloadCount);
+    
+    // Every signature is over its own payload, with the patched creation time:
+    for (NSUInteger i = 0; i < signatures.count; i++) {
+        SignaturePacket *signaturePacket = [SignaturePacket packetWithSignature:signatures[i]];
+        SignatureVerifier *verifier = [SignatureVerifier verifierWithSignaturePacket:signaturePacket];
+        
+        [verifier updateWithData:payloads[i]];
+        
+        XCTAssertTrue([verifier verifySignaturePacket:signaturePacket withPublicKey:keypair.publicKey]);
+    }
+    
+    // Throughput from one worker up to every core:
+    NSUInteger cores = [NSProcessInfo processInfo].activeProcessorCount;
+    NSUInteger workers = 1;
+    
+    while (YES) {
+        [signer signPayloads:payloads workerCount:workers];
+        NSLog(@"Batch signing: %lu workers, %.0f signatures/s", (unsigned long) workers, signer.signaturesPerSecond);
+        
+        if (workers == cores) {
+            break;
+        }
+        
+        workers = MIN(workers * 2, cores);
+    }
+}
+
+- (void)testMalformedCorpusPerformance {
+    NSArray *corpus = [self malformedCorpus];
+    NSUInteger corpusLength = 0;
+    
+    for (NSData *input in corpus) {
+        corpusLength += input.length;
+    }
+    
+    // Unknown packet types are skipped rather than failing the list:
+    NSData *content = [ASCIIArmor armorFromText:self.privateKey].content;
+    const Byte privatePacket[] = {0xC0 | PacketTypePrivateA, 0x02, 0x00, 0x00};
+    NSMutableData *withPrivatePacket = [NSMutableData dataWithBytes:privatePacket length:sizeof(privatePacket)];
+    [withPrivatePacket appendData:content];
+    
+    XCTAssertEqual([PacketList packetListFromData:withPrivatePacket error:NULL].packets.count,
+                   [PacketList packetListFromData:content error:NULL].packets.count);
+    
+    __block NSUInteger rejected = 0;
+    
+    [self measureBlock:^{
+        NSDate *start = [NSDate date];
+        rejected = 0;
+        
+        for (NSData *input in corpus) {
+            NSError *error = nil;
+            PacketList *packetList = nil;
+            
+            XCTAssertNoThrow(packetList = [PacketList packetListFromData:input error:&error]);
+            
+            if (packetList == nil) {
+                rejected++;
+            }
+        }
+        
+        NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+        NSLog(@"Malformed corpus: %.0f inputs/s, %.1f MB/s", corpus.count / elapsed, corpusLength / elapsed / (1 << 20));
+    }];
+    
+    NSLog(@"Malformed corpus: %lu of %lu inputs rejected", (unsigned long) rejected, (unsigned long) corpus.count);
+    XCTAssertGreaterThan(rejected, 0);
+}
+
+- (void)testKeyringLookupPerformance {
+    NSArray *keys = [self benchmarkKeys];
+    
+    vm_size_t memoryBefore = [self residentMemorySize];
+    
+    Keyring *keyring = [Keyring keyring];
+    
+    for (PublicKey *key in keys) {
+        [keyring addPublicKey:key forUserId:nil];
+    }
+    
+    NSLog(@"Keyring with %lu keys: %lu KB", (unsigned long) keyring.count, (unsigned long) ([self residentMemorySize] - memoryBefore) / 1024);
+    XCTAssertEqual(keyring.count, KeyringBenchmarkKeyCount);
+    
+    [self measureBlock:^{
+        for (PublicKey *key in keys) {
+            XCTAssertEqual([keyring publicKeyForKeyId:key.keyID], key);
+        }
+    }];
+}
+
+- (void)testEmailLookup {
+    NSArray *keys = [[self benchmarkKeys] subarrayWithRange:NSMakeRange(0, 4)];
+    Keyring *keyring = [Keyring keyring];
+    
+    [keyring addPublicKey:keys[0] forUserId:@"James Knight <James@JKnight.co>"];
+    [keyring addPublicKey:keys[1] forUserId:@"jim@jknight.co"];
+    [keyring addPublicKey:keys[2] forUserId:@"Someone Else <someone@example.com>"];
+    [keyring addPublicKey:keys[3] forUserId:@"No Address"];
+    
+    XCTAssertEqualObjects([keyring publicKeysForEmail:@"james@jknight.CO"], @[keys[0]]);
+    XCTAssertEqualObjects([keyring publicKeysWithEmailPrefix:@"J"], (@[keys[0], keys[1]]));
+    XCTAssertEqualObjects([keyring publicKeysForEmailDomain:@"jknight.co"], (@[keys[0], keys[1]]));
+    XCTAssertEqualObjects([keyring publicKeysForEmailDomain:@"knight.co"], @[]);
+    XCTAssertEqualObjects([keyring publicKeysWithEmailContaining:@"one@"], @[keys[2]]);
+}
+
+- (void)testEmailLookupPerformance {
+    NSArray *keys = [self benchmarkKeys];
+    Keyring *keyring = [Keyring keyring];
+    
+    [keys enumerateObjectsUsingBlock:^(PublicKey *key, NSUInteger i, BOOL *stop) {
+        [keyring addPublicKey:key forUserId:[NSString stringWithFormat:@"User %lu <user%lu@domain%lu.com>", (unsigned long) i, (unsigned long) i, (unsigned long) i % 100]];
+    }];
+    
+    // First query sorts the index:
+    XCTAssertEqual([keyring publicKeysForEmail:@"user0@domain0.com"].count, 1);
+    
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 1000; i++) {
+            NSString *email = [NSString stringWithFormat:@"user%lu@domain%lu.com", (unsigned long) i * 97, (unsigned long) (i * 97) % 100];
+            
+            XCTAssertEqual([keyring publicKeysForEmail:email].count, 1);
+            XCTAssertEqual([keyring publicKeysWithEmailPrefix:[email substringToIndex:email.length - 4]].count, 1);
+        }
+        
+        XCTAssertEqual([keyring publicKeysForEmailDomain:@"domain7.com"].count, KeyringBenchmarkKeyCount / 100);
+    }];
+}
+
+/// The per key ID dictionaries the keyring used before, to compare against:
+- (void)testDictionaryLookupPerformance {
+    NSArray *keys = [self benchmarkKeys];
+    
+    vm_size_t memoryBefore = [self residentMemorySize];
+    
+    NSMutableDictionary *keysByKeyId = [NSMutableDictionary dictionary];
+    
+    for (PublicKey *key in keys) {
+        keysByKeyId[@(key.keyID)] = key;
+    }
+    
+    NSLog(@"Dictionary with %lu keys: %lu KB", (unsigned long) keysByKeyId.count, (unsigned long) ([self residentMemorySize] - memoryBefore) / 1024);
+    
+    [self measureBlock:^{
+        for (PublicKey *key in keys) {
+            XCTAssertEqual(keysByKeyId[@(key.keyID)], key);
+        }
+    }];
+}
+
+/// Keys with random points, fine for anything that only needs their key IDs:
+- (NSArray *)benchmarkKeys {
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:KeyringBenchmarkKeyCount];
+    
+    for (NSUInteger i = 0; i < KeyringBenchmarkKeyCount; i++) {
+        Byte point[33];
+        point[0] = 0x40;
+        arc4random_buf(point + 1, 32);
+        
+        PublicKey *key = [PublicKey keyWithCreationTime:0
+                                     publicKeyAlgorithm:PublicKeyAlgorithmEdDSA
+                                               curveOID:[Crypto ed25519CurveOID]
+                                                      q:[MPI mpiFromBytes:point byteCount:sizeof(point)]];
+        
+        // Work the key IDs out up front so they aren't part of the measurements:
+        [key keyID];
+        [keys addObject:key];
+    }
+    
+    return [NSArray arrayWithArray:keys];
+}
+
+/// Every truncation of the fixtures, random byte corruptions, and unsupported versions:
+- (NSArray *)malformedCorpus {
+    NSMutableArray *corpus = [NSMutableArray array];
+    
+    for (NSString *text in @[self.message, self.publicKey, self.privateKey]) {
+        NSData *content = [ASCIIArmor armorFromText:text].content;
+        
+        for (NSUInteger length = 0; length < content.length; length += 7) {
+            [corpus addObject:[content subdataWithRange:NSMakeRange(0, length)]];
+        }
+        
+        for (NSUInteger i = 0; i < MalformedCorpusCorruptionsPerInput; i++) {
+            NSMutableData *corrupted = [content mutableCopy];
+            Byte *bytes = corrupted.mutableBytes;
+            
+            for (NSUInteger j = 1 + arc4random_uniform(4); j > 0; j--) {
+                bytes[arc4random_uniform((uint32_t) corrupted.length)] = arc4random_uniform(256);
+            }
+            
+            [corpus addObject:corrupted];
+        }
+        
+        // The first packet's version byte:
+        NSMutableData *unsupported = [content mutableCopy];
+        pgp_packet packet;
+        pgp_packet_read_header(unsupported.bytes, unsupported.length, 0, &packet);
+        ((Byte *) unsupported.mutableBytes)[packet.bodyOffset] = 0xFF;
+        
+        [corpus addObject:unsupported];
+    }
+    
+    return [NSArray arrayWithArray:corpus];
+}
+
+- (vm_size_t)residentMemorySize {
+    struct mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    
+    return info.resident_size;
+}
+
+- (void)measureSigningWithKeypair:(Keypair *)keypair {
+    NSData *digest = [Crypto hashData:[@"Hello!" dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100; i++) {
+            NSData *signature = [Crypto signDigest:digest algorithm:HashAlgorithmSHA256 withSecretKey:keypair.secretKey];
+            
+            XCTAssertTrue([Crypto verifyDigest:digest
+                                     algorithm:HashAlgorithmSHA256
+                             withSignatureData:signature
+                                 withPublicKey:keypair.publicKey]);
+        }
+    }];
+}
 
 @end